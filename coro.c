@@ -0,0 +1,315 @@
+// coro.c — stackful coroutines
+// ---------------------------------------------------------------
+// a runner belongs to whichever thread calls coro_run() on it; pcb->coro
+// points at it for as long as that lasts, which is how task_yield() finds
+// its runner. only that thread touches the ready queue, so yielding takes
+// no lock. other threads hand in new coroutines through `incoming`, a
+// lock-free stack the host empties (oldest first) whenever it looks.
+//
+// a coroutine that returns cannot free its own stack while it is still on
+// it: it parks itself in r->dead and switches to the host, which frees it.
+// if the host thread is preempted, the trap frame simply goes on top of the
+// running coroutine's stack, and the thread resumes there later.
+//
+// a sleeping coroutine is not on any queue: it switches to the host, which
+// arms its timer. until then it is still on its own stack, so the timer
+// must not be able to fire. the timer's callback hands it in like a new one.
+// ---------------------------------------------------------------
+
+#include "coro.h"
+#include "sched.h"
+#include "tasks.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "timer.h"
+#include "uart.h"
+#include "riscv.h"
+#include "kprintf.h"
+
+// -----------------------------------------------------------------------------
+// Ready queue
+// -----------------------------------------------------------------------------
+
+static void ready_push(coro_runner_t *r, coro_t *c) {
+    c->next = 0;
+    if (r->tail)
+        r->tail->next = c;
+    else
+        r->head = c;
+    r->tail = c;
+}
+
+static coro_t *ready_pop(coro_runner_t *r) {
+    coro_t *c = r->head;
+    if (c) {
+        r->head = c->next;
+        if (!r->head)
+            r->tail = 0;
+    }
+    return c;
+}
+
+// move everything handed in by other threads to the ready queue. it was
+// pushed newest first, so reverse it to keep spawn order.
+static void take_incoming(coro_runner_t *r) {
+    coro_t *c = __atomic_exchange_n(&r->incoming, 0, __ATOMIC_ACQUIRE);
+    coro_t *rev = 0;
+    while (c) {
+        coro_t *n = c->next;
+        c->next = rev;
+        rev = c;
+        c = n;
+    }
+    while (rev) {
+        coro_t *n = rev->next;
+        ready_push(r, rev);
+        rev = n;
+    }
+}
+
+static void push_incoming(coro_runner_t *r, coro_t *c) {
+    coro_t *old = __atomic_load_n(&r->incoming, __ATOMIC_RELAXED);
+    do {
+        c->next = old;
+    } while (!__atomic_compare_exchange_n(&r->incoming, &old, c, 0,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void wake_host(coro_runner_t *r) {
+    uint64_t s = spin_lock_irqsave(&r->lock);
+    sched_wakeup(r);
+    spin_unlock_irqrestore(&r->lock, s);
+}
+
+// `from` stops running and `to` starts (either may be 0, the host): charge
+// from's task with what the host thread used since it started. coroutines
+// without a task record (bench coro) cost nothing here.
+static void coro_account(coro_runner_t *r, coro_t *from, coro_t *to) {
+    if (!(from && from->acct) && !(to && to->acct))
+        return;
+    acct_t now;
+    pcb_t *me = sched_acct_self(&now);
+    if (from && from->acct) {
+        acct_t *a = from->acct;
+        a->time += now.time - r->mark.time;
+        a->cycles += now.cycles - r->mark.cycles;
+        a->instret += now.instret - r->mark.instret;
+    }
+    r->mark = now;
+    me->sub_acct = to ? to->acct : 0;
+    if (to && to->acct)
+        to->acct->switches++;
+}
+
+static void coro_free(coro_t *c) {
+    kfree_pages(c->stack, CORO_STACK_ORDER);
+    kfree(c);
+}
+
+// -----------------------------------------------------------------------------
+// Coroutines
+// -----------------------------------------------------------------------------
+
+// first code a new coroutine runs; coro_switch() "returns" here on its
+// fresh stack
+static void coro_entry(void) {
+    coro_runner_t *r = sched_current()->coro;
+    coro_t *c = r->current;
+    c->fn(c->arg);
+    r->dead = c;
+    r->current = 0;
+    coro_account(r, c, 0);
+    coro_switch(&c->ctx, &r->host);
+}
+
+static int spawn(coro_runner_t *r, const char *name, void (*fn)(void *), void *arg,
+                 acct_t *acct) {
+    coro_t *c = (coro_t *)kzalloc(sizeof(coro_t));
+    if (!c)
+        return -1;
+    c->stack = kalloc_pages(CORO_STACK_ORDER);
+    if (!c->stack) {
+        kfree(c);
+        return -1;
+    }
+    c->fn = fn;
+    c->arg = arg;
+    c->name = name;
+    c->ctx.ra = (uint64_t)coro_entry;
+    c->ctx.sp = (uint64_t)c->stack + CORO_STACK_SIZE;
+    c->runner = r;
+    c->acct = acct;
+    push_incoming(r, c);
+    wake_host(r);
+    return 0;
+}
+
+int coro_spawn(coro_runner_t *r, const char *name, void (*fn)(void *), void *arg) {
+    return spawn(r, name, fn, arg, 0);
+}
+
+// timer interrupt: a sleeping coroutine is due. it leaves `sleeping` under
+// the lock, after it is in `incoming`: the host decides to return under the
+// same lock, and may take its runner with it once we let go.
+static void coro_wake(void *arg) {
+    coro_t *c = (coro_t *)arg;
+    coro_runner_t *r = c->runner;
+    push_incoming(r, c);
+    spin_lock(&r->lock);
+    r->sleeping--;
+    sched_wakeup(r);
+    spin_unlock(&r->lock);
+}
+
+void coro_run(coro_runner_t *r) {
+    pcb_t *me = sched_current();
+    coro_runner_t *outer = me->coro;
+    me->coro = r;
+    for (;;) {
+        if (r->dead) {
+            coro_free(r->dead);
+            r->dead = 0;
+        }
+        if (r->incoming)
+            take_incoming(r);
+        coro_t *c = ready_pop(r);
+        if (!c) {
+            // a runner that is not a daemon returns once nothing is left,
+            // sleepers included
+            uint64_t s = spin_lock_irqsave(&r->lock);
+            while (!__atomic_load_n(&r->incoming, __ATOMIC_ACQUIRE) &&
+                   (r->daemon || r->sleeping))
+                sched_sleep(r, &r->lock);
+            int done = !__atomic_load_n(&r->incoming, __ATOMIC_ACQUIRE);
+            spin_unlock_irqrestore(&r->lock, s);
+            if (done)
+                break;
+            continue;
+        }
+        // back here only once a coroutine has finished or gone to sleep
+        r->current = c;
+        r->switches++;
+        coro_account(r, 0, c);
+        coro_switch(&r->host, &c->ctx);
+        if (r->sleeper) {
+            coro_t *z = r->sleeper;
+            r->sleeper = 0;
+            uint64_t s = spin_lock_irqsave(&r->lock);
+            r->sleeping++;
+            spin_unlock_irqrestore(&r->lock, s);
+            ktimer_init(&z->timer, coro_wake, z);
+            ktimer_arm(&z->timer, z->wake_at);
+        }
+    }
+    me->coro = outer;
+}
+
+void task_yield(void) {
+    coro_runner_t *r = sched_current()->coro;
+    coro_t *cur = r ? r->current : 0;
+    if (!cur) {
+        sched_yield();
+        return;
+    }
+    if (r->incoming)
+        take_incoming(r);
+    coro_t *next = ready_pop(r);
+    if (!next)
+        return;                 // nobody else is ready: keep going
+    ready_push(r, cur);
+    r->current = next;
+    r->switches++;
+    coro_account(r, cur, next);
+    coro_switch(&cur->ctx, &next->ctx);
+}
+
+void task_sleep_us(uint64_t us) {
+    coro_runner_t *r = sched_current()->coro;
+    coro_t *cur = r ? r->current : 0;
+    if (!cur) {
+        sched_sleep_us(us);
+        return;
+    }
+    cur->wake_at = timer_now() + timer_us_to_ticks(us);
+    r->sleeper = cur;
+    r->current = 0;
+    r->switches++;
+    coro_account(r, cur, 0);
+    coro_switch(&cur->ctx, &r->host);
+}
+
+// -----------------------------------------------------------------------------
+// Task runner
+// -----------------------------------------------------------------------------
+
+static coro_runner_t task_runner = { .daemon = 1 };
+static int task_runner_started;
+
+static void task_runner_thread(void) {
+    coro_run(&task_runner);
+}
+
+int coro_spawn_task(const char *name, void (*fn)(void *), void *arg, acct_t *acct) {
+    if (spawn(&task_runner, name, fn, arg, acct) != 0)
+        return -1;
+    if (!__atomic_exchange_n(&task_runner_started, 1, __ATOMIC_ACQ_REL) &&
+        tasks_spawn("tasks", (uint64_t)task_runner_thread, 0) < 0) {
+        // stays queued; the next `run` tries to start the thread again
+        __atomic_store_n(&task_runner_started, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+static void bench_yielder(void *arg) {
+    for (uint64_t i = (uint64_t)arg; i; i--)
+        task_yield();
+}
+
+// hart id and counters read together, so a migration shows up
+static int read_cycles(uint64_t *cycles) {
+    uint64_t s = irq_save();
+    int hart = (int)hart_id();
+    *cycles = rdcycle();
+    irq_restore(s);
+    return hart;
+}
+
+//   two coroutines on a private runner on the shell's thread, each calling
+//   task_yield() n times: every call is one coro_switch() straight into the
+//   other. the cycle figure is only shown if the shell stayed on one hart;
+//   a timer tick in between is included either way.
+void coro_bench(int iters) {
+    if (iters <= 0) iters = 100000;
+    coro_runner_t r = {0};
+    if (coro_spawn(&r, "bench", bench_yielder, (void *)(uint64_t)iters) != 0 ||
+        coro_spawn(&r, "bench", bench_yielder, (void *)(uint64_t)iters) != 0) {
+        uart_puts("bench coro: out of memory\n");
+        coro_run(&r);           // runs and frees whatever did get queued
+        return;
+    }
+
+    uint64_t c0, c1;
+    int h0 = read_cycles(&c0);
+    uint64_t t0 = timer_now();
+    coro_run(&r);
+    uint64_t ticks = timer_now() - t0;
+    int h1 = read_cycles(&c1);
+
+    uint64_t n = r.switches;
+    uint64_t ns = ticks * (1000000000UL / TIMER_HZ);
+    char line[96];
+    ksnprintf(line, sizeof(line), "coroutine switch benchmark (%lu switches)\n", n);
+    uart_puts(line);
+    if (h0 == h1) {
+        ksnprintf(line, sizeof(line), "  %lu cycles per switch\n", (c1 - c0) / n);
+        uart_puts(line);
+    }
+    ksnprintf(line, sizeof(line), "  %lu ns per switch, %lu switches/s\n",
+              ns / n, ns ? n * 1000000000UL / ns : 0);
+    uart_puts(line);
+}
@@ -0,0 +1,95 @@
+// coro.h — stackful coroutines hosted by a kernel thread
+// a coroutine is a function with its own small stack that gives up the CPU
+// only when it calls task_yield(). a runner multiplexes any number of them
+// on one kernel thread: the thread is scheduled (and preempted) like every
+// other, the coroutines take turns inside it.
+//
+// task_yield() switches straight to the next ready coroutine with
+// coro_switch(), which saves and restores only the callee-saved registers.
+// nothing traps, nothing is locked, the scheduler never hears of it. what
+// a coroutine uses is the difference of the host thread's acct (tasks.h)
+// between its switch in and its switch out.
+//
+// `run <task>` starts the task as a coroutine on the "tasks" thread, so a
+// long task that yields shares its thread with the other tasks and the
+// thread shares the harts with the shell.
+//
+// task_sleep_us() parks just the coroutine: a kernel timer (ktimer.h)
+// hands it back to its runner when it is due, and the others keep running.
+
+#ifndef CORO_H
+#define CORO_H
+
+#include <stdint.h>
+#include "spinlock.h"
+#include "ktimer.h"
+#include "tasks.h"
+
+// stack per coroutine; preemption pushes a trapframe on it too
+#define CORO_STACK_ORDER 1
+#define CORO_STACK_SIZE  (4096UL << CORO_STACK_ORDER)
+
+// ra, sp, s0..s11 (offsets used by coro_switch.S)
+typedef struct coro_ctx {
+    uint64_t ra;
+    uint64_t sp;
+    uint64_t s[12];
+} coro_ctx_t;
+
+typedef struct coro {
+    coro_ctx_t ctx;             // saved while switched out
+    void (*fn)(void *);
+    void *arg;
+    void *stack;
+    const char *name;
+    struct coro *next;
+    struct coro_runner *runner;
+    ktimer_t timer;             // task_sleep_us()
+    uint64_t wake_at;
+    acct_t *acct;               // its task's record, charged while it runs
+} coro_t;
+
+typedef struct coro_runner {
+    coro_ctx_t host;            // the hosting thread while a coroutine runs
+    coro_t *current;
+    coro_t *head, *tail;        // ready queue, touched only by the host thread
+    coro_t *incoming;           // new coroutines from other threads (lock-free push)
+    coro_t *dead;               // finished, stack still in use until the host frees it
+    coro_t *sleeper;            // going to sleep, its timer armed by the host
+    uint32_t sleeping;          // timers not fired yet (under lock)
+    spinlock_t lock;            // sleeping for work, `sleeping`
+    int daemon;                 // keep waiting for work instead of returning
+    uint64_t switches;
+    acct_t mark;                // host thread's acct when `current` started
+} coro_runner_t;
+
+//   saves the callee-saved registers into from and resumes to (coro_switch.S).
+void coro_switch(coro_ctx_t *from, coro_ctx_t *to);
+
+//   queues fn(arg) as a new coroutine on r; callable from any thread.
+//   0 on success, -1 if out of memory.
+int coro_spawn(coro_runner_t *r, const char *name, void (*fn)(void *), void *arg);
+
+//   runs r's coroutines on the calling thread until none are left (or, for
+//   a daemon runner, forever).
+void coro_run(coro_runner_t *r);
+
+//   lets the next coroutine of this runner go. in a thread that is not
+//   running a coroutine it is sched_yield().
+void task_yield(void);
+
+//   lets the other coroutines of this runner go for at least `us`
+//   microseconds. in a thread that is not running a coroutine it is
+//   sched_sleep_us().
+void task_sleep_us(uint64_t us);
+
+//   the runner behind `run <task>`, its thread started on first use. the
+//   coroutine's time, cycles, instructions, switches and console bytes are
+//   added to *acct. 0 on success.
+int coro_spawn_task(const char *name, void (*fn)(void *), void *arg, acct_t *acct);
+
+//   switches per second between two coroutines on one thread (shell
+//   command "bench coro [n]").
+void coro_bench(int iters);
+
+#endif
@@ -1,111 +1,1073 @@
-// fs.c — simple in-memory filesystem for RISC-V OS
-// embeds demo text files and one loadable ELF (userprog.elf)
+// fs.c — writable in-memory filesystem (ramfs) for RISC-V OS
+// ---------------------------------------------------------------
+// every file and directory is an inode in a growable inode table. inodes
+// store their size, so nothing is ever rescanned for a terminating NUL.
+//
+//   files       data lives in extents: contiguous blocks from the buddy
+//               allocator, each at least twice the size of the one before
+//               (up to FS_MAX_EXTENT_ORDER), so a file of n bytes needs
+//               O(log n) extents.
+//   the image   the files shipped with the kernel (rootfs/ and the user
+//               programs) are one packed image (tools/fspack, fsimg.h)
+//               under "/". a name missing from the root directory is looked
+//               up in the image's perfect hash, and only then does it get
+//               an inode. a raw file starts out as one "borrowed" extent
+//               pointing into the image; the first write replaces it with
+//               owned ones. its checksum is checked on first access.
+//   compressed  files the packer stored LZ4-compressed (lz4.h) have no
+//               extents until first read; then they are inflated into one
+//               owned extent.
+//               inflated files form a cache of at most FS_CACHE_BUDGET
+//               bytes: the least recently used one goes back to just its
+//               compressed copy when room is needed. a write makes the
+//               file an ordinary one that is never evicted.
+//   directories a hash table of dirents (FNV-1a, chained, doubled once it
+//               holds more entries than buckets), so lookup is O(1) however
+//               many files a directory holds. ".." goes through the parent
+//               inode number, "." is implicit.
+//
+// all operations take fs_lock, a sleeping lock: a thread that finds the fs
+// busy sleeps until the holder is done.
+// ---------------------------------------------------------------
 
 #include "uart.h"
 #include "fs.h"
+#include "string.h"
+#include "riscv.h"
+#include "sched.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "perf.h"
+#include "kprintf.h"
+#include "handle.h"
+#include "lz4.h"
+#include "fsimg.h"
 #include <stdint.h>
 #include <stddef.h>
 
-// symbols from userprog_bin.o (generated by objcopy)
-extern const uint8_t _binary_userprog_elf_start[];
-extern const uint8_t _binary_userprog_elf_end[];
+// symbols from fs_img.o (objcopy of fs.img)
+extern const uint8_t _binary_fs_img_start[];
+extern const uint8_t _binary_fs_img_end[];
+
+#define FS_TYPE_FILE 1
+#define FS_TYPE_DIR  2
+
+#define FS_ROOT_INO          1
+#define FS_INITIAL_INODES    64
+#define FS_INITIAL_BUCKETS   8
+#define FS_INITIAL_EXTENTS   4
+#define FS_MAX_EXTENT_ORDER  8    // 1 MiB
+
+// inflated compressed files kept around, in bytes of extent
+#ifndef FS_CACHE_BUDGET
+#define FS_CACHE_BUDGET      (256 * 1024)
+#endif
+
+typedef struct {
+    uint8_t *data;
+    uint64_t cap;          // bytes this extent can hold
+    int8_t order;          // kalloc order, -1 if borrowed from the image
+} fs_extent_t;
+
+typedef struct fs_dirent {
+    char name[FS_NAME_MAX];
+    uint32_t hash;
+    uint32_t ino;
+    struct fs_dirent *next;
+} fs_dirent_t;
 
 typedef struct {
-    const char *name;
-    const uint8_t *data;
-    int is_binary;   // 0 = text (for cat), 1 = binary (ELF)
-} File;
+    uint32_t ino;
+    uint16_t type;
+    uint64_t size;          // file: bytes; directory: entries
+    uint32_t parent;        // directory containing this inode
+    uint64_t version;       // changes whenever the contents do (fs_identity)
+    // files
+    fs_extent_t *ext;
+    uint16_t next;
+    uint16_t ext_cap;
+    // directories
+    fs_dirent_t **buckets;
+    uint32_t nbuckets;
+    // files from the image
+    uint32_t img;           // entry index + 1 while the contents are the image's
+    uint8_t checked;        // checksum verified
+    const uint8_t *lz;      // LZ4 block in the image, 0 once written
+    uint32_t lz_size;
+    uint16_t pins;          // fs_get_file() users: its buffer stays put
+    uint64_t used;          // cache clock at the last access
+} fs_inode_t;
+
+static kmem_cache_t *inode_cache;
+static kmem_cache_t *dirent_cache;
+
+static fs_inode_t **inodes;      // inodes[ino], 0 = free
+static uint32_t ninodes;         // capacity of inodes[]
+static uint32_t inodes_used;
+static uint32_t ino_hint = FS_ROOT_INO;
+static uint64_t next_version = 1; // never reused, so (ino, version) is unique
+
+static uint32_t cwd = FS_ROOT_INO;
+
+static int fs_busy;
+static spinlock_t fs_spin;      // guards fs_busy
+
+// the inflated-file cache, under fs_lock like everything else
+static struct fs_cache {
+    uint64_t bytes;             // extent bytes of inflated files
+    uint64_t clock;
+    uint64_t hits, misses, evictions;
+    uint64_t miss_cycles;       // inflating, on first access or after eviction
+} cache;
+
+// the packed image, 0 if the one linked in is not valid. taken[i] is set
+// once entry i has an inode: from then on the root directory has the
+// final word on that name, so a removed file stays removed.
+static const fsimg_header_t *image;
+static uint8_t *taken;
+
+// -----------------------------------------------------------------------------
+// Locking
+// -----------------------------------------------------------------------------
+
+static void fs_lock(void) {
+    uint64_t s = spin_lock_irqsave(&fs_spin);
+    while (fs_busy)
+        sched_sleep(&fs_busy, &fs_spin);
+    fs_busy = 1;
+    spin_unlock_irqrestore(&fs_spin, s);
+}
+
+static void fs_unlock(void) {
+    uint64_t s = spin_lock_irqsave(&fs_spin);
+    fs_busy = 0;
+    spin_unlock_irqrestore(&fs_spin, s);
+    sched_wakeup(&fs_busy);
+}
+
+// -----------------------------------------------------------------------------
+// Inodes
+// -----------------------------------------------------------------------------
+
+static fs_inode_t *iget(uint32_t ino) {
+    return ino && ino < ninodes ? inodes[ino] : 0;
+}
+
+static int grow_inode_table(void) {
+    uint32_t cap = ninodes ? ninodes * 2 : FS_INITIAL_INODES;
+    fs_inode_t **t = (fs_inode_t **)kzalloc(cap * sizeof(*t));
+    if (!t)
+        return -1;
+    if (inodes) {
+        memcpy(t, inodes, ninodes * sizeof(*t));
+        kfree(inodes);
+    }
+    inodes = t;
+    ninodes = cap;
+    return 0;
+}
+
+static fs_inode_t *ialloc(uint16_t type, uint32_t parent) {
+    if (inodes_used + 1 >= ninodes && grow_inode_table() != 0)
+        return 0;
+    fs_inode_t *ip = (fs_inode_t *)kmem_cache_alloc(inode_cache);
+    if (!ip)
+        return 0;
+    memset(ip, 0, sizeof(*ip));
+
+    uint32_t ino = ino_hint % ninodes;
+    while (ino == 0 || inodes[ino])
+        ino = (ino + 1) % ninodes;
+    ino_hint = ino + 1;
+
+    ip->ino = ino;
+    ip->type = type;
+    ip->parent = parent ? parent : ino;
+    ip->version = next_version++;
+    inodes[ino] = ip;
+    inodes_used++;
+    return ip;
+}
+
+static void cache_detach(fs_inode_t *ip);
+
+static void free_extents(fs_inode_t *ip) {
+    cache_detach(ip);
+    for (int i = 0; i < ip->next; i++)
+        if (ip->ext[i].order >= 0)
+            kfree_pages(ip->ext[i].data, ip->ext[i].order);
+    ip->next = 0;
+    ip->size = 0;
+    ip->img = 0;
+}
+
+static void ifree(fs_inode_t *ip) {
+    free_extents(ip);
+    kfree(ip->ext);
+    kfree(ip->buckets);
+    inodes[ip->ino] = 0;
+    inodes_used--;
+    if (ip->ino < ino_hint)
+        ino_hint = ip->ino;
+    kmem_cache_free(inode_cache, ip);
+}
+
+// -----------------------------------------------------------------------------
+// File data (extents)
+// -----------------------------------------------------------------------------
+
+static uint64_t file_capacity(const fs_inode_t *ip) {
+    uint64_t cap = 0;
+    for (int i = 0; i < ip->next; i++)
+        cap += ip->ext[i].cap;
+    return cap;
+}
 
-// text file contents
-static const char readme_txt[] =
-    "This is the RISC-V OS demo filesystem.\n";
+static int add_extent(fs_inode_t *ip, uint64_t want) {
+    if (ip->next == ip->ext_cap) {
+        uint16_t cap = ip->ext_cap ? ip->ext_cap * 2 : FS_INITIAL_EXTENTS;
+        fs_extent_t *e = (fs_extent_t *)kmalloc(cap * sizeof(*e));
+        if (!e)
+            return -1;
+        if (ip->ext) {
+            memcpy(e, ip->ext, ip->next * sizeof(*e));
+            kfree(ip->ext);
+        }
+        ip->ext = e;
+        ip->ext_cap = cap;
+    }
 
-static const char hello_txt[] =
-    "Hello from your in-memory filesystem!\n";
+    int order = kalloc_order_for(want);
+    if (ip->next && ip->ext[ip->next - 1].order >= order)
+        order = ip->ext[ip->next - 1].order + 1;
+    if (order > FS_MAX_EXTENT_ORDER)
+        order = FS_MAX_EXTENT_ORDER;
 
-static const char manual_txt[] =
-    "Commands: help, ls, cat <file>, run <task>, load <file>\n";
+    uint8_t *data = (uint8_t *)kalloc_pages(order);
+    if (!data)
+        return -1;
+    fs_extent_t *e = &ip->ext[ip->next++];
+    e->data = data;
+    e->cap = PGSIZE << order;
+    e->order = (int8_t)order;
+    return 0;
+}
 
-// file table (mix of text and binary)
-static File files[] = {
-    { "README.md",   (const uint8_t *)readme_txt,   0 },
-    { "hello.txt",   (const uint8_t *)hello_txt,    0 },
-    { "manual.txt",  (const uint8_t *)manual_txt,   0 },
+// copy [off, off+n) between the file and buf (write = 1: into the file).
+// the range must already be within capacity.
+static void extent_copy(fs_inode_t *ip, uint64_t off, uint8_t *buf, uint64_t n, int write) {
+    for (int i = 0; i < ip->next && n; i++) {
+        fs_extent_t *e = &ip->ext[i];
+        if (off >= e->cap) {
+            off -= e->cap;
+            continue;
+        }
+        uint64_t chunk = e->cap - off < n ? e->cap - off : n;
+        if (write)
+            memcpy(e->data + off, buf, chunk);
+        else
+            memcpy(buf, e->data + off, chunk);
+        buf += chunk;
+        n -= chunk;
+        off = 0;
+    }
+}
 
-    // ELF file that the loader can load
-    { "userprog.elf", _binary_userprog_elf_start,   1 },
-};
+// replace a borrowed image extent with owned memory before modifying it
+static int privatize(fs_inode_t *ip) {
+    if (ip->next != 1 || ip->ext[0].order >= 0)
+        return 0;
+    fs_extent_t old = ip->ext[0];
+    uint64_t size = ip->size;
+    ip->next = 0;
+    while (file_capacity(ip) < size) {
+        if (add_extent(ip, size - file_capacity(ip)) != 0) {
+            for (int i = 0; i < ip->next; i++)
+                kfree_pages(ip->ext[i].data, ip->ext[i].order);
+            ip->ext[0] = old;
+            ip->next = 1;
+            return -1;
+        }
+    }
+    extent_copy(ip, 0, old.data, size, 1);
+    return 0;
+}
 
-#define FILE_COUNT ((int)(sizeof(files) / sizeof(files[0])))
+static int file_load(fs_inode_t *ip);
 
-// simple string equality
-static int str_eq(const char *a, const char *b) {
-    while (*a && *b) {
-        if (*a != *b) return 0;
-        a++; b++;
+static int file_write(fs_inode_t *ip, uint64_t off, const void *src, uint64_t n) {
+    if (file_load(ip) != 0 || privatize(ip) != 0)
+        return -1;
+    cache_detach(ip);
+    ip->img = 0;
+    uint64_t cap = file_capacity(ip);
+    while (cap < off + n) {
+        if (add_extent(ip, off + n - cap) != 0)
+            return -1;
+        cap = file_capacity(ip);
     }
-    return (*a == '\0' && *b == '\0');
+    extent_copy(ip, off, (uint8_t *)src, n, 1);
+    if (off + n > ip->size)
+        ip->size = off + n;
+    return 0;
 }
 
-// compute length of a C string (for text files)
-static size_t cstr_len(const char *s) {
-    size_t n = 0;
-    while (s[n] != '\0') n++;
+static uint64_t file_read(fs_inode_t *ip, uint64_t off, void *dst, uint64_t n) {
+    if (off >= ip->size)
+        return 0;
+    if (n > ip->size - off)
+        n = ip->size - off;
+    extent_copy(ip, off, (uint8_t *)dst, n, 0);
     return n;
 }
 
-void fs_init(void) {
-    uart_puts("[FS] initialized with demo files.\n");
+// merge all extents into one so the file can be handed out as a single
+// contiguous buffer (the ELF loader needs that). not while someone still
+// reads the current one: only an append can have split it since
+static int compact(fs_inode_t *ip) {
+    if (ip->next <= 1)
+        return 0;
+    if (ip->pins)
+        return -1;
+    int order = kalloc_order_for(ip->size);
+    if (order > KALLOC_MAX_ORDER)
+        return -1;
+    uint8_t *data = (uint8_t *)kalloc_pages(order);
+    if (!data)
+        return -1;
+    extent_copy(ip, 0, data, ip->size, 0);
+    uint64_t size = ip->size;
+    free_extents(ip);
+    ip->ext[0].data = data;
+    ip->ext[0].cap = PGSIZE << order;
+    ip->ext[0].order = (int8_t)order;
+    ip->next = 1;
+    ip->size = size;
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Compressed files
+// -----------------------------------------------------------------------------
+
+// a compressed file becomes an ordinary one (written or removed): it
+// leaves the cache, keeping whatever extent it has
+static void cache_detach(fs_inode_t *ip) {
+    if (!ip->lz)
+        return;
+    if (ip->next)
+        cache.bytes -= ip->ext[0].cap;
+    ip->lz = 0;
+}
+
+// back to just the compressed copy in the image
+static void cache_drop(fs_inode_t *ip) {
+    cache.bytes -= ip->ext[0].cap;
+    kfree_pages(ip->ext[0].data, ip->ext[0].order);
+    ip->next = 0;
 }
 
-void fs_list(void) {
-    uart_puts("Files:\n");
-    for (int i = 0; i < FILE_COUNT; i++) {
-        uart_puts("  ");
-        uart_puts(files[i].name);
-        uart_puts("\n");
+// evict least recently used inflated files until `need` more bytes fit.
+// the few compressed files are found by walking the inode table.
+static void cache_trim(uint64_t need) {
+    while (cache.bytes && cache.bytes + need > FS_CACHE_BUDGET) {
+        fs_inode_t *victim = 0;
+        for (uint32_t i = 1; i < ninodes; i++) {
+            fs_inode_t *ip = inodes[i];
+            if (ip && ip->lz && ip->next && !ip->pins &&
+                (!victim || ip->used < victim->used))
+                victim = ip;
+        }
+        if (!victim)
+            return;
+        cache_drop(victim);
+        cache.evictions++;
     }
 }
 
-void fs_cat(const char *filename) {
-    for (int i = 0; i < FILE_COUNT; i++) {
-        if (str_eq(filename, files[i].name)) {
-            if (files[i].is_binary) {
-                uart_puts("Cannot cat binary file.\n");
-                return;
-            }
-            const char *text = (const char *)files[i].data;
-            for (size_t j = 0; text[j] != '\0'; j++) {
-                uart_putc(text[j]);
-            }
+// the first access to a file from the image compares its contents with
+// the checksum the packer recorded
+static int img_verify(fs_inode_t *ip) {
+    if (!ip->img || ip->checked)
+        return 0;
+    const fsimg_entry_t *e = &fsimg_entries(image)[ip->img - 1];
+    if (fsimg_sum(ip->next ? ip->ext[0].data : 0, ip->size) != e->sum) {
+        kprintf(KERN_ERR "[FS] %s: checksum mismatch, image corrupt\n", e->name);
+        return -1;
+    }
+    ip->checked = 1;
+    return 0;
+}
+
+// called before a file's data is touched: a compressed file is inflated
+// into one owned extent unless it already is, and a file from the image
+// is verified on first access. nothing to do for others.
+static int file_load(fs_inode_t *ip) {
+    if (!ip->lz || !ip->size)
+        return img_verify(ip);
+    ip->used = ++cache.clock;
+    if (ip->next) {
+        cache.hits++;
+        return 0;
+    }
+    PERF_SCOPE(PERF_FS_INFLATE);
+    uint64_t t0 = rdcycle();
+    cache_trim(PGSIZE << kalloc_order_for(ip->size));
+    if (add_extent(ip, ip->size) != 0)
+        return -1;
+    fs_extent_t *e = &ip->ext[0];
+    if (lz4_decompress(ip->lz, ip->lz_size, e->data, ip->size) != (long)ip->size ||
+        img_verify(ip) != 0) {
+        kprintf(KERN_ERR "[FS] corrupt compressed file, inode %u\n", ip->ino);
+        kfree_pages(e->data, e->order);
+        ip->next = 0;
+        return -1;
+    }
+    cache.bytes += e->cap;
+    cache.misses++;
+    cache.miss_cycles += rdcycle() - t0;
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Directories (hashed)
+// -----------------------------------------------------------------------------
+
+static uint32_t name_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static fs_dirent_t *dir_find(fs_inode_t *dp, const char *name) {
+    if (!dp->nbuckets)
+        return 0;
+    uint32_t h = name_hash(name);
+    for (fs_dirent_t *d = dp->buckets[h & (dp->nbuckets - 1)]; d; d = d->next)
+        if (d->hash == h && str_eq(d->name, name))
+            return d;
+    return 0;
+}
+
+static int dir_add(fs_inode_t *dp, const char *name, uint32_t ino);
+static fs_dirent_t *img_materialize(fs_inode_t *dp, const char *name);
+
+// the root directory falls through to the image for names it has not seen
+static fs_dirent_t *dir_lookup(fs_inode_t *dp, const char *name) {
+    fs_dirent_t *d = dir_find(dp, name);
+    if (!d && dp->ino == FS_ROOT_INO && image)
+        d = img_materialize(dp, name);
+    return d;
+}
+
+static int dir_rehash(fs_inode_t *dp) {
+    uint32_t n = dp->nbuckets ? dp->nbuckets * 2 : FS_INITIAL_BUCKETS;
+    fs_dirent_t **b = (fs_dirent_t **)kzalloc(n * sizeof(*b));
+    if (!b)
+        return -1;
+    for (uint32_t i = 0; i < dp->nbuckets; i++) {
+        fs_dirent_t *d = dp->buckets[i];
+        while (d) {
+            fs_dirent_t *next = d->next;
+            d->next = b[d->hash & (n - 1)];
+            b[d->hash & (n - 1)] = d;
+            d = next;
+        }
+    }
+    kfree(dp->buckets);
+    dp->buckets = b;
+    dp->nbuckets = n;
+    return 0;
+}
+
+static int dir_add(fs_inode_t *dp, const char *name, uint32_t ino) {
+    if (dp->size >= dp->nbuckets && dir_rehash(dp) != 0 && !dp->nbuckets)
+        return -1;
+    fs_dirent_t *d = (fs_dirent_t *)kmem_cache_alloc(dirent_cache);
+    if (!d)
+        return -1;
+    int i = 0;
+    for (; name[i] && i < FS_NAME_MAX - 1; i++)
+        d->name[i] = name[i];
+    d->name[i] = '\0';
+    d->hash = name_hash(d->name);
+    d->ino = ino;
+    fs_dirent_t **head = &dp->buckets[d->hash & (dp->nbuckets - 1)];
+    d->next = *head;
+    *head = d;
+    dp->size++;
+    return 0;
+}
+
+static void dir_remove(fs_inode_t *dp, const char *name) {
+    uint32_t h = name_hash(name);
+    fs_dirent_t **pp = &dp->buckets[h & (dp->nbuckets - 1)];
+    while (*pp) {
+        fs_dirent_t *d = *pp;
+        if (d->hash == h && str_eq(d->name, name)) {
+            *pp = d->next;
+            kmem_cache_free(dirent_cache, d);
+            dp->size--;
             return;
         }
+        pp = &d->next;
     }
-    uart_puts("No such file.\n");
 }
 
-// fs_get_file: returns pointer+size for text files and binary ELF.
-//   Returns 0 on success, -1 on not found.
-int fs_get_file(const char *name, const uint8_t **data_out, size_t *size_out) {
-    for (int i = 0; i < FILE_COUNT; ++i) {
-        if (!str_eq(name, files[i].name)) continue;
+// -----------------------------------------------------------------------------
+// Paths
+// -----------------------------------------------------------------------------
 
-        *data_out = files[i].data;
+// copy the next path component into name; returns the rest of the path or 0
+// at the end. components longer than FS_NAME_MAX-1 are an error (-1 in *err).
+static const char *next_component(const char *p, char *name, int *err) {
+    while (*p == '/') p++;
+    if (!*p)
+        return 0;
+    int n = 0;
+    while (*p && *p != '/') {
+        if (n == FS_NAME_MAX - 1) {
+            *err = -1;
+            return 0;
+        }
+        name[n++] = *p++;
+    }
+    name[n] = '\0';
+    return p;
+}
 
-        if (files[i].is_binary) {
-            // currently only userprog.elf is binary
-            if (files[i].data == _binary_userprog_elf_start) {
-                *size_out = (size_t)(_binary_userprog_elf_end -
-                                     _binary_userprog_elf_start);
-            } else {
-                // fallback, in case you add other binaries later
-                *size_out = 0;
-            }
-        } else {
-            *size_out = cstr_len((const char *)files[i].data);
+// walk `path`. with `parent` set, stop before the last component: returns
+// its directory and copies the final name into `last`.
+static fs_inode_t *namei(const char *path, int parent, char *last) {
+    PERF_SCOPE(PERF_FS_LOOKUP);
+    if (!path)
+        return 0;
+    fs_inode_t *ip = iget(*path == '/' ? FS_ROOT_INO : cwd);
+    char name[FS_NAME_MAX];
+    int err = 0;
+    const char *p = next_component(path, name, &err);
+    if (!p) {
+        // "/" or "": no final component
+        return err || parent ? 0 : ip;
+    }
+    for (;;) {
+        char next[FS_NAME_MAX];
+        const char *rest = next_component(p, next, &err);
+        if (err)
+            return 0;
+        if (!rest && parent) {
+            int i = 0;
+            for (; name[i]; i++) last[i] = name[i];
+            last[i] = '\0';
+            return ip;
+        }
+        if (ip->type != FS_TYPE_DIR)
+            return 0;
+        if (str_eq(name, "..")) {
+            ip = iget(ip->parent);
+        } else if (!str_eq(name, ".")) {
+            fs_dirent_t *d = dir_lookup(ip, name);
+            if (!d)
+                return 0;
+            ip = iget(d->ino);
         }
+        if (!rest)
+            return ip;
+        for (int i = 0; i < FS_NAME_MAX; i++) name[i] = next[i];
+        p = rest;
+    }
+}
+
+static fs_inode_t *create(const char *path, uint16_t type) {
+    char name[FS_NAME_MAX];
+    fs_inode_t *dp = namei(path, 1, name);
+    if (!dp || dp->type != FS_TYPE_DIR || str_eq(name, ".") || str_eq(name, ".."))
+        return 0;
+    fs_dirent_t *d = dir_lookup(dp, name);
+    if (d) {
+        fs_inode_t *ip = iget(d->ino);
+        return ip->type == type ? ip : 0;
+    }
+    fs_inode_t *ip = ialloc(type, dp->ino);
+    if (!ip)
+        return 0;
+    if (dir_add(dp, name, ip->ino) != 0) {
+        ifree(ip);
+        return 0;
+    }
+    return ip;
+}
 
+// -----------------------------------------------------------------------------
+// The packed image
+// -----------------------------------------------------------------------------
+
+// give image entry `name` an inode in the root directory. only its entry
+// is read: a raw file borrows its bytes, a compressed one is inflated by
+// file_load() when first touched. 0 if there is no such entry.
+static fs_dirent_t *img_materialize(fs_inode_t *dp, const char *name) {
+    int i = fsimg_lookup(image, name);
+    if (i < 0 || taken[i])
+        return 0;
+    const fsimg_entry_t *e = &fsimg_entries(image)[i];
+    int lz = e->flags & FSIMG_LZ4;
+    if (e->offset > image->size || e->stored > image->size - e->offset ||
+        (!lz && e->stored != e->size)) {
+        kprintf(KERN_ERR "[FS] %s: bad image entry\n", e->name);
+        return 0;
+    }
+    fs_inode_t *ip = ialloc(FS_TYPE_FILE, dp->ino);
+    if (!ip)
+        return 0;
+    const uint8_t *data = (const uint8_t *)image + e->offset;
+    if (lz) {
+        ip->lz = data;
+        ip->lz_size = e->stored;
+    } else if (e->size) {
+        if (add_extent(ip, 1) != 0) {
+            ifree(ip);
+            return 0;
+        }
+        kfree_pages(ip->ext[0].data, ip->ext[0].order);
+        ip->ext[0].data = (uint8_t *)data;
+        ip->ext[0].cap = e->size;
+        ip->ext[0].order = -1;
+    }
+    ip->size = e->size;
+    ip->img = (uint32_t)i + 1;
+    if (dir_add(dp, name, ip->ino) != 0) {
+        ifree(ip);
         return 0;
     }
-    return -1;
+    taken[i] = 1;
+    return dir_find(dp, name);
+}
+
+// only the header and index are looked at: files get inodes when first named
+static void img_init(void) {
+    const fsimg_header_t *h = (const fsimg_header_t *)_binary_fs_img_start;
+    uint64_t n = (uint64_t)(_binary_fs_img_end - _binary_fs_img_start);
+    if (fsimg_check(h, n) != 0) {
+        kprintf(KERN_ERR "[FS] no valid file system image\n");
+        return;
+    }
+    taken = (uint8_t *)kzalloc(h->nfiles ? h->nfiles : 1);
+    if (!taken)
+        return;
+    image = h;
+    kprintf("[FS] image: %u files, %lu bytes, %u hash buckets\n",
+            h->nfiles, (unsigned long)h->size, h->nbuckets);
+}
+
+void fs_init(void) {
+    inode_cache = kmem_cache_create("inode", sizeof(fs_inode_t));
+    dirent_cache = kmem_cache_create("dirent", sizeof(fs_dirent_t));
+    grow_inode_table();
+    fs_inode_t *root = ialloc(FS_TYPE_DIR, 0);
+    cwd = root ? root->ino : 0;
+    img_init();
+    kprintf("[FS] ramfs initialized.\n");
+}
+
+// -----------------------------------------------------------------------------
+// Kernel API
+// -----------------------------------------------------------------------------
+
+// the buffer is read after the lock is gone, so while a file is pinned
+// nothing may free its extents: fs_write() may only append (which never
+// moves existing bytes), fs_remove() and compact() refuse, and the cache
+// does not evict it. the inode number stays valid because the file
+// cannot be removed meanwhile.
+int fs_get_file(const char *name, const uint8_t **data_out, size_t *size_out,
+                uint32_t *ino_out, uint64_t *version_out) {
+    fs_lock();
+    fs_inode_t *ip = namei(name, 0, 0);
+    if (!ip || ip->type != FS_TYPE_FILE || file_load(ip) != 0 || compact(ip) != 0) {
+        fs_unlock();
+        return -1;
+    }
+    *data_out = ip->next ? ip->ext[0].data : (const uint8_t *)"";
+    *size_out = (size_t)ip->size;
+    *ino_out = ip->ino;
+    *version_out = ip->version;
+    ip->pins++;
+    fs_unlock();
+    return 0;
+}
+
+void fs_put_file(uint32_t ino) {
+    fs_lock();
+    fs_inode_t *ip = iget(ino);
+    if (ip && ip->type == FS_TYPE_FILE && ip->pins)
+        ip->pins--;
+    fs_unlock();
+}
+
+int fs_write(const char *path, const void *data, size_t n, int append) {
+    fs_lock();
+    fs_inode_t *ip = create(path, FS_TYPE_FILE);
+    int r = -1;
+    if (ip && (append || !ip->pins)) {
+        if (!append)
+            free_extents(ip);
+        r = file_write(ip, ip->size, data, n);
+        ip->version = next_version++;
+    }
+    fs_unlock();
+    return r;
+}
+
+long fs_read(const char *path, uint64_t off, void *buf, size_t n) {
+    fs_lock();
+    fs_inode_t *ip = namei(path, 0, 0);
+    long r = -1;
+    if (ip && ip->type == FS_TYPE_FILE && file_load(ip) == 0)
+        r = (long)file_read(ip, off, buf, n);
+    fs_unlock();
+    return r;
+}
+
+int fs_identity(const char *path, uint32_t *ino_out, uint64_t *version_out) {
+    fs_lock();
+    fs_inode_t *ip = namei(path, 0, 0);
+    int r = -1;
+    if (ip && ip->type == FS_TYPE_FILE) {
+        *ino_out = ip->ino;
+        *version_out = ip->version;
+        r = 0;
+    }
+    fs_unlock();
+    return r;
+}
+
+int fs_size(const char *path, uint64_t *size_out) {
+    fs_lock();
+    fs_inode_t *ip = namei(path, 0, 0);
+    int r = -1;
+    if (ip && ip->type == FS_TYPE_FILE) {
+        *size_out = ip->size;
+        r = 0;
+    }
+    fs_unlock();
+    return r;
+}
+
+int fs_copy(const char *src, const char *dst) {
+    uint8_t buf[256];
+    uint64_t size;
+
+    fs_lock();
+    fs_inode_t *s = namei(src, 0, 0), *d = namei(dst, 0, 0);
+    fs_unlock();
+    if (!s || s == d)
+        return -1;   // copying onto itself would truncate the source first
+    if (fs_size(src, &size) != 0 || fs_write(dst, "", 0, 0) != 0)
+        return -1;
+    for (uint64_t off = 0; off < size; ) {
+        long n = fs_read(src, off, buf, sizeof(buf));
+        if (n <= 0 || fs_write(dst, buf, (size_t)n, 1) != 0)
+            return -1;
+        off += (uint64_t)n;
+    }
+    return 0;
+}
+
+int fs_remove(const char *path) {
+    fs_lock();
+    char name[FS_NAME_MAX];
+    fs_inode_t *dp = namei(path, 1, name);
+    fs_dirent_t *d = dp && dp->type == FS_TYPE_DIR ? dir_lookup(dp, name) : 0;
+    fs_inode_t *ip = d ? iget(d->ino) : 0;
+    int r = -1;
+    // directories must be empty, and nobody may be sitting in one; a file
+    // must not be pinned by fs_get_file()
+    if (ip && !(ip->type == FS_TYPE_DIR && (ip->size || ip->ino == cwd)) && !ip->pins) {
+        dir_remove(dp, name);
+        ifree(ip);
+        r = 0;
+    }
+    fs_unlock();
+    return r;
+}
+
+int fs_mkdir(const char *path) {
+    fs_lock();
+    char name[FS_NAME_MAX];
+    fs_inode_t *dp = namei(path, 1, name);
+    int r = -1;
+    if (dp && dp->type == FS_TYPE_DIR && !dir_lookup(dp, name))
+        r = create(path, FS_TYPE_DIR) ? 0 : -1;
+    fs_unlock();
+    return r;
+}
+
+int fs_chdir(const char *path) {
+    fs_lock();
+    fs_inode_t *ip = namei(path, 0, 0);
+    int r = -1;
+    if (ip && ip->type == FS_TYPE_DIR) {
+        cwd = ip->ino;
+        r = 0;
+    }
+    fs_unlock();
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+// Shell commands
+// -----------------------------------------------------------------------------
+
+// the listing is formatted under the lock and written after it: stdout may
+// be a pipe that only drains once the next stage gets the fs lock itself
+#define LIST_LINE_MAX (FS_NAME_MAX + 24)
+
+void fs_list(const char *path) {
+    fs_lock();
+    fs_inode_t *dp = namei(path && *path ? path : ".", 0, 0);
+    if (!dp || dp->type != FS_TYPE_DIR) {
+        fs_unlock();
+        uart_puts("No such directory.\n");
+        return;
+    }
+    // image files nobody has named yet are listed without an inode
+    uint32_t nimg = dp->ino == FS_ROOT_INO && image ? image->nfiles : 0;
+    uint64_t n = 1 + nimg;
+    for (uint32_t i = 0; i < dp->nbuckets; i++)
+        for (fs_dirent_t *d = dp->buckets[i]; d; d = d->next)
+            n++;
+    char *out = (char *)kmalloc(n * LIST_LINE_MAX);
+    if (!out) {
+        fs_unlock();
+        uart_puts("ls: out of memory\n");
+        return;
+    }
+    size_t len = (size_t)ksnprintf(out, LIST_LINE_MAX, "Files:\n");
+    for (uint32_t i = 0; i < dp->nbuckets; i++) {
+        for (fs_dirent_t *d = dp->buckets[i]; d; d = d->next) {
+            fs_inode_t *ip = iget(d->ino);
+            if (ip->type == FS_TYPE_DIR)
+                len += (size_t)ksnprintf(out + len, LIST_LINE_MAX, "  %s/\n", d->name);
+            else
+                len += (size_t)ksnprintf(out + len, LIST_LINE_MAX, "  %s  %lu\n",
+                                         d->name, (unsigned long)ip->size);
+        }
+    }
+    for (uint32_t i = 0; i < nimg; i++) {
+        const fsimg_entry_t *e = &fsimg_entries(image)[i];
+        if (taken[i])
+            continue;
+        char name[FS_NAME_MAX];
+        int k = 0;
+        for (; k < FS_NAME_MAX - 1 && e->name[k]; k++)
+            name[k] = e->name[k];
+        name[k] = '\0';
+        len += (size_t)ksnprintf(out + len, LIST_LINE_MAX, "  %s  %lu\n",
+                                 name, (unsigned long)e->size);
+    }
+    fs_unlock();
+    out_write(out, len);
+    kfree(out);
+}
+
+// a page per round: into a pipe this is one copy out of the fs and one
+// into the reader, so bigger rounds mean fewer lock round trips per byte
+#define CAT_CHUNK 4096
+
+void fs_cat(const char *filename) {
+    char magic[4];
+    uint64_t size;
+    if (fs_size(filename, &size) != 0) {
+        uart_puts("No such file.\n");
+        return;
+    }
+    if (size >= 4 && fs_read(filename, 0, magic, 4) == 4 &&
+        magic[0] == 0x7f && magic[1] == 'E' && magic[2] == 'L' && magic[3] == 'F') {
+        uart_puts("Cannot cat binary file.\n");
+        return;
+    }
+    char *buf = (char *)kmalloc(CAT_CHUNK);
+    if (!buf) {
+        uart_puts("cat: out of memory\n");
+        return;
+    }
+    for (uint64_t off = 0; off < size; ) {
+        long n = fs_read(filename, off, buf, CAT_CHUNK);
+        if (n <= 0)
+            break;
+        out_write(buf, (size_t)n);
+        off += (uint64_t)n;
+    }
+    kfree(buf);
+}
+
+// ksnprintf() returns the length it wanted; keep len on the buffer
+static size_t put_len(size_t len, int n, size_t cap) {
+    return len + (size_t)n < cap ? len + (size_t)n : cap - 1;
+}
+
+// appends "/dir/.../name" for ino to buf, which holds len bytes; returns
+// the new length. a path longer than the buffer is cut off
+static size_t put_path(uint32_t ino, char *buf, size_t len, size_t cap) {
+    fs_inode_t *ip = iget(ino);
+    if (!ip || ino == FS_ROOT_INO)
+        return len;
+    len = put_path(ip->parent, buf, len, cap);
+    fs_inode_t *dp = iget(ip->parent);
+    for (uint32_t i = 0; i < dp->nbuckets; i++)
+        for (fs_dirent_t *d = dp->buckets[i]; d; d = d->next)
+            if (d->ino == ino)
+                return put_len(len, ksnprintf(buf + len, cap - len, "/%s", d->name), cap);
+    return len;
+}
+
+// pwd and stat, like ls, format under the lock and print after it
+#define PWD_MAX 256
+
+void fs_pwd(void) {
+    char path[PWD_MAX];
+    path[0] = '\0';
+    fs_lock();
+    size_t len = put_path(cwd, path, 0, sizeof(path));
+    fs_unlock();
+    uart_puts(len ? path : "/");
+    uart_puts("\n");
+}
+
+void fs_stat(const char *path) {
+    char out[192];
+    fs_lock();
+    fs_inode_t *ip = namei(path, 0, 0);
+    if (!ip) {
+        fs_unlock();
+        uart_puts("No such file.\n");
+        return;
+    }
+    size_t len, cap = sizeof(out);
+    if (ip->type == FS_TYPE_DIR) {
+        len = put_len(0, ksnprintf(out, cap, "inode %u, directory, %lu entries, %u buckets\n",
+                                   ip->ino, (unsigned long)ip->size, ip->nbuckets), cap);
+    } else {
+        len = put_len(0, ksnprintf(out, cap, "inode %u, file, %lu bytes, %u%s\n",
+                                   ip->ino, (unsigned long)ip->size, ip->next,
+                                   ip->next == 1 && ip->ext[0].order < 0
+                                       ? " extent (in kernel image)" : " extents"), cap);
+        if (ip->lz)
+            len = put_len(len, ksnprintf(out + len, cap - len,
+                                         "  lz4: %u bytes in kernel image, %s\n",
+                                         ip->lz_size, ip->next ? "inflated" : "not inflated"),
+                          cap);
+        if (ip->img)
+            len = put_len(len, ksnprintf(out + len, cap - len, "  image entry %u, %s\n",
+                                         ip->img - 1, ip->checked ? "checksum ok"
+                                                                 : "checksum not checked yet"),
+                          cap);
+    }
+    fs_unlock();
+    uart_puts(out);
+}
+
+// printed from a copy: uart output may sleep, so not under the fs lock
+void fs_cache_stats(void) {
+    fs_lock();
+    struct fs_cache c = cache;
+    fs_unlock();
+
+    // the image never changes, so it needs no lock
+    uint32_t files = 0, nfiles = image ? image->nfiles : 0;
+    uint64_t raw = 0, packed = 0;
+    for (uint32_t i = 0; i < nfiles; i++) {
+        const fsimg_entry_t *e = &fsimg_entries(image)[i];
+        if (e->flags & FSIMG_LZ4) {
+            files++;
+            raw += e->size;
+            packed += e->stored;
+        }
+    }
+    char line[112];
+    ksnprintf(line, sizeof(line), "image: %u files, %lu bytes, %u hash buckets\n",
+              nfiles, image ? (unsigned long)image->size : 0UL, image ? image->nbuckets : 0);
+    uart_puts(line);
+    ksnprintf(line, sizeof(line),
+              "compressed files: %u, %lu bytes stored as %lu in the image (%lu%%)\n",
+              files, raw, packed, raw ? packed * 100 / raw : 0);
+    uart_puts(line);
+    ksnprintf(line, sizeof(line), "inflated: %lu of %lu bytes, %lu evictions\n",
+              c.bytes, (uint64_t)FS_CACHE_BUDGET, c.evictions);
+    uart_puts(line);
+    ksnprintf(line, sizeof(line),
+              "accesses: %lu hits, %lu first accesses (avg %lu cycles to inflate)\n",
+              c.hits, c.misses, c.misses ? c.miss_cycles / c.misses : 0);
+    uart_puts(line);
+}
+
+// drop every inflated file nobody holds, so the next access of each is a
+// first access again
+void fs_cache_flush(void) {
+    fs_lock();
+    for (uint32_t i = 1; i < ninodes; i++) {
+        fs_inode_t *ip = inodes[i];
+        if (ip && ip->lz && ip->next && !ip->pins)
+            cache_drop(ip);
+    }
+    cache.hits = cache.misses = cache.evictions = cache.miss_cycles = 0;
+    fs_unlock();
+}
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+static void make_name(char *buf, const char *prefix, int i) {
+    int n = 0;
+    while (*prefix) buf[n++] = *prefix++;
+    char digits[12];
+    int d = 0;
+    do { digits[d++] = (char)('0' + i % 10); i /= 10; } while (i);
+    while (d) buf[n++] = digits[--d];
+    buf[n] = '\0';
+}
+
+//   creates `count` empty files in /fsbench, then times a lookup of every
+//   one of them at 1/8, 1/2 and all of `count` to show lookup cost does not
+//   grow with directory size. everything is removed again afterwards.
+void fs_bench(int count) {
+    if (count <= 0) count = 2000;
+    char path[FS_NAME_MAX + 16];
+
+    if (fs_mkdir("/fsbench") != 0) {
+        uart_puts("fs bench: cannot create /fsbench\n");
+        return;
+    }
+    uart_puts("ramfs lookup benchmark (");
+    uart_put_dec(count);
+    uart_puts(" files)\n");
+
+    int created = 0, mark = count / 8 ? count / 8 : 1;
+    for (int i = 0; i < count; i++) {
+        make_name(path, "/fsbench/f", i);
+        if (fs_write(path, "", 0, 0) != 0)
+            break;
+        created++;
+        if (created == mark || created == count) {
+            uint64_t size, c0 = rdcycle();
+            for (int j = 0; j < created; j++) {
+                make_name(path, "/fsbench/f", j);
+                fs_size(path, &size);
+            }
+            uart_puts("  ");
+            uart_put_dec(created);
+            uart_puts(" files: ");
+            uart_put_dec((int)((rdcycle() - c0) / (uint64_t)created));
+            uart_puts(" cycles/lookup\n");
+            mark = mark * 4 < count ? mark * 4 : count;
+        }
+    }
+    for (int i = 0; i < created; i++) {
+        make_name(path, "/fsbench/f", i);
+        fs_remove(path);
+    }
+    fs_remove("/fsbench");
 }
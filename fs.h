@@ -1,28 +1,83 @@
-// fs.h — header file for the simple in-memory filesystem
+// fs.h — header file for the writable in-memory filesystem (ramfs)
 // this header declares the public interface for the filesystem module (`fs.c`).
-// it allows other kernel components (like `shell.c` or `main.c`) to initialize
-// the filesystem, list available files, and display their contents.
+// it allows other kernel components (like `shell.c`, `loader.c` or `main.c`)
+// to initialize the filesystem, look files up, read and write them, and
+// manage directories. paths are absolute ("/dir/file") or relative to the
+// current directory; "." and ".." work as usual.
 
 #ifndef FS_H
 #define FS_H
 #include <stddef.h>
 #include <stdint.h>
 
+// longest path component, including the terminating NUL
+#define FS_NAME_MAX 32
 
-//   initializes the in-memory filesystem. in this simple OS, it just prints a
-//   message announcing that the filesystem has been set up.
-//   called by: - kernel_main() in main.c
+//   creates the root directory and checks the packed image (fsimg.h)
+//   linked into the kernel. its files (rootfs/ and the programs) appear in
+//   "/" and get an inode when first named, so boot reads only the header.
+//   called by: - kernel_main() in main.c (after kmem_init)
 void fs_init(void);
-//   lists all available files stored in the in-memory filesystem. each file
-//   name is printed via the UART driver.
-//   called by: - shell command "ls"
-void fs_list(void);
-//   displays the contents of a specific file. If the given filename exists in
-//   the filesystem array, its contents are printed to the console via UART.
-//   if not found, prints "No such file."
-//   parameters: - filename: the name of the file to display (e.g., "hello.txt")
+
+//   lists a directory (the current one if path is empty): names, with
+//   sizes for files and a trailing '/' for directories. the listing goes
+//   to the calling thread's stdout (out_write() in handle.h).
+//   called by: - shell command "ls [dir]"
+void fs_list(const char *path);
+
+//   writes the contents of a file to the calling thread's stdout, or prints
+//   "No such file." if it does not exist. ELF files are refused.
 //   called by: - shell command "cat <filename>"
 void fs_cat(const char *filename);
-int fs_get_file(const char *name, const uint8_t **data_out, size_t *size_out);
+
+//   returns the file's data as one contiguous buffer (merging its extents
+//   or inflating a compressed file if necessary) and its size. a raw file
+//   from the image is a pointer into the image. 0 on success, -1 if not
+//   found or if its checksum does not match. the buffer is not evicted
+//   from the inflated file cache until fs_put_file(). the file is pinned
+//   until then: it can be appended to, but not rewritten or removed.
+//   ino/version identify what was returned (see fs_identity()), and ino
+//   is what fs_put_file() takes back.
+//   called by: - load_program_from_fs() in loader.c
+int fs_get_file(const char *name, const uint8_t **data_out, size_t *size_out,
+                uint32_t *ino_out, uint64_t *version_out);
+void fs_put_file(uint32_t ino);
+
+//   creates the file if needed, then replaces (append = 0) or extends
+//   (append = 1) its contents. 0 on success, -1 on error, including a
+//   replace of a file fs_get_file() has pinned.
+int fs_write(const char *path, const void *data, size_t n, int append);
+
+//   reads up to n bytes at offset off. returns bytes read (0 at end of file)
+//   or -1 if path is not a file.
+long fs_read(const char *path, uint64_t off, void *buf, size_t n);
+int fs_size(const char *path, uint64_t *size_out);
+
+//   identifies the current contents of a file: the inode number plus a
+//   version that changes on every write and is never handed out twice, so
+//   the pair still tells files apart after an inode number is reused.
+//   0 on success, -1 if path is not a file.
+//   called by: - load_program_from_fs() in loader.c (image cache key)
+int fs_identity(const char *path, uint32_t *ino_out, uint64_t *version_out);
+
+int fs_copy(const char *src, const char *dst);
+//   removes a file or an empty directory; -1 for a pinned file.
+int fs_remove(const char *path);
+int fs_mkdir(const char *path);
+int fs_chdir(const char *path);
+
+//   called by: - shell commands "pwd" and "stat <path>"
+void fs_pwd(void);
+void fs_stat(const char *path);
+
+//   image size, compressed sizes, inflated bytes, hits, first accesses and their
+//   latency in cycles (shell command "fscache"); flush drops every
+//   inflated file and resets the counters ("fscache flush").
+void fs_cache_stats(void);
+void fs_cache_flush(void);
+
+//   lookup cost with a growing number of files in one directory
+//   (shell command "bench fs [n]").
+void fs_bench(int count);
 
 #endif
@@ -0,0 +1,115 @@
+// fsimg.h — the packed file system image built by tools/fspack
+// the build turns rootfs/ and the user programs into one image that is
+// linked into the kernel (fs_img.o). fs.c serves it as the lower layer of
+// "/": a name is looked up in the image in constant time, whatever the
+// number of files, and nothing is read at boot beyond the header.
+//
+//   header    magic, version, file count, hash parameters, offsets
+//   disp[]    one displacement per hash bucket (nbuckets of them)
+//   entries[] one per file, indexed by the perfect hash of its name
+//   data      the stored bytes of every file: LZ4 blocks (lz4.h) for files
+//             that compress, the raw bytes otherwise. raw ELF files start
+//             on a page boundary so the loader can map them in place.
+//
+// the index is a minimal perfect hash ("hash and displace"): the name's
+// hash with `seed` picks a bucket, the hash with that bucket's
+// displacement picks the entry. the packer chose the displacements so that
+// every name lands on its own entry, so a lookup is two hashes and one
+// name compare, and a miss is detected by that compare.
+//
+// this header is shared with the host tool, so it needs nothing but
+// <stdint.h>. both sides are little-endian with the LP64 layout below.
+
+#ifndef FSIMG_H
+#define FSIMG_H
+
+#include <stdint.h>
+
+#define FSIMG_MAGIC    0x53465652u  // "RVFS"
+#define FSIMG_VERSION  1
+#define FSIMG_NAME_MAX 32           // = FS_NAME_MAX, with the NUL
+#define FSIMG_PAGE     4096
+
+#define FSIMG_LZ4      0x1          // entry flag: data is an LZ4 block
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nfiles;
+    uint32_t nbuckets;
+    uint32_t seed;                  // first-level hash seed
+    uint32_t entries_off;           // from the start of the image
+    uint64_t size;                  // of the whole image
+} fsimg_header_t;
+
+typedef struct {
+    char name[FSIMG_NAME_MAX];
+    uint64_t offset;                // of the stored bytes
+    uint32_t size;                  // original size
+    uint32_t stored;                // bytes in the image
+    uint32_t flags;
+    uint32_t sum;                   // fsimg_sum() of the original contents
+} fsimg_entry_t;
+
+// FNV-1a over the name, seeded, with a final avalanche so that different
+// seeds give unrelated values
+static inline uint32_t fsimg_hash(const char *s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// per-file checksum (FNV-1a)
+static inline uint32_t fsimg_sum(const uint8_t *p, uint64_t n) {
+    uint32_t h = 2166136261u;
+    for (uint64_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline const uint32_t *fsimg_disp(const fsimg_header_t *h) {
+    return (const uint32_t *)(h + 1);
+}
+
+static inline const fsimg_entry_t *fsimg_entries(const fsimg_header_t *h) {
+    return (const fsimg_entry_t *)((const uint8_t *)h + h->entries_off);
+}
+
+//   0 if the n bytes at h look like an image whose index lies within them.
+//   the entries themselves are checked when they are used.
+static inline int fsimg_check(const fsimg_header_t *h, uint64_t n) {
+    if (n < sizeof(*h) || h->magic != FSIMG_MAGIC || h->version != FSIMG_VERSION ||
+        h->size > n || (h->nfiles && !h->nbuckets) || h->entries_off % 8 ||
+        h->entries_off < sizeof(*h) + 4ull * h->nbuckets ||
+        h->entries_off + (uint64_t)h->nfiles * sizeof(fsimg_entry_t) > h->size)
+        return -1;
+    return 0;
+}
+
+//   index of the entry named `name`, or -1.
+static inline int fsimg_lookup(const fsimg_header_t *h, const char *name) {
+    if (!h->nfiles)
+        return -1;
+    uint32_t b = fsimg_hash(name, h->seed) % h->nbuckets;
+    uint32_t slot = fsimg_hash(name, fsimg_disp(h)[b]) % h->nfiles;
+    const char *e = fsimg_entries(h)[slot].name;
+    for (int i = 0; i < FSIMG_NAME_MAX; i++) {
+        if (e[i] != name[i])
+            return -1;
+        if (!e[i])
+            return (int)slot;
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,187 @@
+// handle.c — stdin/stdout handles: console, pipe ends and output files
+// ---------------------------------------------------------------
+// a thin switch over the handle types in handle.h. pipes do their own
+// copying between address spaces (pipe.c); the console and ramfs files
+// go through a bounce buffer, since the UART and fs_write() want kernel
+// memory anyway.
+// ---------------------------------------------------------------
+
+#include "handle.h"
+#include "fs.h"
+#include "uart.h"
+#include "sched.h"
+#include "tasks.h"
+#include "slab.h"
+#include "string.h"
+#include "vm.h"
+
+// bytes moved per bounce-buffer round for the console and files
+#define HANDLE_CHUNK 128
+
+// -----------------------------------------------------------------------------
+// Handles
+// -----------------------------------------------------------------------------
+
+static handle_t *handle_new(int type) {
+    handle_t *f = (handle_t *)kzalloc(sizeof(handle_t));
+    if (!f)
+        return 0;
+    f->type = type;
+    f->refs = 1;
+    return f;
+}
+
+int handle_pipe(handle_t **rd, handle_t **wr) {
+    handle_t *r = handle_new(HANDLE_PIPE_R);
+    handle_t *w = handle_new(HANDLE_PIPE_W);
+    pipe_t *p = pipe_create();
+    if (!r || !w || !p) {
+        if (p) {
+            pipe_close(p, 0);
+            pipe_close(p, 1);
+        }
+        kfree(r);
+        kfree(w);
+        return -1;
+    }
+    r->pipe = w->pipe = p;
+    *rd = r;
+    *wr = w;
+    return 0;
+}
+
+handle_t *handle_open(const char *path, int append) {
+    if (strlen(path) >= HANDLE_PATH_MAX)
+        return 0;
+    // create (or empty) it now, so a failing path is reported up front
+    if (fs_write(path, "", 0, append) != 0)
+        return 0;
+    handle_t *f = handle_new(HANDLE_FS);
+    if (f)
+        memcpy(f->path, path, (size_t)strlen(path) + 1);
+    return f;
+}
+
+handle_t *handle_dup(handle_t *f) {
+    if (f)
+        __atomic_fetch_add(&f->refs, 1, __ATOMIC_RELAXED);
+    return f;
+}
+
+void handle_close(handle_t *f) {
+    if (!f || __atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    if (f->type == HANDLE_PIPE_R || f->type == HANDLE_PIPE_W)
+        pipe_close(f->pipe, f->type == HANDLE_PIPE_W);
+    kfree(f);
+}
+
+// -----------------------------------------------------------------------------
+// Console
+// -----------------------------------------------------------------------------
+
+static void mem_out(const pipe_mem_t *m, uint64_t off, const void *src, uint64_t n) {
+    if (m->pt)
+        vm_copy_out(m->pt, m->addr + off, src, n);
+    else
+        memcpy((void *)(m->addr + off), src, n);
+}
+
+static void mem_in(void *dst, const pipe_mem_t *m, uint64_t off, uint64_t n) {
+    if (m->pt)
+        vm_copy_in(m->pt, dst, m->addr + off, n);
+    else
+        memcpy(dst, (const void *)(m->addr + off), n);
+}
+
+static int64_t console_write(const pipe_mem_t *src, uint64_t n) {
+    sched_acct_tx(n);
+    if (!src->pt) {
+        uart_write((const char *)src->addr, n);
+        return (int64_t)n;
+    }
+    char buf[HANDLE_CHUNK];
+    for (uint64_t done = 0; done < n; ) {
+        uint64_t k = n - done < HANDLE_CHUNK ? n - done : HANDLE_CHUNK;
+        mem_in(buf, src, done, k);
+        uart_write(buf, k);
+        done += k;
+    }
+    return (int64_t)n;
+}
+
+static int64_t console_read(const pipe_mem_t *dst, uint64_t n) {
+    char buf[HANDLE_CHUNK];
+    uint64_t got = 0, k = 0;
+    while (got + k < n) {
+        char c = uart_getc();
+        if (c == '\r') c = '\n';
+        uart_putc(c);
+        buf[k++] = c;
+        if (k == HANDLE_CHUNK || c == '\n') {
+            mem_out(dst, got, buf, k);
+            got += k;
+            k = 0;
+            if (c == '\n')
+                break;
+        }
+    }
+    if (k) {
+        mem_out(dst, got, buf, k);
+        got += k;
+    }
+    return (int64_t)got;
+}
+
+// -----------------------------------------------------------------------------
+// Read and write
+// -----------------------------------------------------------------------------
+
+static int64_t fs_append(handle_t *f, const pipe_mem_t *src, uint64_t n) {
+    if (!src->pt)
+        return fs_write(f->path, (const void *)src->addr, n, 1) == 0 ? (int64_t)n : -1;
+    char buf[HANDLE_CHUNK];
+    for (uint64_t done = 0; done < n; ) {
+        uint64_t k = n - done < HANDLE_CHUNK ? n - done : HANDLE_CHUNK;
+        mem_in(buf, src, done, k);
+        if (fs_write(f->path, buf, k, 1) != 0)
+            return done ? (int64_t)done : -1;
+        done += k;
+    }
+    return (int64_t)n;
+}
+
+int64_t handle_read(handle_t *f, const pipe_mem_t *dst, uint64_t n, int nonblock) {
+    if (!f)
+        return nonblock ? PIPE_AGAIN : console_read(dst, n);
+    if (f->type != HANDLE_PIPE_R)
+        return -1;
+    return pipe_read(f->pipe, dst, n, nonblock);
+}
+
+int64_t handle_write(handle_t *f, const pipe_mem_t *src, uint64_t n, int nonblock) {
+    if (!f)
+        return console_write(src, n);
+    switch (f->type) {
+    case HANDLE_PIPE_W:
+        return pipe_write(f->pipe, src, n, nonblock);
+    case HANDLE_FS:
+        return fs_append(f, src, n);
+    default:
+        return -1;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Kernel output
+// -----------------------------------------------------------------------------
+
+void out_write(const void *buf, size_t n) {
+    pcb_t *me = sched_current();
+    pipe_mem_t src = { 0, (uint64_t)buf };
+    handle_write(me ? me->stdio[1] : 0, &src, n, 0);
+}
+
+void out_puts(const char *s) {
+    out_write(s, (size_t)strlen(s));
+}
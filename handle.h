@@ -0,0 +1,59 @@
+// handle.h — handles: what a task's stdin/stdout/stderr refer to
+// every pcb has three slots, stdio[0..2]. an empty slot (0) is the
+// console, so threads that never heard of handles keep talking to the
+// UART. the shell fills the slots when it starts a pipeline stage:
+//
+//   HANDLE_PIPE_R / HANDLE_PIPE_W   one end of a pipe (pipe.h)
+//   HANDLE_FS                       a ramfs file opened by "> file" or
+//                                   ">> file"; every write appends to it
+//
+// handles are reference counted: a pcb, a ring (ring.c) and the shell can
+// share one, and the underlying pipe end is closed with the last reference.
+// that is how a stage's exit turns into end of file for the next one.
+
+#ifndef HANDLE_H
+#define HANDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pipe.h"
+
+#define HANDLE_PIPE_R 1
+#define HANDLE_PIPE_W 2
+#define HANDLE_FS     3
+
+#define HANDLE_PATH_MAX 128
+
+typedef struct handle {
+    int type;
+    int refs;
+    pipe_t *pipe;               // HANDLE_PIPE_R/W
+    char path[HANDLE_PATH_MAX]; // HANDLE_FS
+} handle_t;
+
+//   a new pipe and a handle for each end. 0 on success, -1 if out of memory.
+int handle_pipe(handle_t **rd, handle_t **wr);
+
+//   opens path for output, emptying it first unless append. 0 on error.
+handle_t *handle_open(const char *path, int append);
+
+//   another reference to f (f may be 0, the console). returns f.
+handle_t *handle_dup(handle_t *f);
+
+//   drops a reference (f may be 0).
+void handle_close(handle_t *f);
+
+//   read into / write from dst/src through handle f, 0 meaning the console.
+//   results as for pipe_read()/pipe_write(); -1 if f cannot do it. console
+//   reads are line-oriented like a cooked tty: they echo and return after
+//   a newline.
+int64_t handle_read(handle_t *f, const pipe_mem_t *dst, uint64_t n, int nonblock);
+int64_t handle_write(handle_t *f, const pipe_mem_t *src, uint64_t n, int nonblock);
+
+//   kernel-side output for commands that can run as pipeline stages: goes
+//   to the current thread's stdout handle, or to the UART if it has none.
+//   called by: - fs_cat(), fs_list() in fs.c, shell command "echo"
+void out_write(const void *buf, size_t n);
+void out_puts(const char *s);
+
+#endif
@@ -0,0 +1,351 @@
+// bench.c — host microbenchmarks for fs lookup, libk and program loading
+// ---------------------------------------------------------------
+// usage: bench [-r reps] [filter]
+//
+// every measurement runs a fixed number of operations once untimed, then
+// `reps` times timed (default 9), and reports the median. inputs are fixed
+// (names, sizes, elfgen seeds), so the output of two commits built and run
+// on the same machine can be compared line by line:
+//
+//   make host-bench > old.txt      (on the old commit)
+//   make host-bench > new.txt
+//   tools/benchcmp.py old.txt new.txt
+//
+// one line per measurement: "<name> <ns> ns/op <cycles> cycles/op", where
+// cycles are the host's cycle counter (TSC on x86). lines starting with
+// '#' are comments. a filter runs only the names containing it.
+// ---------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "kalloc.h"
+#include "vm.h"
+#include "fs.h"
+#include "loader.h"
+#include "string.h"
+#include "tasks.h"
+
+#define MAX_REPS 64
+
+static int reps = 9;
+static const char *filter;
+
+// -----------------------------------------------------------------------------
+// Harness
+// -----------------------------------------------------------------------------
+
+// what one run of a benchmark measured; a benchmark that has set-up work
+// per operation brackets only the part it wants timed
+typedef struct {
+    uint64_t ns, cycles, t0, c0;
+} meter_t;
+
+static inline void meter_start(meter_t *m) {
+    m->t0 = host_now_ns();
+    m->c0 = rdcycle();
+}
+
+static inline void meter_stop(meter_t *m) {
+    m->cycles += rdcycle() - m->c0;
+    m->ns += host_now_ns() - m->t0;
+}
+
+typedef void (*bench_fn)(meter_t *m, void *arg, uint64_t n);
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(const char *name, bench_fn fn, void *arg, uint64_t n) {
+    if (filter && !strstr(name, filter))
+        return;
+    uint64_t ns[MAX_REPS], cyc[MAX_REPS];
+    meter_t m = {0};
+    fn(&m, arg, n);
+    for (int r = 0; r < reps; r++) {
+        m = (meter_t){0};
+        fn(&m, arg, n);
+        ns[r] = m.ns;
+        cyc[r] = m.cycles;
+    }
+    qsort(ns, (size_t)reps, sizeof(ns[0]), cmp_u64);
+    qsort(cyc, (size_t)reps, sizeof(cyc[0]), cmp_u64);
+    printf("%-32s %12.2f ns/op %12.1f cycles/op\n", name,
+           (double)ns[reps / 2] / (double)n, (double)cyc[reps / 2] / (double)n);
+    fflush(stdout);
+}
+
+// keeps results alive without the compiler seeing through them
+static volatile uint64_t sink;
+
+// -----------------------------------------------------------------------------
+// File lookup
+// -----------------------------------------------------------------------------
+
+#define FS_MAX_FILES 4096
+
+typedef struct {
+    int count;
+    char (*names)[FS_NAME_MAX * 2];
+} names_t;
+
+static void fs_lookup(meter_t *m, void *arg, uint64_t n) {
+    names_t *nm = (names_t *)arg;
+    uint64_t size, hits = 0;
+    meter_start(m);
+    for (uint64_t i = 0; i < n; i++)
+        hits += fs_size(nm->names[i % (uint64_t)nm->count], &size) == 0;
+    meter_stop(m);
+    sink = hits;
+}
+
+static void fs_read_page(meter_t *m, void *arg, uint64_t n) {
+    static uint8_t buf[4096];
+    long got = 0;
+    meter_start(m);
+    for (uint64_t i = 0; i < n; i++)
+        got += fs_read((const char *)arg, 0, buf, sizeof(buf));
+    meter_stop(m);
+    sink = (uint64_t)got;
+}
+
+// a directory /bN with N files, and the names looked up: its own files,
+// or names that are not there
+static void make_names(names_t *nm, int files, int miss) {
+    static char names[FS_MAX_FILES][FS_NAME_MAX * 2];
+    char dir[16];
+    snprintf(dir, sizeof(dir), "/b%d", files);
+    if (!miss) {
+        fs_mkdir(dir);
+        for (int i = 0; i < files; i++) {
+            snprintf(names[i], sizeof(names[i]), "%s/file%05d", dir, i);
+            fs_write(names[i], "0123456789abcdef", 16, 0);
+        }
+    } else {
+        for (int i = 0; i < files; i++)
+            snprintf(names[i], sizeof(names[i]), "%s/none%05d", dir, i);
+    }
+    nm->count = files;
+    nm->names = names;
+}
+
+static void bench_fs(void) {
+    static const int sizes[] = { 16, 256, 4096 };
+    char name[64];
+    names_t nm;
+    for (int i = 0; i < 3; i++) {
+        make_names(&nm, sizes[i], 0);
+        snprintf(name, sizeof(name), "fs.lookup.hit/files=%d", sizes[i]);
+        run(name, fs_lookup, &nm, 200000);
+        make_names(&nm, sizes[i], 1);
+        snprintf(name, sizeof(name), "fs.lookup.miss/files=%d", sizes[i]);
+        run(name, fs_lookup, &nm, 200000);
+    }
+
+    // misses in "/" fall through to the image's perfect hash
+    static char root_miss[1][FS_NAME_MAX * 2] = { "/no-such-file" };
+    nm = (names_t){ 1, root_miss };
+    run("fs.lookup.miss/image", fs_lookup, &nm, 200000);
+
+    static char deep[1][FS_NAME_MAX * 2] = { "/d1/d2/d3/d4/file" };
+    fs_mkdir("/d1");
+    fs_mkdir("/d1/d2");
+    fs_mkdir("/d1/d2/d3");
+    fs_mkdir("/d1/d2/d3/d4");
+    fs_write(deep[0], "x", 1, 0);
+    nm = (names_t){ 1, deep };
+    run("fs.lookup.hit/depth=5", fs_lookup, &nm, 200000);
+
+    static uint8_t page[4096];
+    fs_write("/page.bin", page, sizeof(page), 0);
+    run("fs.read/4096", fs_read_page, "/page.bin", 100000);
+}
+
+// -----------------------------------------------------------------------------
+// libk
+// -----------------------------------------------------------------------------
+
+#define STR_MAX 65536
+static uint8_t src_buf[STR_MAX + 64] __attribute__((aligned(64)));
+static uint8_t dst_buf[STR_MAX + 64] __attribute__((aligned(64)));
+static char str_a[4096 + 8] __attribute__((aligned(64)));
+static char str_b[4096 + 8] __attribute__((aligned(64)));
+
+typedef struct {
+    size_t size;
+    size_t skew;                // source misalignment
+} str_arg_t;
+
+static void b_memcpy(meter_t *m, void *arg, uint64_t n) {
+    str_arg_t *a = (str_arg_t *)arg;
+    meter_start(m);
+    for (uint64_t i = 0; i < n; i++)
+        memcpy(dst_buf, src_buf + a->skew, a->size);
+    meter_stop(m);
+}
+
+static void b_memset(meter_t *m, void *arg, uint64_t n) {
+    str_arg_t *a = (str_arg_t *)arg;
+    meter_start(m);
+    for (uint64_t i = 0; i < n; i++)
+        memset(dst_buf + a->skew, (int)i, a->size);
+    meter_stop(m);
+}
+
+static void b_memcmp(meter_t *m, void *arg, uint64_t n) {
+    str_arg_t *a = (str_arg_t *)arg;
+    int r = 0;
+    memcpy(dst_buf, src_buf, a->size);
+    meter_start(m);
+    for (uint64_t i = 0; i < n; i++)
+        r += memcmp(dst_buf, src_buf, a->size);
+    meter_stop(m);
+    sink = (uint64_t)r;
+}
+
+// strings of a->size characters, equal in strcmp
+static void str_setup(size_t size) {
+    for (size_t i = 0; i < size; i++)
+        str_a[i] = str_b[i] = (char)('a' + i % 26);
+    str_a[size] = str_b[size] = '\0';
+}
+
+static void b_strlen(meter_t *m, void *arg, uint64_t n) {
+    str_arg_t *a = (str_arg_t *)arg;
+    uint64_t total = 0;
+    str_setup(a->size);
+    meter_start(m);
+    for (uint64_t i = 0; i < n; i++)
+        total += (uint64_t)strlen(str_a);
+    meter_stop(m);
+    sink = total;
+}
+
+static void b_strcmp(meter_t *m, void *arg, uint64_t n) {
+    str_arg_t *a = (str_arg_t *)arg;
+    int r = 0;
+    str_setup(a->size);
+    meter_start(m);
+    for (uint64_t i = 0; i < n; i++)
+        r += strcmp(str_a, str_b);
+    meter_stop(m);
+    sink = (uint64_t)r;
+}
+
+// about the same amount of work per measurement whatever the size
+static uint64_t str_iters(size_t size) {
+    return 20000000 / (size + 32);
+}
+
+static void bench_string(void) {
+    static const size_t mem_sizes[] = { 16, 256, 4096, STR_MAX };
+    static const size_t str_sizes[] = { 8, 64, 1024, 4096 };
+    char name[64];
+    for (int i = 0; i < 4; i++) {
+        size_t sz = mem_sizes[i];
+        str_arg_t aligned = { sz, 0 }, skewed = { sz, 3 };
+        snprintf(name, sizeof(name), "libk.memcpy/%zu", sz);
+        run(name, b_memcpy, &aligned, str_iters(sz));
+        snprintf(name, sizeof(name), "libk.memcpy/%zu+3", sz);
+        run(name, b_memcpy, &skewed, str_iters(sz));
+        snprintf(name, sizeof(name), "libk.memset/%zu", sz);
+        run(name, b_memset, &aligned, str_iters(sz));
+        snprintf(name, sizeof(name), "libk.memcmp/%zu", sz);
+        run(name, b_memcmp, &aligned, str_iters(sz));
+    }
+    for (int i = 0; i < 4; i++) {
+        str_arg_t a = { str_sizes[i], 0 };
+        snprintf(name, sizeof(name), "libk.strlen/%zu", a.size);
+        run(name, b_strlen, &a, str_iters(a.size));
+        snprintf(name, sizeof(name), "libk.strcmp/%zu", a.size);
+        run(name, b_strcmp, &a, str_iters(a.size));
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Program loading
+// -----------------------------------------------------------------------------
+
+// what tasks_release() and sched.c would give back once the program is gone
+static void unload(pcb_t *pcb) {
+    vm_free(pcb->pagetable);
+    loader_image_put(pcb->image);
+    kfree_pages((void *)(pcb->sp - KSTACK_SIZE), KSTACK_ORDER);
+}
+
+typedef struct {
+    const char *path;
+    int cold;                   // empty the image cache before every load
+} load_arg_t;
+
+static void b_load(meter_t *m, void *arg, uint64_t n) {
+    load_arg_t *a = (load_arg_t *)arg;
+    for (uint64_t i = 0; i < n; i++) {
+        pcb_t pcb = {0};
+        if (a->cold)
+            loader_cache_flush();
+        meter_start(m);
+        int r = load_program_from_fs(a->path, &pcb);
+        meter_stop(m);
+        if (r != 0) {
+            fprintf(stderr, "bench: cannot load %s\n", a->path);
+            exit(1);
+        }
+        unload(&pcb);
+    }
+}
+
+// the programs mkelf put into host/fs.img (Makefile), from small to large
+static void bench_loader(void) {
+    static const char *progs[] = { "small.elf", "static.elf", "medium.elf", "large.elf" };
+    static const uint64_t iters[] = { 2000, 1000, 200, 40 };
+    char name[64], copy[FS_NAME_MAX];
+    for (int i = 0; i < 4; i++) {
+        // the image's raw text executes in place; a copy written at run
+        // time lives in allocator pages and has to be copied
+        load_arg_t img_cold = { progs[i], 1 }, img_warm = { progs[i], 0 };
+        snprintf(copy, sizeof(copy), "/ram-%s", progs[i]);
+        if (fs_copy(progs[i], copy) != 0) {
+            fprintf(stderr, "bench: %s is not in host/fs.img\n", progs[i]);
+            exit(1);
+        }
+        load_arg_t ram_cold = { copy, 1 };
+        snprintf(name, sizeof(name), "loader.cold/%s", progs[i]);
+        run(name, b_load, &img_cold, iters[i]);
+        snprintf(name, sizeof(name), "loader.cold.ram/%s", progs[i]);
+        run(name, b_load, &ram_cold, iters[i]);
+        snprintf(name, sizeof(name), "loader.warm/%s", progs[i]);
+        run(name, b_load, &img_warm, iters[i]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Main
+// -----------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    int i = 1;
+    if (i + 1 < argc && !strcmp(argv[i], "-r")) {
+        reps = atoi(argv[i + 1]);
+        if (reps < 1) reps = 1;
+        if (reps > MAX_REPS) reps = MAX_REPS;
+        i += 2;
+    }
+    if (i < argc)
+        filter = argv[i];
+
+    host_init();
+    printf("# host bench: median of %d runs, compiler %s\n", reps, __VERSION__);
+    bench_fs();
+    bench_string();
+    bench_loader();
+    uint64_t free_pages = kalloc_free_pages();
+    printf("# free pages at exit: %lu\n", (unsigned long)free_pages);
+    return 0;
+}
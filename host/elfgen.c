@@ -0,0 +1,139 @@
+// elfgen.c — synthetic RISC-V programs for the host build (elfgen.h)
+// file layout:
+//   0       ELF header and program headers
+//   0x1000  text, then the RELA table (pie with relocations)
+//   next    data: the dynamic section first (pie with relocations), then
+//           one 8-byte relocation target per relocation, then filler
+// every segment's file offset equals its offset from the link base.
+
+#include <string.h>
+#include <elf.h>
+
+#include "elfgen.h"
+
+#ifndef EM_RISCV
+#define EM_RISCV 243
+#endif
+#define R_RISCV_RELATIVE 3
+
+#define PAGE      4096UL
+#define LINK_BASE 0x400000UL    // USER_BASE, for ET_EXEC
+#define TEXT_OFF  PAGE
+#define NDYN      4             // DT_RELA, DT_RELASZ, DT_RELAENT, DT_NULL
+
+static uint64_t round_up(uint64_t v, uint64_t a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+typedef struct {
+    int nph;
+    uint64_t text_filesz;       // text + RELA table
+    uint64_t rela_off;
+    uint64_t data_off;
+    uint64_t dyn_size;
+    uint64_t data_filesz;
+} layout_t;
+
+static int has_relocs(const elfgen_t *g) {
+    return g->pie && g->relocs;
+}
+
+static void lay_out(const elfgen_t *g, layout_t *l) {
+    l->nph = has_relocs(g) ? 3 : 2;
+    l->rela_off = TEXT_OFF + round_up(g->text, 8);
+    l->text_filesz = l->rela_off - TEXT_OFF +
+                     (has_relocs(g) ? (uint64_t)g->relocs * sizeof(Elf64_Rela) : 0);
+    l->data_off = round_up(TEXT_OFF + l->text_filesz, PAGE);
+    l->dyn_size = has_relocs(g) ? NDYN * sizeof(Elf64_Dyn) : 0;
+    uint64_t need = l->dyn_size + (has_relocs(g) ? 8UL * g->relocs : 0);
+    l->data_filesz = round_up(g->data > need ? g->data : need, 8);
+}
+
+size_t elfgen_size(const elfgen_t *g) {
+    layout_t l;
+    lay_out(g, &l);
+    return (size_t)(l.data_off + l.data_filesz);
+}
+
+// xorshift32: the same seed gives the same bytes on every host
+static void fill(uint8_t *p, uint64_t n, uint32_t *state) {
+    uint32_t x = *state ? *state : 1;
+    for (uint64_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        p[i] = (uint8_t)x;
+    }
+    *state = x;
+}
+
+size_t elfgen(uint8_t *buf, const elfgen_t *g) {
+    layout_t l;
+    lay_out(g, &l);
+    size_t size = (size_t)(l.data_off + l.data_filesz);
+    uint64_t base = g->pie ? 0 : LINK_BASE;
+    uint32_t rng = g->seed;
+    memset(buf, 0, size);
+
+    Elf64_Ehdr *eh = (Elf64_Ehdr *)buf;
+    memcpy(eh->e_ident, ELFMAG, SELFMAG);
+    eh->e_ident[EI_CLASS] = ELFCLASS64;
+    eh->e_ident[EI_DATA] = ELFDATA2LSB;
+    eh->e_ident[EI_VERSION] = EV_CURRENT;
+    eh->e_type = g->pie ? ET_DYN : ET_EXEC;
+    eh->e_machine = EM_RISCV;
+    eh->e_version = EV_CURRENT;
+    eh->e_entry = base + TEXT_OFF;
+    eh->e_phoff = sizeof(Elf64_Ehdr);
+    eh->e_ehsize = sizeof(Elf64_Ehdr);
+    eh->e_phentsize = sizeof(Elf64_Phdr);
+    eh->e_phnum = (uint16_t)l.nph;
+
+    Elf64_Phdr *ph = (Elf64_Phdr *)(buf + sizeof(Elf64_Ehdr));
+    ph[0].p_type = PT_LOAD;
+    ph[0].p_flags = PF_R | PF_X;
+    ph[0].p_offset = TEXT_OFF;
+    ph[0].p_vaddr = ph[0].p_paddr = base + TEXT_OFF;
+    ph[0].p_filesz = ph[0].p_memsz = l.text_filesz;
+    ph[0].p_align = PAGE;
+
+    ph[1].p_type = PT_LOAD;
+    ph[1].p_flags = PF_R | PF_W;
+    ph[1].p_offset = l.data_off;
+    ph[1].p_vaddr = ph[1].p_paddr = base + l.data_off;
+    ph[1].p_filesz = l.data_filesz;
+    ph[1].p_memsz = l.data_filesz + g->bss;
+    ph[1].p_align = PAGE;
+
+    fill(buf + TEXT_OFF, g->text, &rng);
+    fill(buf + l.data_off + l.dyn_size, l.data_filesz - l.dyn_size, &rng);
+    if (!has_relocs(g))
+        return size;
+
+    ph[2].p_type = PT_DYNAMIC;
+    ph[2].p_flags = PF_R | PF_W;
+    ph[2].p_offset = l.data_off;
+    ph[2].p_vaddr = ph[2].p_paddr = base + l.data_off;
+    ph[2].p_filesz = ph[2].p_memsz = l.dyn_size;
+    ph[2].p_align = 8;
+
+    Elf64_Dyn *dyn = (Elf64_Dyn *)(buf + l.data_off);
+    dyn[0].d_tag = DT_RELA;
+    dyn[0].d_un.d_ptr = base + l.rela_off;
+    dyn[1].d_tag = DT_RELASZ;
+    dyn[1].d_un.d_val = (uint64_t)g->relocs * sizeof(Elf64_Rela);
+    dyn[2].d_tag = DT_RELAENT;
+    dyn[2].d_un.d_val = sizeof(Elf64_Rela);
+    dyn[3].d_tag = DT_NULL;
+
+    // each relocation points a data word back into the text
+    Elf64_Rela *r = (Elf64_Rela *)(buf + l.rela_off);
+    uint64_t target = l.data_off + l.dyn_size;
+    for (uint32_t i = 0; i < g->relocs; i++) {
+        r[i].r_offset = base + target + 8UL * i;
+        r[i].r_info = ELF64_R_INFO(0, R_RISCV_RELATIVE);
+        r[i].r_addend = (int64_t)(TEXT_OFF + (g->text ? (64UL * i) % g->text : 0));
+        memset(buf + target + 8UL * i, 0, 8);
+    }
+    return size;
+}
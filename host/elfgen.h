@@ -0,0 +1,31 @@
+// elfgen.h — synthetic RISC-V programs for the host build
+// builds an ELF file shaped like what user_linker.ld produces: a read/exec
+// text segment and a read/write data segment with BSS, both page-aligned in
+// the file, and for a PIE a PT_DYNAMIC with R_RISCV_RELATIVE relocations
+// into the data. the bytes are pseudo-random from `seed`, so the same spec
+// always gives the same file and LZ4 does not shrink it: fspack stores it
+// raw and the loader maps its text in place, like a real program.
+// nothing in it is meant to run.
+
+#ifndef HOST_ELFGEN_H
+#define HOST_ELFGEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    int pie;                // ET_DYN linked at 0, else ET_EXEC at USER_BASE
+    uint64_t text;          // bytes
+    uint64_t data;
+    uint64_t bss;
+    uint32_t relocs;        // RELATIVE relocations (pie only)
+    uint32_t seed;
+} elfgen_t;
+
+//   size of the file elfgen() writes for g.
+size_t elfgen_size(const elfgen_t *g);
+
+//   writes the file into buf (elfgen_size(g) bytes) and returns its size.
+size_t elfgen(uint8_t *buf, const elfgen_t *g);
+
+#endif
@@ -0,0 +1,238 @@
+// fuzz_loader.c — fuzz target for load_program_from_fs()
+// ---------------------------------------------------------------
+// each input is written to the file system as one file and loaded like
+// `run` would load it. besides the sanitizers' own checks (the Makefile
+// builds this with ASan and UBSan), every input must leave the page
+// allocator where it found it: a load that fails has to give back
+// everything, and one that succeeds has to be undone completely by the
+// same teardown tasks_release() does.
+//
+// two ways to drive it:
+//   libFuzzer   make fuzz (clang): LLVMFuzzerTestOneInput below
+//   standalone  make host-fuzz (any cc, -DFUZZ_STANDALONE):
+//                 fuzz_loader <file>...            run each file once
+//                                                  (AFL: fuzz_loader @@)
+//                 fuzz_loader -n N [-s S] <seed>... N mutations of the seeds
+//               the mutations only depend on S and the seeds, so a failing
+//               iteration reproduces exactly; -w writes each input to
+//               host/crash.elf before running it.
+// ---------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "kalloc.h"
+#include "vm.h"
+#include "fs.h"
+#include "loader.h"
+#include "string.h"
+#include "tasks.h"
+
+#define FUZZ_PATH  "/fuzz.elf"
+#define FUZZ_MAX   (4UL << 20)
+// pages the slab caches may keep as spares between inputs
+#define LEAK_SLACK 16
+
+static int ready;
+static uint64_t baseline;
+
+static void check_leaks(void) {
+    uint64_t now = kalloc_free_pages();
+    if (!baseline) {
+        baseline = now;
+        return;
+    }
+    if (now + LEAK_SLACK < baseline) {
+        fprintf(stderr, "fuzz_loader: %lu pages leaked\n",
+                (unsigned long)(baseline - now));
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (!ready) {
+        host_init();
+        ready = 1;
+    }
+    if (size > FUZZ_MAX)
+        return 0;
+    if (fs_write(FUZZ_PATH, data, size, 0) != 0)
+        return 0;
+
+    pcb_t pcb = {0};
+    if (load_program_from_fs(FUZZ_PATH, &pcb) == 0) {
+        vm_free(pcb.pagetable);
+        loader_image_put(pcb.image);
+        kfree_pages((void *)(pcb.sp - KSTACK_SIZE), KSTACK_ORDER);
+    }
+    loader_cache_flush();
+    fs_remove(FUZZ_PATH);
+    check_leaks();
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+// -----------------------------------------------------------------------------
+// Standalone driver
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} blob_t;
+
+static int read_file(const char *path, blob_t *b) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    b->data = malloc(n > 0 ? (size_t)n : 1);
+    b->size = n > 0 ? (size_t)n : 0;
+    if (!b->data || fread(b->data, 1, b->size, f) != b->size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static uint64_t rng;
+
+static uint64_t next(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+// values that sit on the loader's bounds checks
+static const uint64_t interesting[] = {
+    0, 1, 7, 8, 0x38, 0x40, 0xfff, 0x1000, 0x1001, 0x400000,
+    0x7fffffff, 0x80000000, 0xffffffff, 1UL << 38, (1UL << 63),
+    ~0UL - 0xfff, ~0UL - 7, ~0UL,
+};
+#define NINTERESTING (sizeof(interesting) / sizeof(interesting[0]))
+
+// most of what the loader decides on is in the first few hundred bytes
+// (headers, program headers) and in the dynamic section and relocations,
+// so aim there more often than at the rest of the file
+static size_t pick_offset(size_t size) {
+    if (size == 0)
+        return 0;
+    if (next() & 1)
+        return (size_t)(next() % (size < 512 ? size : 512));
+    return (size_t)(next() % size);
+}
+
+static void mutate(uint8_t *buf, size_t *size) {
+    int rounds = 1 + (int)(next() % 8);
+    for (int r = 0; r < rounds && *size; r++) {
+        size_t off = pick_offset(*size);
+        switch (next() % 5) {
+        case 0:
+            buf[off] ^= (uint8_t)(1u << (next() % 8));
+            break;
+        case 1:
+            buf[off] = (uint8_t)next();
+            break;
+        case 2: {
+            // a whole field, in the width the headers use
+            static const size_t widths[] = { 2, 4, 8 };
+            size_t w = widths[next() % 3];
+            off &= ~(w - 1);
+            if (off + w <= *size) {
+                uint64_t v = interesting[next() % NINTERESTING];
+                if (next() & 1)
+                    v += (next() % 16) - 8;
+                memcpy(buf + off, &v, w);
+            }
+            break;
+        }
+        case 3:
+            *size = off;
+            break;
+        default: {
+            // copy a chunk of the file over another place in it
+            size_t src = pick_offset(*size), len = 1 + next() % 64;
+            if (src + len <= *size && off + len <= *size)
+                memmove(buf + off, buf + src, len);
+            break;
+        }
+        }
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-w] [-n iters] [-s seed] <file>...\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    uint64_t iters = 0, seed = 1;
+    int save = 0, i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            iters = strtoull(argv[++i], 0, 0);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = strtoull(argv[++i], 0, 0);
+        else if (!strcmp(argv[i], "-w"))
+            save = 1;
+        else
+            usage(argv[0]);
+    }
+    int nseeds = argc - i;
+    if (nseeds < 1)
+        usage(argv[0]);
+
+    blob_t *seeds = calloc((size_t)nseeds, sizeof(blob_t));
+    size_t largest = 0;
+    for (int s = 0; s < nseeds; s++) {
+        if (read_file(argv[i + s], &seeds[s]) != 0)
+            return 1;
+        if (seeds[s].size > largest)
+            largest = seeds[s].size;
+    }
+
+    // every file once unchanged, which also sets the leak baseline
+    for (int s = 0; s < nseeds; s++)
+        LLVMFuzzerTestOneInput(seeds[s].data, seeds[s].size);
+
+    uint8_t *buf = malloc(largest ? largest : 1);
+    rng = seed ? seed : 1;
+    for (uint64_t it = 0; it < iters; it++) {
+        blob_t *b = &seeds[next() % (uint64_t)nseeds];
+        size_t size = b->size;
+        memcpy(buf, b->data, size);
+        mutate(buf, &size);
+        if (save) {
+            FILE *f = fopen("host/crash.elf", "wb");
+            if (f) {
+                fwrite(buf, 1, size, f);
+                fclose(f);
+            }
+        }
+        LLVMFuzzerTestOneInput(buf, size);
+    }
+    if (iters)
+        printf("fuzz_loader: %lu mutations of %d seeds ok (seed %lu)\n",
+               (unsigned long)iters, nseeds, (unsigned long)seed);
+    else
+        printf("fuzz_loader: %d inputs ok\n", nseeds);
+
+    free(buf);
+    for (int s = 0; s < nseeds; s++)
+        free(seeds[s].data);
+    free(seeds);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,25 @@
+// host.h — the host build of fs, loader and libk
+// `make host` compiles fs.c, loader.c, string.c and what they stand on
+// (vm.c, kalloc.c, slab.c, lz4.c) natively with -DHOST_BUILD, next to
+// stubs for the rest of the kernel (stubs.c). "RAM" is an anonymous
+// mapping handed to kalloc_init(), and the kernel keeps treating pointers
+// as physical addresses, exactly as it does on the board.
+
+#ifndef HOST_HOST_H
+#define HOST_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//   maps the RAM, then runs kalloc_init, kmem_init, vm_init, string_init and
+//   fs_init like kernel_main() does. exits if the mapping fails.
+void host_init(void);
+
+//   kernel messages (kprintf) go to stderr only when set; the loader logs
+//   every launch, which would swamp a benchmark or a fuzzer.
+extern int host_verbose;
+
+//   monotonic host time in nanoseconds.
+uint64_t host_now_ns(void);
+
+#endif
@@ -0,0 +1,56 @@
+// mkelf.c — writes one synthetic program (elfgen.h) to a file
+// usage: mkelf [-pie] [-relocs n] [-seed n] <text> <data> <bss> <out.elf>
+// sizes in bytes, with an optional k or m suffix. the Makefile uses it for
+// the programs in host/fs.img and for the fuzzer's seed corpus.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elfgen.h"
+
+static uint64_t parse_size(const char *s) {
+    char *end;
+    uint64_t v = strtoull(s, &end, 0);
+    if (*end == 'k' || *end == 'K')
+        v <<= 10;
+    else if (*end == 'm' || *end == 'M')
+        v <<= 20;
+    return v;
+}
+
+int main(int argc, char **argv) {
+    elfgen_t g = { 0, 0, 0, 0, 0, 1 };
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-pie"))
+            g.pie = 1;
+        else if (!strcmp(argv[i], "-relocs") && i + 1 < argc)
+            g.relocs = (uint32_t)strtoul(argv[++i], 0, 0);
+        else if (!strcmp(argv[i], "-seed") && i + 1 < argc)
+            g.seed = (uint32_t)strtoul(argv[++i], 0, 0);
+        else
+            break;
+    }
+    if (argc - i != 4) {
+        fprintf(stderr, "usage: %s [-pie] [-relocs n] [-seed n] <text> <data> <bss> <out.elf>\n",
+                argv[0]);
+        return 2;
+    }
+    g.text = parse_size(argv[i]);
+    g.data = parse_size(argv[i + 1]);
+    g.bss = parse_size(argv[i + 2]);
+
+    size_t n = elfgen_size(&g);
+    uint8_t *buf = malloc(n);
+    if (!buf)
+        return 1;
+    elfgen(buf, &g);
+    FILE *f = fopen(argv[i + 3], "wb");
+    if (!f || fwrite(buf, 1, n, f) != n || fclose(f) != 0) {
+        perror(argv[i + 3]);
+        return 1;
+    }
+    free(buf);
+    return 0;
+}
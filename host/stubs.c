@@ -0,0 +1,192 @@
+// stubs.c — the rest of the kernel, as far as the host build needs it
+// ---------------------------------------------------------------
+// console output goes to stdout, kernel messages to stderr (host_verbose).
+// there is one thread and nothing ever waits: fs.c and the loader only
+// sleep when another hart holds what they need, so sched_sleep() here is a
+// bug. string_init() finds no Zbb and no vector unit, so libk runs its
+// portable word-at-a-time routines, the ones every rv64 hart can use.
+// ---------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "host.h"
+#include "riscv.h"
+#include "memlayout.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "vm.h"
+#include "fs.h"
+#include "string.h"
+#include "kprintf.h"
+#include "uart.h"
+#include "trap.h"
+#include "sched.h"
+#include "tasks.h"
+
+uint64_t host_ram_base;
+int host_verbose;
+
+// -----------------------------------------------------------------------------
+// Clock
+// -----------------------------------------------------------------------------
+
+uint64_t host_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+// rdcycle() in the host build (riscv.h)
+uint64_t host_cycles(void) {
+#if defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return host_now_ns();
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// Setup
+// -----------------------------------------------------------------------------
+
+// RAM goes at the same address in every run when the host lets it, so
+// where pages land in the caches does not change from one run to the
+// next, and it is populated up front so no benchmark pays for page faults
+#define HOST_RAM_HINT 0x200040000000UL
+
+// the block is aligned to its own size so the direct map in vm.c sits in
+// one level-2 slot, and that slot must not be the one user programs use
+void host_init(void) {
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+    uint8_t *p = mmap((void *)HOST_RAM_HINT, RAM_SIZE, prot,
+                      flags | MAP_FIXED_NOREPLACE, -1, 0);
+    if (p != MAP_FAILED && (uint64_t)p == HOST_RAM_HINT) {
+        host_ram_base = (uint64_t)p;
+    } else {
+        // kernels before 4.17 take the address as a mere hint
+        if (p != MAP_FAILED)
+            munmap(p, RAM_SIZE);
+        p = mmap(0, 2 * RAM_SIZE, prot, flags, -1, 0);
+        if (p == MAP_FAILED) {
+            perror("host: mmap");
+            exit(1);
+        }
+        host_ram_base = ((uint64_t)p + RAM_SIZE - 1) & ~(RAM_SIZE - 1);
+    }
+    if (((host_ram_base >> 30) & 0x1ff) == 0) {
+        fprintf(stderr, "host: RAM mapped at %#lx, in the user programs' level-2 slot\n",
+                (unsigned long)host_ram_base);
+        exit(1);
+    }
+    kalloc_init();
+    kmem_init();
+    vm_init();
+    string_init();
+    fs_init();
+}
+
+// -----------------------------------------------------------------------------
+// Console and kernel log
+// -----------------------------------------------------------------------------
+
+void uart_putc(char c) {
+    putchar(c);
+}
+
+void uart_puts(const char *s) {
+    fputs(s, stdout);
+}
+
+void uart_write(const char *buf, size_t n) {
+    fwrite(buf, 1, n, stdout);
+}
+
+void uart_put_dec(int v) {
+    printf("%d", v);
+}
+
+void uart_put_hex(uint64_t v) {
+    printf("0x%lx", (unsigned long)v);
+}
+
+void uart_put_u64(uint64_t v) {
+    printf("%lu", (unsigned long)v);
+}
+
+void out_write(const void *buf, size_t n) {
+    fwrite(buf, 1, n, stdout);
+}
+
+int kprintf(const char *fmt, ...) {
+    if (fmt[0] == KERN_SOH[0] && fmt[1])
+        fmt += 2;
+    if (!host_verbose)
+        return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Scheduler, tasks and traps
+// -----------------------------------------------------------------------------
+
+void sched_sleep(void *chan, spinlock_t *lk) {
+    (void)chan;
+    (void)lk;
+    fprintf(stderr, "host: sched_sleep() with a single thread\n");
+    abort();
+}
+
+void sched_wakeup(void *chan) {
+    (void)chan;
+}
+
+int tasks_alloc_stack(pcb_t *pcb) {
+    uint8_t *stack = (uint8_t *)kalloc_pages(KSTACK_ORDER);
+    if (!stack)
+        return -1;
+    pcb->sp = (uint64_t)(stack + KSTACK_SIZE);
+    return 0;
+}
+
+// the exit stub page every program gets mapped (uexit.S); never executed
+char uexit_start[4096] __attribute__((aligned(4096)));
+
+// string_init() probes for Zbb: report that it trapped
+void trap_probe_begin(void) {
+}
+
+int trap_probe_end(void) {
+    return 1;
+}
+
+// not selected without a vector unit
+void rvv_memcpy(void *dst, const void *src, size_t n) {
+    (void)dst; (void)src; (void)n;
+    abort();
+}
+
+void rvv_memset(void *dst, int c, size_t n) {
+    (void)dst; (void)c; (void)n;
+    abort();
+}
@@ -0,0 +1,222 @@
+// kalloc.c — physical page allocator for the RISC-V OS
+// ---------------------------------------------------------------
+// a binary buddy allocator over all RAM above the kernel image and its boot
+// stack. a block of order k is 2^k contiguous pages, aligned (relative to
+// RAM_BASE) to its own size, so its buddy is found by flipping bit k of the
+// page index. there is one free list per order; freeing a block merges it
+// with its buddy for as long as the buddy is free too.
+//
+// per-page state is one byte: for the first page of a free block it holds
+// KALLOC_FREE | order, for every other page it is 0. the free lists are
+// doubly linked through the free blocks themselves, so taking a buddy off
+// its list is O(1).
+//
+// every hart allocates stacks and page tables from here, so the lists sit
+// behind a ticket lock: under contention harts get in in arrival order.
+// ---------------------------------------------------------------
+
+#include "kalloc.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "string.h"
+#include "uart.h"
+#include "kprintf.h"
+
+#define RAM_PAGES   (RAM_SIZE / PGSIZE)
+#define KALLOC_FREE 0x80
+
+#ifndef HOST_BUILD
+extern char stack_top[];   // linker.ld: end of the boot stack
+#else
+#define stack_top ((char *)RAM_BASE)    // all of the host's "RAM" is pool
+#endif
+
+struct run {
+    struct run *next;
+    struct run *prev;
+};
+
+static struct run *free_lists[KALLOC_MAX_ORDER + 1];
+static uint8_t page_state[RAM_PAGES];
+static uint64_t free_count[KALLOC_MAX_ORDER + 1];
+static uint64_t free_pages;
+static uint64_t pool_base, pool_pages;
+static uint64_t alloc_calls, alloc_failures;
+static ticketlock_t kalloc_lock;
+
+static inline uint64_t page_index(uint64_t pa) {
+    return (pa - RAM_BASE) / PGSIZE;
+}
+
+static inline uint64_t page_addr(uint64_t idx) {
+    return RAM_BASE + idx * PGSIZE;
+}
+
+static void list_push(int order, uint64_t idx) {
+    struct run *r = (struct run *)page_addr(idx);
+    r->prev = 0;
+    r->next = free_lists[order];
+    if (r->next)
+        r->next->prev = r;
+    free_lists[order] = r;
+    page_state[idx] = KALLOC_FREE | (uint8_t)order;
+    free_count[order]++;
+}
+
+static void list_remove(int order, uint64_t idx) {
+    struct run *r = (struct run *)page_addr(idx);
+    if (r->prev)
+        r->prev->next = r->next;
+    else
+        free_lists[order] = r->next;
+    if (r->next)
+        r->next->prev = r->prev;
+    page_state[idx] = 0;
+    free_count[order]--;
+}
+
+// give back a block and coalesce it upwards. kalloc_lock must be held.
+static void free_block(uint64_t idx, int order) {
+    free_pages += 1UL << order;
+    while (order < KALLOC_MAX_ORDER) {
+        uint64_t buddy = idx ^ (1UL << order);
+        if (buddy >= RAM_PAGES ||
+            page_state[buddy] != (KALLOC_FREE | (uint8_t)order))
+            break;
+        list_remove(order, buddy);
+        idx &= ~(1UL << order);
+        order++;
+    }
+    list_push(order, idx);
+}
+
+void kalloc_init(void) {
+    pool_base = PGROUNDUP((uint64_t)stack_top);
+    pool_pages = (RAM_END - pool_base) / PGSIZE;
+
+    // hand the pool over in the largest naturally aligned blocks that fit
+    uint64_t idx = page_index(pool_base);
+    uint64_t end = RAM_PAGES;
+    while (idx < end) {
+        int order = KALLOC_MAX_ORDER;
+        while (order > 0 &&
+               ((idx & ((1UL << order) - 1)) || idx + (1UL << order) > end))
+            order--;
+        free_block(idx, order);
+        idx += 1UL << order;
+    }
+
+    kprintf("[MEM] buddy allocator: %lu pages free from %p\n",
+            (unsigned long)free_pages, (void *)pool_base);
+}
+
+void *kalloc_pages(int order) {
+    if (order < 0 || order > KALLOC_MAX_ORDER)
+        return 0;
+
+    uint64_t s = ticket_lock_irqsave(&kalloc_lock);
+    alloc_calls++;
+    int o = order;
+    while (o <= KALLOC_MAX_ORDER && !free_lists[o])
+        o++;
+    if (o > KALLOC_MAX_ORDER) {
+        alloc_failures++;
+        ticket_unlock_irqrestore(&kalloc_lock, s);
+        return 0;
+    }
+
+    uint64_t idx = page_index((uint64_t)free_lists[o]);
+    list_remove(o, idx);
+    // split down, returning the upper halves to their free lists
+    while (o > order) {
+        o--;
+        list_push(o, idx + (1UL << o));
+    }
+    free_pages -= 1UL << order;
+    ticket_unlock_irqrestore(&kalloc_lock, s);
+
+    void *p = (void *)page_addr(idx);
+    memset(p, 0, PGSIZE << order);
+    return p;
+}
+
+void kfree_pages(void *pa, int order) {
+    uint64_t a = (uint64_t)pa;
+    if (a < pool_base || a >= RAM_END || (a & (PGSIZE - 1)) ||
+        order < 0 || order > KALLOC_MAX_ORDER) {
+        kprintf(KERN_ERR "[MEM] bad kfree_pages %p\n", (void *)a);
+        return;
+    }
+    uint64_t s = ticket_lock_irqsave(&kalloc_lock);
+    free_block(page_index(a), order);
+    ticket_unlock_irqrestore(&kalloc_lock, s);
+}
+
+void *kalloc_page(void) {
+    return kalloc_pages(0);
+}
+
+void kfree_page(void *pa) {
+    kfree_pages(pa, 0);
+}
+
+int kalloc_order_for(uint64_t bytes) {
+    int order = 0;
+    while ((PGSIZE << order) < bytes)
+        order++;
+    return order;
+}
+
+uint64_t kalloc_free_pages(void) {
+    return free_pages;
+}
+
+int kalloc_in_pool(uint64_t pa) {
+    return pa >= pool_base && pa < RAM_END;
+}
+
+// free blocks per order, plus a fragmentation figure: how much of the free
+// memory is unusable for a request the size of the largest possible block,
+// i.e. 100 - 100 * (pages in the largest free block) / (free pages).
+void kalloc_stats(void) {
+    uint64_t s = ticket_lock_irqsave(&kalloc_lock);
+    uint64_t counts[KALLOC_MAX_ORDER + 1];
+    for (int o = 0; o <= KALLOC_MAX_ORDER; o++)
+        counts[o] = free_count[o];
+    uint64_t total = free_pages, calls = alloc_calls, fails = alloc_failures;
+    ticket_unlock_irqrestore(&kalloc_lock, s);
+
+    int largest = -1;
+    uart_puts("order  block     free\n");
+    for (int o = 0; o <= KALLOC_MAX_ORDER; o++) {
+        if (counts[o]) largest = o;
+        uart_puts("  ");
+        if (o < 10) uart_putc(' ');
+        uart_put_dec(o);
+        uart_puts("  ");
+        uart_put_dec((int)((PGSIZE << o) / 1024));
+        uart_puts(" KiB\t");
+        uart_put_dec((int)counts[o]);
+        uart_puts("\n");
+    }
+    uart_puts("free: ");
+    uart_put_dec((int)total);
+    uart_puts(" of ");
+    uart_put_dec((int)pool_pages);
+    uart_puts(" pages (");
+    uart_put_dec((int)(total * PGSIZE / 1024));
+    uart_puts(" KiB)\n");
+    if (largest >= 0) {
+        uart_puts("largest free block: order ");
+        uart_put_dec(largest);
+        uart_puts(", fragmentation ");
+        uart_put_dec((int)(100 - (100UL << largest) / total));
+        uart_puts("%\n");
+    }
+    uart_puts("allocations: ");
+    uart_put_dec((int)calls);
+    uart_puts(", failed: ");
+    uart_put_dec((int)fails);
+    uart_puts("\n");
+}
@@ -0,0 +1,44 @@
+// kalloc.h — physical page allocator
+// a buddy allocator owning all RAM after the kernel image. hands out
+// naturally aligned blocks of 2^order 4 KiB frames for kernel stacks, page
+// tables and user program memory.
+
+#ifndef KALLOC_H
+#define KALLOC_H
+
+#include <stdint.h>
+
+#define PGSIZE 4096UL
+#define PGROUNDUP(a)   (((a) + PGSIZE - 1) & ~(PGSIZE - 1))
+#define PGROUNDDOWN(a) ((a) & ~(PGSIZE - 1))
+
+// largest block: 2^14 pages = 64 MiB
+#define KALLOC_MAX_ORDER 14
+
+//   puts all RAM from the end of the boot stack up to RAM_END on the free
+//   lists.
+//   called by: - kernel_main() in main.c
+void kalloc_init(void);
+
+//   returns 2^order zeroed, contiguous pages aligned to their size, or 0 if
+//   no block that large is free. kfree_pages() must get the same order.
+void *kalloc_pages(int order);
+void kfree_pages(void *pa, int order);
+
+//   single-page shorthands (order 0).
+void *kalloc_page(void);
+void kfree_page(void *pa);
+
+//   smallest order whose block holds `bytes`.
+int kalloc_order_for(uint64_t bytes);
+
+uint64_t kalloc_free_pages(void);
+
+//   1 if pa lies in memory the allocator manages (as opposed to the kernel
+//   image or MMIO).
+int kalloc_in_pool(uint64_t pa);
+
+//   prints free blocks per order and fragmentation (shell command "mem").
+void kalloc_stats(void);
+
+#endif
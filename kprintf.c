@@ -0,0 +1,369 @@
+// kprintf.c — format engine, log ring and console drain
+// ---------------------------------------------------------------
+// the ring is KLOG_SLOTS fixed-size records. a writer claims the next
+// sequence number with one atomic add, fills the slot it maps to and then
+// publishes it by storing seq + 1 into the slot (release). readers (the
+// console drain and dmesg) go through sequence numbers in order:
+//
+//   slot->seq == n + 1   record n is there; copy it, then check seq again
+//                        in case a writer lapped us while we copied
+//   slot->seq <  n + 1   record n is still being written: stop here
+//   slot->seq >  n + 1   record n was overwritten: skip ahead, count loss
+//
+// writers never wait for readers; if the console falls a whole ring
+// behind the oldest messages are lost, not the newest. a writer keeps
+// interrupts off from claiming its number to publishing it, so it is
+// never preempted with a slot half written: readers would stall on it,
+// and 256 later records would land a second writer in the same slot.
+// ---------------------------------------------------------------
+
+#include "kprintf.h"
+#include "uart.h"
+#include "timer.h"
+#include "sched.h"
+#include "tasks.h"
+#include "spinlock.h"
+#include "string.h"
+#include "riscv.h"
+
+#define KLOG_SLOTS  256                 // power of two
+#define KLOG_SLOT   256
+#define KLOG_TEXT   (KLOG_SLOT - 24)
+#define KLOG_BATCH  1024                // bytes per uart_write() when draining
+
+typedef struct {
+    volatile uint64_t seq;              // record number + 1, 0 while written
+    uint64_t time;                      // mtime when it was logged
+    uint8_t level;
+    uint8_t hart;
+    uint16_t len;
+    uint32_t pad;
+    char text[KLOG_TEXT];
+} klog_rec_t;
+
+static klog_rec_t ring[KLOG_SLOTS];
+static uint64_t log_next;               // next sequence number to hand out
+static uint64_t console_seq;            // next record for the console
+static uint64_t lost;                   // overwritten before the console saw them
+static int console_level = 7;           // print levels below this
+static int draining;                    // a thread is copying to the console
+
+static spinlock_t klogd_lock;           // klogd_waiting
+static int klogd_waiting;
+
+// -----------------------------------------------------------------------------
+// Format engine
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;                         // may run past size: the would-be length
+} out_t;
+
+static void out_c(out_t *o, char c) {
+    if (o->len + 1 < o->size)
+        o->buf[o->len] = c;
+    o->len++;
+}
+
+static void out_pad(out_t *o, char c, int n) {
+    while (n-- > 0)
+        out_c(o, c);
+}
+
+// one converted field: sign/prefix, zero padding, digits or text
+static void out_field(out_t *o, const char *prefix, const char *s, int n,
+                      int width, int left, int zero) {
+    int plen = (int)strlen(prefix);
+    int pad = width - plen - n;
+    if (!left && !zero)
+        out_pad(o, ' ', pad);
+    while (*prefix)
+        out_c(o, *prefix++);
+    if (!left && zero)
+        out_pad(o, '0', pad);
+    for (int i = 0; i < n; i++)
+        out_c(o, s[i]);
+    if (left)
+        out_pad(o, ' ', pad);
+}
+
+static int utoa(char *end, uint64_t v, unsigned base, int upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    int n = 0;
+    do {
+        *--end = digits[v % base];
+        v /= base;
+        n++;
+    } while (v);
+    return n;
+}
+
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap) {
+    out_t o = { buf, size, 0 };
+    char num[24];
+
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            out_c(&o, *fmt);
+            continue;
+        }
+        int left = 0, zero = 0, width = 0, lng = 0;
+        for (;; fmt++) {
+            if (fmt[1] == '-') left = 1;
+            else if (fmt[1] == '0') zero = 1;
+            else break;
+        }
+        if (fmt[1] == '*') {
+            width = va_arg(ap, int);
+            if (width < 0) {
+                left = 1;
+                width = -width;
+            }
+            fmt++;
+        }
+        while (fmt[1] >= '0' && fmt[1] <= '9')
+            width = width * 10 + (*++fmt - '0');
+        while (fmt[1] == 'l' || fmt[1] == 'z') {
+            lng++;
+            fmt++;
+        }
+        char conv = *++fmt;
+        if (!conv)
+            break;
+
+        uint64_t u;
+        int64_t d;
+        int n;
+        switch (conv) {
+        case 'd':
+        case 'i':
+            d = lng ? va_arg(ap, int64_t) : va_arg(ap, int);
+            u = d < 0 ? -(uint64_t)d : (uint64_t)d;
+            n = utoa(num + sizeof(num), u, 10, 0);
+            out_field(&o, d < 0 ? "-" : "", num + sizeof(num) - n, n, width, left, zero);
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+            u = lng ? va_arg(ap, uint64_t) : va_arg(ap, unsigned int);
+            n = utoa(num + sizeof(num), u, conv == 'u' ? 10 : 16, conv == 'X');
+            out_field(&o, "", num + sizeof(num) - n, n, width, left, zero);
+            break;
+        case 'p':
+            u = (uint64_t)va_arg(ap, void *);
+            n = utoa(num + sizeof(num), u, 16, 0);
+            out_field(&o, "0x", num + sizeof(num) - n, n, width, left, zero);
+            break;
+        case 's': {
+            const char *s = va_arg(ap, const char *);
+            if (!s)
+                s = "(null)";
+            out_field(&o, "", s, (int)strlen(s), width, left, 0);
+            break;
+        }
+        case 'c':
+            num[0] = (char)va_arg(ap, int);
+            out_field(&o, "", num, 1, width, left, 0);
+            break;
+        default:                        // "%%" and anything unknown
+            out_c(&o, conv);
+            break;
+        }
+    }
+    if (size)
+        buf[o.len < size ? o.len : size - 1] = '\0';
+    return (int)o.len;
+}
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Log ring
+// -----------------------------------------------------------------------------
+
+int kprintf(const char *fmt, ...) {
+    int level = LOGLEVEL_DEFAULT;
+    if (fmt[0] == KERN_SOH[0] && fmt[1] >= '0' && fmt[1] <= '7') {
+        level = fmt[1] - '0';
+        fmt += 2;
+    }
+
+    char text[KLOG_TEXT];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    if (n > (int)sizeof(text) - 1)
+        n = sizeof(text) - 1;
+
+    uint64_t irq = irq_save();
+    uint64_t seq = __atomic_fetch_add(&log_next, 1, __ATOMIC_RELAXED);
+    klog_rec_t *r = &ring[seq & (KLOG_SLOTS - 1)];
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->time = timer_now();
+    r->level = (uint8_t)level;
+    r->hart = (uint8_t)hart_id();
+    r->len = (uint16_t)n;
+    memcpy(r->text, text, (size_t)n);
+    __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+    irq_restore(irq);
+    sched_acct_tx((uint64_t)n);
+    return n;
+}
+
+// copy record `seq` into *out. 1 if it was there, 0 if it is still being
+// written, -1 if it has been overwritten
+static int read_rec(uint64_t seq, klog_rec_t *out) {
+    klog_rec_t *r = &ring[seq & (KLOG_SLOTS - 1)];
+    uint64_t s = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+    if (s != seq + 1)
+        return s > seq + 1 || (s == 0 && log_next > seq + KLOG_SLOTS) ? -1 : 0;
+    out->time = r->time;
+    out->level = r->level;
+    out->hart = r->hart;
+    out->len = r->len < KLOG_TEXT ? r->len : KLOG_TEXT;
+    memcpy(out->text, r->text, out->len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq + 1 ? 1 : -1;
+}
+
+// the oldest record that can still be in the ring
+static uint64_t oldest(void) {
+    uint64_t next = __atomic_load_n(&log_next, __ATOMIC_RELAXED);
+    return next > KLOG_SLOTS ? next - KLOG_SLOTS : 0;
+}
+
+// -----------------------------------------------------------------------------
+// Console
+// -----------------------------------------------------------------------------
+
+// copy new records to the UART in batches. 0 if another thread is already
+// at it (it will get everything we would have)
+static int drain(void) {
+    if (__atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE))
+        return 0;
+    static char batch[KLOG_BATCH];      // only used by the drainer
+    static klog_rec_t rec;
+    size_t len = 0;
+    uint64_t seq = console_seq;
+    for (;;) {
+        int r = read_rec(seq, &rec);
+        if (r < 0) {
+            uint64_t o = oldest();
+            lost += o > seq ? o - seq : 1;
+            seq = o > seq ? o : seq + 1;
+            continue;
+        }
+        if (r == 0)
+            break;
+        seq++;
+        if (rec.level >= console_level)
+            continue;
+        if (len + rec.len > sizeof(batch)) {
+            uart_write(batch, len);
+            len = 0;
+        }
+        memcpy(batch + len, rec.text, rec.len);
+        len += rec.len;
+    }
+    if (len)
+        uart_write(batch, len);
+    console_seq = seq;
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int pending(void) {
+    return console_seq != __atomic_load_n(&log_next, __ATOMIC_RELAXED);
+}
+
+void klog_flush(void) {
+    while (!drain())
+        sched_yield();
+}
+
+static void klogd(void) {
+    for (;;) {
+        uint64_t s = spin_lock_irqsave(&klogd_lock);
+        while (!pending()) {
+            klogd_waiting = 1;
+            sched_sleep(&klogd_waiting, &klogd_lock);
+        }
+        klogd_waiting = 0;
+        spin_unlock_irqrestore(&klogd_lock, s);
+        // no progress: the next record is still being written on another
+        // hart, or klog_flush() is draining. let others run rather than
+        // spin on pending() for the rest of the quantum
+        uint64_t seq = console_seq;
+        drain();
+        if (console_seq == seq)
+            sched_yield();
+    }
+}
+
+void klog_kick(void) {
+    if (!klogd_waiting || !pending())
+        return;
+    spin_lock(&klogd_lock);
+    if (klogd_waiting)
+        sched_wakeup(&klogd_waiting);
+    spin_unlock(&klogd_lock);
+}
+
+void klog_start(void) {
+    if (tasks_spawn("klogd", (uint64_t)klogd, 0) < 0)
+        kprintf(KERN_WARNING "[LOG] no klogd thread, console drains at the prompt only\n");
+}
+
+int klog_console_level(int level) {
+    if (level >= 0 && level <= 8)
+        console_level = level;
+    return console_level;
+}
+
+// [seconds.micros] and the hart in front of every line
+void klog_dmesg(void) {
+    klog_rec_t rec;
+    char head[32];
+    int bol = 1;
+    uint64_t end = __atomic_load_n(&log_next, __ATOMIC_ACQUIRE);
+    for (uint64_t seq = oldest(); seq < end; seq++) {
+        if (read_rec(seq, &rec) != 1)
+            continue;
+        for (int i = 0; i < rec.len; i++) {
+            if (bol) {
+                uint64_t us = rec.time / timer_us_to_ticks(1);
+                int n = ksnprintf(head, sizeof(head), "[%5lu.%06lu] <%d> ",
+                                  us / 1000000, us % 1000000, rec.level);
+                uart_write(head, (size_t)n);
+                bol = 0;
+            }
+            int j = i;
+            while (j < rec.len && rec.text[j] != '\n')
+                j++;
+            if (j < rec.len) {
+                uart_write(rec.text + i, (size_t)(j - i + 1));
+                bol = 1;
+            } else {
+                uart_write(rec.text + i, (size_t)(j - i));
+            }
+            i = j;
+        }
+    }
+    if (!bol)
+        uart_puts("\n");
+    if (lost) {
+        int n = ksnprintf(head, sizeof(head), "(%lu lost on the console)\n",
+                          (unsigned long)lost);
+        uart_write(head, (size_t)n);
+    }
+}
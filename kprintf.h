@@ -0,0 +1,56 @@
+// kprintf.h — formatted kernel logging into an in-memory ring
+// kprintf() formats the message on the caller's stack and drops it into a
+// fixed ring of log records; it never touches the UART, never takes a lock
+// and never sleeps, so it is safe from interrupt context and from any
+// hart. the "klogd" kernel thread copies new records to the console in
+// large batches; the shell drains the ring before each prompt.
+//
+// a message may start with a level, as in kprintf(KERN_WARNING "...").
+// records above the console level are kept for `dmesg` but not printed.
+
+#ifndef KPRINTF_H
+#define KPRINTF_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#define KERN_SOH     "\001"
+#define KERN_EMERG   KERN_SOH "0"
+#define KERN_ALERT   KERN_SOH "1"
+#define KERN_CRIT    KERN_SOH "2"
+#define KERN_ERR     KERN_SOH "3"
+#define KERN_WARNING KERN_SOH "4"
+#define KERN_NOTICE  KERN_SOH "5"
+#define KERN_INFO    KERN_SOH "6"
+#define KERN_DEBUG   KERN_SOH "7"
+
+#define LOGLEVEL_DEFAULT 6      // messages without a level are KERN_INFO
+
+// printf-style formatting: %d %i %u %x %X %p %s %c %%, with the flags '-'
+// and '0', a width (or '*') and the length modifiers l, ll and z. returns
+// the length the full output would have had; buf is always terminated.
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+int ksnprintf(char *buf, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+//   logs a message. text beyond one record (KLOG_TEXT bytes) is cut off.
+int kprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+//   starts the klogd thread.
+//   called by: - kernel_main() in main.c, once the scheduler runs
+void klog_start(void);
+
+//   wakes klogd if there is anything for the console.
+//   called by: - sched_tick() in sched.c (trap context)
+void klog_kick(void);
+
+//   copies everything logged so far to the console before returning.
+//   called by: - shell_run() before the prompt, kernel_main() during boot
+void klog_flush(void);
+
+//   prints the whole ring with timestamps and levels ("dmesg"), and shows
+//   or sets the console level ("dmesg -n <level>").
+void klog_dmesg(void);
+int klog_console_level(int level);     // level < 0: just return it
+
+#endif
@@ -0,0 +1,370 @@
+// ktimer.c — per-hart hierarchical timing wheels
+// ---------------------------------------------------------------
+// `clk` is the first jiffy the wheel has not processed yet. a timer due in
+// jiffy j (its deadline rounded up, so it never fires early) sits at
+//
+//   level 0, slot j % 64            if j - clk < 64
+//   level l, slot (j >> 6l) % 64    if j - clk < 64^(l+1)
+//
+// and past the last level in the slot of the farthest jiffy it reaches;
+// cascading puts it back where it belongs. processing jiffy j first
+// cascades every level whose slot boundary j is (highest first), then runs
+// level-0 slot j % 64.
+//
+// ktimer_expire() does not walk the jiffies one by one: the pending bitmaps
+// give the next jiffy with anything to do, and clk jumps straight there. a
+// hart that wakes after a long idle stretch therefore catches up in a few
+// steps, and processes each cascade exactly as if it had been on time.
+//
+// callbacks run with the wheel unlocked, so they may arm timers and wake
+// threads. `running` lets ktimer_cancel() on another hart wait for one.
+// ---------------------------------------------------------------
+
+#include "ktimer.h"
+#include "timer.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "slab.h"
+#include "uart.h"
+#include "riscv.h"
+#include "kprintf.h"
+
+#define SLOTS        (1u << KTIMER_LEVEL_BITS)
+#define SLOT_MASK    (SLOTS - 1)
+#define LVL_SHIFT(l) ((unsigned)(l) * KTIMER_LEVEL_BITS)
+#define HORIZON      (1UL << LVL_SHIFT(KTIMER_LEVELS))      // in jiffies
+
+typedef struct ktimer_wheel {
+    spinlock_t lock;
+    uint64_t clk;                       // first jiffy not processed
+    uint64_t pending[KTIMER_LEVELS];    // bit i: slot i is not empty
+    ktimer_t *slots[KTIMER_LEVELS][SLOTS];
+    ktimer_t *running;                  // callback in progress
+    uint32_t queued;
+    uint64_t fired, cascaded;
+    uint64_t runs;                      // ktimer_expire() calls
+    uint64_t cycles;                    // spent in them, callbacks included
+} __attribute__((aligned(64))) ktimer_wheel_t;
+
+static ktimer_wheel_t wheels[MAX_HARTS];
+
+// -----------------------------------------------------------------------------
+// Slots
+// -----------------------------------------------------------------------------
+
+static inline uint64_t ror64(uint64_t x, unsigned n) {
+    n &= 63;
+    return n ? (x >> n) | (x << (64 - n)) : x;
+}
+
+static uint64_t jiffy_of(uint64_t expires) {
+    return (expires >> KTIMER_SHIFT) + ((expires & ((1UL << KTIMER_SHIFT) - 1)) != 0);
+}
+
+static void enqueue(ktimer_wheel_t *w, ktimer_t *t) {
+    uint64_t j = jiffy_of(t->expires);
+    if (j < w->clk)
+        j = w->clk;                     // overdue: the next jiffy processed
+    uint64_t delta = j - w->clk;
+    if (delta >= HORIZON) {
+        delta = HORIZON - 1;
+        j = w->clk + delta;
+    }
+    unsigned l = 0;
+    while (delta >= 1UL << LVL_SHIFT(l + 1))
+        l++;
+    unsigned i = (unsigned)(j >> LVL_SHIFT(l)) & SLOT_MASK;
+
+    ktimer_t **head = &w->slots[l][i];
+    t->next = *head;
+    if (t->next)
+        t->next->pprev = &t->next;
+    *head = t;
+    t->pprev = head;
+    t->slot = (uint16_t)(l * SLOTS + i);
+    t->wheel = w;
+    w->pending[l] |= 1UL << i;
+    w->queued++;
+}
+
+static void dequeue(ktimer_wheel_t *w, ktimer_t *t) {
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    t->pprev = 0;
+    unsigned l = t->slot / SLOTS, i = t->slot % SLOTS;
+    if (!w->slots[l][i])
+        w->pending[l] &= ~(1UL << i);
+    w->queued--;
+}
+
+// move every timer of slot i at level l down to where it belongs now
+static void cascade(ktimer_wheel_t *w, unsigned l, unsigned i) {
+    ktimer_t *t = w->slots[l][i];
+    w->slots[l][i] = 0;
+    w->pending[l] &= ~(1UL << i);
+    while (t) {
+        ktimer_t *next = t->next;
+        w->queued--;
+        enqueue(w, t);
+        w->cascaded++;
+        t = next;
+    }
+}
+
+// the first jiffy at or after clk with work to do: a level-0 slot to run
+// or a higher slot to cascade. a slot boundary at clk itself is still to
+// be processed, hence the rounding up. ~0 if the wheel is empty.
+static uint64_t next_jiffy(const ktimer_wheel_t *w) {
+    uint64_t best = ~0UL;
+    for (unsigned l = 0; l < KTIMER_LEVELS; l++) {
+        if (!w->pending[l])
+            continue;
+        unsigned s = LVL_SHIFT(l);
+        uint64_t first = (w->clk + (1UL << s) - 1) >> s;
+        uint64_t r = ror64(w->pending[l], (unsigned)first & SLOT_MASK);
+        uint64_t j = (first + (uint64_t)__builtin_ctzll(r)) << s;
+        if (j < best)
+            best = j;
+    }
+    return best;
+}
+
+// -----------------------------------------------------------------------------
+// API
+// -----------------------------------------------------------------------------
+
+void ktimer_arm(ktimer_t *t, uint64_t expires) {
+    if (t->pprev)
+        ktimer_cancel(t);
+    uint64_t s = irq_save();
+    ktimer_wheel_t *w = &wheels[hart_id()];
+    spin_lock(&w->lock);
+    if (!w->clk)
+        w->clk = timer_now() >> KTIMER_SHIFT;
+    t->expires = expires;
+    enqueue(w, t);
+    uint64_t j = jiffy_of(expires);
+    uint64_t at = (j > w->clk ? j : w->clk) << KTIMER_SHIFT;
+    spin_unlock(&w->lock);
+    // sooner than this hart's next timer interrupt: bring that forward.
+    // cascades on the way are caught up with then.
+    if (at < timer_deadline())
+        timer_arm_at(at);
+    irq_restore(s);
+}
+
+int ktimer_cancel(ktimer_t *t) {
+    ktimer_wheel_t *w = t->wheel;
+    if (!w)
+        return -1;
+    uint64_t s = spin_lock_irqsave(&w->lock);
+    int r = -1;
+    if (t->pprev) {
+        dequeue(w, t);
+        r = 0;
+    }
+    while (w->running == t) {
+        spin_unlock(&w->lock);
+        asm volatile("nop");
+        spin_lock(&w->lock);
+    }
+    spin_unlock_irqrestore(&w->lock, s);
+    return r;
+}
+
+void ktimer_expire(uint64_t now) {
+    ktimer_wheel_t *w = &wheels[hart_id()];
+    uint64_t c0 = rdcycle();
+    uint64_t target = now >> KTIMER_SHIFT;
+    spin_lock(&w->lock);
+    w->runs++;
+    while (w->clk <= target) {
+        uint64_t j = next_jiffy(w);
+        if (j > target) {
+            w->clk = target + 1;
+            break;
+        }
+        w->clk = j;
+        for (unsigned l = KTIMER_LEVELS - 1; l > 0; l--)
+            if (!(j & ((1UL << LVL_SHIFT(l)) - 1)))
+                cascade(w, l, (unsigned)(j >> LVL_SHIFT(l)) & SLOT_MASK);
+        ktimer_t **head = &w->slots[0][j & SLOT_MASK];
+        while (*head) {
+            ktimer_t *t = *head;
+            dequeue(w, t);
+            w->fired++;
+            w->running = t;
+            spin_unlock(&w->lock);
+            t->fn(t->arg);
+            spin_lock(&w->lock);
+            w->running = 0;
+        }
+        w->clk = j + 1;
+    }
+    spin_unlock(&w->lock);
+    w->cycles += rdcycle() - c0;
+}
+
+uint64_t ktimer_next(void) {
+    uint64_t s = irq_save();
+    ktimer_wheel_t *w = &wheels[hart_id()];
+    spin_lock(&w->lock);
+    uint64_t j = w->queued ? next_jiffy(w) : ~0UL;
+    spin_unlock(&w->lock);
+    irq_restore(s);
+    return j == ~0UL ? j : j << KTIMER_SHIFT;
+}
+
+void ktimer_stats(void) {
+    uart_puts("  HART  QUEUED  FIRED     CASCADED  RUNS      NEXT(us)\n");
+    uint64_t now = timer_now();
+    for (int h = 0; h < sched_ncpus() && h < MAX_HARTS; h++) {
+        ktimer_wheel_t *w = &wheels[h];
+        uint64_t s = spin_lock_irqsave(&w->lock);
+        uint64_t j = w->queued ? next_jiffy(w) : ~0UL;
+        uint32_t queued = w->queued;
+        spin_unlock_irqrestore(&w->lock, s);
+
+        char line[96];
+        int n = ksnprintf(line, sizeof(line), "  %-4d  %-6u  %-8lu  %-8lu  %-8lu  ",
+                          h, queued, w->fired, w->cascaded, w->runs);
+        if (j == ~0UL)
+            ksnprintf(line + n, sizeof(line) - (size_t)n, "-\n");
+        else
+            ksnprintf(line + n, sizeof(line) - (size_t)n, "%lu\n",
+                      (j << KTIMER_SHIFT) > now ?
+                      ((j << KTIMER_SHIFT) - now) / timer_us_to_ticks(1) : 0UL);
+        uart_puts(line);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+#define BENCH_ROUNDS 200
+
+struct bench_shot {
+    volatile uint64_t fired;        // mtime in the callback, 0 until then
+};
+
+struct bench_lat {
+    uint64_t min, max, sum, n;
+};
+
+static void bench_fire(void *arg) {
+    struct bench_shot *b = (struct bench_shot *)arg;
+    b->fired = timer_now();
+    sched_wakeup(b);
+}
+
+// all on one wheel, so the callbacks never run at the same time
+static void bench_count(void *arg) {
+    (*(volatile uint64_t *)arg)++;
+}
+
+static void lat_add(struct bench_lat *l, uint64_t v) {
+    if (!l->n || v < l->min) l->min = v;
+    if (v > l->max) l->max = v;
+    l->sum += v;
+    l->n++;
+}
+
+//   one timer at a time, 100 us to 1 ms ahead. the shell sleeps until its
+//   callback wakes it: fire is how late the callback ran, wake how late
+//   the shell ran again, both after the deadline.
+static void bench_latency(struct bench_lat *fire, struct bench_lat *wake) {
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        struct bench_shot b = {0};
+        ktimer_t t;
+        ktimer_init(&t, bench_fire, &b);
+        uint64_t s = irq_save();
+        uint64_t deadline = timer_now() + timer_us_to_ticks(100 + (uint64_t)(i * 37 % 19) * 50);
+        ktimer_arm(&t, deadline);
+        while (!b.fired)
+            sched_sleep(&b, 0);
+        uint64_t woke = timer_now();
+        irq_restore(s);
+        lat_add(fire, b.fired - deadline);
+        lat_add(wake, woke - deadline);
+    }
+}
+
+static void lat_report(const char *what, const struct bench_lat *fire,
+                       const struct bench_lat *wake) {
+    const uint64_t ns = 1000000000UL / TIMER_HZ;
+    char line[128];
+    ksnprintf(line, sizeof(line), "    %-20s fire %lu/%lu/%lu  wake %lu/%lu/%lu\n", what,
+              fire->min * ns, fire->sum / fire->n * ns, fire->max * ns,
+              wake->min * ns, wake->sum / wake->n * ns, wake->max * ns);
+    uart_puts(line);
+}
+
+void ktimer_bench(int n) {
+    if (n <= 0) n = 4096;
+    ktimer_t *ts = (ktimer_t *)kmalloc((uint64_t)n * sizeof(*ts));
+    if (!ts) {
+        uart_puts("bench timer: out of memory\n");
+        return;
+    }
+    char line[128];
+    ksnprintf(line, sizeof(line), "timer benchmark (%d timers, %d rounds, jiffy %lu ns)\n",
+              n, BENCH_ROUNDS, (1UL << KTIMER_SHIFT) * (1000000000UL / TIMER_HZ));
+    uart_puts(line);
+
+    struct bench_lat fire0 = {0}, wake0 = {0}, fire1 = {0}, wake1 = {0};
+    bench_latency(&fire0, &wake0);
+
+    // n timers parked 10 to 60 s out, over many slots of the upper levels.
+    // interrupts stay off so that they all go on this hart's wheel.
+    volatile uint64_t count = 0;
+    uint64_t s = irq_save();
+    uint64_t now = timer_now();
+    uint64_t c0 = rdcycle();
+    for (int i = 0; i < n; i++) {
+        ktimer_init(&ts[i], bench_count, (void *)&count);
+        ktimer_arm(&ts[i], now + 10 * TIMER_HZ + (uint64_t)i * (50 * TIMER_HZ) / (uint64_t)n);
+    }
+    uint64_t arm = rdcycle() - c0;
+    irq_restore(s);
+
+    // latency again with all of them outstanding, then take them off
+    bench_latency(&fire1, &wake1);
+    c0 = rdcycle();
+    for (int i = 0; i < n; i++)
+        ktimer_cancel(&ts[i]);
+    uint64_t cancel = rdcycle() - c0;
+
+    // the same n due within the next 100 ms: what expiring them costs
+    s = irq_save();
+    ktimer_wheel_t *w = &wheels[hart_id()];
+    uint64_t cyc0 = w->cycles, casc0 = w->cascaded, runs0 = w->runs;
+    now = timer_now();
+    for (int i = 0; i < n; i++)
+        ktimer_arm(&ts[i], now + timer_us_to_ticks(1000) +
+                           (uint64_t)i * timer_us_to_ticks(100000) / (uint64_t)n);
+    irq_restore(s);
+    uint64_t give_up = timer_now() + TIMER_HZ;
+    while (count < (uint64_t)n && timer_now() < give_up)
+        sched_sleep_us(10000);
+    // the wheel's totals also hold the shell's own sleeps, a few timers
+    uint64_t fired = count;
+    uint64_t cyc = w->cycles - cyc0, casc = w->cascaded - casc0, runs = w->runs - runs0;
+    for (int i = 0; i < n; i++)
+        ktimer_cancel(&ts[i]);
+    kfree(ts);
+
+    ksnprintf(line, sizeof(line), "  arm      %lu cycles per timer\n", arm / (uint64_t)n);
+    uart_puts(line);
+    ksnprintf(line, sizeof(line), "  cancel   %lu cycles per timer\n", cancel / (uint64_t)n);
+    uart_puts(line);
+    uart_puts("  past the deadline, min/avg/max ns:\n");
+    lat_report("no other timers", &fire0, &wake0);
+    ksnprintf(line, sizeof(line), "%d outstanding", n);
+    lat_report(line, &fire1, &wake1);
+    ksnprintf(line, sizeof(line),
+              "  expiry   %lu of %d fired over 100 ms: %lu cycles each, %lu cascades, %lu interrupts\n",
+              fired, n, fired ? cyc / fired : 0UL, casc, runs);
+    uart_puts(line);
+}
@@ -0,0 +1,71 @@
+// ktimer.h — kernel timers on a hierarchical timing wheel
+// a ktimer_t calls fn(arg) from the machine timer interrupt once mtime has
+// reached its deadline. every hart has its own wheel: a timer runs on the
+// hart that armed it, and that hart programs its mtimecmp for the earliest
+// thing it has to do (sched.c), so an idle hart sleeps in wfi until then.
+//
+// the wheel has KTIMER_LEVELS levels of 64 slots. a level-0 slot is one
+// "jiffy" of 2^KTIMER_SHIFT mtime ticks (6.4 us); every level up a slot
+// covers 64 slots of the level below. a timer goes into the slot of the
+// lowest level that reaches its deadline, in O(1), and is unlinked from its
+// slot in O(1). when level 0 wraps, the next slot of level 1 is cascaded:
+// its timers move down to wherever their deadline now falls, and so on up.
+// a bitmap per level tells which slots hold anything, so finding the next
+// deadline and skipping an idle stretch cost O(levels), not O(jiffies).
+
+#ifndef KTIMER_H
+#define KTIMER_H
+
+#include <stdint.h>
+
+#define KTIMER_SHIFT      6     // a jiffy is 64 mtime ticks, 6.4 us at 10 MHz
+#define KTIMER_LEVEL_BITS 6     // 64 slots per level
+#define KTIMER_LEVELS     4     // reaches 2^30 ticks (107 s) before it clamps
+
+typedef struct ktimer {
+    uint64_t expires;           // mtime deadline
+    void (*fn)(void *arg);      // runs in the timer interrupt, irqs off
+    void *arg;
+    struct ktimer *next;        // in its slot
+    struct ktimer **pprev;      // 0 while not queued
+    struct ktimer_wheel *wheel; // of the hart that armed it
+    uint16_t slot;              // level * 64 + index
+} ktimer_t;
+
+static inline void ktimer_init(ktimer_t *t, void (*fn)(void *), void *arg) {
+    t->fn = fn;
+    t->arg = arg;
+    t->next = 0;
+    t->pprev = 0;
+    t->wheel = 0;
+}
+
+//   queues t on the calling hart's wheel to fire at mtime `expires` (in the
+//   past: at the next timer interrupt). a queued timer is moved. a timer
+//   has one owner: it is not armed or cancelled from two places at once.
+void ktimer_arm(ktimer_t *t, uint64_t expires);
+
+//   takes t off its wheel: 0 if it was queued, -1 if it had fired or was
+//   never armed. if its callback is running on another hart, waits for it
+//   to return, so t may be freed afterwards. not from t's own callback.
+int ktimer_cancel(ktimer_t *t);
+
+//   runs every timer of this hart's wheel that is due at `now`.
+//   called by: - sched_tick() in sched.c (timer interrupt)
+void ktimer_expire(uint64_t now);
+
+//   mtime at which this hart's wheel next needs ktimer_expire(): a timer
+//   or a cascade. ~0 if the wheel is empty.
+//   called by: - sched.c, whenever it programs mtimecmp
+uint64_t ktimer_next(void);
+
+//   per-hart queued, fired and cascaded timers and the next deadline
+//   (shell command "timers").
+void ktimer_stats(void);
+
+//   arm/cancel cost with n timers outstanding, fire and wakeup latency
+//   with and without them, expiry cost per timer (shell command
+//   "bench timer [n]").
+void ktimer_bench(int n);
+
+#endif
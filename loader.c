@@ -1,9 +1,35 @@
-// loader.c - copy PT_LOAD segments from embedded buffer into memory (no libc)
-// loader.c — load ELF from in-memory FS into user region (0x80200000)
+// loader.c — load ELF from in-memory FS into a fresh per-process address
+// space: every PT_LOAD segment is mapped at p_vaddr (+ load bias for PIE)
+// with the segment's R/W/X permissions, plus a user stack below
+// USER_STACK_TOP. segments must end below USER_EXIT_VA, where the kernel's
+// own fixed pages start, and e_entry must lie in an executable segment.
+//
+// read-only pages whose file bytes are page-aligned inside the embedded
+// image execute in place: the PTE points straight at the kernel image frame
+// (PTE_BORROWED), so there is no copy and every instance shares the same
+// code. everything else is copied into private frames.
+//
+// the parsed and relocated result is kept in a small cache of prepared
+// images keyed by file identity (inode + version, see fs_identity()). a
+// later load of the same, unchanged file skips the ELF entirely: read-only
+// pages are mapped shared from the cache, writable pages are copied from a
+// pristine snapshot and BSS pages are fresh zeroed frames. a running
+// process holds a reference to its image, so shared frames stay valid
+// after the entry is evicted or the file is rewritten.
 
+#include "loader.h"
 #include "uart.h"
 #include "fs.h"
 #include "tasks.h"
+#include "string.h"
+#include "memlayout.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "perf.h"
+#include "kprintf.h"
+#include "vm.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -14,7 +40,13 @@
 #define ELFCLASS64 2
 #define ELFDATA2LSB 1
 #define EM_RISCV 243
+#define ET_EXEC 2
+#define ET_DYN 3
 #define PT_LOAD 1
+#define PT_DYNAMIC 2
+#define PF_X 1
+#define PF_W 2
+#define PF_R 4
 
 typedef struct {
     unsigned char e_ident[16];
@@ -44,43 +76,240 @@ typedef struct {
     uint64_t p_align;
 } Elf64_Phdr;
 
-#ifndef USER_BASE
-#define USER_BASE 0x80200000UL
-#endif
-#ifndef USER_SIZE
-#define USER_SIZE (32 * 1024 * 1024)
-#endif
+typedef struct {
+    int64_t  d_tag;
+    uint64_t d_val;
+} Elf64_Dyn;
+
+typedef struct {
+    uint64_t r_offset;
+    uint64_t r_info;
+    int64_t  r_addend;
+} Elf64_Rela;
+
+typedef struct {
+    uint32_t st_name;
+    unsigned char st_info;
+    unsigned char st_other;
+    uint16_t st_shndx;
+    uint64_t st_value;
+    uint64_t st_size;
+} Elf64_Sym;
+
+#define DT_NULL    0
+#define DT_SYMTAB  6
+#define DT_RELA    7
+#define DT_RELASZ  8
+#define DT_RELAENT 9
+
+#define ELF64_R_SYM(i)  ((i) >> 32)
+#define ELF64_R_TYPE(i) ((i) & 0xffffffff)
+
+#define R_RISCV_NONE      0
+#define R_RISCV_64        2
+#define R_RISCV_RELATIVE  3
+#define R_RISCV_JUMP_SLOT 5
+
+// per-load statistics, printed once the program is mapped
+typedef struct {
+    int xip_pages;
+    int copied_pages;
+    int relocs;
+} load_stats_t;
 
 static int address_in_user_region(uint64_t vaddr, uint64_t memsz) {
     if (vaddr < USER_BASE) return 0;
+    if (vaddr + memsz < vaddr) return 0;
     if (vaddr + memsz > USER_BASE + USER_SIZE) return 0;
     return 1;
 }
 
-static void *mini_memcpy(void *dst, const void *src, size_t n) {
-    uint8_t *d = (uint8_t *)dst;
-    const uint8_t *s = (const uint8_t *)src;
-    for (size_t i = 0; i < n; ++i) d[i] = s[i];
-    return dst;
+// the entry point has to be in a segment that is mapped executable
+static int entry_in_text(const Elf64_Phdr *phdrs, uint16_t phnum, uint64_t entry) {
+    for (uint16_t i = 0; i < phnum; ++i) {
+        const Elf64_Phdr *ph = &phdrs[i];
+        if (ph->p_type == PT_LOAD && (ph->p_flags & PF_X) &&
+            entry >= ph->p_vaddr && entry - ph->p_vaddr < ph->p_memsz)
+            return 1;
+    }
+    return 0;
+}
+
+static uint64_t elf_perm(uint32_t flags) {
+    uint64_t perm = PTE_U;
+    if (flags & PF_R) perm |= PTE_R;
+    if (flags & PF_W) perm |= PTE_W;
+    if (flags & PF_X) perm |= PTE_X;
+    return perm;
 }
 
-static void *mini_memset(void *dst, int c, size_t n) {
-    uint8_t *d = (uint8_t *)dst;
-    for (size_t i = 0; i < n; ++i) d[i] = (uint8_t)c;
-    return dst;
+// can the page at va be mapped straight from the image? only when the
+// segment is read-only, the page holds nothing but file bytes, and the
+// whole page lies inside the image at a page-aligned address. the image
+// must also be part of the kernel: a file written at runtime lives in
+// allocator pages that go away when the file is removed or rewritten.
+static int can_map_in_place(const Elf64_Phdr *ph, uint64_t va, uint64_t vaddr,
+                            const uint8_t *buf, size_t size) {
+    if ((ph->p_flags & PF_W) || kalloc_in_pool((uint64_t)buf))
+        return 0;
+    if (va < vaddr || va + PGSIZE > vaddr + ph->p_filesz)
+        return 0;
+    uint64_t src = (uint64_t)buf + ph->p_offset + (va - vaddr);
+    if (src & (PGSIZE - 1))
+        return 0;
+    return src + PGSIZE <= (uint64_t)buf + size;
 }
 
-int load_program_from_fs(const char *path, pcb_t *out_pcb) {
-    const uint8_t *buf = NULL;
-    size_t size = 0;
+// map one PT_LOAD segment page by page at vaddr = p_vaddr + bias. a page may
+// already be mapped when two segments share it (end of text / start of
+// data); then we reuse the frame (privatizing it first if it was borrowed
+// and this segment is writable) and widen its permissions. fresh frames
+// come back zeroed from kalloc, so the BSS part (p_filesz..p_memsz) needs
+// no extra clearing.
+static int load_segment(pagetable_t pt, const Elf64_Phdr *ph, const uint8_t *buf,
+                        size_t size, uint64_t bias, load_stats_t *st) {
+    uint64_t perm = elf_perm(ph->p_flags);
+    uint64_t vaddr = ph->p_vaddr + bias;
+    uint64_t start = PGROUNDDOWN(vaddr);
+    uint64_t end = PGROUNDUP(vaddr + ph->p_memsz);
+    uint64_t file_end = vaddr + ph->p_filesz;
 
-    if (fs_get_file(path, &buf, &size) != 0) {
-        uart_puts("loader: file not found in FS\n");
+    for (uint64_t va = start; va < end; va += PGSIZE) {
+        uint64_t pa = vm_translate(pt, va);
+        if (pa) {
+            // a borrowed page may only stay shared if this segment would
+            // have borrowed the very same image frame
+            if (vm_is_borrowed(pt, va) &&
+                !(can_map_in_place(ph, va, vaddr, buf, size) &&
+                  (uint64_t)buf + ph->p_offset + (va - vaddr) == (pa & ~(uint64_t)(PGSIZE - 1)))) {
+                if (vm_privatize(pt, va) != 0)
+                    return -1;
+                st->xip_pages--;
+                st->copied_pages++;
+            }
+            vm_add_perm(pt, va, perm);
+            pa = vm_translate(pt, va);
+            if (vm_is_borrowed(pt, va))
+                continue;
+        } else if (can_map_in_place(ph, va, vaddr, buf, size)) {
+            uint64_t src = (uint64_t)buf + ph->p_offset + (va - vaddr);
+            if (vm_map(pt, va, src, PGSIZE, perm | PTE_BORROWED) != 0)
+                return -1;
+            st->xip_pages++;
+            continue;
+        } else {
+            void *page = kalloc_page();
+            if (!page)
+                return -1;
+            if (vm_map(pt, va, (uint64_t)page, PGSIZE, perm) != 0) {
+                kfree_page(page);
+                return -1;
+            }
+            pa = (uint64_t)page;
+            st->copied_pages++;
+        }
+
+        pa &= ~(uint64_t)(PGSIZE - 1);
+        uint64_t lo = va > vaddr ? va : vaddr;
+        uint64_t hi = va + PGSIZE < file_end ? va + PGSIZE : file_end;
+        if (lo < hi)
+            memcpy((uint8_t *)(pa + (lo - va)),
+                   buf + ph->p_offset + (lo - vaddr), (size_t)(hi - lo));
+        // a page shared with the previous segment may have had file bytes
+        // where this segment's BSS now sits
+        uint64_t zlo = va > file_end ? va : file_end;
+        uint64_t zhi = va + PGSIZE < vaddr + ph->p_memsz ? va + PGSIZE : vaddr + ph->p_memsz;
+        if (zlo < zhi)
+            memset((uint8_t *)(pa + (zlo - va)), 0, (size_t)(zhi - zlo));
+    }
+    return 0;
+}
+
+// translate a link-time vaddr from the dynamic section into a pointer into
+// the file image, or 0 if [vaddr, vaddr+len) is not file-backed.
+static const uint8_t *file_ptr(const uint8_t *buf, size_t size, const Elf64_Phdr *phdrs,
+                               uint16_t phnum, uint64_t vaddr, uint64_t len) {
+    for (uint16_t i = 0; i < phnum; i++) {
+        const Elf64_Phdr *ph = &phdrs[i];
+        if (ph->p_type != PT_LOAD)
+            continue;
+        if (vaddr >= ph->p_vaddr && len <= ph->p_filesz &&
+            vaddr - ph->p_vaddr <= ph->p_filesz - len) {
+            uint64_t off = ph->p_offset + (vaddr - ph->p_vaddr);
+            return off + len <= size ? buf + off : 0;
+        }
+    }
+    return 0;
+}
+
+// apply the RELA table named by PT_DYNAMIC. only what a static PIE needs:
+// RELATIVE (base + addend) and 64/JUMP_SLOT against symbols the binary
+// defines itself; there is no dynamic linker to resolve anything else.
+static int apply_relocations(pagetable_t pt, const uint8_t *buf, size_t size,
+                             const Elf64_Phdr *phdrs, uint16_t phnum,
+                             const Elf64_Phdr *dynph, uint64_t bias, load_stats_t *st) {
+    if (dynph->p_offset > size || dynph->p_filesz > size - dynph->p_offset ||
+        (dynph->p_offset & 7))
         return -1;
+    const Elf64_Dyn *dyn = (const Elf64_Dyn *)(buf + dynph->p_offset);
+    uint64_t ndyn = dynph->p_filesz / sizeof(Elf64_Dyn);
+    uint64_t rela = 0, relasz = 0, relaent = sizeof(Elf64_Rela), symtab = 0;
+
+    for (uint64_t i = 0; i < ndyn && dyn[i].d_tag != DT_NULL; i++) {
+        switch (dyn[i].d_tag) {
+        case DT_RELA:    rela = dyn[i].d_val; break;
+        case DT_RELASZ:  relasz = dyn[i].d_val; break;
+        case DT_RELAENT: relaent = dyn[i].d_val; break;
+        case DT_SYMTAB:  symtab = dyn[i].d_val; break;
+        }
     }
+    if (!relasz)
+        return 0;
+    if (relaent != sizeof(Elf64_Rela))
+        return -1;
+
+    // the tables are read in place, so they must be aligned in the file
+    const Elf64_Rela *r = (const Elf64_Rela *)file_ptr(buf, size, phdrs, phnum, rela, relasz);
+    if (!r || ((uint64_t)r & 7))
+        return -1;
 
+    for (uint64_t i = 0; i < relasz / sizeof(Elf64_Rela); i++) {
+        uint64_t type = ELF64_R_TYPE(r[i].r_info);
+        uint64_t value;
+
+        if (type == R_RISCV_NONE)
+            continue;
+        if (type == R_RISCV_RELATIVE) {
+            value = bias + (uint64_t)r[i].r_addend;
+        } else if (type == R_RISCV_64 || type == R_RISCV_JUMP_SLOT) {
+            uint64_t symoff = ELF64_R_SYM(r[i].r_info) * sizeof(Elf64_Sym);
+            const Elf64_Sym *sym = symtab ? (const Elf64_Sym *)file_ptr(
+                buf, size, phdrs, phnum, symtab + symoff, sizeof(Elf64_Sym)) : 0;
+            if (!sym || ((uint64_t)sym & 7) || sym->st_shndx == 0)
+                return -1;   // undefined: nothing to bind against
+            value = sym->st_value + bias + (uint64_t)r[i].r_addend;
+        } else {
+            return -1;
+        }
+
+        uint64_t where = r[i].r_offset + bias;
+        if (vm_privatize(pt, where) != 0 ||
+            vm_privatize(pt, where + sizeof(value) - 1) != 0 ||
+            vm_copy_out(pt, where, &value, sizeof(value)) != 0)
+            return -1;
+        st->relocs++;
+    }
+    return 0;
+}
+
+// parse and validate the ELF image, then map its segments into a fresh
+// address space and relocate them. no stack yet. on success the page
+// table, the entry point and the page range the segments cover come back.
+static int load_elf(const uint8_t *buf, size_t size, pagetable_t *pt_out,
+                    uint64_t *entry_out, uint64_t *lo_out, uint64_t *hi_out,
+                    load_stats_t *st) {
     if (size < sizeof(Elf64_Ehdr)) {
-        uart_puts("loader: file too small\n");
+        kprintf(KERN_ERR "loader: file too small\n");
         return -1;
     }
 
@@ -88,45 +317,465 @@ int load_program_from_fs(const char *path, pcb_t *out_pcb) {
 
     if (ehdr->e_ident[0] != ELF_MAGIC0 || ehdr->e_ident[1] != ELF_MAGIC1 ||
         ehdr->e_ident[2] != ELF_MAGIC2 || ehdr->e_ident[3] != ELF_MAGIC3) {
-        uart_puts("loader: not ELF\n");
+        kprintf(KERN_ERR "loader: not ELF\n");
         return -1;
     }
     if (ehdr->e_ident[4] != ELFCLASS64 || ehdr->e_ident[5] != ELFDATA2LSB) {
-        uart_puts("loader: wrong ELF class/endian\n");
+        kprintf(KERN_ERR "loader: wrong ELF class/endian\n");
         return -1;
     }
     if (ehdr->e_machine != EM_RISCV) {
-        uart_puts("loader: not RISC-V ELF\n");
+        kprintf(KERN_ERR "loader: not RISC-V ELF\n");
+        return -1;
+    }
+
+    if (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) {
+        kprintf(KERN_ERR "loader: not an executable\n");
+        return -1;
+    }
+    if (ehdr->e_phentsize != sizeof(Elf64_Phdr) || (ehdr->e_phoff & 7) ||
+        ehdr->e_phoff > size ||
+        (uint64_t)ehdr->e_phnum * sizeof(Elf64_Phdr) > size - ehdr->e_phoff) {
+        kprintf(KERN_ERR "loader: program headers truncated\n");
         return -1;
     }
 
     const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(buf + ehdr->e_phoff);
+    const Elf64_Phdr *dynph = 0;
+    uint64_t lowest = ~0UL, highest = 0;
+    for (uint16_t i = 0; i < ehdr->e_phnum; ++i) {
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_vaddr < lowest)
+            lowest = phdrs[i].p_vaddr;
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_vaddr + phdrs[i].p_memsz > highest)
+            highest = phdrs[i].p_vaddr + phdrs[i].p_memsz;
+        if (phdrs[i].p_type == PT_DYNAMIC)
+            dynph = &phdrs[i];
+    }
+    if (!entry_in_text(phdrs, ehdr->e_phnum, ehdr->e_entry)) {
+        kprintf(KERN_ERR "loader: entry point not in an executable segment\n");
+        return -1;
+    }
+
+    // a PIE is linked at (usually) 0 and can go anywhere; every address
+    // space is private, so place its lowest segment at USER_BASE
+    uint64_t bias = 0;
+    if (ehdr->e_type == ET_DYN && lowest != ~0UL)
+        bias = USER_BASE - PGROUNDDOWN(lowest);
+
+    pagetable_t pt = vm_create();
+    if (!pt) {
+        kprintf(KERN_ERR "loader: out of memory\n");
+        return -1;
+    }
+
     for (uint16_t i = 0; i < ehdr->e_phnum; ++i) {
         const Elf64_Phdr *ph = &phdrs[i];
         if (ph->p_type != PT_LOAD) continue;
 
-        if (ph->p_offset + ph->p_filesz > size) {
-            uart_puts("loader: segment truncated\n");
+        if (ph->p_offset > size || ph->p_filesz > size - ph->p_offset ||
+            ph->p_filesz > ph->p_memsz) {
+            kprintf(KERN_ERR "loader: segment truncated\n");
+            vm_free(pt);
+            return -1;
+        }
+        if (!address_in_user_region(ph->p_vaddr + bias, ph->p_memsz)) {
+            kprintf(KERN_ERR "loader: segment out of user region\n");
+            vm_free(pt);
             return -1;
         }
-        if (!address_in_user_region(ph->p_vaddr, ph->p_memsz)) {
-            uart_puts("loader: segment out of user region\n");
+        if (load_segment(pt, ph, buf, size, bias, st) != 0) {
+            kprintf(KERN_ERR "loader: out of memory\n");
+            vm_free(pt);
             return -1;
         }
+    }
+
+    if (dynph && apply_relocations(pt, buf, size, phdrs, ehdr->e_phnum,
+                                   dynph, bias, st) != 0) {
+        kprintf(KERN_ERR "loader: bad or unsupported relocation\n");
+        vm_free(pt);
+        return -1;
+    }
+
+    *pt_out = pt;
+    *entry_out = ehdr->e_entry + bias;
+    *lo_out = lowest == ~0UL ? USER_BASE : PGROUNDDOWN(lowest + bias);
+    *hi_out = lowest == ~0UL ? USER_BASE : PGROUNDUP(highest + bias);
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Prepared image cache
+// -----------------------------------------------------------------------------
+
+// how a page of a prepared image is set up in a new address space
+#define IMG_XIP    0    // kernel image frame, mapped borrowed
+#define IMG_SHARED 1    // read-only frame owned by the cache, mapped borrowed
+#define IMG_DATA   2    // pristine copy, copied into a fresh frame
+#define IMG_ZERO   3    // all zero (BSS): a fresh frame and nothing else
+
+#define IMG_CACHE_MAX 8
+
+typedef struct {
+    uint64_t va;
+    uint64_t perm;
+    uint8_t *frame;             // 0 for IMG_ZERO
+    int kind;
+} img_page_t;
+
+typedef struct image {
+    uint32_t ino;               // file identity (fs_identity)
+    uint64_t version;
+    char name[FS_NAME_MAX];
+    uint64_t entry;
+    int npages;
+    img_page_t *pages;
+    int refs;                   // the cache's own plus one per process
+    uint64_t launches;
+    uint64_t last_used;         // LRU stamp
+    struct image *next;
+} image_t;
+
+static image_t *images;
+static int nimages;
+static uint64_t lru_clock;
+static spinlock_t img_lock;     // the list, refs, stamps and counters
+
+static struct {
+    uint64_t hits, misses;
+    uint64_t hit_cycles, miss_cycles;
+} img_stats;
+
+static void image_free(image_t *img) {
+    for (int i = 0; i < img->npages; i++)
+        if (img->pages[i].kind == IMG_SHARED || img->pages[i].kind == IMG_DATA)
+            kfree_page(img->pages[i].frame);
+    kfree(img->pages);
+    kfree(img);
+}
+
+static int page_is_zero(const uint8_t *p) {
+    const uint64_t *w = (const uint64_t *)p;
+    for (uint64_t i = 0; i < PGSIZE / 8; i++)
+        if (w[i])
+            return 0;
+    return 1;
+}
+
+// load the file the slow way into a scratch address space, then keep its
+// frames: borrowed image frames are remembered, private read-only frames
+// become shared, private writable frames become the pristine copy of the
+// initialized data (relocations included), and pages that are still all
+// zero are dropped and recreated empty on every launch.
+static image_t *image_prepare(const uint8_t *buf, size_t size, load_stats_t *st) {
+    pagetable_t pt;
+    uint64_t entry, lo, hi;
+    if (load_elf(buf, size, &pt, &entry, &lo, &hi, st) != 0)
+        return 0;
+
+    int n = 0;
+    for (uint64_t va = lo; va < hi; va += PGSIZE)
+        if (vm_translate(pt, va))
+            n++;
+    image_t *img = (image_t *)kzalloc(sizeof(image_t));
+    img_page_t *pages = (img_page_t *)kmalloc((n ? n : 1) * sizeof(img_page_t));
+    if (!img || !pages) {
+        kfree(img);
+        kfree(pages);
+        vm_free(pt);
+        kprintf(KERN_ERR "loader: out of memory\n");
+        return 0;
+    }
+    img->entry = entry;
+    img->pages = pages;
+
+    for (uint64_t va = lo; va < hi; va += PGSIZE) {
+        uint64_t flags;
+        uint64_t pa = vm_take(pt, va, &flags);
+        if (!pa)
+            continue;
+        img_page_t *p = &pages[img->npages++];
+        p->va = va;
+        p->perm = flags & (PTE_R | PTE_W | PTE_X | PTE_U);
+        p->frame = (uint8_t *)pa;
+        if (flags & PTE_BORROWED)
+            p->kind = IMG_XIP;
+        else if (!(flags & PTE_W))
+            p->kind = IMG_SHARED;
+        else if (page_is_zero(p->frame)) {
+            kfree_page(p->frame);
+            p->frame = 0;
+            p->kind = IMG_ZERO;
+        } else
+            p->kind = IMG_DATA;
+    }
+    vm_free(pt);                // only the table pages: every frame was taken
+    return img;
+}
+
+// build a process's address space from a prepared image: no parsing, no
+// relocation, and the only bytes copied are the initialized writable data
+static pagetable_t image_launch(const image_t *img) {
+    pagetable_t pt = vm_create();
+    if (!pt)
+        return 0;
+    for (int i = 0; i < img->npages; i++) {
+        const img_page_t *p = &img->pages[i];
+        int r;
+        if (p->kind == IMG_XIP || p->kind == IMG_SHARED) {
+            r = vm_map(pt, p->va, (uint64_t)p->frame, PGSIZE, p->perm | PTE_BORROWED);
+        } else if (p->kind == IMG_ZERO) {
+            r = vm_alloc(pt, p->va, PGSIZE, p->perm);
+        } else {
+            void *page = kalloc_page();
+            if (!page) {
+                vm_free(pt);
+                return 0;
+            }
+            memcpy(page, p->frame, PGSIZE);
+            r = vm_map(pt, p->va, (uint64_t)page, PGSIZE, p->perm);
+            if (r != 0)
+                kfree_page(page);
+        }
+        if (r != 0) {
+            vm_free(pt);
+            return 0;
+        }
+    }
+    return pt;
+}
+
+static void image_unlink(image_t **pp) {
+    image_t *img = *pp;
+    *pp = img->next;
+    nimages--;
+    if (--img->refs == 0)
+        image_free(img);
+}
+
+// look the file up; on a hit the caller gets a reference
+static image_t *cache_lookup(uint32_t ino, uint64_t version) {
+    uint64_t s = spin_lock_irqsave(&img_lock);
+    image_t *found = 0;
+    for (image_t **pp = &images; *pp; ) {
+        image_t *img = *pp;
+        if (img->ino == ino && img->version != version) {
+            image_unlink(pp);   // the file has changed since
+            continue;
+        }
+        if (img->ino == ino) {
+            img->refs++;
+            img->last_used = ++lru_clock;
+            found = img;
+        }
+        pp = &img->next;
+    }
+    spin_unlock_irqrestore(&img_lock, s);
+    return found;
+}
 
-        uint8_t *dst = (uint8_t *)(uintptr_t)ph->p_vaddr;
-        mini_memcpy(dst, buf + ph->p_offset, (size_t)ph->p_filesz);
-        if (ph->p_memsz > ph->p_filesz) {
-            mini_memset(dst + ph->p_filesz, 0, (size_t)(ph->p_memsz - ph->p_filesz));
+// add a freshly prepared image (the caller keeps its reference), evicting
+// the least recently used entry when the cache is full
+static void cache_insert(image_t *img) {
+    uint64_t s = spin_lock_irqsave(&img_lock);
+    for (image_t *i = images; i; i = i->next) {
+        if (i->ino == img->ino && i->version == img->version) {
+            spin_unlock_irqrestore(&img_lock, s);
+            return;             // another hart got here first
         }
     }
+    if (nimages == IMG_CACHE_MAX) {
+        image_t **victim = &images;
+        for (image_t **pp = &images; *pp; pp = &(*pp)->next)
+            if ((*pp)->last_used < (*victim)->last_used)
+                victim = pp;
+        image_unlink(victim);
+    }
+    img->refs++;
+    img->last_used = ++lru_clock;
+    img->next = images;
+    images = img;
+    nimages++;
+    spin_unlock_irqrestore(&img_lock, s);
+}
 
-    out_pcb->entry = (uint64_t)ehdr->e_entry;
+void loader_image_put(struct image *img) {
+    uint64_t s = spin_lock_irqsave(&img_lock);
+    int last = --img->refs == 0;
+    spin_unlock_irqrestore(&img_lock, s);
+    if (last)
+        image_free(img);
+}
+
+static void copy_name(char *dst, const char *path) {
+    const char *base = path;
+    for (const char *p = path; *p; p++)
+        if (*p == '/' && p[1])
+            base = p + 1;
+    int i = 0;
+    while (base[i] && i < FS_NAME_MAX - 1) {
+        dst[i] = base[i];
+        i++;
+    }
+    dst[i] = '\0';
+}
+
+// the page a returning _start lands in (uexit.S)
+extern char uexit_start[];
+
+int load_program_from_fs(const char *path, pcb_t *out_pcb) {
+    PERF_SCOPE(PERF_LOAD);
+    uint64_t t0 = rdcycle();
+    uint32_t ino;
+    uint64_t version;
+    if (fs_identity(path, &ino, &version) != 0) {
+        kprintf(KERN_ERR "loader: file not found in FS\n");
+        return -1;
+    }
+
+    load_stats_t st = {0, 0, 0};
+    image_t *img = cache_lookup(ino, version);
+    int hit = img != 0;
+    if (!img) {
+        // the file is pinned while it is parsed: nobody can rewrite or
+        // remove it under us. it is cached under the identity of the
+        // contents actually read, which is newer than ino/version if the
+        // file changed since fs_identity()
+        const uint8_t *buf = NULL;
+        size_t size = 0;
+        if (fs_get_file(path, &buf, &size, &ino, &version) != 0) {
+            kprintf(KERN_ERR "loader: file not found in FS\n");
+            return -1;
+        }
+        img = image_prepare(buf, size, &st);
+        fs_put_file(ino);
+        if (!img)
+            return -1;
+        img->ino = ino;
+        img->version = version;
+        img->refs = 1;
+        copy_name(img->name, path);
+        cache_insert(img);
+    }
+
+    // user stack and exit stub. programs reach the console through system
+    // calls (syscall.c), so no device pages are mapped
+    pagetable_t pt = image_launch(img);
+    if (!pt || vm_alloc(pt, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_SIZE,
+                        PTE_R | PTE_W | PTE_U) != 0 ||
+        vm_map(pt, USER_EXIT_VA, (uint64_t)uexit_start, PGSIZE,
+               PTE_R | PTE_X | PTE_U | PTE_BORROWED) != 0) {
+        kprintf(KERN_ERR "loader: out of memory\n");
+        if (pt)
+            vm_free(pt);
+        loader_image_put(img);
+        return -1;
+    }
+
+    out_pcb->entry = img->entry;
+    out_pcb->pagetable = pt;
+    out_pcb->usp = USER_STACK_TOP;
+    out_pcb->image = img;
     if (tasks_alloc_stack(out_pcb) != 0) {
-        uart_puts("loader: no stack\n");
+        kprintf(KERN_ERR "loader: no stack\n");
+        vm_free(pt);
+        out_pcb->pagetable = 0;
+        out_pcb->image = 0;
+        loader_image_put(img);
         return -1;
     }
     out_pcb->state = TASK_RUNNABLE;
-    uart_puts("loader: program loaded successfully\n");
+
+    uint64_t cycles = rdcycle() - t0;
+    uint64_t s = spin_lock_irqsave(&img_lock);
+    img->launches++;
+    if (hit) {
+        img_stats.hits++;
+        img_stats.hit_cycles += cycles;
+    } else {
+        img_stats.misses++;
+        img_stats.miss_cycles += cycles;
+    }
+    spin_unlock_irqrestore(&img_lock, s);
+
+    if (hit)
+        kprintf("loader: program loaded from image cache (%lu cycles)\n",
+                (unsigned long)cycles);
+    else
+        kprintf("loader: program loaded successfully (%d pages in place, %d copied, "
+                "%d relocs, %lu cycles)\n", st.xip_pages, st.copied_pages, st.relocs,
+                (unsigned long)cycles);
     return 0;
 }
+
+static void put_avg(uint64_t cycles, uint64_t n) {
+    uart_put_dec(n ? (int)(cycles / n) : 0);
+}
+
+// printed from a snapshot: uart output may sleep, so not under img_lock
+void loader_cache_stats(void) {
+    static const char *const kinds[] = { "xip", "shared", "data", "zero" };
+    struct {
+        char name[FS_NAME_MAX];
+        uint32_t ino;
+        uint64_t launches;
+        int running;
+        int count[4];
+    } snap[IMG_CACHE_MAX];
+    int n = 0;
+
+    uint64_t s = spin_lock_irqsave(&img_lock);
+    uint64_t hits = img_stats.hits, misses = img_stats.misses;
+    uint64_t hit_cycles = img_stats.hit_cycles, miss_cycles = img_stats.miss_cycles;
+    for (image_t *img = images; img && n < IMG_CACHE_MAX; img = img->next, n++) {
+        memcpy(snap[n].name, img->name, FS_NAME_MAX);
+        snap[n].ino = img->ino;
+        snap[n].launches = img->launches;
+        snap[n].running = img->refs - 1;
+        memset(snap[n].count, 0, sizeof(snap[n].count));
+        for (int i = 0; i < img->npages; i++)
+            snap[n].count[img->pages[i].kind]++;
+    }
+    spin_unlock_irqrestore(&img_lock, s);
+
+    uart_puts("image cache: ");
+    uart_put_dec(n);
+    uart_puts("/");
+    uart_put_dec(IMG_CACHE_MAX);
+    uart_puts(" images, ");
+    uart_put_dec((int)hits);
+    uart_puts(" hits (avg ");
+    put_avg(hit_cycles, hits);
+    uart_puts(" cycles), ");
+    uart_put_dec((int)misses);
+    uart_puts(" misses (avg ");
+    put_avg(miss_cycles, misses);
+    uart_puts(" cycles)\n");
+    for (int i = 0; i < n; i++) {
+        uart_puts("  ");
+        uart_puts(snap[i].name);
+        uart_puts(": inode ");
+        uart_put_dec((int)snap[i].ino);
+        uart_puts(", ");
+        uart_put_dec((int)snap[i].launches);
+        uart_puts(" launches, ");
+        uart_put_dec(snap[i].running);
+        uart_puts(" running, pages");
+        for (int k = 0; k < 4; k++) {
+            uart_puts(" ");
+            uart_puts(kinds[k]);
+            uart_puts("=");
+            uart_put_dec(snap[i].count[k]);
+        }
+        uart_puts("\n");
+    }
+}
+
+void loader_cache_flush(void) {
+    uint64_t s = spin_lock_irqsave(&img_lock);
+    while (images)
+        image_unlink(&images);
+    img_stats.hits = img_stats.misses = 0;
+    img_stats.hit_cycles = img_stats.miss_cycles = 0;
+    spin_unlock_irqrestore(&img_lock, s);
+}
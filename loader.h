@@ -5,6 +5,19 @@
 #include <stdint.h>
 #include "tasks.h"
 
+//   loads an ELF file into a new address space (out_pcb gets the entry
+//   point, page table, user stack and a reference to the cached image).
+//   repeated loads of an unchanged file come from the image cache.
 int load_program_from_fs(const char *path, pcb_t *out_pcb);
 
-#endif
\ No newline at end of file
+//   drops a process's reference to its prepared image.
+//   called by: - tasks_release() in tasks.c
+void loader_image_put(struct image *img);
+
+//   hit/miss counts, average load latency in cycles and the cached images
+//   (shell command "imgcache"); flush empties the cache and resets the
+//   counters ("imgcache flush").
+void loader_cache_stats(void);
+void loader_cache_flush(void);
+
+#endif
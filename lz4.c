@@ -0,0 +1,72 @@
+// lz4.c — LZ4 block decoder
+// every length and offset is checked against the input and output bounds
+// before it is used, so a damaged block is an error, not a stray write.
+// literals and non-overlapping matches are single memcpy() calls; a match
+// that overlaps its own output (offset < length, a repeated pattern) is
+// copied in chunks that double in size, each one reading only bytes that
+// are already written.
+
+#include "lz4.h"
+#include "string.h"
+
+// a length field of 15 continues in the following bytes, 255 meaning "more"
+static int read_length(const uint8_t **ip, const uint8_t *iend, uint64_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend)
+            return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+long lz4_decompress(const uint8_t *src, uint64_t n, uint8_t *dst, uint64_t cap) {
+    const uint8_t *ip = src, *iend = src + n;
+    uint8_t *op = dst, *oend = dst + cap;
+
+    for (;;) {
+        if (ip >= iend)
+            return -1;
+        uint8_t token = *ip++;
+
+        uint64_t len = token >> 4;
+        if (len == 15 && read_length(&ip, iend, &len) != 0)
+            return -1;
+        if (len > (uint64_t)(iend - ip) || len > (uint64_t)(oend - op))
+            return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if (ip == iend)
+            break;                  // the last sequence has literals only
+
+        if (iend - ip < 2)
+            return -1;
+        uint64_t off = ip[0] | (uint64_t)ip[1] << 8;
+        ip += 2;
+        if (off == 0 || off > (uint64_t)(op - dst))
+            return -1;
+        len = (token & 15) + 4;
+        if ((token & 15) == 15 && read_length(&ip, iend, &len) != 0)
+            return -1;
+        if (len > (uint64_t)(oend - op))
+            return -1;
+
+        const uint8_t *m = op - off;
+        if (off >= len) {
+            memcpy(op, m, len);
+            op += len;
+        } else {
+            while (len) {
+                uint64_t chunk = (uint64_t)(op - m);
+                if (chunk > len)
+                    chunk = len;
+                memcpy(op, m, chunk);
+                op += chunk;
+                len -= chunk;
+            }
+        }
+    }
+    return (long)(op - dst);
+}
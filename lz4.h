@@ -0,0 +1,18 @@
+// lz4.h — LZ4 block decoder for the compressed built-in files
+// tools/fspack stores every file of the packed image (fsimg.h) that
+// compresses well as one LZ4 block (the standard block format, no frame):
+// a sequence is a token (literal length << 4 | match length - 4), the
+// literals, a 16-bit little-endian offset back into the output and the
+// match. fs.c inflates a file from it on first access.
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+
+//   decodes the block src[0..n) into dst, which has room for cap bytes.
+//   returns the number of bytes produced, or -1 if the block is corrupt
+//   or would not fit. never reads or writes outside the two buffers.
+long lz4_decompress(const uint8_t *src, uint64_t n, uint8_t *dst, uint64_t cap);
+
+#endif
@@ -1,7 +1,9 @@
 // this file contains the top-level `kernel_main()` function, which acts as the
 // C entry point for the kernel after low-level initialization (performed in
-// `start.S`). it initializes hardware interfaces (UART), core OS services
-// (filesystem and task manager), and then starts the interactive shell.
+// `start.S`). it initializes hardware interfaces (UART, trap vector), core OS
+// services (filesystem, task manager, scheduler), and then starts the
+// interactive shell. `secondary_main()` is where every other hart goes: it
+// waits for hart 0 to finish, then joins the scheduler.
 
 
 #include <stdint.h>
@@ -9,30 +11,109 @@
 #include "fs.h"
 #include "tasks.h"
 #include "shell.h"
+#include "trap.h"
+#include "plic.h"
+#include "sched.h"
+#include "string.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "vm.h"
+#include "timer.h"
+#include "riscv.h"
+#include "kprintf.h"
 
 //   the primary entry point for the OS kernel after boot. this function is
 //   called from the `_start` routine defined in `start.S`, once the CPU and
 //   stack have been initialized.
 //
-//   1. initialize the UART hardware so the system can print to the console.
+//   1. initialize the UART hardware (FIFOs, receive interrupt) so the system
+//      can print to the console.
 //   2. print a boot message over UART.
-//   3. initialize the in-memory filesystem (fs.c).
+//   3. set up the physical page allocator (kalloc.c), the slab caches on top
+//      of it (slab.c) and Sv39 paging (vm.c), then
+//      initialize the in-memory filesystem (fs.c).
 //   4. initialize the task subsystem (tasks.c).
 //   5. register the demo tasks, which can be run via the `run` shell command.
-//   6. announce completion and start the interactive command shell (shell.c).
-//   7. remain in an infinite loop after the shell is launched.
+//   6. install the trap vector, pick the memcpy/strlen variants for this
+//      hart (string.c), route the UART interrupt through the PLIC
+//      and start the preemptive scheduler; from here
+//      on this thread is the "shell" thread and gets time-sliced with the rest.
+//   7. release the other harts (see secondary_main) and give them a moment
+//      to come online.
+//   8. start klogd (kprintf.c), which copies the kernel log to the console,
+//      announce completion and start the interactive command shell (shell.c).
+//   9. remain in an infinite loop after the shell is launched.
+
+// how long hart 0 waits for the other harts to check in / come online
+#define SMP_WAIT_US 10000
+
+static volatile int harts_present = 1;
+static volatile uint8_t hart_here[MAX_HARTS];
+static volatile int smp_go;
+
+static void smp_boot(void) {
+    uint64_t deadline = timer_now() + timer_us_to_ticks(SMP_WAIT_US);
+    while (timer_now() < deadline)
+        ;
+    int n = harts_present;
+    __atomic_store_n(&smp_go, 1, __ATOMIC_RELEASE);
+    for (int i = 1; i < MAX_HARTS; i++)
+        if (hart_here[i])
+            timer_send_ipi(i);
+
+    deadline = timer_now() + timer_us_to_ticks(SMP_WAIT_US);
+    while (sched_ncpus() < n && timer_now() < deadline)
+        ;
+    kprintf("[SMP] %d of %d harts online\n", sched_ncpus(), n);
+}
 
 void kernel_main(void) {
     uart_init();
-    uart_puts("booting RISC-V OS demo kernel...\n");
+    kprintf("booting RISC-V OS demo kernel...\n");
 
+    kalloc_init();
+    kmem_init();
+    vm_init();
     fs_init();
     tasks_init();
     tasks_register_demo_programs();
+    klog_flush();               // no klogd yet: show the boot log so far
+
+    trap_init();
+    string_init();
+    plic_init();
+    sched_init();
+    sched_start();
+    smp_boot();
+    klog_start();
 
-    uart_puts("initialization complete. starting shell.\n");
+    kprintf("initialization complete. starting shell.\n");
 
     shell_run();  
 
     while (1) { }  
 }
+
+//   entry point for harts 1..MAX_HARTS-1 (start.S), on their own boot
+//   stacks. they must not touch any kernel state before hart 0 has built
+//   it, so they announce themselves and sleep in wfi with only the software
+//   interrupt enabled (mstatus.MIE stays off: the IPI just ends the wfi).
+//
+//   1. wait for smp_go, then acknowledge the IPI.
+//   2. per-hart setup: trap vector, PMP, vector unit.
+//   3. become this hart's idle thread in the scheduler (never returns).
+
+void secondary_main(void) {
+    uint64_t id = hart_id();
+    hart_here[id] = 1;
+    __atomic_fetch_add(&harts_present, 1, __ATOMIC_RELAXED);
+    csr_set(mie, MIE_MSIE);
+    while (!__atomic_load_n(&smp_go, __ATOMIC_ACQUIRE))
+        asm volatile("wfi");
+    timer_clear_ipi();
+
+    trap_init();
+    vm_init_hart();
+    string_init_hart();
+    sched_start_secondary();
+}
@@ -0,0 +1,45 @@
+// memlayout.h — physical and virtual memory layout of the RISC-V OS
+// ---------------------------------------------------------------
+// physical (QEMU virt, 128 MiB of RAM at 0x80000000):
+//   0x80000000  kernel image + 16 KiB boot stack per hart (linker.ld)
+//   stack_top   everything above is owned by the buddy allocator (kalloc.c):
+//               kernel stacks, page tables, user frames
+//   0x88000000  end of RAM
+//
+// virtual, per user process (Sv39, vm.c):
+//   0x00400000  USER_BASE: programs are linked at or above this
+//   0x3e000000  USER_EXIT_VA: exit stub _start returns into (uexit.S);
+//               program segments end below it (USER_SIZE)
+//   0x3f000000  RING_VA: syscall ring, once set up (ring.h)
+//   0x40000000  USER_STACK_TOP: user stack grows down from here
+//   0x80000000  kernel direct map of RAM (megapages, not user-accessible)
+// ---------------------------------------------------------------
+
+#ifndef MEMLAYOUT_H
+#define MEMLAYOUT_H
+
+#ifndef HOST_BUILD
+#define RAM_BASE        0x80000000UL
+#else
+// host build (riscv.h): "RAM" is wherever host/stubs.c managed to map it
+#include <stdint.h>
+extern uint64_t host_ram_base;
+#define RAM_BASE        host_ram_base
+#endif
+#define RAM_SIZE        (128UL * 1024 * 1024)
+#define RAM_END         (RAM_BASE + RAM_SIZE)
+
+// kernel stack of every thread (kernel threads run on it, user programs
+// trap onto it): one order-KSTACK_ORDER block from kalloc.c
+#define KSTACK_ORDER    2
+#define KSTACK_SIZE     (4096UL << KSTACK_ORDER)
+
+#define USER_BASE       0x00400000UL
+#define USER_STACK_TOP  0x40000000UL
+#define USER_STACK_SIZE (16 * 1024)
+#define USER_EXIT_VA    0x3e000000UL
+// what the loader lets segments cover: the kernel maps fixed pages from
+// USER_EXIT_VA up (exit stub, ring, stack)
+#define USER_SIZE       (USER_EXIT_VA - USER_BASE)
+
+#endif
@@ -0,0 +1,423 @@
+// mq.c — bounded lock-free message queues
+// ---------------------------------------------------------------
+// indexes are free-running 32-bit counters, masked on access.
+//
+// SPSC: the sender owns tail, the receiver owns head. each keeps a cached
+// copy of the other's index and only reloads it (one shared cache line
+// miss) when the cached view says the queue is full or empty. a batch is
+// published with one release store.
+//
+// MPSC: Vyukov's bounded queue. slot i carries seq: i + lap * size when it
+// is free for the sender of that position, one more once it holds a
+// message. a sender claims k slots at once with a CAS on tail after
+// checking that the last of them is free (the receiver frees slots in
+// order, so the ones before it are free too), fills them and bumps each
+// seq. the single receiver needs no atomics beyond the acquire on seq.
+//
+// blocking receive: the receiver sets recv_waiting, fences, and looks at
+// the queue once more before it sleeps; a sender fences after publishing
+// and wakes the receiver if the flag is set. one side always sees the
+// other, so no wakeup is lost, and senders only touch the lock when
+// somebody is actually asleep.
+// ---------------------------------------------------------------
+
+#include "mq.h"
+#include "sched.h"
+#include "tasks.h"
+#include "spinlock.h"
+#include "slab.h"
+#include "timer.h"
+#include "uart.h"
+#include "riscv.h"
+#include "kprintf.h"
+
+// empty polls of a blocking receive before it goes to sleep, when another
+// hart could be filling the queue in the meantime
+#define MQ_SPIN 200
+
+struct mq {
+    uint64_t *slots;
+    uint32_t *seq;              // MPSC only
+    uint32_t size;
+    uint32_t mask;
+    int kind;
+
+    // sender side
+    uint32_t tail __attribute__((aligned(64)));
+    uint32_t head_cache;        // SPSC: sender's last look at head
+
+    // receiver side
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t tail_cache;        // SPSC: receiver's last look at tail
+
+    // sleeping receiver; only written around a sleep
+    volatile int recv_waiting __attribute__((aligned(64)));
+    spinlock_t lock;
+};
+
+// -----------------------------------------------------------------------------
+// Queues
+// -----------------------------------------------------------------------------
+
+mq_t *mq_create(uint32_t entries, int kind) {
+    if (entries == 0 || entries > MQ_MAX_ENTRIES)
+        return 0;
+    uint32_t size = 1;
+    while (size < entries)
+        size <<= 1;
+    mq_t *q = (mq_t *)kzalloc(sizeof(mq_t));
+    if (!q)
+        return 0;
+    q->size = size;
+    q->mask = size - 1;
+    q->kind = kind;
+    q->slots = (uint64_t *)kmalloc(size * sizeof(uint64_t));
+    if (kind == MQ_MPSC) {
+        q->seq = (uint32_t *)kmalloc(size * sizeof(uint32_t));
+        if (q->seq)
+            for (uint32_t i = 0; i < size; i++)
+                q->seq[i] = i;
+    }
+    if (!q->slots || (kind == MQ_MPSC && !q->seq)) {
+        mq_destroy(q);
+        return 0;
+    }
+    return q;
+}
+
+void mq_destroy(mq_t *q) {
+    kfree(q->slots);
+    kfree(q->seq);
+    kfree(q);
+}
+
+// after publishing: wake the receiver if it is (about to be) asleep
+static void mq_notify(mq_t *q) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!q->recv_waiting)
+        return;
+    uint64_t s = spin_lock_irqsave(&q->lock);
+    sched_wakeup(q);
+    spin_unlock_irqrestore(&q->lock, s);
+}
+
+static int mq_empty(mq_t *q) {
+    uint32_t h = q->head;
+    if (q->kind == MQ_SPSC)
+        return __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == h;
+    return __atomic_load_n(&q->seq[h & q->mask], __ATOMIC_ACQUIRE) != h + 1;
+}
+
+// -----------------------------------------------------------------------------
+// SPSC
+// -----------------------------------------------------------------------------
+
+static uint32_t spsc_send(mq_t *q, const uint64_t *msgs, uint32_t n) {
+    uint32_t t = q->tail;
+    uint32_t room = q->size - (t - q->head_cache);
+    if (room < n) {
+        q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        room = q->size - (t - q->head_cache);
+    }
+    uint32_t k = n < room ? n : room;
+    for (uint32_t i = 0; i < k; i++)
+        q->slots[(t + i) & q->mask] = msgs[i];
+    __atomic_store_n(&q->tail, t + k, __ATOMIC_RELEASE);
+    return k;
+}
+
+static uint32_t spsc_recv(mq_t *q, uint64_t *msgs, uint32_t max) {
+    uint32_t h = q->head;
+    uint32_t avail = q->tail_cache - h;
+    if (avail < max) {
+        q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        avail = q->tail_cache - h;
+    }
+    uint32_t k = max < avail ? max : avail;
+    for (uint32_t i = 0; i < k; i++)
+        msgs[i] = q->slots[(h + i) & q->mask];
+    __atomic_store_n(&q->head, h + k, __ATOMIC_RELEASE);
+    return k;
+}
+
+// -----------------------------------------------------------------------------
+// MPSC
+// -----------------------------------------------------------------------------
+
+static uint32_t mpsc_send(mq_t *q, const uint64_t *msgs, uint32_t n) {
+    if (n > q->size)
+        n = q->size;
+    uint32_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    uint32_t k;
+    for (;;) {
+        int stale = 0;
+        k = n;
+        while (k) {
+            uint32_t last = pos + k - 1;
+            int32_t d = (int32_t)(__atomic_load_n(&q->seq[last & q->mask],
+                                                  __ATOMIC_ACQUIRE) - last);
+            if (d == 0)
+                break;          // the whole range is free
+            if (d > 0) {
+                stale = 1;      // another sender got there first
+                break;
+            }
+            k >>= 1;            // still full that far out: try fewer
+        }
+        if (stale) {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (!k)
+            return 0;
+        if (__atomic_compare_exchange_n(&q->tail, &pos, pos + k, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+        // pos now holds the current tail: look again from there
+    }
+    for (uint32_t i = 0; i < k; i++) {
+        uint32_t at = (pos + i) & q->mask;
+        q->slots[at] = msgs[i];
+        __atomic_store_n(&q->seq[at], pos + i + 1, __ATOMIC_RELEASE);
+    }
+    return k;
+}
+
+static uint32_t mpsc_recv(mq_t *q, uint64_t *msgs, uint32_t max) {
+    uint32_t h = q->head;
+    uint32_t k = 0;
+    while (k < max &&
+           __atomic_load_n(&q->seq[(h + k) & q->mask], __ATOMIC_ACQUIRE) == h + k + 1) {
+        msgs[k] = q->slots[(h + k) & q->mask];
+        k++;
+    }
+    // hand the slots to the senders of the next lap
+    for (uint32_t i = 0; i < k; i++)
+        __atomic_store_n(&q->seq[(h + i) & q->mask], h + i + q->size, __ATOMIC_RELEASE);
+    q->head = h + k;
+    return k;
+}
+
+// -----------------------------------------------------------------------------
+// Send and receive
+// -----------------------------------------------------------------------------
+
+uint32_t mq_send(mq_t *q, const uint64_t *msgs, uint32_t n) {
+    uint32_t k = q->kind == MQ_SPSC ? spsc_send(q, msgs, n) : mpsc_send(q, msgs, n);
+    if (k)
+        mq_notify(q);
+    return k;
+}
+
+static uint32_t mq_try_recv(mq_t *q, uint64_t *msgs, uint32_t max) {
+    return q->kind == MQ_SPSC ? spsc_recv(q, msgs, max) : mpsc_recv(q, msgs, max);
+}
+
+uint32_t mq_recv(mq_t *q, uint64_t *msgs, uint32_t max, int wait) {
+    if (!wait)
+        return max ? mq_try_recv(q, msgs, max) : 0;
+    return mq_recv_until(q, msgs, max, SCHED_NO_DEADLINE);
+}
+
+uint32_t mq_recv_until(mq_t *q, uint64_t *msgs, uint32_t max, uint64_t deadline) {
+    if (max == 0)
+        return 0;
+    uint32_t k = mq_try_recv(q, msgs, max);
+    if (k)
+        return k;
+    if (sched_ncpus() > 1) {
+        for (int i = 0; i < MQ_SPIN; i++) {
+            if (!mq_empty(q))
+                return mq_try_recv(q, msgs, max);
+            asm volatile("nop");
+        }
+    }
+    for (;;) {
+        uint64_t s = spin_lock_irqsave(&q->lock);
+        q->recv_waiting = 1;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int late = 0;
+        if (mq_empty(q))
+            late = sched_sleep_until(q, &q->lock, deadline);
+        q->recv_waiting = 0;
+        spin_unlock_irqrestore(&q->lock, s);
+        if ((k = mq_try_recv(q, msgs, max)) != 0 || late)
+            return k;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+#define IPC_BATCH_MAX 32
+#define IPC_WARMUP    16
+#define IPC_SENDERS   3         // MPSC run: senders on harts 1..3
+
+typedef struct ipc_run {
+    mq_t *to;                   // driver -> partner
+    mq_t *back;                 // ping-pong replies
+    uint32_t iters;             // messages per sender
+    uint32_t batch;
+    uint32_t total;             // messages the receiver waits for
+    volatile int abort;         // a thread did not start: stop early
+    uint64_t cycles;            // ping-pong: round trips, on the ping hart
+    uint64_t ticks;             // bulk: first to last message, mtime
+    uint32_t out_of_order;      // SPSC bulk: messages not in sequence
+} ipc_run_t;
+
+static void ping_thread(ipc_run_t *r) {
+    uint64_t c0 = 0;
+    for (uint32_t i = 0; i < r->iters + IPC_WARMUP && !r->abort; i++) {
+        if (i == IPC_WARMUP)
+            c0 = rdcycle();
+        mq_send1(r->to, i);
+        mq_recv1(r->back);
+    }
+    r->cycles = rdcycle() - c0;
+}
+
+static void pong_thread(ipc_run_t *r) {
+    for (uint32_t i = 0; i < r->iters + IPC_WARMUP; i++) {
+        uint64_t m = mq_recv1(r->to);
+        if (r->abort)
+            return;
+        while (mq_send1(r->back, m) != 0)
+            sched_yield();
+    }
+}
+
+static void sender_thread(ipc_run_t *r) {
+    uint64_t buf[IPC_BATCH_MAX];
+    for (uint32_t sent = 0; sent < r->iters; ) {
+        uint32_t k = r->iters - sent < r->batch ? r->iters - sent : r->batch;
+        for (uint32_t i = 0; i < k; i++)
+            buf[i] = sent + i;
+        uint32_t got = mq_send(r->to, buf, k);
+        if (!got) {
+            if (r->abort)
+                return;
+            sched_yield();
+        }
+        sent += got;
+    }
+}
+
+static void receiver_thread(ipc_run_t *r) {
+    uint64_t buf[IPC_BATCH_MAX];
+    uint64_t t0 = 0;
+    uint32_t got = 0;
+    while (got < r->total) {
+        uint32_t k = mq_recv(r->to, buf, r->batch, 1);
+        if (r->abort)
+            return;
+        if (!got)
+            t0 = timer_now();
+        for (uint32_t i = 0; i < k; i++)
+            if (buf[i] != got + i)
+                r->out_of_order++;
+        got += k;
+    }
+    r->ticks = timer_now() - t0;
+}
+
+static int ipc_start(void (*fn)(ipc_run_t *), ipc_run_t *r, int hart,
+                     task_group_t *g) {
+    pcb_t pcb = {0};
+    pcb.name = "ipc";
+    pcb.entry = (uint64_t)fn;
+    pcb.pinned = hart + 1;
+    tasks_group_add(g, &pcb);
+    if (tasks_spawn_pcb(&pcb, (uint64_t)r) >= 0)
+        return 0;
+    // the partner may already be waiting for us: let it go
+    r->abort = 1;
+    mq_send1(r->to, 0);
+    return -1;
+}
+
+static void ipc_report(const char *what, const char *fmt, uint64_t a, uint64_t b) {
+    char line[96];
+    ksnprintf(line, sizeof(line), fmt, a, b);
+    uart_puts("  ");
+    uart_puts(what);
+    uart_puts(line);
+}
+
+// one message there and back, `iters` times, between harts a and b
+static void bench_pingpong(const char *what, uint32_t iters, int a, int b) {
+    ipc_run_t r = {0};
+    r.iters = iters;
+    r.to = mq_create(64, MQ_SPSC);
+    r.back = mq_create(64, MQ_SPSC);
+    task_group_t g = {0};
+    if (r.to && r.back &&
+        ipc_start(pong_thread, &r, b, &g) == 0 &&
+        ipc_start(ping_thread, &r, a, &g) == 0) {
+        tasks_group_wait(&g);
+        ipc_report(what, "%lu cycles round trip\n", r.cycles / iters, 0);
+    } else {
+        tasks_group_wait(&g);
+        uart_puts("  ipc: out of memory or pcb slots\n");
+    }
+    if (r.to) mq_destroy(r.to);
+    if (r.back) mq_destroy(r.back);
+}
+
+// `senders` threads on harts first_sender.. stream iters messages each
+// to a receiver on hart `recv_hart`, `batch` per call
+static void bench_bulk(const char *what, uint32_t iters, int kind, uint32_t batch,
+                       int recv_hart, int first_sender, int senders) {
+    ipc_run_t r = {0};
+    r.iters = iters;
+    r.batch = batch;
+    r.total = iters * (uint32_t)senders;
+    r.to = mq_create(1024, kind);
+    task_group_t g = {0};
+    int ok = r.to && ipc_start(receiver_thread, &r, recv_hart, &g) == 0;
+    for (int i = 0; ok && i < senders; i++)
+        ok = ipc_start(sender_thread, &r, first_sender + i, &g) == 0;
+    tasks_group_wait(&g);
+    if (ok) {
+        uint64_t ns = r.ticks * (1000000000UL / TIMER_HZ);
+        ipc_report(what, "%lu ns/msg, %lu k msgs/s\n", ns / r.total,
+                   ns ? (uint64_t)r.total * 1000000UL / ns : 0);
+        if (kind == MQ_SPSC && r.out_of_order)
+            uart_puts("  ipc: messages arrived out of order!\n");
+    } else {
+        uart_puts("  ipc: out of memory or pcb slots\n");
+    }
+    if (r.to) mq_destroy(r.to);
+}
+
+//   ping-pong: two SPSC queues, one each way; the round trip includes two
+//   sleeps and wakeups (on one hart, two context switches). bulk: a stream
+//   of numbered messages through one queue, one at a time and in batches
+//   of 32, and several senders into an MPSC queue. threads are pinned
+//   (pcb->pinned) so "one hart" and "two harts" mean what they say.
+void mq_bench(int iters) {
+    if (iters <= 0) iters = 10000;
+    uint32_t n = (uint32_t)iters;
+    int harts = sched_ncpus();
+
+    uart_puts("ipc benchmark (");
+    uart_put_dec(iters);
+    uart_puts(" round trips, ");
+    uart_put_dec(iters * 10);
+    uart_puts(" messages per bulk run)\n");
+
+    bench_pingpong("ping-pong, one hart:        ", n, 0, 0);
+    if (harts > 1)
+        bench_pingpong("ping-pong, two harts:       ", n, 0, 1);
+    bench_bulk("spsc, one hart, batch 1:    ", n * 10, MQ_SPSC, 1, 0, 0, 1);
+    bench_bulk("spsc, one hart, batch 32:   ", n * 10, MQ_SPSC, 32, 0, 0, 1);
+    if (harts > 1) {
+        bench_bulk("spsc, two harts, batch 1:   ", n * 10, MQ_SPSC, 1, 0, 1, 1);
+        bench_bulk("spsc, two harts, batch 32:  ", n * 10, MQ_SPSC, 32, 0, 1, 1);
+        int senders = harts - 1 < IPC_SENDERS ? harts - 1 : IPC_SENDERS;
+        char what[40];
+        ksnprintf(what, sizeof(what), "mpsc, %d sender%s, batch 32: ",
+                  senders, senders > 1 ? "s" : "");
+        bench_bulk(what, n * 10 / (uint32_t)senders, MQ_MPSC, 32, 0, 1, senders);
+    }
+}
@@ -0,0 +1,65 @@
+// mq.h — bounded lock-free message queues between kernel threads
+// a queue carries 64-bit messages (a value, or a pointer the two sides
+// agree on) through a power-of-two ring. sending and receiving take no
+// lock; only a receiver that goes to sleep and the sender that wakes it
+// touch the queue's spinlock.
+//
+//   MQ_SPSC  one sender thread, one receiver thread. the fast path: each
+//            side owns one index and keeps a cached copy of the other's.
+//   MQ_MPSC  any number of senders, one receiver (a service thread). slots
+//            carry sequence numbers, senders claim slots with one CAS.
+//
+// the sender-owned and receiver-owned indexes live on separate cache lines,
+// so the two sides only share a line when one of them has to look at the
+// other's progress. both calls take arrays: a batch costs one index
+// update and one wakeup check however many messages it carries.
+
+#ifndef MQ_H
+#define MQ_H
+
+#include <stdint.h>
+
+#define MQ_SPSC 0
+#define MQ_MPSC 1
+
+// largest queue, in messages
+#define MQ_MAX_ENTRIES 4096
+
+typedef struct mq mq_t;
+
+//   a queue with room for `entries` messages (rounded up to a power of
+//   two, at most MQ_MAX_ENTRIES). 0 if out of memory.
+mq_t *mq_create(uint32_t entries, int kind);
+
+//   frees the queue. nobody may be using it any more.
+void mq_destroy(mq_t *q);
+
+//   queues up to n messages without blocking; returns how many fit (0 if
+//   the queue is full). wakes the receiver if it is asleep.
+uint32_t mq_send(mq_t *q, const uint64_t *msgs, uint32_t n);
+
+//   takes up to max messages, oldest first. with wait set it blocks until
+//   at least one is there, spinning briefly first when other harts could
+//   be sending; otherwise it returns 0 on an empty queue.
+uint32_t mq_recv(mq_t *q, uint64_t *msgs, uint32_t max, int wait);
+
+//   mq_recv() with wait set that gives up at mtime `deadline` (sched.h):
+//   0 if nothing came by then.
+uint32_t mq_recv_until(mq_t *q, uint64_t *msgs, uint32_t max, uint64_t deadline);
+
+//   one message each way.
+static inline int mq_send1(mq_t *q, uint64_t msg) {
+    return mq_send(q, &msg, 1) ? 0 : -1;
+}
+
+static inline uint64_t mq_recv1(mq_t *q) {
+    uint64_t msg;
+    mq_recv(q, &msg, 1, 1);
+    return msg;
+}
+
+//   ping-pong latency and bulk throughput between two threads, on one hart
+//   and across harts (shell command "bench ipc [n]").
+void mq_bench(int iters);
+
+#endif
@@ -0,0 +1,74 @@
+// perf.c — storage and reporting for the probes in perf.h
+
+#include "perf.h"
+#include "uart.h"
+#include "string.h"
+
+#if PERF
+
+static const char *const perf_names[PERF_NPROBES] = {
+    [PERF_LOAD]       = "loader.load",
+    [PERF_FS_LOOKUP]  = "fs.lookup",
+    [PERF_UART_TX]    = "uart.tx",
+    [PERF_UART_BYTES] = "uart.bytes",
+    [PERF_TASK_RUN]   = "task.run",
+    [PERF_IDLE]       = "sched.idle",
+    [PERF_PIPE_DIRECT] = "pipe.direct",
+    [PERF_PIPE_RING]  = "pipe.ring",
+    [PERF_FS_INFLATE] = "fs.inflate",
+};
+
+perf_hart_t perf_harts[MAX_HARTS];
+
+static void put_padded(const char *s, int width) {
+    uart_puts(s);
+    for (int n = strlen(s); n < width; n++)
+        uart_putc(' ');
+}
+
+// right-aligned in a column of the given width
+static void put_u64_col(uint64_t v, int width) {
+    int digits = 1;
+    for (uint64_t t = v; t >= 10; t /= 10)
+        digits++;
+    while (width-- > digits)
+        uart_putc(' ');
+    uart_put_u64(v);
+}
+
+void perf_dump(void) {
+    uart_puts("probe                count        cycles       avg       max\n");
+    for (int i = 0; i < PERF_NPROBES; i++) {
+        perf_probe_t sum = {0, 0, 0};
+        for (int h = 0; h < MAX_HARTS; h++) {
+            const perf_probe_t *p = &perf_harts[h].p[i];
+            sum.count += p->count;
+            sum.cycles += p->cycles;
+            if (p->max > sum.max)
+                sum.max = p->max;
+        }
+        put_padded(perf_names[i], 14);
+        put_u64_col(sum.count, 12);
+        if (sum.cycles) {
+            put_u64_col(sum.cycles, 14);
+            put_u64_col(sum.cycles / sum.count, 10);
+            put_u64_col(sum.max, 10);
+        }
+        uart_puts("\n");
+    }
+}
+
+void perf_reset(void) {
+    memset(perf_harts, 0, sizeof(perf_harts));
+}
+
+#else
+
+void perf_dump(void) {
+    uart_puts("perf: probes compiled out (built with PERF=0)\n");
+}
+
+void perf_reset(void) {
+}
+
+#endif
@@ -0,0 +1,96 @@
+// perf.h — kernel instrumentation: scoped cycle timers and event counters
+// a probe is a slot with a count, a cycle total and the largest single
+// sample. code marks what it wants measured:
+//
+//   PERF_SCOPE(PERF_FS_LOOKUP);   time from here to the end of the block
+//   PERF_COUNT(PERF_UART_BYTES, n); count n events, no timing
+//   PERF_ADD(PERF_TASK_RUN, c);   one sample of c cycles measured by hand
+//
+// the counters are per hart, so recording never bounces a cache line
+// between harts; `perf` in the shell adds them up. build with -DPERF=0
+// (make PERF=0) and every probe compiles to nothing.
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include "riscv.h"
+
+#ifndef PERF
+#define PERF 1
+#endif
+
+// probes. keep perf_names[] in perf.c in the same order.
+#define PERF_LOAD        0   // load_program_from_fs(): lookup to ready pcb
+#define PERF_FS_LOOKUP   1   // namei(): one path walk
+#define PERF_UART_TX     2   // uart_puts()/uart_write(), waiting for room included
+#define PERF_UART_BYTES  3   // event: bytes queued for the UART
+#define PERF_TASK_RUN    4   // a thread's stay on a hart, switch in to switch out
+#define PERF_IDLE        5   // a hart's stay in its idle thread
+#define PERF_PIPE_DIRECT 6   // event: pipe bytes copied straight from writer to reader
+#define PERF_PIPE_RING   7   // event: pipe bytes that were buffered in the ring
+#define PERF_FS_INFLATE  8   // fs.c: first access to a compressed built-in file
+#define PERF_NPROBES     9
+
+typedef struct {
+    uint64_t count;
+    uint64_t cycles;
+    uint64_t max;
+} perf_probe_t;
+
+#if PERF
+
+typedef struct {
+    perf_probe_t p[PERF_NPROBES];
+} __attribute__((aligned(64))) perf_hart_t;
+
+extern perf_hart_t perf_harts[MAX_HARTS];
+
+// a thread may be preempted and moved between reading tp and the update,
+// and a trap on this hart may record too, so the adds are atomic. they
+// almost never contend: the line normally belongs to this hart.
+static inline void perf_add(int id, uint64_t cycles) {
+    perf_probe_t *p = &perf_harts[hart_id()].p[id];
+    __atomic_fetch_add(&p->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->cycles, cycles, __ATOMIC_RELAXED);
+    if (cycles > p->max)
+        p->max = cycles;    // racy, but only ever loses a sample
+}
+
+static inline void perf_count(int id, uint64_t n) {
+    __atomic_fetch_add(&perf_harts[hart_id()].p[id].count, n, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    int id;
+    uint64_t t0;
+} perf_scope_t;
+
+static inline void perf_scope_end(perf_scope_t *s) {
+    perf_add(s->id, rdcycle() - s->t0);
+}
+
+#define PERF_CAT2(a, b) a##b
+#define PERF_CAT(a, b)  PERF_CAT2(a, b)
+#define PERF_SCOPE(id) \
+    perf_scope_t PERF_CAT(perf_scope_, __LINE__) \
+        __attribute__((cleanup(perf_scope_end))) = { (id), rdcycle() }
+#define PERF_COUNT(id, n)   perf_count((id), (n))
+#define PERF_ADD(id, c)     perf_add((id), (c))
+
+#else
+
+#define PERF_SCOPE(id)      do { } while (0)
+#define PERF_COUNT(id, n)   do { (void)(n); } while (0)
+#define PERF_ADD(id, c)     do { (void)(c); } while (0)
+
+#endif
+
+//   prints every probe summed over all harts: count, total and average
+//   cycles and the largest sample (shell command "perf").
+void perf_dump(void);
+
+//   zeroes all probes ("perf reset").
+void perf_reset(void);
+
+#endif
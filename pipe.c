@@ -0,0 +1,239 @@
+// pipe.c — in-kernel pipes
+// ---------------------------------------------------------------
+// the pipe owns a PIPE_SIZE ring indexed by free-running 32-bit counters,
+// but bytes only go through it when the two ends are out of step:
+//
+//   reader waiting  a reader that finds the pipe empty parks its
+//                   destination in rd_wait; the next writer copies straight
+//                   into it and wakes it.
+//   writer waiting  a writer that finds the ring full parks the rest of its
+//                   source in wr_wait; readers drain the ring, then copy
+//                   straight out of the writer's buffer.
+//
+// so a byte is copied once when one side is already waiting and twice only
+// if it had to be buffered while the writer got ahead. user memory is
+// reached through its physical address (the kernel runs untranslated), so
+// either side of a copy can be a kernel buffer or another address space.
+// the pipe.direct / pipe.ring counters (perf.h) show the split.
+//
+// all of it runs under one spinlock per pipe; sleepers wait on &rpos
+// (readers) and &wpos (writers).
+// ---------------------------------------------------------------
+
+#include "pipe.h"
+#include "spinlock.h"
+#include "sched.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "string.h"
+#include "perf.h"
+
+// a blocked end's half of a direct copy: mem+off, len bytes in all
+typedef struct pipe_waiter {
+    const pipe_mem_t *mem;
+    uint64_t off;
+    uint64_t len;
+} pipe_waiter_t;
+
+struct pipe {
+    spinlock_t lock;
+    uint8_t *buf;
+    uint32_t rpos, wpos;        // wpos - rpos bytes are in the ring
+    int readers, writers;       // open ends
+    pipe_waiter_t *rd_wait;     // reader parked on an empty pipe
+    pipe_waiter_t *wr_wait;     // writer parked on a full ring
+};
+
+// -----------------------------------------------------------------------------
+// Copies
+// -----------------------------------------------------------------------------
+
+// kernel address of m+off, with *len cut down so the range stays inside
+// one page of a user mapping
+static uint8_t *mem_at(const pipe_mem_t *m, uint64_t off, uint64_t *len) {
+    uint64_t a = m->addr + off;
+    if (!m->pt)
+        return (uint8_t *)a;
+    uint64_t room = PGSIZE - (a & (PGSIZE - 1));
+    if (*len > room)
+        *len = room;
+    return (uint8_t *)vm_translate(m->pt, a);
+}
+
+static void mem_copy(const pipe_mem_t *dst, uint64_t doff,
+                     const pipe_mem_t *src, uint64_t soff, uint64_t n) {
+    while (n) {
+        uint64_t k = n, kd = n;
+        uint8_t *s = mem_at(src, soff, &k);
+        uint8_t *d = mem_at(dst, doff, &kd);
+        if (kd < k)
+            k = kd;
+        memcpy(d, s, k);
+        soff += k;
+        doff += k;
+        n -= k;
+    }
+}
+
+// ring <-> mem, split where the ring wraps
+static void ring_put(pipe_t *p, const pipe_mem_t *src, uint64_t off, uint64_t n) {
+    pipe_mem_t ring = { 0, (uint64_t)p->buf };
+    uint64_t at = p->wpos & (PIPE_SIZE - 1);
+    uint64_t first = n < PIPE_SIZE - at ? n : PIPE_SIZE - at;
+    mem_copy(&ring, at, src, off, first);
+    mem_copy(&ring, 0, src, off + first, n - first);
+    p->wpos += (uint32_t)n;
+}
+
+static void ring_get(pipe_t *p, const pipe_mem_t *dst, uint64_t n) {
+    pipe_mem_t ring = { 0, (uint64_t)p->buf };
+    uint64_t at = p->rpos & (PIPE_SIZE - 1);
+    uint64_t first = n < PIPE_SIZE - at ? n : PIPE_SIZE - at;
+    mem_copy(dst, 0, &ring, at, first);
+    mem_copy(dst, first, &ring, 0, n - first);
+    p->rpos += (uint32_t)n;
+}
+
+// -----------------------------------------------------------------------------
+// Pipe objects
+// -----------------------------------------------------------------------------
+
+pipe_t *pipe_create(void) {
+    pipe_t *p = (pipe_t *)kzalloc(sizeof(pipe_t));
+    if (!p)
+        return 0;
+    p->buf = (uint8_t *)kalloc_pages(PIPE_ORDER);
+    if (!p->buf) {
+        kfree(p);
+        return 0;
+    }
+    p->readers = 1;
+    p->writers = 1;
+    return p;
+}
+
+void pipe_close(pipe_t *p, int writer) {
+    uint64_t s = spin_lock_irqsave(&p->lock);
+    if (writer)
+        p->writers--;
+    else
+        p->readers--;
+    // the other side may be waiting for something that can now never come
+    sched_wakeup(&p->rpos);
+    sched_wakeup(&p->wpos);
+    int dead = !p->readers && !p->writers;
+    spin_unlock_irqrestore(&p->lock, s);
+    if (dead) {
+        kfree_pages(p->buf, PIPE_ORDER);
+        kfree(p);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Read and write
+// -----------------------------------------------------------------------------
+
+int64_t pipe_read(pipe_t *p, const pipe_mem_t *dst, uint64_t n, int nonblock) {
+    if (n == 0)
+        return 0;
+    int64_t ret;
+    uint64_t s = spin_lock_irqsave(&p->lock);
+    for (;;) {
+        uint32_t used = p->wpos - p->rpos;
+        if (used) {
+            // buffered bytes are older than anything a writer still holds
+            uint64_t k = n < used ? n : used;
+            ring_get(p, dst, k);
+            PERF_COUNT(PERF_PIPE_RING, k);
+            sched_wakeup(&p->wpos);
+            ret = (int64_t)k;
+            break;
+        }
+        pipe_waiter_t *w = p->wr_wait;
+        if (w) {
+            uint64_t k = w->len - w->off;
+            if (k > n)
+                k = n;
+            mem_copy(dst, 0, w->mem, w->off, k);
+            PERF_COUNT(PERF_PIPE_DIRECT, k);
+            w->off += k;
+            if (w->off == w->len) {
+                p->wr_wait = 0;
+                sched_wakeup(&p->wpos);
+            }
+            ret = (int64_t)k;
+            break;
+        }
+        if (!p->writers) {
+            ret = 0;
+            break;
+        }
+        if (nonblock) {
+            ret = PIPE_AGAIN;
+            break;
+        }
+        if (p->rd_wait) {
+            sched_sleep(&p->rpos, &p->lock);    // another reader is parked
+            continue;
+        }
+        pipe_waiter_t me = { dst, 0, n };
+        p->rd_wait = &me;
+        sched_sleep(&p->rpos, &p->lock);
+        if (p->rd_wait == &me)
+            p->rd_wait = 0;
+        if (me.off) {
+            ret = (int64_t)me.off;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&p->lock, s);
+    return ret;
+}
+
+int64_t pipe_write(pipe_t *p, const pipe_mem_t *src, uint64_t n, int nonblock) {
+    uint64_t done = 0;
+    uint64_t s = spin_lock_irqsave(&p->lock);
+    while (done < n && p->readers) {
+        uint32_t used = p->wpos - p->rpos;
+        pipe_waiter_t *r = p->rd_wait;
+        if (!used && r) {
+            uint64_t k = n - done < r->len ? n - done : r->len;
+            mem_copy(r->mem, 0, src, done, k);
+            PERF_COUNT(PERF_PIPE_DIRECT, k);
+            r->off = k;
+            p->rd_wait = 0;
+            sched_wakeup(&p->rpos);
+            done += k;
+            continue;
+        }
+        if (!p->wr_wait && used < PIPE_SIZE) {
+            uint64_t k = n - done < PIPE_SIZE - used ? n - done : PIPE_SIZE - used;
+            ring_put(p, src, done, k);
+            sched_wakeup(&p->rpos);
+            done += k;
+            continue;
+        }
+        if (nonblock)
+            break;
+        if (p->wr_wait) {
+            sched_sleep(&p->wpos, &p->lock);    // another writer is parked
+            continue;
+        }
+        // full: leave the rest where it is for the readers to take
+        pipe_waiter_t me = { src, done, n };
+        p->wr_wait = &me;
+        sched_wakeup(&p->rpos);
+        while (p->wr_wait == &me && p->readers)
+            sched_sleep(&p->wpos, &p->lock);
+        if (p->wr_wait == &me)
+            p->wr_wait = 0;
+        done = me.off;
+    }
+    int readers = p->readers;
+    spin_unlock_irqrestore(&p->lock, s);
+    if (done)
+        return (int64_t)done;
+    if (n && !readers)
+        return PIPE_BROKEN;
+    return nonblock && n ? PIPE_AGAIN : 0;
+}
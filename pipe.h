@@ -0,0 +1,50 @@
+// pipe.h — in-kernel pipes between threads and programs
+// a pipe is a fixed-size byte ring with a read end and a write end. the
+// shell connects pipeline stages with them ("cat notes.txt | wc.elf"), each
+// end being a handle (handle.h) in a task's stdin/stdout slot.
+//
+// readers and writers block when the ring is empty/full unless they ask
+// not to. closing the last write end gives readers end of file; writing
+// with no read end left fails.
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stdint.h>
+#include "vm.h"
+
+// ring size, a power of two (kalloc order PIPE_ORDER)
+#define PIPE_ORDER  2
+#define PIPE_SIZE   (4096 << PIPE_ORDER)
+
+// pipe_read/pipe_write results besides a byte count
+#define PIPE_BROKEN (-1)    // write: nobody can ever read it
+#define PIPE_AGAIN  (-2)    // nonblocking: nothing could be moved right now
+
+// one side of a transfer: kernel memory (pt == 0) or a range of a user
+// address space that has already been checked with vm_user_ok()
+typedef struct pipe_mem {
+    pagetable_t pt;
+    uint64_t addr;
+} pipe_mem_t;
+
+typedef struct pipe pipe_t;
+
+//   a pipe with one reader and one writer reference. 0 if out of memory.
+pipe_t *pipe_create(void);
+
+//   moves up to n bytes out of the pipe into dst. blocks while it is empty
+//   and a writer is left (unless nonblock). returns the byte count, 0 at
+//   end of file, or PIPE_AGAIN.
+int64_t pipe_read(pipe_t *p, const pipe_mem_t *dst, uint64_t n, int nonblock);
+
+//   moves all n bytes from src into the pipe, blocking while it is full
+//   (unless nonblock: then as much as fits). returns the byte count,
+//   PIPE_AGAIN or PIPE_BROKEN.
+int64_t pipe_write(pipe_t *p, const pipe_mem_t *src, uint64_t n, int nonblock);
+
+//   drop a read or write reference; the pipe is freed with the last one.
+//   called by: - handle_close() in handle.c
+void pipe_close(pipe_t *p, int writer);
+
+#endif
@@ -0,0 +1,38 @@
+// plic.c — PLIC driver for the RISC-V OS
+// each hart has an M-mode and an S-mode context; on QEMU virt hart N's
+// M-mode context is number 2*N. we only run M-mode, so everything here
+// talks to context 0 (hart 0, M-mode).
+
+#include "plic.h"
+#include "riscv.h"
+
+#define PLIC_BASE           0x0c000000UL
+#define PLIC_PRIORITY(irq)  (PLIC_BASE + 4 * (irq))
+#define PLIC_ENABLE(ctx)    (PLIC_BASE + 0x2000 + 0x80 * (ctx))
+#define PLIC_THRESHOLD(ctx) (PLIC_BASE + 0x200000 + 0x1000 * (ctx))
+#define PLIC_CLAIM(ctx)     (PLIC_THRESHOLD(ctx) + 4)
+
+#define PLIC_CTX 0
+
+static inline void plic_write(uintptr_t addr, uint32_t v) {
+    *(volatile uint32_t *)addr = v;
+}
+
+static inline uint32_t plic_read(uintptr_t addr) {
+    return *(volatile uint32_t *)addr;
+}
+
+void plic_init(void) {
+    plic_write(PLIC_PRIORITY(UART0_IRQ), 1);
+    plic_write(PLIC_ENABLE(PLIC_CTX), 1U << UART0_IRQ);
+    plic_write(PLIC_THRESHOLD(PLIC_CTX), 0);
+    csr_set(mie, MIE_MEIE);
+}
+
+uint32_t plic_claim(void) {
+    return plic_read(PLIC_CLAIM(PLIC_CTX));
+}
+
+void plic_complete(uint32_t irq) {
+    plic_write(PLIC_CLAIM(PLIC_CTX), irq);
+}
@@ -0,0 +1,23 @@
+// plic.h — platform-level interrupt controller
+// routes device interrupts (just the UART for now) to hart 0's M-mode
+// context on the QEMU virt board.
+
+#ifndef PLIC_H
+#define PLIC_H
+
+#include <stdint.h>
+
+// device interrupt sources on QEMU virt
+#define UART0_IRQ 10
+
+//   sets source priorities, enables them for hart 0 M-mode and turns on
+//   machine external interrupts (mie.MEIE).
+//   called by: - kernel_main() in main.c
+void plic_init(void);
+
+//   claims the highest-priority pending source (0 if none) and signals
+//   completion once the device has been serviced.
+uint32_t plic_claim(void);
+void plic_complete(uint32_t irq);
+
+#endif
@@ -0,0 +1,151 @@
+// prof.c — sampling profiler (see prof.h)
+// ---------------------------------------------------------------
+// a sample is taken in the timer interrupt with interrupts off, so each
+// hart appends to its own buffer without a lock. the count is published
+// with a release store after the entry is written. when a buffer is full
+// new samples are dropped (and counted): the profile covers the start of
+// the run instead of a random mix.
+//
+// dump format, one line per sample:
+//   S <hart> <pid> <k|u> <pc> <thread name>
+// framed by "# prof begin ..." and "# prof end ..." lines so the host
+// script can find it in a console log.
+// ---------------------------------------------------------------
+
+#include "prof.h"
+#include "sched.h"
+#include "tasks.h"
+#include "timer.h"
+#include "kalloc.h"
+#include "uart.h"
+#include "riscv.h"
+
+#define PROF_ORDER      4       // 64 KiB of samples per hart
+#define PROF_HZ_DEFAULT 1000
+#define PROF_HZ_MAX     100000
+
+typedef struct {
+    uint64_t pc;
+    const char *name;           // thread names are string literals
+    uint32_t pid;
+    uint8_t hart;
+    uint8_t user;
+    uint16_t pad;
+} prof_sample_t;
+
+typedef struct {
+    prof_sample_t *buf;
+    uint32_t cap;
+    volatile uint32_t n;
+    uint64_t dropped;
+} __attribute__((aligned(64))) prof_ring_t;
+
+static prof_ring_t rings[MAX_HARTS];
+static int prof_hz;
+volatile uint64_t prof_period;
+
+void prof_sample(const trapframe_t *tf) {
+    uint64_t h = hart_id();
+    prof_ring_t *r = &rings[h];
+    uint32_t n = r->n;
+    if (!r->buf)
+        return;
+    if (n == r->cap) {
+        r->dropped++;
+        return;
+    }
+    pcb_t *cur = sched_current();
+    prof_sample_t *s = &r->buf[n];
+    s->pc = tf->mepc;
+    s->name = cur->name;
+    s->pid = cur->pid;
+    s->hart = (uint8_t)h;
+    s->user = (tf->mstatus & MSTATUS_MPP_M) == MSTATUS_MPP_U;
+    __atomic_store_n(&r->n, n + 1, __ATOMIC_RELEASE);
+}
+
+void prof_start(int hz) {
+    if (hz <= 0)
+        hz = PROF_HZ_DEFAULT;
+    if (hz > PROF_HZ_MAX)
+        hz = PROF_HZ_MAX;
+    prof_period = 0;
+    for (int h = 0; h < sched_ncpus() && h < MAX_HARTS; h++) {
+        prof_ring_t *r = &rings[h];
+        if (!r->buf) {
+            r->buf = (prof_sample_t *)kalloc_pages(PROF_ORDER);
+            if (!r->buf) {
+                uart_puts("prof: out of memory\n");
+                return;
+            }
+            r->cap = (PGSIZE << PROF_ORDER) / sizeof(prof_sample_t);
+        }
+        r->n = 0;
+        r->dropped = 0;
+    }
+    prof_hz = hz;
+    // every hart picks the new period up at its next tick
+    __atomic_store_n(&prof_period, TIMER_HZ / (uint64_t)hz, __ATOMIC_RELEASE);
+    uart_puts("prof: sampling at ");
+    uart_put_dec(hz);
+    uart_puts(" Hz on ");
+    uart_put_dec(sched_ncpus());
+    uart_puts(" harts\n");
+}
+
+void prof_stop(void) {
+    __atomic_store_n(&prof_period, 0, __ATOMIC_RELEASE);
+}
+
+void prof_status(void) {
+    uart_puts(prof_period ? "prof: running at " : "prof: stopped, last run at ");
+    uart_put_dec(prof_hz);
+    uart_puts(" Hz\n");
+    for (int h = 0; h < MAX_HARTS; h++) {
+        prof_ring_t *r = &rings[h];
+        if (!r->buf)
+            continue;
+        uart_puts("  hart ");
+        uart_put_dec(h);
+        uart_puts(": ");
+        uart_put_dec((int)r->n);
+        uart_puts("/");
+        uart_put_dec((int)r->cap);
+        uart_puts(" samples, ");
+        uart_put_dec((int)r->dropped);
+        uart_puts(" dropped\n");
+    }
+}
+
+void prof_dump(void) {
+    prof_stop();
+    uint64_t total = 0, dropped = 0;
+    uart_puts("# prof begin hz=");
+    uart_put_dec(prof_hz);
+    uart_puts("\n");
+    for (int h = 0; h < MAX_HARTS; h++) {
+        prof_ring_t *r = &rings[h];
+        if (!r->buf)
+            continue;
+        uint32_t n = __atomic_load_n(&r->n, __ATOMIC_ACQUIRE);
+        for (uint32_t i = 0; i < n; i++) {
+            const prof_sample_t *s = &r->buf[i];
+            uart_puts("S ");
+            uart_put_dec(s->hart);
+            uart_puts(" ");
+            uart_put_dec((int)s->pid);
+            uart_puts(s->user ? " u " : " k ");
+            uart_put_hex(s->pc);
+            uart_puts(" ");
+            uart_puts(s->name ? s->name : "?");
+            uart_puts("\n");
+        }
+        total += n;
+        dropped += r->dropped;
+    }
+    uart_puts("# prof end samples=");
+    uart_put_u64(total);
+    uart_puts(" dropped=");
+    uart_put_u64(dropped);
+    uart_puts("\n");
+}
@@ -0,0 +1,32 @@
+// prof.h — statistical sampling profiler
+// while it runs, every hart's machine timer fires once per sampling period
+// instead of once per quantum, and each tick records where the hart was
+// interrupted: mepc, the hart, the running thread and whether it was in
+// U-mode. samples go into a per-hart buffer that only that hart writes.
+// `prof dump` prints them over the console and tools/profsym.py turns the
+// capture into a flat profile and folded stacks against kernel.elf and
+// userprog.elf.
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+#include "trap.h"
+
+//   timer ticks between samples, 0 while the profiler is stopped. read on
+//   every timer interrupt (trap.c) and by sched_tick(), which only switches
+//   threads on the ticks that end a quantum.
+extern volatile uint64_t prof_period;
+
+//   records one sample for the calling hart from the interrupted frame.
+//   called by: - trap_handler() in trap.c (timer interrupt, interrupts off)
+void prof_sample(const trapframe_t *tf);
+
+//   shell commands "prof start [hz]", "prof stop", "prof dump" and "prof".
+//   starting discards earlier samples; dumping stops the profiler first.
+void prof_start(int hz);
+void prof_stop(void);
+void prof_dump(void);
+void prof_status(void);
+
+#endif
@@ -0,0 +1,312 @@
+// ring.c — batched asynchronous syscalls over shared rings
+// ---------------------------------------------------------------
+// kernel side of ring.h. a ring is a block of kalloc pages mapped into the
+// owner's address space at RING_VA (PTE_BORROWED: the ring, not vm_free(),
+// owns the pages) and read/written by the kernel through its physical
+// address. everything in it can be changed by the program at any time, so
+// each sqe is copied before it is looked at and all indexes are masked.
+//
+// two ways to get sqes executed:
+//   SYS_ring_enter    the owner traps in; the kernel runs up to to_submit
+//                     sqes in the owner's context and posts their cqes.
+//   RING_SETUP_SQPOLL a kernel thread ("sqpoll") watches sq_tail and runs
+//                     new sqes as they appear, so a busy program submits
+//                     without any ecall. after RING_POLL_IDLE empty polls it
+//                     sets RING_NEED_WAKEUP and sleeps; the program then
+//                     calls SYS_ring_enter with RING_ENTER_WAKEUP once.
+//
+// operations run synchronously (one after another, in sq order), so a cqe
+// is posted as soon as its sqe has been consumed. if the cq is full the
+// kernel stops consuming until the program has made room.
+// ---------------------------------------------------------------
+
+#include "ring.h"
+#include "tasks.h"
+#include "sched.h"
+#include "syscall.h"
+#include "spinlock.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "fs.h"
+#include "vm.h"
+#include "uart.h"
+#include "handle.h"
+#include "loader.h"
+
+// idle polls before the sq poller goes to sleep
+#define RING_POLL_IDLE 64
+
+// file data moved per fs_read/fs_write round
+#define RING_IO_CHUNK  16384
+#define RING_PATH_MAX  128
+
+typedef struct ring {
+    ring_hdr_t *hdr;            // kernel (physical) address of the shared block
+    int order;                  // kalloc order of the block
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    pagetable_t pt;             // owner's address space
+    struct image *image;        // its shared frames, once the poller owns pt
+    handle_t *stdio[3];         // owner's stdio handles, one reference each
+    int sqpoll;
+    spinlock_t lock;            // cq_waiters, closing, poller sleep
+    int cq_waiters;
+    volatile int closing;       // owner gone: the poller cleans up
+} ring_t;
+
+static inline ring_sqe_t *sqe_at(ring_t *r, uint32_t i) {
+    return (ring_sqe_t *)((uint8_t *)r->hdr + RING_SQ_OFF) + (i & (r->sq_entries - 1));
+}
+
+static inline ring_cqe_t *cqe_at(ring_t *r, uint32_t i) {
+    return (ring_cqe_t *)((uint8_t *)r->hdr + RING_CQ_OFF(r->sq_entries)) +
+           (i & (r->cq_entries - 1));
+}
+
+// -----------------------------------------------------------------------------
+// Operations
+// -----------------------------------------------------------------------------
+
+static int64_t op_fwrite(ring_t *r, const ring_sqe_t *e, const char *path) {
+    if (!vm_user_ok(r->pt, e->addr, e->len, PTE_R))
+        return -1;
+    uint64_t chunk = e->len < RING_IO_CHUNK ? e->len : RING_IO_CHUNK;
+    uint8_t *buf = (uint8_t *)kmalloc(chunk ? chunk : 1);
+    if (!buf)
+        return -1;
+    int append = (e->flags & RING_F_APPEND) != 0;
+    uint64_t done = 0;
+    do {
+        uint64_t k = e->len - done < chunk ? e->len - done : chunk;
+        vm_copy_in(r->pt, buf, e->addr + done, k);
+        if (fs_write(path, buf, k, append) != 0) {
+            kfree(buf);
+            return -1;
+        }
+        append = 1;
+        done += k;
+    } while (done < e->len);
+    kfree(buf);
+    return (int64_t)done;
+}
+
+static int64_t op_fread(ring_t *r, const ring_sqe_t *e, const char *path) {
+    if (!vm_user_ok(r->pt, e->addr, e->len, PTE_W))
+        return -1;
+    uint64_t chunk = e->len < RING_IO_CHUNK ? e->len : RING_IO_CHUNK;
+    uint8_t *buf = (uint8_t *)kmalloc(chunk ? chunk : 1);
+    if (!buf)
+        return -1;
+    uint64_t done = 0;
+    while (done < e->len) {
+        uint64_t want = e->len - done < chunk ? e->len - done : chunk;
+        long got = fs_read(path, e->off + done, buf, want);
+        if (got < 0) {
+            kfree(buf);
+            return -1;
+        }
+        vm_copy_out(r->pt, e->addr + done, buf, (uint64_t)got);
+        done += (uint64_t)got;
+        if ((uint64_t)got < want)
+            break;
+    }
+    kfree(buf);
+    return (int64_t)done;
+}
+
+static int64_t ring_exec(ring_t *r, const ring_sqe_t *e) {
+    char path[RING_PATH_MAX];
+    switch (e->op) {
+    case RING_OP_NOP:
+        return 0;
+    case RING_OP_WRITE:
+        return syscall_write(r->pt, r->stdio, (uint64_t)e->fd, e->addr, e->len,
+                             (e->flags & RING_F_NONBLOCK) != 0);
+    case RING_OP_READ:
+        return syscall_read(r->pt, r->stdio, (uint64_t)e->fd, e->addr, e->len,
+                            (e->flags & RING_F_NONBLOCK) != 0);
+    case RING_OP_FWRITE:
+    case RING_OP_FREAD:
+        if (vm_copy_in_str(r->pt, path, e->path, sizeof(path)) != 0)
+            return -1;
+        return e->op == RING_OP_FWRITE ? op_fwrite(r, e, path)
+                                       : op_fread(r, e, path);
+    default:
+        r->hdr->dropped++;
+        return -1;
+    }
+}
+
+// consume up to max sqes; returns how many were run
+static uint32_t ring_submit(ring_t *r, uint64_t max) {
+    ring_hdr_t *h = r->hdr;
+    uint32_t head = h->sq_head;
+    uint32_t tail = __atomic_load_n(&h->sq_tail, __ATOMIC_ACQUIRE);
+    uint32_t n = 0;
+    while (head != tail && n < max) {
+        uint32_t cq_tail = h->cq_tail;
+        if (cq_tail - __atomic_load_n(&h->cq_head, __ATOMIC_ACQUIRE) >= r->cq_entries)
+            break;              // no room for the completion
+        ring_sqe_t e = *sqe_at(r, head);
+        ring_cqe_t *c = cqe_at(r, cq_tail);
+        c->user_data = e.user_data;
+        c->res = ring_exec(r, &e);
+        __atomic_store_n(&h->cq_tail, cq_tail + 1, __ATOMIC_RELEASE);
+        // sq_head moves only once the cqe is out: an empty sq means every
+        // submitted operation has completed
+        head++;
+        __atomic_store_n(&h->sq_head, head, __ATOMIC_RELEASE);
+        n++;
+    }
+    return n;
+}
+
+static void ring_wake_waiters(ring_t *r) {
+    uint64_t s = spin_lock_irqsave(&r->lock);
+    if (r->cq_waiters)
+        sched_wakeup(&r->cq_waiters);
+    spin_unlock_irqrestore(&r->lock, s);
+}
+
+static void ring_free(ring_t *r) {
+    for (int i = 0; i < 3; i++)
+        handle_close(r->stdio[i]);
+    kfree_pages(r->hdr, r->order);
+    kfree(r);
+}
+
+// -----------------------------------------------------------------------------
+// SQ poller
+// -----------------------------------------------------------------------------
+
+static int sq_empty(ring_t *r) {
+    return r->hdr->sq_head == __atomic_load_n(&r->hdr->sq_tail, __ATOMIC_ACQUIRE);
+}
+
+static void ring_poller(ring_t *r) {
+    int idle = 0;
+    while (!r->closing) {
+        if (ring_submit(r, RING_MAX_ENTRIES)) {
+            ring_wake_waiters(r);
+            idle = 0;
+            continue;
+        }
+        if (++idle < RING_POLL_IDLE) {
+            sched_yield();
+            continue;
+        }
+        // tell the program, then look once more: a submission that raced
+        // with setting the flag is either seen here or followed by a wakeup
+        uint64_t s = spin_lock_irqsave(&r->lock);
+        __atomic_or_fetch(&r->hdr->flags, RING_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+        while (sq_empty(r) && !r->closing)
+            sched_sleep(r, &r->lock);
+        __atomic_and_fetch(&r->hdr->flags, ~RING_NEED_WAKEUP, __ATOMIC_RELAXED);
+        spin_unlock_irqrestore(&r->lock, s);
+        idle = 0;
+    }
+    // the owner is gone and has handed us its address space. the image's
+    // shared frames are mapped in it, so they go back only after it is gone
+    vm_free(r->pt);
+    if (r->image)
+        loader_image_put(r->image);
+    ring_free(r);
+}
+
+// -----------------------------------------------------------------------------
+// Syscalls
+// -----------------------------------------------------------------------------
+
+int64_t ring_setup(pcb_t *p, uint64_t entries, uint64_t flags) {
+    if (p->ring || !p->pagetable || entries == 0 || entries > RING_MAX_ENTRIES)
+        return -1;
+    uint32_t sq = 1;
+    while (sq < entries)
+        sq <<= 1;
+
+    ring_t *r = (ring_t *)kzalloc(sizeof(ring_t));
+    if (!r)
+        return -1;
+    r->sq_entries = sq;
+    r->cq_entries = 2 * sq;
+    r->order = kalloc_order_for(RING_CQ_OFF(sq) + 2 * sq * RING_CQE_SIZE);
+    r->hdr = (ring_hdr_t *)kalloc_pages(r->order);
+    r->pt = p->pagetable;
+    if (!r->hdr) {
+        kfree(r);
+        return -1;
+    }
+    r->hdr->sq_entries = sq;
+    r->hdr->sq_mask = sq - 1;
+    r->hdr->cq_entries = 2 * sq;
+    r->hdr->cq_mask = 2 * sq - 1;
+
+    if (vm_map(p->pagetable, RING_VA, (uint64_t)r->hdr, PGSIZE << r->order,
+               PTE_R | PTE_W | PTE_U | PTE_BORROWED) != 0) {
+        ring_free(r);
+        return -1;
+    }
+    // the sq poller may outlive the owner's pcb, so it keeps its own
+    // references to where the owner's reads and writes go
+    for (int i = 0; i < 3; i++)
+        r->stdio[i] = handle_dup(p->stdio[i]);
+    p->ring = r;
+    if (flags & RING_SETUP_SQPOLL) {
+        r->sqpoll = 1;
+        if (tasks_spawn("sqpoll", (uint64_t)ring_poller, (uint64_t)r) < 0) {
+            // the mapping stays but is harmless; fall back to ring_enter
+            r->sqpoll = 0;
+        }
+    }
+    return RING_VA;
+}
+
+int64_t ring_enter(pcb_t *p, uint64_t to_submit, uint64_t min_complete,
+                   uint64_t flags) {
+    ring_t *r = p->ring;
+    if (!r)
+        return -1;
+    int64_t submitted = 0;
+    if (r->sqpoll) {
+        if (flags & RING_ENTER_WAKEUP) {
+            uint64_t s = spin_lock_irqsave(&r->lock);
+            sched_wakeup(r);
+            spin_unlock_irqrestore(&r->lock, s);
+        }
+    } else {
+        submitted = ring_submit(r, to_submit);
+    }
+
+    if (min_complete > r->cq_entries)
+        min_complete = r->cq_entries;
+    if (min_complete) {
+        ring_hdr_t *h = r->hdr;
+        uint64_t s = spin_lock_irqsave(&r->lock);
+        while (__atomic_load_n(&h->cq_tail, __ATOMIC_ACQUIRE) - h->cq_head < min_complete) {
+            if (!r->sqpoll || sq_empty(r))
+                break;          // nothing left that could complete
+            r->cq_waiters++;
+            sched_sleep(&r->cq_waiters, &r->lock);
+            r->cq_waiters--;
+        }
+        spin_unlock_irqrestore(&r->lock, s);
+    }
+    return submitted;
+}
+
+void ring_release(pcb_t *p) {
+    ring_t *r = p->ring;
+    p->ring = 0;
+    if (!r->sqpoll) {
+        ring_free(r);
+        return;
+    }
+    uint64_t s = spin_lock_irqsave(&r->lock);
+    r->pt = p->pagetable;
+    p->pagetable = 0;
+    r->image = p->image;
+    p->image = 0;
+    r->closing = 1;
+    sched_wakeup(r);
+    spin_unlock_irqrestore(&r->lock, s);
+}
@@ -0,0 +1,129 @@
+// ring.h — shared submission/completion rings (user <-> kernel ABI)
+// a program asks for a ring with SYS_ring_setup and gets back the address
+// where the kernel mapped it. the ring is one block of memory shared by
+// both sides:
+//
+//   header   head/tail indexes of both rings, masks and flags
+//   sq       submission queue entries (ring_sqe_t), written by the program
+//   cq       completion queue entries (ring_cqe_t), written by the kernel
+//
+// the program fills sqes at sq_tail and publishes them by advancing
+// sq_tail; the kernel consumes from sq_head. the kernel posts cqes at
+// cq_tail; the program consumes from cq_head. indexes are free-running
+// 32-bit counters, masked on access. one SYS_ring_enter submits any number
+// of queued operations; with RING_SETUP_SQPOLL a kernel thread picks them
+// up without any ecall at all.
+//
+// the layout is also used from assembly (ubench.S), hence the offsets.
+
+#ifndef RING_H
+#define RING_H
+
+// where the ring is mapped in every address space that has one
+#define RING_VA             0x3f000000
+
+#define RING_MAX_ENTRIES    256         // sq entries; the cq gets twice as many
+
+// header field offsets
+#define RING_SQ_HEAD        0           // kernel writes
+#define RING_SQ_TAIL        4           // program writes
+#define RING_SQ_MASK        8
+#define RING_SQ_ENTRIES     12
+#define RING_CQ_HEAD        16          // program writes
+#define RING_CQ_TAIL        20          // kernel writes
+#define RING_CQ_MASK        24
+#define RING_CQ_ENTRIES     28
+#define RING_FLAGS          32          // kernel writes: RING_NEED_WAKEUP
+#define RING_SQ_OFF         64          // first sqe
+#define RING_SQE_SIZE       64
+#define RING_CQE_SIZE       16
+#define RING_CQ_OFF(sq_entries) (RING_SQ_OFF + (sq_entries) * RING_SQE_SIZE)
+
+// sqe field offsets
+#define RING_SQE_OP         0
+#define RING_SQE_FLAGS      1
+#define RING_SQE_FD         4
+#define RING_SQE_ADDR       8
+#define RING_SQE_LEN        16
+#define RING_SQE_OFFSET     24
+#define RING_SQE_PATH       32
+#define RING_SQE_USER_DATA  40
+
+// operations
+#define RING_OP_NOP         0
+#define RING_OP_WRITE       1   // write(fd, addr, len)
+#define RING_OP_READ        2   // read(fd, addr, len)
+#define RING_OP_FWRITE      3   // replace (or append) file `path` with addr/len
+#define RING_OP_FREAD       4   // read len bytes of file `path` at offset into addr
+
+// sqe flags
+#define RING_F_APPEND       0x01    // RING_OP_FWRITE: append instead of replace
+#define RING_F_NONBLOCK     0x02    // RING_OP_READ/WRITE: res -2 instead of waiting on a pipe
+
+// SYS_ring_setup flags
+#define RING_SETUP_SQPOLL   0x01    // a kernel thread polls the sq
+
+// SYS_ring_enter flags
+#define RING_ENTER_WAKEUP   0x01    // the sq poller went to sleep: wake it
+
+// header flags
+#define RING_NEED_WAKEUP    0x01    // set by an idle sq poller
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+typedef struct ring_hdr {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t cq_mask;
+    uint32_t cq_entries;
+    volatile uint32_t flags;
+    uint32_t dropped;           // sqes with an unknown op
+    uint32_t pad[6];
+} ring_hdr_t;
+
+typedef struct ring_sqe {
+    uint8_t op;
+    uint8_t flags;
+    uint16_t pad;
+    int32_t fd;
+    uint64_t addr;
+    uint64_t len;
+    uint64_t off;
+    uint64_t path;              // user address of a NUL-terminated path
+    uint64_t user_data;         // copied into the cqe untouched
+    uint64_t pad2[2];
+} ring_sqe_t;
+
+typedef struct ring_cqe {
+    uint64_t user_data;
+    int64_t res;                // like the syscall result: < 0 is an error
+} ring_cqe_t;
+
+// kernel side (ring.c)
+struct pcb;
+
+//   SYS_ring_setup: allocates the ring for `p` and maps it at RING_VA.
+//   entries is rounded up to a power of two (at most RING_MAX_ENTRIES).
+//   returns RING_VA, or -1.
+int64_t ring_setup(struct pcb *p, uint64_t entries, uint64_t flags);
+
+//   SYS_ring_enter: runs up to to_submit queued sqes, then waits until at
+//   least min_complete cqes are waiting. returns the number submitted.
+int64_t ring_enter(struct pcb *p, uint64_t to_submit, uint64_t min_complete,
+                   uint64_t flags);
+
+//   drops p's ring when p is torn down. with an sq poller the poller takes
+//   over p's page table and program image, and frees them and the ring
+//   once it has stopped (the image after the page table that maps it).
+//   called by: - tasks_release() in tasks.c
+void ring_release(struct pcb *p);
+
+#endif
+
+#endif
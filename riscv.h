@@ -0,0 +1,140 @@
+// riscv.h — machine-mode CSR helpers and bit definitions
+// small inline wrappers around the csrr/csrw family so the C side of the
+// kernel (trap.c, timer.c, sched.c) never has to spell out inline assembly.
+//
+// the host build (-DHOST_BUILD, `make host`) compiles the modules that do
+// not touch devices natively, for benchmarks and fuzzing. there the wrappers
+// are plain C: one hart, interrupts always off, rdcycle() from the host.
+
+#ifndef RISCV_H
+#define RISCV_H
+
+#include <stdint.h>
+
+#ifndef HOST_BUILD
+
+#define csr_read(csr) ({                                   \
+    uint64_t __v;                                          \
+    asm volatile("csrr %0, " #csr : "=r"(__v));            \
+    __v; })
+
+#define csr_write(csr, val) \
+    asm volatile("csrw " #csr ", %0" :: "r"((uint64_t)(val)) : "memory")
+
+#define csr_set(csr, bits) \
+    asm volatile("csrs " #csr ", %0" :: "r"((uint64_t)(bits)) : "memory")
+
+#define csr_clear(csr, bits) \
+    asm volatile("csrc " #csr ", %0" :: "r"((uint64_t)(bits)) : "memory")
+
+#else
+
+#define csr_read(csr)        0UL
+#define csr_write(csr, val)  ((void)(val))
+#define csr_set(csr, bits)   ((void)(bits))
+#define csr_clear(csr, bits) ((void)(bits))
+
+#endif
+
+// mstatus bits
+#define MSTATUS_MIE     (1UL << 3)
+#define MSTATUS_MPIE    (1UL << 7)
+#define MSTATUS_VS              (3UL << 9)
+#define MSTATUS_VS_INITIAL      (1UL << 9)
+#define MSTATUS_MPP_M   (3UL << 11)
+#define MSTATUS_MPP_U   (0UL << 11)
+
+// mie bits
+#define MIE_MSIE        (1UL << 3)
+#define MIE_MTIE        (1UL << 7)
+#define MIE_MEIE        (1UL << 11)
+
+// mcause values
+#define MCAUSE_INTR     (1UL << 63)
+#define IRQ_M_SOFT      3
+#define IRQ_M_TIMER     7
+#define IRQ_M_EXT       11
+#define EXC_ILLEGAL_INSN 2
+#define EXC_ECALL_U     8
+#define EXC_ECALL_M     11
+
+// upper bound on harts we keep per-hart state for (QEMU virt allows 8)
+#define MAX_HARTS       8
+
+#ifndef HOST_BUILD
+
+// kernel code keeps its hart id in tp (set in start.S, re-established by
+// trapvec.S on every entry from U-mode and every return to M-mode). only
+// meaningful with interrupts off: a preempted thread may resume elsewhere.
+static inline uint64_t hart_id(void) {
+    uint64_t id;
+    asm volatile("mv %0, tp" : "=r"(id));
+    return id;
+}
+
+// cycle counter (we run in M-mode, so mcycle is always readable)
+static inline uint64_t rdcycle(void) {
+    return csr_read(mcycle);
+}
+
+// instructions retired on this hart
+static inline uint64_t rdinstret(void) {
+    return csr_read(minstret);
+}
+
+// disable machine interrupts and return the previous mstatus so the caller
+// can put things back with irq_restore(). used around short critical
+// sections that touch state shared with the trap handler.
+static inline uint64_t irq_save(void) {
+    uint64_t s;
+    asm volatile("csrrci %0, mstatus, 8" : "=r"(s) :: "memory");
+    return s;
+}
+
+static inline void irq_restore(uint64_t s) {
+    if (s & MSTATUS_MIE)
+        csr_set(mstatus, MSTATUS_MIE);
+}
+
+// drop this hart's TLB entries tagged with asid
+static inline void sfence_vma_asid(uint64_t asid) {
+    asm volatile("sfence.vma zero, %0" :: "r"(asid) : "memory");
+}
+
+// Zbb orc.b (0xff for every nonzero byte) and ctz, encoded with .insn so
+// the kernel still builds for rv64imac. only on harts that have Zbb.
+static inline uint64_t zbb_orc_b(uint64_t x) {
+    uint64_t r;
+    asm(".insn i 0x13, 5, %0, %1, 0x287" : "=r"(r) : "r"(x));
+    return r;
+}
+
+static inline uint64_t zbb_ctz(uint64_t x) {
+    uint64_t r;
+    asm(".insn i 0x13, 1, %0, %1, 0x601" : "=r"(r) : "r"(x));
+    return r;
+}
+
+#else
+
+uint64_t host_cycles(void);     // host/stubs.c
+
+static inline uint64_t hart_id(void) { return 0; }
+static inline uint64_t rdcycle(void) { return host_cycles(); }
+static inline uint64_t rdinstret(void) { return 0; }
+static inline uint64_t irq_save(void) { return 0; }
+static inline void irq_restore(uint64_t s) { (void)s; }
+static inline void sfence_vma_asid(uint64_t asid) { (void)asid; }
+
+static inline uint64_t zbb_orc_b(uint64_t x) {
+    uint64_t t = ((x & 0x7f7f7f7f7f7f7f7fUL) + 0x7f7f7f7f7f7f7f7fUL) | x;
+    return ((t & 0x8080808080808080UL) >> 7) * 0xff;
+}
+
+static inline uint64_t zbb_ctz(uint64_t x) {
+    return x ? (uint64_t)__builtin_ctzll(x) : 64;
+}
+
+#endif
+
+#endif
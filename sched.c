@@ -0,0 +1,770 @@
+// sched.c — preemptive round-robin SMP scheduler for the RISC-V OS
+// ---------------------------------------------------------------
+// threads are pcb_t entries with a saved trapframe_t. a thread is either
+// running on some hart (`current` of that hart's cpu_t), sitting on one
+// hart's FIFO run queue, sleeping on a channel (the global sleep list), or
+// stopped. at the end of every quantum (and every sched_yield()) the
+// running thread goes to the back of its hart's queue and the head of the
+// queue is resumed. a hart whose queue is empty steals from the longest
+// queue of another hart; if there is nothing to steal and the current
+// thread cannot continue, the hart's idle thread waits for an interrupt. a
+// thread with pcb->pinned set is queued on that hart only and never stolen.
+//
+// idle is tickless: each hart's mtimecmp is set to the earliest of the end
+// of the quantum (only while a thread runs), its next kernel timer
+// (ktimer.h) and the next profiler sample. an idle hart with no timers
+// gets no timer interrupt at all; it is woken by an IPI when work is
+// queued for it, or when a thread is left waiting on a busy hart.
+//
+// locking: each run queue has its own spinlock, the sleep list has one
+// more. everything in here runs either from the trap handler (interrupts
+// already off) or inside irq_save()/spin_lock_irqsave().
+//
+// a thread that was just switched away from is still running on its own
+// stack until trapvec.S has moved to the next frame. pcb->on_cpu stays set
+// until then (sched_finish_switch()), and a hart that picks the thread up
+// waits for it to clear. stopped threads are reaped at the same point, once
+// nobody is on their stack any more.
+//
+// accounting: every entry into sched_switch() charges the thread that was
+// running the mtime, mcycle and minstret that passed since the hart last
+// took a sample, and takes a new one. that is three counter reads per
+// switch or tick, cheap enough to leave on.
+// ---------------------------------------------------------------
+
+#include "uart.h"
+#include "riscv.h"
+#include "timer.h"
+#include "ktimer.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "vm.h"
+#include "perf.h"
+#include "prof.h"
+#include "kprintf.h"
+#include "memlayout.h"
+
+typedef struct cpu {
+    pcb_t *current;
+    pcb_t *idle;
+    pcb_t *prev;            // switched away from, not yet finished
+    spinlock_t rq_lock;
+    pcb_t *rq_head;
+    pcb_t *rq_tail;
+    volatile uint32_t rq_len;
+    volatile int online;
+    uint64_t switches;
+    uint64_t steals;
+    uint64_t tick_due;      // mtime at which the running thread's quantum ends
+    uint64_t acct_time;     // counters at the last sample, for `current`
+    uint64_t acct_cycles;
+    uint64_t acct_instret;
+#if PERF
+    uint64_t switched_in;   // rdcycle() when `current` got the hart
+#endif
+} __attribute__((aligned(64))) cpu_t;
+
+static cpu_t cpus[MAX_HARTS];
+
+// the thread that booted the kernel and runs the shell. it has no pcb_table
+// slot and no allocated stack; it keeps running on hart 0's boot stack.
+static pcb_t boot_pcb;
+
+// one idle thread per hart, never on a run queue. hart 0's runs on its own
+// small stack; the other harts' idle threads are their boot contexts.
+#define IDLE_STACK_SIZE 4096
+static pcb_t idle_pcbs[MAX_HARTS];
+static uint8_t idle_stack[IDLE_STACK_SIZE] __attribute__((aligned(16)));
+
+static spinlock_t sleep_lock;
+static pcb_t *sleep_head;
+
+static volatile int ncpus;
+
+static uint32_t quantum_us = SCHED_QUANTUM_US;
+static uint64_t quantum_ticks;
+
+static inline cpu_t *mycpu(void) {
+    return &cpus[hart_id()];
+}
+
+// -----------------------------------------------------------------------------
+// Run queues
+// -----------------------------------------------------------------------------
+
+static void rq_push(cpu_t *c, pcb_t *p) {
+    spin_lock(&c->rq_lock);
+    p->next = 0;
+    if (c->rq_tail)
+        c->rq_tail->next = p;
+    else
+        c->rq_head = p;
+    c->rq_tail = p;
+    c->rq_len++;
+    spin_unlock(&c->rq_lock);
+}
+
+static pcb_t *rq_pop(cpu_t *c) {
+    if (!c->rq_len)             // racy peek, rechecked under the lock
+        return 0;
+    spin_lock(&c->rq_lock);
+    pcb_t *p = c->rq_head;
+    if (p) {
+        c->rq_head = p->next;
+        if (!c->rq_head) c->rq_tail = 0;
+        p->next = 0;
+        c->rq_len--;
+    }
+    spin_unlock(&c->rq_lock);
+    return p;
+}
+
+// the oldest thread on c's queue that is not pinned there
+static pcb_t *rq_steal(cpu_t *c) {
+    if (!c->rq_len)
+        return 0;
+    spin_lock(&c->rq_lock);
+    pcb_t *prev = 0, *p = c->rq_head;
+    while (p && p->pinned) {
+        prev = p;
+        p = p->next;
+    }
+    if (p) {
+        if (prev)
+            prev->next = p->next;
+        else
+            c->rq_head = p->next;
+        if (c->rq_tail == p)
+            c->rq_tail = prev;
+        p->next = 0;
+        c->rq_len--;
+    }
+    spin_unlock(&c->rq_lock);
+    return p;
+}
+
+// take the oldest movable thread from the hart with the longest queue
+static pcb_t *steal(cpu_t *self) {
+    cpu_t *victim = 0;
+    uint32_t best = 0;
+    for (int i = 0; i < MAX_HARTS; i++) {
+        cpu_t *c = &cpus[i];
+        if (c != self && c->online && c->rq_len > best) {
+            best = c->rq_len;
+            victim = c;
+        }
+    }
+    pcb_t *p = victim ? rq_steal(victim) : 0;
+    if (p)
+        self->steals++;
+    return p;
+}
+
+// nudge an idle hart so it looks for work now instead of at its next tick
+static void kick_idle(cpu_t *prefer) {
+    if (prefer && prefer->online && prefer->current == prefer->idle &&
+        prefer != mycpu()) {
+        timer_send_ipi((int)(prefer - cpus));
+        return;
+    }
+    for (int i = 0; i < MAX_HARTS; i++) {
+        cpu_t *c = &cpus[i];
+        if (c->online && c != mycpu() && c->current == c->idle) {
+            timer_send_ipi(i);
+            return;
+        }
+    }
+}
+
+// the next timer interrupt of this hart: see the top of the file
+static void program_timer(cpu_t *c) {
+    uint64_t when = ktimer_next();
+    if (c->current != c->idle && c->tick_due < when)
+        when = c->tick_due;
+    uint64_t period = prof_period;
+    if (period && timer_now() + period < when)
+        when = timer_now() + period;
+    timer_arm_at(when);
+}
+
+// -----------------------------------------------------------------------------
+// Setup
+// -----------------------------------------------------------------------------
+
+// no tick comes to an idle hart to drain the log, so it hands the log to
+// klogd itself before it waits. idle never migrates: mycpu() is stable.
+static void __attribute__((noreturn)) idle_loop(void) {
+    for (;;) {
+        uint64_t s = irq_save();
+        klog_kick();
+        irq_restore(s);
+        if (mycpu()->rq_len)
+            sched_yield();
+        asm volatile("wfi");
+    }
+}
+
+void sched_init(void) {
+    cpu_t *c = mycpu();
+    boot_pcb.pid = 0;
+    boot_pcb.name = "shell";
+    boot_pcb.state = TASK_RUNNING;
+    boot_pcb.on_cpu = 1;
+    quantum_ticks = timer_us_to_ticks(quantum_us);
+
+    pcb_t *idle = &idle_pcbs[hart_id()];
+    idle->name = "idle";
+    idle->entry = (uint64_t)idle_loop;
+    idle->sp = (uint64_t)(idle_stack + IDLE_STACK_SIZE);
+    idle->state = TASK_RUNNING;
+    sched_prepare(idle, 0);
+
+    c->current = &boot_pcb;
+    c->idle = idle;
+    c->online = 1;
+    ncpus = 1;
+}
+
+static void start_tick(void) {
+    cpu_t *c = mycpu();
+    c->acct_time = timer_now();
+    c->acct_cycles = rdcycle();
+    c->acct_instret = rdinstret();
+    timer_init();
+    c->tick_due = timer_now() + quantum_ticks;
+    program_timer(c);
+    csr_set(mie, MIE_MSIE);
+    csr_set(mstatus, MSTATUS_MIE);
+}
+
+void sched_start(void) {
+    start_tick();
+    kprintf("[SCHED] preemptive scheduler started, quantum %u us\n", quantum_us);
+}
+
+// the boot context of a secondary hart becomes its idle thread. from here
+// on it only runs what it steals or what is woken onto its queue.
+void sched_start_secondary(void) {
+    cpu_t *c = mycpu();
+    pcb_t *idle = &idle_pcbs[hart_id()];
+    idle->name = "idle";
+    idle->state = TASK_RUNNING;
+    idle->on_cpu = 1;
+    idle->cpu = (int)hart_id();
+    c->current = c->idle = idle;
+    __atomic_store_n(&c->online, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&ncpus, 1, __ATOMIC_RELAXED);
+    start_tick();
+    idle_loop();
+}
+
+int sched_ncpus(void) {
+    return ncpus;
+}
+
+// where a kernel thread's entry function returns to. entry functions are
+// void, so a0 means nothing here: the thread exits with status 0.
+static void thread_return(void) {
+    sched_exit(0);
+}
+
+// the frame goes at the very top of the kernel stack (pcb->sp). for a user
+// program that is also where trapvec.S expects it on every later trap.
+void sched_prepare(pcb_t *pcb, uint64_t arg) {
+    trapframe_t *tf = (trapframe_t *)(pcb->sp - sizeof(trapframe_t));
+    for (int i = 0; i < 32; i++)
+        tf->regs[i] = 0;
+    tf->regs[TF_A0] = arg;
+    tf->mepc = pcb->entry;
+    if (pcb->pagetable) {
+        // U-mode under its own page table; returning from the entry point
+        // lands in the exit stub the loader maps (uexit.S), which exits
+        // with the return value as status
+        tf->regs[TF_SP] = pcb->usp;
+        tf->regs[TF_RA] = USER_EXIT_VA;
+        tf->mstatus = MSTATUS_MPP_U | MSTATUS_MPIE;
+    } else {
+        // M-mode, irqs on after mret, vector unit as enabled by string_init()
+        tf->regs[TF_SP] = pcb->sp;
+        tf->regs[TF_RA] = (uint64_t)thread_return;
+        tf->mstatus = MSTATUS_MPP_M | MSTATUS_MPIE | (csr_read(mstatus) & MSTATUS_VS);
+    }
+    pcb->tf = tf;
+    pcb->on_cpu = 0;
+}
+
+// a pinned thread goes straight to its own hart; anything else starts here
+// and may be stolen
+void sched_enqueue(pcb_t *pcb) {
+    uint64_t s = irq_save();
+    cpu_t *c = pcb->pinned ? &cpus[pcb->pinned - 1] : mycpu();
+    pcb->state = TASK_RUNNABLE;
+    pcb->cpu = (int)(c - cpus);
+    rq_push(c, pcb);
+    kick_idle(pcb->pinned ? c : 0);
+    irq_restore(s);
+}
+
+// -----------------------------------------------------------------------------
+// Switching (trap context)
+// -----------------------------------------------------------------------------
+
+// charge the running thread for what it used since the last sample
+static void account(cpu_t *c, pcb_t *p) {
+    uint64_t now = timer_now(), cyc = rdcycle(), ins = rdinstret();
+    p->acct.time += now - c->acct_time;
+    p->acct.cycles += cyc - c->acct_cycles;
+    p->acct.instret += ins - c->acct_instret;
+    c->acct_time = now;
+    c->acct_cycles = cyc;
+    c->acct_instret = ins;
+}
+
+trapframe_t *sched_switch(trapframe_t *tf) {
+    cpu_t *c = mycpu();
+    pcb_t *prev = c->current;
+    prev->tf = tf;
+    account(c, prev);
+
+    pcb_t *next = rq_pop(c);
+    if (!next)
+        next = steal(c);
+    if (!next) {
+        // nobody else wants the CPU; keep going if we can, else idle
+        if (prev->state == TASK_RUNNING)
+            return tf;
+        next = c->idle;
+    }
+
+    if (prev == c->idle) {
+        // idle is never queued
+    } else if (prev->state == TASK_RUNNING) {
+        prev->state = TASK_RUNNABLE;
+        rq_push(c, prev);
+        // idle harts no longer tick, so tell one there is work to steal
+        if (ncpus > 1)
+            kick_idle(0);
+    } else if (prev->state == TASK_BLOCKED) {
+        spin_lock(&sleep_lock);
+        prev->next = sleep_head;
+        sleep_head = prev;
+        spin_unlock(&sleep_lock);
+        // only now can a waker find us, so only now drop the caller's lock
+        if (prev->sleep_lk)
+            spin_unlock(prev->sleep_lk);
+    }
+    // TASK_STOPPED: reaped in sched_finish_switch()
+
+    // the hart that last ran `next` may still be on its stack
+    while (__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE))
+        ;
+    next->on_cpu = 1;
+    next->state = TASK_RUNNING;
+    next->cpu = (int)hart_id();
+    next->acct.switches++;
+#if PERF
+    PERF_ADD(prev == c->idle ? PERF_IDLE : PERF_TASK_RUN, c->acct_cycles - c->switched_in);
+    c->switched_in = c->acct_cycles;
+#endif
+    c->current = next;
+    c->prev = prev;
+    c->switches++;
+    if (next->pagetable)
+        vm_activate(next->pagetable, next->asid);
+    if ((prev == c->idle) != (next == c->idle)) {
+        // leaving idle starts a quantum; entering it stops the tick
+        if (prev == c->idle)
+            c->tick_due = timer_now() + quantum_ticks;
+        program_timer(c);
+    }
+    return next->tf;
+}
+
+// called by trapvec.S after it has moved onto the new thread's frame
+void sched_finish_switch(void) {
+    cpu_t *c = mycpu();
+    pcb_t *prev = c->prev;
+    c->prev = 0;
+    if (!prev)
+        return;
+    if (prev->state == TASK_STOPPED && prev != &boot_pcb && prev != c->idle)
+        tasks_reap(prev);
+    else
+        __atomic_store_n(&prev->on_cpu, 0, __ATOMIC_RELEASE);
+}
+
+// one timer interrupt serves the quantum, this hart's kernel timers and
+// the profiler alike. only the end of a quantum switches threads, or a
+// timer that woke somebody while the hart was idle.
+trapframe_t *sched_tick(trapframe_t *tf) {
+    cpu_t *c = mycpu();
+    uint64_t now = timer_now();
+    ktimer_expire(now);
+    klog_kick();
+    if (c->current == c->idle || now >= c->tick_due) {
+        c->tick_due = now + quantum_ticks;
+        tf = sched_switch(tf);
+    }
+    program_timer(c);
+    return tf;
+}
+
+trapframe_t *sched_wake_check(trapframe_t *tf) {
+    cpu_t *c = mycpu();
+    if (c->current == c->idle)
+        return sched_switch(tf);
+    return tf;
+}
+
+trapframe_t *sched_kill_current(trapframe_t *tf) {
+    cpu_t *c = mycpu();
+    if (c->current == &boot_pcb || c->current == c->idle) {
+        uart_puts("[SCHED] fault in kernel thread, halting.\n");
+        uart_flush();
+        for (;;) asm volatile("wfi");
+    }
+    kprintf(KERN_WARNING "[SCHED] killed pid %u\n", c->current->pid);
+    c->current->exit_status = TASK_EXIT_KILLED;
+    c->current->state = TASK_STOPPED;
+    return sched_switch(tf);
+}
+
+// -----------------------------------------------------------------------------
+// Thread-side API
+// -----------------------------------------------------------------------------
+
+// an M-mode ecall traps straight into trap_handler(), which treats it as a
+// voluntary reschedule. this keeps a single save/restore path for both
+// preemption and yielding.
+void sched_yield(void) {
+    asm volatile("ecall" ::: "memory");
+}
+
+void sched_sleep(void *chan, spinlock_t *lk) {
+    pcb_t *p = mycpu()->current;   // interrupts are off: we cannot move
+    p->chan = chan;
+    p->sleep_lk = lk;
+    p->state = TASK_BLOCKED;
+    sched_yield();   // ecall traps even with interrupts masked
+    p->sleep_lk = 0;
+    if (lk)
+        spin_lock(lk);
+}
+
+// back onto the queue of the hart it last ran on (warm caches)
+static void make_runnable(pcb_t *p) {
+    cpu_t *c = &cpus[p->cpu];
+    p->state = TASK_RUNNABLE;
+    rq_push(c, p);
+    kick_idle(c);
+}
+
+void sched_wakeup(void *chan) {
+    uint64_t s = spin_lock_irqsave(&sleep_lock);
+    pcb_t *woken = 0;
+    pcb_t **pp = &sleep_head;
+    while (*pp) {
+        pcb_t *p = *pp;
+        if (p->chan == chan) {
+            *pp = p->next;
+            p->chan = 0;
+            p->next = woken;
+            woken = p;
+        } else {
+            pp = &p->next;
+        }
+    }
+    spin_unlock(&sleep_lock);
+
+    while (woken) {
+        pcb_t *p = woken;
+        woken = p->next;
+        make_runnable(p);
+    }
+    irq_restore(s);
+}
+
+struct sleep_timeout {
+    pcb_t *p;
+    int fired;
+};
+
+// the deadline of sched_sleep_until() has passed: wake the thread unless
+// a sched_wakeup() got to it first (timer interrupt, irqs off)
+static void sleep_timeout(void *arg) {
+    struct sleep_timeout *st = (struct sleep_timeout *)arg;
+    spin_lock(&sleep_lock);
+    pcb_t **pp = &sleep_head;
+    while (*pp && *pp != st->p)
+        pp = &(*pp)->next;
+    pcb_t *p = *pp;
+    if (p) {
+        *pp = p->next;
+        p->chan = 0;
+        st->fired = 1;
+    }
+    spin_unlock(&sleep_lock);
+    if (p)
+        make_runnable(p);
+}
+
+// the timer goes on this hart's wheel and interrupts are off, so it cannot
+// fire before the thread is on the sleep list
+int sched_sleep_until(void *chan, spinlock_t *lk, uint64_t deadline) {
+    if (deadline == SCHED_NO_DEADLINE) {
+        sched_sleep(chan, lk);
+        return 0;
+    }
+    if (timer_now() >= deadline)
+        return -1;
+    struct sleep_timeout st = { mycpu()->current, 0 };
+    ktimer_t t;
+    ktimer_init(&t, sleep_timeout, &st);
+    ktimer_arm(&t, deadline);
+    sched_sleep(chan, lk);
+    ktimer_cancel(&t);
+    return st.fired || timer_now() >= deadline ? -1 : 0;
+}
+
+void sched_sleep_us(uint64_t us) {
+    uint64_t deadline = timer_now() + timer_us_to_ticks(us);
+    int nobody;                     // a channel no one wakes
+    uint64_t s = irq_save();
+    while (sched_sleep_until(&nobody, 0, deadline) == 0)
+        ;
+    irq_restore(s);
+}
+
+void sched_exit(int status) {
+    uint64_t s = irq_save();
+    mycpu()->current->exit_status = status;
+    mycpu()->current->state = TASK_STOPPED;
+    irq_restore(s);
+    for (;;)
+        sched_yield();
+}
+
+pcb_t *sched_current(void) {
+    uint64_t s = irq_save();
+    pcb_t *p = mycpu()->current;
+    irq_restore(s);
+    return p;
+}
+
+void sched_set_quantum(uint32_t us) {
+    if (us == 0) us = 1;
+    uint64_t s = irq_save();
+    quantum_us = us;
+    quantum_ticks = timer_us_to_ticks(us);
+    mycpu()->tick_due = timer_now() + quantum_ticks;
+    program_timer(mycpu());
+    irq_restore(s);
+}
+
+uint32_t sched_get_quantum(void) {
+    return quantum_us;
+}
+
+// -----------------------------------------------------------------------------
+// Accounting
+// -----------------------------------------------------------------------------
+
+pcb_t *sched_acct_self(acct_t *out) {
+    uint64_t s = irq_save();
+    cpu_t *c = mycpu();
+    pcb_t *p = c->current;
+    account(c, p);
+    *out = p->acct;
+    irq_restore(s);
+    return p;
+}
+
+// another hart's cycle counters cannot be read from here, so a thread
+// running elsewhere only gets its current slice added to `time`
+void sched_acct_read(pcb_t *p, acct_t *out) {
+    uint64_t s = irq_save();
+    cpu_t *c = &cpus[p->cpu];
+    if (c == mycpu() && c->current == p)
+        account(c, p);
+    *out = p->acct;
+    if (c != mycpu() && c->current == p) {
+        uint64_t now = timer_now(), since = c->acct_time;
+        if (now > since)
+            out->time += now - since;
+    }
+    irq_restore(s);
+}
+
+void sched_acct_tx(uint64_t n) {
+    uint64_t s = irq_save();
+    pcb_t *p = mycpu()->current;
+    if (p) {
+        p->acct.tx_bytes += n;
+        if (p->sub_acct)
+            p->sub_acct->tx_bytes += n;
+    }
+    irq_restore(s);
+}
+
+pcb_t *sched_boot_thread(void) {
+    return &boot_pcb;
+}
+
+pcb_t *sched_idle_thread(int hart) {
+    if (hart < 0 || hart >= MAX_HARTS || !cpus[hart].online)
+        return 0;
+    return cpus[hart].idle;
+}
+
+void sched_cpu_stats(void) {
+    uart_puts("  HART  CURRENT   QUEUED  SWITCHES  STEALS\n");
+    for (int i = 0; i < MAX_HARTS; i++) {
+        cpu_t *c = &cpus[i];
+        if (!c->online) continue;
+        uart_puts("  ");
+        uart_put_dec(i);
+        uart_puts("     ");
+        uart_puts(c->current->name);
+        uart_puts("\t");
+        uart_put_dec((int)c->rq_len);
+        uart_puts("\t");
+        uart_put_dec((int)c->switches);
+        uart_puts("\t");
+        uart_put_dec((int)c->steals);
+        uart_puts("\n");
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Context switch benchmark
+// -----------------------------------------------------------------------------
+
+static volatile int bench_running;
+
+static void bench_partner(void) {
+    while (bench_running)
+        sched_yield();
+}
+
+static void bench_report(const char *what, uint64_t cycles, uint64_t ticks, int n) {
+    uart_puts("  ");
+    uart_puts(what);
+    uart_puts(": ");
+    uart_put_dec((int)(cycles / (uint64_t)n));
+    uart_puts(" cycles, ");
+    uart_put_dec((int)(ticks * (1000000000UL / TIMER_HZ) / (uint64_t)n));
+    uart_puts(" ns\n");
+}
+
+//   1. yield with whatever else is runnable: one trap round trip per call
+//      when the shell is alone, which is the fixed cost of the trap path.
+//   2. ping-pong with a partner thread that yields straight back: every
+//      shell yield is two full context switches.
+//   run it with no other tasks active for clean numbers. with more than one
+//   hart the partner may be stolen by another hart, and then step 2 shows
+//   the cost of a yield with nothing else queued locally.
+void sched_bench(int iters) {
+    if (iters <= 0) iters = 10000;
+
+    uart_puts("context switch benchmark (");
+    uart_put_dec(iters);
+    uart_puts(" iterations, quantum ");
+    uart_put_dec((int)quantum_us);
+    uart_puts(" us)\n");
+
+    uint64_t c0 = rdcycle(), t0 = timer_now();
+    for (int i = 0; i < iters; i++)
+        sched_yield();
+    bench_report("yield round trip", rdcycle() - c0, timer_now() - t0, iters);
+
+    bench_running = 1;
+    if (tasks_spawn("bench", (uint64_t)bench_partner, 0) < 0) {
+        bench_running = 0;
+        uart_puts("  no free slot for partner thread\n");
+        return;
+    }
+    sched_yield();   // let the partner get going
+
+    c0 = rdcycle();
+    t0 = timer_now();
+    for (int i = 0; i < iters; i++)
+        sched_yield();
+    bench_report("context switch", rdcycle() - c0, timer_now() - t0, 2 * iters);
+
+    bench_running = 0;
+    sched_yield();   // partner sees the flag and exits
+}
+
+// -----------------------------------------------------------------------------
+// Parallel throughput benchmark
+// -----------------------------------------------------------------------------
+
+static spinlock_t smp_lock;
+static int smp_done;              // guarded by smp_lock
+static int smp_target;
+static uint64_t smp_work;
+
+// fixed amount of pure ALU work, no shared memory
+static void smp_worker(void) {
+    uint64_t x = 88172645463325252UL;
+    for (uint64_t i = 0; i < smp_work; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    asm volatile("" :: "r"(x));
+
+    uint64_t s = spin_lock_irqsave(&smp_lock);
+    if (++smp_done == smp_target)
+        sched_wakeup(&smp_done);
+    spin_unlock_irqrestore(&smp_lock, s);
+}
+
+//   for k = 1 .. online harts: start k workers with the same amount of work
+//   each and time until all are done. ideal scaling keeps the time flat, so
+//   the speedup column should track k.
+void sched_bench_smp(int work) {
+    if (work <= 0) work = 2000000;
+    smp_work = (uint64_t)work;
+    int n = ncpus;
+
+    uart_puts("parallel throughput benchmark (");
+    uart_put_dec(work);
+    uart_puts(" iterations per worker, ");
+    uart_put_dec(n);
+    uart_puts(" harts online)\n");
+    uart_puts("  workers  time(us)  speedup x100\n");
+
+    uint64_t base = 0;
+    for (int k = 1; k <= n; k++) {
+        smp_done = 0;
+        smp_target = k;
+        uint64_t t0 = timer_now();
+        int started = 0;
+        for (int i = 0; i < k; i++)
+            if (tasks_spawn("smp", (uint64_t)smp_worker, 0) >= 0)
+                started++;
+        if (started < k) {
+            uart_puts("  out of pcb slots\n");
+            smp_target = started;
+        }
+
+        uint64_t s = spin_lock_irqsave(&smp_lock);
+        while (smp_done < smp_target)
+            sched_sleep(&smp_done, &smp_lock);
+        spin_unlock_irqrestore(&smp_lock, s);
+
+        uint64_t dt = timer_now() - t0;
+        if (k == 1) base = dt;
+        uart_puts("  ");
+        uart_put_dec(k);
+        uart_puts("        ");
+        uart_put_dec((int)(dt / timer_us_to_ticks(1)));
+        uart_puts("\t    ");
+        // k workers' worth of work in dt, against one worker's in base
+        uart_put_dec(dt ? (int)((uint64_t)k * base * 100 / dt) : 0);
+        uart_puts("\n");
+        if (started < k)
+            return;
+    }
+}
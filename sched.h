@@ -0,0 +1,135 @@
+// sched.h — preemptive round-robin SMP scheduler
+// every runnable thread (the shell, tasks started with `run`, and programs
+// started with `load`) is a pcb_t with a saved trapframe. each hart has its
+// own run queue; the machine timer fires once per quantum on every hart
+// that runs a thread and trap_handler() asks the scheduler for the next
+// frame to resume. a hart with an empty queue steals work from the busiest
+// other hart. threads waiting on a device sleep on a channel and are woken
+// from the interrupt handler, or by a deadline (sched_sleep_until()); when
+// nothing is runnable the hart's idle thread parks it in wfi with no tick,
+// until its next kernel timer (ktimer.h) or an interrupt.
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "tasks.h"
+#include "trap.h"
+#include "spinlock.h"
+
+// default time slice, in microseconds. can be overridden at build time
+// (-DSCHED_QUANTUM_US=...) or changed at runtime with the `quantum` command.
+#ifndef SCHED_QUANTUM_US
+#define SCHED_QUANTUM_US 10000
+#endif
+
+//   adopts the currently running boot thread (kernel_main -> shell) as the
+//   first schedulable thread.
+//   called by: - kernel_main() in main.c
+void sched_init(void);
+
+//   arms the first tick and enables machine interrupts. from here on the
+//   shell can be preempted.
+//   called by: - kernel_main() in main.c
+void sched_start(void);
+
+//   turns the calling secondary hart's boot context into its idle thread,
+//   starts its tick and never returns.
+//   called by: - secondary_main() in main.c
+void sched_start_secondary(void) __attribute__((noreturn));
+
+//   number of harts taking part in scheduling.
+int sched_ncpus(void);
+
+//   builds the initial trapframe at the top of pcb->sp so that the first
+//   switch to this thread "returns" to pcb->entry with a0 = arg. if the
+//   entry function returns, it lands in sched_exit(): with status 0 for a
+//   kernel thread, with the return value for a user program.
+void sched_prepare(pcb_t *pcb, uint64_t arg);
+
+//   marks a thread runnable and appends it to this hart's run queue.
+void sched_enqueue(pcb_t *pcb);
+
+//   trap-side entry points (trap.c). sched_tick() runs the expired kernel
+//   timers, switches at the end of a quantum and programs the next timer
+//   interrupt; sched_switch() is used for voluntary yields.
+trapframe_t *sched_tick(trapframe_t *tf);
+trapframe_t *sched_switch(trapframe_t *tf);
+
+//   called by trapvec.S once it runs on the new thread's frame: lets other
+//   harts pick up the previous thread, or reaps it if it stopped.
+void sched_finish_switch(void);
+
+//   stops the current thread after a fatal exception and switches away.
+trapframe_t *sched_kill_current(trapframe_t *tf);
+
+//   after a device interrupt: if the hart was idling and the interrupt
+//   woke somebody up, switch to them right away instead of waiting for the
+//   next tick.
+trapframe_t *sched_wake_check(trapframe_t *tf);
+
+//   give up the rest of the time slice.
+void sched_yield(void);
+
+//   block the current thread until sched_wakeup(chan). must be called with
+//   interrupts disabled and with the wait condition re-checked in a loop by
+//   the caller. `lk`, if not 0, is the spinlock protecting that condition:
+//   it is held on entry, released once the thread is on the sleep list (so
+//   no wakeup can be missed) and held again on return. interrupts are still
+//   off when it returns.
+void sched_sleep(void *chan, spinlock_t *lk);
+
+//   make every thread sleeping on chan runnable. safe from interrupt context.
+void sched_wakeup(void *chan);
+
+//   sched_sleep() with a timeout: also gives up at mtime `deadline`. 0 if
+//   woken, -1 once the deadline has passed (also if it already had).
+//   SCHED_NO_DEADLINE sleeps without a timer.
+#define SCHED_NO_DEADLINE (~0UL)
+int sched_sleep_until(void *chan, spinlock_t *lk, uint64_t deadline);
+
+//   blocks the calling thread for at least `us` microseconds. the hart
+//   idles meanwhile unless something else is runnable.
+//   called by: - task_sleep_us() in coro.c, the `sleep` shell command and
+//                the sleep system call
+void sched_sleep_us(uint64_t us);
+
+//   terminates the calling thread with an exit status for its group
+//   (tasks.h). its stack and pcb slot are reclaimed once the scheduler has
+//   switched away from it.
+void sched_exit(int status) __attribute__((noreturn));
+
+pcb_t *sched_current(void);
+
+void sched_set_quantum(uint32_t us);
+uint32_t sched_get_quantum(void);
+
+//   context switch benchmark (shell command "bench ctx").
+void sched_bench(int iters);
+
+//   runs 1..N CPU-bound workers on N harts and prints the speedup (shell
+//   command "bench smp").
+void sched_bench_smp(int work);
+
+//   per-hart switch and steal counters (shell command "cpus").
+void sched_cpu_stats(void);
+
+//   brings the calling thread's acct up to this moment, copies it to *out
+//   and returns the thread.
+//   called by: - coro.c, to charge a coroutine's task at each switch
+pcb_t *sched_acct_self(acct_t *out);
+
+//   p's acct including the slice it is running right now (on another hart:
+//   time only). p must not be torn down meanwhile.
+void sched_acct_read(pcb_t *p, acct_t *out);
+
+//   charges n console bytes to the running thread and its coroutine's task.
+//   called by: - uart.c, handle.c (console) and kprintf()
+void sched_acct_tx(uint64_t n);
+
+//   the shell's thread, and hart's idle thread (0 if the hart is offline),
+//   which have no pcb_table slot.
+pcb_t *sched_boot_thread(void);
+pcb_t *sched_idle_thread(int hart);
+
+#endif
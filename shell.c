@@ -2,11 +2,42 @@
 // ---------------------------------------------------------------
 // Built-in commands:
 //   help         - Display this help message
-//   ls           - List all files in the filesystem
+//   ls [dir]     - List a directory (default: the current one)
 //   cat <file>   - Display contents of a specific file
+//   write/append <file> <text> - Replace / extend a file with a line of text
+//   cp <src> <dst>, rm <path>, mkdir <dir>, cd [dir], pwd, stat <path>
 //   tasks        - List registered demo tasks
-//   run <task>   - Execute a named task
-//   load <file>  - Loads a separate ELF file from the in-memory FS
+//   run <task>   - Start a named task in the background
+//   load <file>  - Runs an ELF program from the in-memory FS until it exits
+//   <cmd> &      - Run a program, pipeline or command in the background
+//   jobs, fg [n], wait [n] - List background jobs, wait for them
+//   echo <text>  - Print a line of text
+//   a | b | c [> file] - Pipeline: stages joined by pipes, output to a file
+//   imgcache [flush] - Prepared image cache hits/misses and load latency
+//   fscache [flush] - Compressed file sizes, inflated file cache, first-access latency
+//   time <cmd>   - Cycles, instructions retired and wall time of a command
+//   mark <name> <cmd> - Same as time, as one "@mark" line for scripts
+//   perf [reset] - Dump (or zero) the kernel's instrumentation counters
+//   prof start [hz] / stop / dump - Sampling profiler (tools/profsym.py)
+//   dmesg [-n level] - Kernel log ring, or set the console log level
+//   ps           - List running threads and programs
+//   cpus         - Per-hart scheduler counters
+//   top [ms] [n] - Per-thread and per-task cpu, cycles, syscalls, output
+//   quantum [us] - Show or set the scheduler time slice
+//   sleep <ms>   - Block the shell for ms milliseconds
+//   timers       - Per-hart kernel timer wheels
+//   bench ctx [n]- Context switch benchmark
+//   bench smp [n]- Parallel speedup on 1..N harts
+//   bench syscall [n] - U-mode syscall round trip, fast and full path
+//   bench mem    - memcpy/memset/strlen variant benchmark
+//   bench kmalloc [n] - slab/kmalloc throughput benchmark
+//   bench fs [n] - ramfs lookup cost as a directory grows
+//   bench ipc [n]- Message queue ping-pong latency and throughput
+//   bench coro [n] - Coroutine switches per second
+//   bench spawn [n] - Spawn-to-exit latency of short-lived programs
+//   bench timer [n] - Timer arm/cancel cost, fire latency with n timers queued
+//   mem          - Page allocator free/fragmentation statistics
+//   slabinfo     - Per-cache object counters
 //   whoami       - Display current user
 //   su           - Switch to superuser (password: riscv)
 //   clear        - Clear the screen
@@ -23,21 +54,27 @@
 #include "tasks.h"
 #include "shell.h"
 #include "loader.h"
-
-#define CMD_BUF_SIZE 64
+#include "sched.h"
+#include "string.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "syscall.h"
+#include "perf.h"
+#include "prof.h"
+#include "kprintf.h"
+#include "timer.h"
+#include "riscv.h"
+#include "handle.h"
+#include "mq.h"
+#include "coro.h"
+#include "ktimer.h"
+
+#define CMD_BUF_SIZE 128
 
 // -----------------------------------------------------------------------------
 // Local string helpers
 // -----------------------------------------------------------------------------
 
-static int str_eq(const char *a, const char *b) {
-    while (*a && *b) {
-        if (*a != *b) return 0;
-        a++; b++;
-    }
-    return (*a == '\0' && *b == '\0');
-}
-
 static int starts_with(const char *s, const char *prefix) {
     while (*prefix) {
         if (*s != *prefix) return 0;
@@ -46,10 +83,27 @@ static int starts_with(const char *s, const char *prefix) {
     return 1;
 }
 
-static int str_len(const char *s) {
-    int n = 0;
-    while (*s++) n++;
-    return n;
+// split off the first blank-separated word of s: NUL-terminates it in place
+// and returns the rest of the line with leading blanks skipped. *word gets
+// the start of the word.
+static char *split_word(char *s, char **word) {
+    while (*s == ' ' || *s == '\t') s++;
+    *word = s;
+    while (*s && *s != ' ' && *s != '\t') s++;
+    if (*s) *s++ = '\0';
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+// parse a non-negative decimal number, skipping leading blanks.
+// returns -1 if there are no digits.
+static int parse_uint(const char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s < '0' || *s > '9') return -1;
+    int v = 0;
+    while (*s >= '0' && *s <= '9')
+        v = v * 10 + (*s++ - '0');
+    return v;
 }
 
 // -----------------------------------------------------------------------------
@@ -94,54 +148,538 @@ static void shell_su(void) {
     }
 }
 
+// the shell thread ends; with nothing else to run the harts idle without
+// a tick until QEMU is killed from the host
 static void cmd_quit(void) {
-    uart_puts("Exiting shell + halting CPU. Use host to kill QEMU if needed.\n");
-    for (;;) { asm volatile("wfi"); }
+    uart_puts("Exiting shell. Use host to kill QEMU if needed.\n");
+    klog_flush();
+    sched_exit(0);
 }
 
 // -----------------------------------------------------------------------------
-// File and program loading helpers
+// File system commands
 // -----------------------------------------------------------------------------
 
-static int try_run_file(const char *name) {
-    if (!name || name[0] == '\0') return -1;
+// write/append <file> <text>: the text becomes one line of the file
+static void cmd_write(char *arg, int append) {
+    char *file;
+    char *text = split_word(arg, &file);
+    if (!*file) {
+        uart_puts(append ? "usage: append <file> <text>\n" : "usage: write <file> <text>\n");
+        return;
+    }
+    if (fs_write(file, text, (size_t)strlen(text), append) != 0 ||
+        fs_write(file, "\n", 1, 1) != 0)
+        uart_puts("write failed.\n");
+}
+
+static void cmd_cp(char *arg) {
+    char *src, *dst;
+    split_word(split_word(arg, &src), &dst);
+    if (!*src || !*dst) {
+        uart_puts("usage: cp <src> <dst>\n");
+        return;
+    }
+    if (fs_copy(src, dst) != 0)
+        uart_puts("cp failed.\n");
+}
+
+// commands taking exactly one path: rm, mkdir, cd
+static void cmd_path(char *arg, int (*op)(const char *), const char *usage) {
+    char *path;
+    split_word(arg, &path);
+    if (!*path) {
+        uart_puts(usage);
+        return;
+    }
+    if (op(path) != 0) {
+        uart_puts("failed: ");
+        uart_puts(path);
+        uart_puts("\n");
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Scheduler commands
+// -----------------------------------------------------------------------------
+
+static void cmd_quantum(const char *arg) {
+    int us = parse_uint(arg);
+    if (us > 0)
+        sched_set_quantum((uint32_t)us);
+    uart_puts("quantum: ");
+    uart_put_dec((int)sched_get_quantum());
+    uart_puts(" us\n");
+}
+
+// top [ms] [n]: redraws every ms (1000) until a key is pressed, or prints
+// n frames one after another
+static void cmd_top(char *arg) {
+    char *ms;
+    char *rest = split_word(arg, &ms);
+    int n = parse_uint(rest);
+    tasks_top(parse_uint(ms), n > 0 ? n : 0);
+}
+
+// the hart runs other threads or idles meanwhile, unlike a busy loop
+static void cmd_sleep(const char *arg) {
+    int ms = parse_uint(arg);
+    if (ms < 0) {
+        uart_puts("usage: sleep <ms>\n");
+        return;
+    }
+    sched_sleep_us((uint64_t)ms * 1000);
+}
+
+static void cmd_bench(const char *arg) {
+    while (*arg == ' ') arg++;
+    if (starts_with(arg, "ctx")) {
+        sched_bench(parse_uint(arg + 3));
+    } else if (starts_with(arg, "syscall")) {
+        syscall_bench(parse_uint(arg + 7));
+    } else if (starts_with(arg, "smp")) {
+        sched_bench_smp(parse_uint(arg + 3));
+    } else if (starts_with(arg, "mem")) {
+        string_bench();
+    } else if (starts_with(arg, "kmalloc")) {
+        kmem_bench(parse_uint(arg + 7));
+    } else if (starts_with(arg, "fs")) {
+        fs_bench(parse_uint(arg + 2));
+    } else if (starts_with(arg, "ipc")) {
+        mq_bench(parse_uint(arg + 3));
+    } else if (starts_with(arg, "coro")) {
+        coro_bench(parse_uint(arg + 4));
+    } else if (starts_with(arg, "spawn")) {
+        tasks_bench_spawn(parse_uint(arg + 5));
+    } else if (starts_with(arg, "timer")) {
+        ktimer_bench(parse_uint(arg + 5));
+    } else {
+        uart_puts("usage: bench ctx [n] | bench smp [n] | bench syscall [n] | bench mem | bench kmalloc [n] | bench fs [n] | bench ipc [n] | bench coro [n] | bench spawn [n] | bench timer [n]\n");
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Measurement
+// -----------------------------------------------------------------------------
+
+static void shell_exec(char *cmd);
+
+// counters of the hart we are on, read together with interrupts off
+static int read_counters(uint64_t *cycles, uint64_t *instret) {
+    uint64_t s = irq_save();
+    int hart = (int)hart_id();
+    *cycles = rdcycle();
+    *instret = rdinstret();
+    irq_restore(s);
+    return hart;
+}
+
+// what running one command cost
+typedef struct {
+    uint64_t us;
+    uint64_t cycles, insns;     // on the shell's hart; only if h0 == h1
+    int h0, h1;                 // hart at the start and at the end
+} measure_t;
+
+// cycles include anything else the hart ran in between (the shell can be
+// preempted). programs and pipelines are timed until they exit; `run` and
+// background jobs only until they are started.
+static void measure(char *cmd, measure_t *m) {
+    uint64_t c0, i0, c1, i1;
+    uint64_t t0 = timer_now();
+    m->h0 = read_counters(&c0, &i0);
+    shell_exec(cmd);
+    m->h1 = read_counters(&c1, &i1);
+    m->us = (timer_now() - t0) / timer_us_to_ticks(1);
+    m->cycles = c1 - c0;
+    m->insns = i1 - i0;
+}
+
+// time <command>: run a command and report the cycles and instructions it
+// took on the shell's hart, plus wall time
+static void cmd_time(char *arg) {
+    if (!*arg) {
+        uart_puts("usage: time <command>\n");
+        return;
+    }
+    measure_t m;
+    measure(arg, &m);
+
+    uart_puts("time: ");
+    if (m.h0 != m.h1) {
+        // per-hart counters from two different harts mean nothing
+        uart_puts("moved from hart ");
+        uart_put_dec(m.h0);
+        uart_puts(" to ");
+        uart_put_dec(m.h1);
+        uart_puts(", no cycle counts, ");
+    } else {
+        uint64_t cycles = m.cycles, insns = m.insns;
+        uint64_t ipc = cycles ? insns * 100 / cycles : 0;
+        uart_put_u64(cycles);
+        uart_puts(" cycles, ");
+        uart_put_u64(insns);
+        uart_puts(" instructions (IPC ");
+        uart_put_u64(ipc / 100);
+        uart_putc('.');
+        uart_putc((char)('0' + ipc / 10 % 10));
+        uart_putc((char)('0' + ipc % 10));
+        uart_puts("), ");
+    }
+    uart_put_u64(m.us);
+    uart_puts(" us\n");
+}
+
+// one timing marker: "@mark <name> <us> us [<cycles> cycles <insns> instret]".
+// a single uart_puts() is atomic, so the line never mixes with klogd's
+// output from another hart. tools/qemubench.py (make bench) collects them.
+static void mark_emit(const char *name, const measure_t *m) {
+    char line[128];
+    if (m->h0 == m->h1)
+        ksnprintf(line, sizeof(line), "@mark %s %lu us %lu cycles %lu instret\n",
+                  name, m->us, m->cycles, m->insns);
+    else
+        ksnprintf(line, sizeof(line), "@mark %s %lu us\n", name, m->us);
+    uart_puts(line);
+}
+
+// mark <name> <command>: `time` for scripts. the command's log messages
+// go out first, so the marker is the last thing before the prompt.
+static void cmd_mark(char *arg) {
+    char *name;
+    char *cmd = split_word(arg, &name);
+    if (!*name || !*cmd) {
+        uart_puts("usage: mark <name> <command>\n");
+        return;
+    }
+    measure_t m;
+    measure(cmd, &m);
+    klog_flush();
+    mark_emit(name, &m);
+}
+
+// dmesg -n [level]: show or set which levels reach the console
+static void cmd_loglevel(const char *arg) {
+    int level = klog_console_level(parse_uint(arg));
+    uart_puts("console log level ");
+    uart_put_dec(level);
+    uart_puts(" (levels below it are printed, 0..8)\n");
+}
+
+// echo <text>: one line to stdout, so it can feed a pipe or a file
+static void cmd_echo(const char *arg) {
+    while (*arg == ' ' || *arg == '\t') arg++;
+    out_puts(arg);
+    out_puts("\n");
+}
+
+// -----------------------------------------------------------------------------
+// Pipelines
+// -----------------------------------------------------------------------------
+// "a | b | c > file": every stage runs as its own thread, stdin and stdout
+// wired to pipes (handle.h). a stage naming an ELF file ("wc.elf" or
+// "load wc.elf") runs as a user program; anything else is a shell command
+// run by a kernel thread. commands that print through out_write() (cat,
+// ls, echo) write to the pipe; the rest still print on the console. all
+// stages join one task group, which the job code below waits on.
+
+#define PIPE_MAX_STAGES 4
+
+// strip blanks at both ends, in place
+static char *trim(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char *e = s + strlen(s);
+    while (e > s && (e[-1] == ' ' || e[-1] == '\t')) e--;
+    *e = '\0';
+    return s;
+}
+
+static int is_pipeline(const char *cmd) {
+    for (; *cmd; cmd++)
+        if (*cmd == '|' || *cmd == '>')
+            return 1;
+    return 0;
+}
+
+// the ELF file a stage runs, or 0 if it is a shell command
+static const char *stage_program(const char *cmd) {
+    if (starts_with(cmd, "load ")) {
+        cmd += 5;
+        while (*cmd == ' ' || *cmd == '\t') cmd++;
+        return *cmd ? cmd : 0;
+    }
+    int n = strlen(cmd);
+    for (int i = 0; i < n; i++)
+        if (cmd[i] == ' ' || cmd[i] == '\t')
+            return 0;
+    return n > 4 && str_eq(cmd + n - 4, ".elf") ? cmd : 0;
+}
 
-    uart_puts("Attempting to load file: ");
-    uart_puts(name);
-    uart_puts("\n");
+// a shell command stage: the thread's own copy of the command line
+static void stage_thread(char *cmd) {
+    shell_exec(cmd);
+    kfree(cmd);
+}
 
-    pcb_t pcb;
-    int r = load_program_from_fs(name, &pcb);
-    if (r != 0) {
-        uart_puts("loader: failed to load file or not an ELF.\n");
+// start one stage reading `in` and writing `out`. the stage owns both
+// references from here on, whether or not it starts.
+static int start_stage(const char *cmd, handle_t *in, handle_t *out,
+                       task_group_t *g) {
+    pcb_t pcb = {0};
+    pcb.stdio[0] = in;
+    pcb.stdio[1] = out;
+    tasks_group_add(g, &pcb);
+
+    const char *prog = stage_program(cmd);
+    if (prog) {
+        if (load_program_from_fs(prog, &pcb) != 0 || tasks_add_pcb(&pcb) < 0) {
+            tasks_release(&pcb);
+            return -1;
+        }
+        tasks_start_program(&pcb);
+        return 0;
+    }
+    int n = strlen(cmd) + 1;
+    char *copy = (char *)kmalloc((size_t)n);
+    if (!copy) {
+        tasks_release(&pcb);
+        return -1;
+    }
+    memcpy(copy, cmd, (size_t)n);
+    pcb.name = "pipeline";
+    pcb.entry = (uint64_t)stage_thread;
+    if (tasks_spawn_pcb(&pcb, (uint64_t)copy) < 0) {
+        kfree(copy);
         return -1;
     }
+    return 0;
+}
+
+// start the stages of `line` in g. -1 if nothing could be started because
+// the line is malformed or the output file cannot be opened.
+static int start_pipeline(char *line, task_group_t *g) {
+    // "> file" or ">> file" ends the line
+    char *redir = 0;
+    int append = 0;
+    for (char *s = line; *s; s++) {
+        if (*s == '>') {
+            append = s[1] == '>';
+            *s = '\0';
+            redir = trim(s + 1 + append);
+            if (!*redir || is_pipeline(redir)) {
+                uart_puts("usage: <cmd> [| <cmd> ...] [> file | >> file]\n");
+                return -1;
+            }
+            break;
+        }
+    }
+
+    char *stages[PIPE_MAX_STAGES];
+    int n = 0;
+    for (char *s = line; ; ) {
+        char *bar = s;
+        while (*bar && *bar != '|') bar++;
+        int last = *bar == '\0';
+        *bar = '\0';
+        if (n == PIPE_MAX_STAGES) {
+            uart_puts("pipeline: at most 4 stages\n");
+            return -1;
+        }
+        stages[n] = trim(s);
+        if (!*stages[n]) {
+            uart_puts("usage: <cmd> [| <cmd> ...] [> file | >> file]\n");
+            return -1;
+        }
+        n++;
+        if (last)
+            break;
+        s = bar + 1;
+    }
 
-    if (tasks_add_pcb(&pcb) < 0) {
-        uart_puts("tasks: out of slots\n");
+    handle_t *out = 0;
+    if (redir && !(out = handle_open(redir, append))) {
+        uart_puts("cannot open ");
+        uart_puts(redir);
+        uart_puts("\n");
         return -1;
     }
 
-    tasks_start_program(&pcb);
+    handle_t *in = 0;
+    for (int i = 0; i < n; i++) {
+        handle_t *rd = 0, *wr;
+        if (i < n - 1) {
+            if (handle_pipe(&rd, &wr) != 0) {
+                uart_puts("pipe: out of memory\n");
+                break;
+            }
+        } else {
+            wr = handle_dup(out);
+        }
+        if (start_stage(stages[i], in, wr, g) != 0) {
+            uart_puts("cannot start: ");
+            uart_puts(stages[i]);
+            uart_puts("\n");
+        }
+        in = rd;
+    }
+    handle_close(in);
+    handle_close(out);
     return 0;
 }
 
-static void cmd_load(const char *arg) {
-    if (!arg || arg[0] == '\0') {
-        uart_puts("usage: load <file>\n");
+// -----------------------------------------------------------------------------
+// Jobs
+// -----------------------------------------------------------------------------
+// a program, a pipeline or any command followed by "&" runs as a job: its
+// threads form one task group, and each reports its exit status there as
+// it is torn down. the shell waits for a foreground job straight away. a
+// background job gets a number instead; `jobs` lists them, `fg` and `wait`
+// wait for them, and the prompt reports the ones that have finished.
+
+#define JOB_MAX 8
+
+typedef struct job {
+    task_group_t g;
+    int seq;                    // start order, the newest is fg's default
+    char cmd[CMD_BUF_SIZE];
+} job_t;
+
+static job_t *jobs[JOB_MAX];    // background jobs; job number = slot + 1
+static int job_seq;
+
+// "cmd &": strip the & and say whether it was there
+static int strip_background(char *cmd) {
+    char *e = cmd + strlen(cmd);
+    while (e > cmd && (e[-1] == ' ' || e[-1] == '\t')) e--;
+    if (e == cmd || e[-1] != '&')
+        return 0;
+    e[-1] = '\0';
+    return 1;
+}
+
+// under the group lock: once it is ours, the last member has let go of
+// the group and the job may be freed
+static int job_done(job_t *j) {
+    uint64_t s = spin_lock_irqsave(&j->g.lock);
+    int done = j->g.live == 0;
+    spin_unlock_irqrestore(&j->g.lock, s);
+    return done;
+}
+
+static void job_report(int id, job_t *j) {
+    char line[CMD_BUF_SIZE + 32];
+    if (j->g.status == TASK_EXIT_KILLED)
+        ksnprintf(line, sizeof(line), "[%d] killed    %s\n", id, j->cmd);
+    else
+        ksnprintf(line, sizeof(line), "[%d] exit %d    %s\n", id, j->g.status, j->cmd);
+    uart_puts(line);
+}
+
+// wait for background job `slot`, report and free it
+static void job_wait(int slot) {
+    job_t *j = jobs[slot];
+    tasks_group_wait(&j->g);
+    job_report(slot + 1, j);
+    jobs[slot] = 0;
+    kfree(j);
+}
+
+// before every prompt: report the background jobs that have finished
+static void jobs_notify(void) {
+    for (int i = 0; i < JOB_MAX; i++)
+        if (jobs[i] && job_done(jobs[i]))
+            job_wait(i);
+}
+
+static void run_job(char *line, int bg) {
+    job_t *j = (job_t *)kzalloc(sizeof(job_t));
+    if (!j) {
+        uart_puts("job: out of memory\n");
+        return;
+    }
+    line = trim(line);
+    int n = strlen(line);
+    if (n >= CMD_BUF_SIZE)
+        n = CMD_BUF_SIZE - 1;
+    memcpy(j->cmd, line, (size_t)n);
+
+    int slot = -1;
+    if (bg) {
+        for (int i = 0; i < JOB_MAX && slot < 0; i++)
+            if (!jobs[i])
+                slot = i;
+        if (slot < 0) {
+            uart_puts("jobs: too many background jobs\n");
+            kfree(j);
+            return;
+        }
+    }
+    if (start_pipeline(line, &j->g) != 0) {
+        kfree(j);
         return;
     }
 
-    while (*arg == ' ' || *arg == '\t') arg++;
-
-    if (*arg == '\0') {
-        uart_puts("usage: load <file>\n");
+    if (!bg) {
+        tasks_group_wait(&j->g);
+        if (j->g.status == TASK_EXIT_KILLED) {
+            uart_puts("killed\n");
+        } else if (j->g.status) {
+            char msg[24];
+            ksnprintf(msg, sizeof(msg), "exit %d\n", j->g.status);
+            uart_puts(msg);
+        }
+        kfree(j);
         return;
     }
+    j->seq = ++job_seq;
+    jobs[slot] = j;
+    char msg[CMD_BUF_SIZE + 16];
+    ksnprintf(msg, sizeof(msg), "[%d] %s\n", slot + 1, j->cmd);
+    uart_puts(msg);
+}
+
+static void cmd_jobs(void) {
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (!jobs[i])
+            continue;
+        char line[CMD_BUF_SIZE + 32];
+        ksnprintf(line, sizeof(line), "[%d] %s   %s\n", i + 1,
+                  job_done(jobs[i]) ? "done   " : "running", jobs[i]->cmd);
+        uart_puts(line);
+    }
+}
 
-    if (try_run_file(arg) != 0) {
-        uart_puts("load failed: no such ELF or loader error.\n");
+// fg [n] waits for job n, by default the newest; wait [n] waits for job n
+// or, without n, for all of them. there is no terminal to hand over, so
+// both simply wait.
+static void cmd_wait(const char *arg, int fg) {
+    while (*arg == ' ' || *arg == '\t') arg++;
+    if (*arg == '%') arg++;
+    int id = parse_uint(arg);
+    if (id < 0 && *arg) {
+        uart_puts(fg ? "usage: fg [n]\n" : "usage: wait [n]\n");
+        return;
+    }
+    if (id < 0 && fg) {
+        for (int i = 0; i < JOB_MAX; i++)
+            if (jobs[i] && (id < 0 || jobs[i]->seq > jobs[id - 1]->seq))
+                id = i + 1;
+        if (id < 0) {
+            uart_puts("fg: no background jobs\n");
+            return;
+        }
+    }
+    if (id < 0) {
+        for (int i = 0; i < JOB_MAX; i++)
+            if (jobs[i])
+                job_wait(i);
+        return;
+    }
+    if (id < 1 || id > JOB_MAX || !jobs[id - 1]) {
+        uart_puts("no such job\n");
+        return;
     }
+    job_wait(id - 1);
 }
 
 // -----------------------------------------------------------------------------
@@ -151,18 +689,163 @@ static void cmd_load(const char *arg) {
 static void shell_help(void) {
     uart_puts("Available commands:\n");
     uart_puts("  help         - Show this help message\n");
-    uart_puts("  ls           - List files\n");
+    uart_puts("  ls [dir]     - List files\n");
     uart_puts("  cat <file>   - Display file contents\n");
+    uart_puts("  write <file> <text>  - Replace a file's contents with a line of text\n");
+    uart_puts("  append <file> <text> - Add a line of text to a file\n");
+    uart_puts("  cp <src> <dst> - Copy a file\n");
+    uart_puts("  rm <path>    - Remove a file or empty directory\n");
+    uart_puts("  mkdir <dir>  - Create a directory\n");
+    uart_puts("  cd [dir]     - Change directory (default /)\n");
+    uart_puts("  pwd          - Print the current directory\n");
+    uart_puts("  stat <path>  - Show inode, size and extents\n");
     uart_puts("  tasks        - List available tasks\n");
-    uart_puts("  run <task>   - Run a demo task\n");
-    uart_puts("  load <file>  - Load and start an ELF program from the file system\n");
-    uart_puts("  quit         - Exit the shell (halts the kernel)\n");
+    uart_puts("  run <task>   - Start a demo task as a coroutine in the background\n");
+    uart_puts("  load <file>  - Run an ELF program from the file system until it exits\n");
+    uart_puts("  <cmd> &      - Run a program, pipeline or command in the background\n");
+    uart_puts("  jobs         - List background jobs\n");
+    uart_puts("  fg [n] / wait [n] - Wait for background job n (wait: all jobs)\n");
+    uart_puts("  echo <text>  - Print a line of text\n");
+    uart_puts("  a | b [> f]  - Pipe a's output into b; > or >> sends it to file f\n");
+    uart_puts("  imgcache [flush] - Show (or empty) the prepared program image cache\n");
+    uart_puts("  fscache [flush] - Show (or empty) the inflated compressed file cache\n");
+    uart_puts("  time <cmd>   - Run a command and show its cycles and instructions\n");
+    uart_puts("  mark <name> <cmd> - Time a command, printed as an @mark line for scripts\n");
+    uart_puts("  perf [reset] - Show (or zero) loader/fs/uart/scheduler counters\n");
+    uart_puts("  prof start [hz] | stop | dump - Sample where the harts spend time\n");
+    uart_puts("  dmesg [-n level] - Show the kernel log, or set the console level\n");
+    uart_puts("  ps           - List running threads and programs\n");
+    uart_puts("  cpus         - Show per-hart switches and steals\n");
+    uart_puts("  top [ms] [n] - Live cpu%, cycles, IPC, syscalls and output per thread/task\n");
+    uart_puts("  quantum [us] - Show or set the scheduler time slice\n");
+    uart_puts("  sleep <ms>   - Sleep for ms milliseconds\n");
+    uart_puts("  timers       - Show per-hart kernel timer wheels\n");
+    uart_puts("  bench ctx [n]- Measure context switch cost\n");
+    uart_puts("  bench smp [n]- Measure speedup with 1..N harts busy\n");
+    uart_puts("  bench syscall [n] - Measure syscall round trip from U-mode\n");
+    uart_puts("  bench mem    - Compare memcpy/memset/strlen variants\n");
+    uart_puts("  bench kmalloc [n] - Measure kmalloc/kfree throughput\n");
+    uart_puts("  bench fs [n] - Measure file lookup cost with n files\n");
+    uart_puts("  bench ipc [n]- Measure message queue latency and throughput\n");
+    uart_puts("  bench coro [n] - Measure coroutine switch cost\n");
+    uart_puts("  bench spawn [n] - Measure spawn-to-exit latency of programs\n");
+    uart_puts("  bench timer [n] - Measure timer cost and latency with n timers queued\n");
+    uart_puts("  mem          - Show free pages and fragmentation\n");
+    uart_puts("  slabinfo     - Show slab cache usage counters\n");
+    uart_puts("  quit         - Exit the shell (the harts then idle)\n");
     uart_puts("  whoami       - Show current user (user/root)\n");
     uart_puts("  su           - Become superuser (password: riscv)\n");
     uart_puts("  clear        - Clear the screen\n");
     uart_puts("  !!           - Repeat the last command\n");
 }
 
+// -----------------------------------------------------------------------------
+// Command dispatch
+// -----------------------------------------------------------------------------
+
+static void shell_exec(char *cmd) {
+    int bg = strip_background(cmd);
+    if (bg || is_pipeline(cmd) || stage_program(cmd)) {
+        run_job(cmd, bg);
+    } else if (str_eq(cmd, "help")) {
+        shell_help();
+    } else if (str_eq(cmd, "ls") || starts_with(cmd, "ls ")) {
+        char *dir;
+        split_word(cmd + 2, &dir);
+        fs_list(dir);
+    } else if (starts_with(cmd, "cat ")) {
+        fs_cat(cmd + 4);
+    } else if (starts_with(cmd, "write ")) {
+        cmd_write(cmd + 6, 0);
+    } else if (starts_with(cmd, "append ")) {
+        cmd_write(cmd + 7, 1);
+    } else if (starts_with(cmd, "cp ")) {
+        cmd_cp(cmd + 3);
+    } else if (starts_with(cmd, "rm ")) {
+        cmd_path(cmd + 3, fs_remove, "usage: rm <path>\n");
+    } else if (starts_with(cmd, "mkdir ")) {
+        cmd_path(cmd + 6, fs_mkdir, "usage: mkdir <dir>\n");
+    } else if (str_eq(cmd, "cd")) {
+        fs_chdir("/");
+    } else if (starts_with(cmd, "cd ")) {
+        cmd_path(cmd + 3, fs_chdir, "usage: cd <dir>\n");
+    } else if (str_eq(cmd, "pwd")) {
+        fs_pwd();
+    } else if (starts_with(cmd, "stat ")) {
+        fs_stat(cmd + 5);
+    } else if (str_eq(cmd, "tasks")) {
+        tasks_list();
+    } else if (starts_with(cmd, "run ")) {
+        tasks_run(cmd + 4);
+    } else if (str_eq(cmd, "ps")) {
+        tasks_ps();
+    } else if (str_eq(cmd, "cpus")) {
+        sched_cpu_stats();
+    } else if (str_eq(cmd, "top") || starts_with(cmd, "top ")) {
+        cmd_top(cmd + 3);
+    } else if (str_eq(cmd, "quantum") || starts_with(cmd, "quantum ")) {
+        cmd_quantum(cmd + 7);
+    } else if (str_eq(cmd, "sleep") || starts_with(cmd, "sleep ")) {
+        cmd_sleep(cmd + 5);
+    } else if (str_eq(cmd, "timers")) {
+        ktimer_stats();
+    } else if (starts_with(cmd, "bench ")) {
+        cmd_bench(cmd + 6);
+    } else if (str_eq(cmd, "mem")) {
+        kalloc_stats();
+    } else if (str_eq(cmd, "slabinfo")) {
+        kmem_stats();
+    } else if (str_eq(cmd, "whoami")) {
+        shell_whoami();
+    } else if (str_eq(cmd, "su")) {
+        shell_su();
+    } else if (str_eq(cmd, "quit") || str_eq(cmd, "exit")) {
+        cmd_quit();
+    } else if (str_eq(cmd, "load") || starts_with(cmd, "load ")) {
+        uart_puts("usage: load <file>\n");
+    } else if (str_eq(cmd, "jobs")) {
+        cmd_jobs();
+    } else if (str_eq(cmd, "fg") || starts_with(cmd, "fg ")) {
+        cmd_wait(cmd + 2, 1);
+    } else if (str_eq(cmd, "wait") || starts_with(cmd, "wait ")) {
+        cmd_wait(cmd + 4, 0);
+    } else if (str_eq(cmd, "imgcache")) {
+        loader_cache_stats();
+    } else if (str_eq(cmd, "imgcache flush")) {
+        loader_cache_flush();
+    } else if (str_eq(cmd, "fscache")) {
+        fs_cache_stats();
+    } else if (str_eq(cmd, "fscache flush")) {
+        fs_cache_flush();
+    } else if (starts_with(cmd, "time ")) {
+        cmd_time(cmd + 5);
+    } else if (str_eq(cmd, "mark") || starts_with(cmd, "mark ")) {
+        cmd_mark(cmd + 4);
+    } else if (str_eq(cmd, "perf")) {
+        perf_dump();
+    } else if (str_eq(cmd, "perf reset")) {
+        perf_reset();
+    } else if (str_eq(cmd, "dmesg")) {
+        klog_dmesg();
+    } else if (str_eq(cmd, "dmesg -n") || starts_with(cmd, "dmesg -n ")) {
+        cmd_loglevel(cmd + 8);
+    } else if (str_eq(cmd, "prof")) {
+        prof_status();
+    } else if (str_eq(cmd, "prof start") || starts_with(cmd, "prof start ")) {
+        prof_start(parse_uint(cmd + 10));
+    } else if (str_eq(cmd, "prof stop")) {
+        prof_stop();
+    } else if (str_eq(cmd, "prof dump")) {
+        prof_dump();
+    } else if (str_eq(cmd, "echo") || starts_with(cmd, "echo ")) {
+        cmd_echo(cmd + 4);
+    } else if (str_eq(cmd, "clear")) {
+        uart_puts("\033[2J\033[H");  // ANSI clear screen
+    } else if (strlen(cmd) > 0) {
+        uart_puts("Unknown command. Type 'help'.\n");
+    }
+}
+
 // -----------------------------------------------------------------------------
 // Shell main loop
 // -----------------------------------------------------------------------------
@@ -171,6 +854,13 @@ void shell_run(void) {
     char cmd[CMD_BUF_SIZE];
     static char last_cmd[CMD_BUF_SIZE] = {0};
 
+    // boot marker: mtime and the hart's counters start at reset, so this
+    // is the time from reset to the first prompt
+    measure_t boot;
+    boot.h0 = boot.h1 = read_counters(&boot.cycles, &boot.insns);
+    boot.us = timer_now() / timer_us_to_ticks(1);
+    klog_flush();
+    mark_emit("boot", &boot);
     uart_puts("> ");
     while (1) {
         int i = 0;
@@ -195,29 +885,8 @@ void shell_run(void) {
         // ---------------------------------------------------------------------
         // Command handling
         // ---------------------------------------------------------------------
-        if (str_eq(cmd, "help")) {
-            shell_help();
-        } else if (str_eq(cmd, "ls")) {
-            fs_list();
-        } else if (starts_with(cmd, "cat ")) {
-            fs_cat(cmd + 4);
-        } else if (str_eq(cmd, "tasks")) {
-            tasks_list();
-        } else if (starts_with(cmd, "run ")) {
-            tasks_run(cmd + 4);
-        } else if (str_eq(cmd, "whoami")) {
-            shell_whoami();
-        } else if (str_eq(cmd, "su")) {
-            shell_su();
-        } else if (str_eq(cmd, "quit") || str_eq(cmd, "exit")) {
-            cmd_quit();
-        } else if (starts_with(cmd, "load ")) {
-            // ✅ FIXED: skip "load " prefix to send just the filename
-            cmd_load(cmd + 5);
-        } else if (str_eq(cmd, "clear")) {
-            uart_puts("\033[2J\033[H");  // ANSI clear screen
-        } else if (str_eq(cmd, "!!")) {
-            if (str_len(last_cmd) > 0) {
+        if (str_eq(cmd, "!!")) {
+            if (strlen(last_cmd) > 0) {
                 uart_puts("Repeating last command: ");
                 uart_puts(last_cmd);
                 uart_puts("\n");
@@ -228,16 +897,20 @@ void shell_run(void) {
             } else {
                 uart_puts("No previous command.\n");
             }
-        } else if (str_len(cmd) > 0) {
-            uart_puts("Unknown command. Type 'help'.\n");
+        } else {
+            shell_exec(cmd);
         }
 
         // store last command (if non-empty)
-        if (str_len(cmd) > 0 && !str_eq(cmd, "!!")) {
+        if (strlen(cmd) > 0 && !str_eq(cmd, "!!")) {
             for (int j = 0; j < CMD_BUF_SIZE; j++)
                 last_cmd[j] = cmd[j];
         }
 
+        // the command's log messages go out before the next prompt, and
+        // so does news of finished background jobs
+        klog_flush();
+        jobs_notify();
         uart_puts("> ");
     }
 }
@@ -0,0 +1,378 @@
+// slab.c — slab object caches and kmalloc for the RISC-V OS
+// ---------------------------------------------------------------
+// two layers per cache:
+//
+//   magazines  one per hart: a stack of up to KMEM_MAG_SIZE free objects
+//              plus that hart's counters, on its own cache line. alloc pops,
+//              free pushes; nothing shared is touched.
+//   slabs      single pages from kalloc.c. a small header at the start of
+//              the page, the objects after it, free objects linked through
+//              their first word. an empty magazine is refilled with half a
+//              magazine from the slabs; a full one gives half back.
+//
+// magazines are only ever touched by their own hart with interrupts off;
+// the slab layer is shared and each cache guards it with its own spinlock,
+// taken once per half-magazine transfer rather than once per object.
+//
+// partially used slabs sit on a per-cache list; full slabs are on no list
+// and rejoin it when an object comes back. one empty slab is kept as a
+// spare, further empty slabs go back to the page allocator.
+//
+// kmalloc() rounds up to a power-of-two size class. anything above
+// KMEM_MAX_OBJ gets whole pages with a small header in front. kfree() finds
+// its way back through the header at the start of the object's page.
+// ---------------------------------------------------------------
+
+#include "slab.h"
+#include "kalloc.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "string.h"
+#include "uart.h"
+#include "kprintf.h"
+
+#define SLAB_MAGIC  0x51ab51abU
+#define BIG_MAGIC   0xb16b16b1U
+#define KMEM_ALIGN  16
+
+struct slab {
+    uint32_t magic;
+    uint16_t inuse;
+    uint16_t total;
+    kmem_cache_t *cache;
+    struct slab *next;
+    struct slab *prev;
+    void *free;
+};
+
+// header in front of a kmalloc() block that is too big for a size class
+struct big_hdr {
+    uint32_t magic;
+    uint32_t order;
+    uint64_t pad;
+};
+
+struct kmem_mag {
+    int rounds;
+    void *obj[KMEM_MAG_SIZE];
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t hits;           // allocs served without going to the slabs
+} __attribute__((aligned(64)));
+
+struct kmem_cache {
+    const char *name;
+    uint32_t size;
+    uint32_t per_slab;
+    spinlock_t lock;         // slab layer below
+    struct slab *partial;
+    struct slab *spare;
+    uint64_t slabs;
+    struct kmem_mag mags[MAX_HARTS];
+};
+
+static kmem_cache_t caches[KMEM_MAX_CACHES];
+static int ncaches;
+static spinlock_t caches_lock;
+
+// size classes 16, 32, ... KMEM_MAX_OBJ
+#define KMALLOC_MIN_SHIFT 4
+#define KMALLOC_CLASSES   7
+static kmem_cache_t *kmalloc_caches[KMALLOC_CLASSES];
+static const char *kmalloc_names[KMALLOC_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024",
+};
+
+#define SLAB_HDR_SIZE ((sizeof(struct slab) + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1))
+
+// -----------------------------------------------------------------------------
+// Slab layer (interrupts off, c->lock held)
+// -----------------------------------------------------------------------------
+
+static void partial_push(kmem_cache_t *c, struct slab *s) {
+    s->prev = 0;
+    s->next = c->partial;
+    if (s->next)
+        s->next->prev = s;
+    c->partial = s;
+}
+
+static void partial_remove(kmem_cache_t *c, struct slab *s) {
+    if (s->prev)
+        s->prev->next = s->next;
+    else
+        c->partial = s->next;
+    if (s->next)
+        s->next->prev = s->prev;
+    s->next = s->prev = 0;
+}
+
+static struct slab *slab_new(kmem_cache_t *c) {
+    struct slab *s = (struct slab *)kalloc_page();
+    if (!s)
+        return 0;
+    s->magic = SLAB_MAGIC;
+    s->cache = c;
+    s->inuse = 0;
+    s->total = (uint16_t)c->per_slab;
+    s->free = 0;
+    // link back to front so objects come out in address order
+    uint8_t *base = (uint8_t *)s + SLAB_HDR_SIZE;
+    for (int i = (int)c->per_slab - 1; i >= 0; i--) {
+        void **o = (void **)(base + (uint64_t)i * c->size);
+        *o = s->free;
+        s->free = o;
+    }
+    c->slabs++;
+    return s;
+}
+
+static void *slab_take(kmem_cache_t *c) {
+    struct slab *s = c->partial;
+    if (!s) {
+        if (c->spare) {
+            s = c->spare;
+            c->spare = 0;
+        } else {
+            s = slab_new(c);
+            if (!s)
+                return 0;
+        }
+        partial_push(c, s);
+    }
+    void **o = (void **)s->free;
+    s->free = *o;
+    s->inuse++;
+    if (!s->free)
+        partial_remove(c, s);   // full: off the list until something returns
+    return o;
+}
+
+static void slab_give(kmem_cache_t *c, void *obj) {
+    struct slab *s = (struct slab *)PGROUNDDOWN((uint64_t)obj);
+    int was_full = s->free == 0;
+    *(void **)obj = s->free;
+    s->free = obj;
+    s->inuse--;
+    if (was_full)
+        partial_push(c, s);
+    if (s->inuse == 0) {
+        partial_remove(c, s);
+        if (!c->spare) {
+            c->spare = s;
+        } else {
+            s->magic = 0;
+            c->slabs--;
+            kfree_page(s);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Caches
+// -----------------------------------------------------------------------------
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size) {
+    if (size == 0 || size > KMEM_MAX_OBJ)
+        return 0;
+    uint64_t s = spin_lock_irqsave(&caches_lock);
+    if (ncaches == KMEM_MAX_CACHES) {
+        spin_unlock_irqrestore(&caches_lock, s);
+        return 0;
+    }
+    kmem_cache_t *c = &caches[ncaches++];
+    spin_unlock_irqrestore(&caches_lock, s);
+
+    memset(c, 0, sizeof(*c));
+    c->name = name;
+    c->size = (uint32_t)((size + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1));
+    c->per_slab = (uint32_t)((PGSIZE - SLAB_HDR_SIZE) / c->size);
+    return c;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *c) {
+    uint64_t s = irq_save();
+    struct kmem_mag *m = &c->mags[hart_id()];
+    if (m->rounds) {
+        m->hits++;
+    } else {
+        // empty magazine: refill half of it from the slabs
+        spin_lock(&c->lock);
+        while (m->rounds < KMEM_MAG_SIZE / 2) {
+            void *o = slab_take(c);
+            if (!o)
+                break;
+            m->obj[m->rounds++] = o;
+        }
+        spin_unlock(&c->lock);
+    }
+    void *obj = 0;
+    if (m->rounds) {
+        obj = m->obj[--m->rounds];
+        m->allocs++;
+    }
+    irq_restore(s);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *c, void *obj) {
+    if (!obj)
+        return;
+    uint64_t s = irq_save();
+    struct kmem_mag *m = &c->mags[hart_id()];
+    if (m->rounds == KMEM_MAG_SIZE) {
+        // full magazine: hand the older half back to the slabs
+        spin_lock(&c->lock);
+        for (int i = 0; i < KMEM_MAG_SIZE / 2; i++)
+            slab_give(c, m->obj[i]);
+        spin_unlock(&c->lock);
+        for (int i = 0; i < KMEM_MAG_SIZE / 2; i++)
+            m->obj[i] = m->obj[i + KMEM_MAG_SIZE / 2];
+        m->rounds = KMEM_MAG_SIZE / 2;
+    }
+    m->obj[m->rounds++] = obj;
+    m->frees++;
+    irq_restore(s);
+}
+
+// -----------------------------------------------------------------------------
+// kmalloc
+// -----------------------------------------------------------------------------
+
+void kmem_init(void) {
+    for (int i = 0; i < KMALLOC_CLASSES; i++)
+        kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i],
+                                              1UL << (KMALLOC_MIN_SHIFT + i));
+    kprintf("[MEM] slab allocator: %d kmalloc size classes, %d-object magazines per hart\n",
+            KMALLOC_CLASSES, KMEM_MAG_SIZE);
+}
+
+void *kmalloc(size_t n) {
+    if (n <= KMEM_MAX_OBJ) {
+        int i = 0;
+        while ((1UL << (KMALLOC_MIN_SHIFT + i)) < n)
+            i++;
+        return kmem_cache_alloc(kmalloc_caches[i]);
+    }
+    int order = kalloc_order_for(n + sizeof(struct big_hdr));
+    struct big_hdr *h = (struct big_hdr *)kalloc_pages(order);
+    if (!h)
+        return 0;
+    h->magic = BIG_MAGIC;
+    h->order = (uint32_t)order;
+    return h + 1;
+}
+
+void *kzalloc(size_t n) {
+    void *p = kmalloc(n);
+    if (p)
+        memset(p, 0, n);
+    return p;
+}
+
+void kfree(void *p) {
+    if (!p)
+        return;
+    struct slab *s = (struct slab *)PGROUNDDOWN((uint64_t)p);
+    if (s->magic == SLAB_MAGIC) {
+        kmem_cache_free(s->cache, p);
+    } else if (((struct big_hdr *)s)->magic == BIG_MAGIC) {
+        struct big_hdr *h = (struct big_hdr *)s;
+        h->magic = 0;
+        kfree_pages(h, (int)h->order);
+    } else {
+        kprintf(KERN_ERR "[MEM] kfree of unknown pointer %p\n", p);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Statistics
+// -----------------------------------------------------------------------------
+
+static void put_padded(const char *s, int width) {
+    uart_puts(s);
+    for (int n = strlen(s); n < width; n++)
+        uart_putc(' ');
+}
+
+void kmem_stats(void) {
+    uart_puts("cache           size  active  slabs    allocs     frees  hit%\n");
+    for (int i = 0; i < ncaches; i++) {
+        kmem_cache_t *c = &caches[i];
+        uint64_t allocs = 0, frees = 0, hits = 0;
+        for (int h = 0; h < MAX_HARTS; h++) {
+            allocs += c->mags[h].allocs;
+            frees += c->mags[h].frees;
+            hits += c->mags[h].hits;
+        }
+        put_padded(c->name, 14);
+        uart_puts("  ");
+        uart_put_dec((int)c->size);
+        uart_puts("\t");
+        uart_put_dec((int)(allocs - frees));
+        uart_puts("\t");
+        uart_put_dec((int)c->slabs);
+        uart_puts("\t");
+        uart_put_dec((int)allocs);
+        uart_puts("\t");
+        uart_put_dec((int)frees);
+        uart_puts("\t");
+        uart_put_dec(allocs ? (int)(hits * 100 / allocs) : 0);
+        uart_puts("\n");
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+#define BENCH_BATCH 256
+
+static void bench_line(const char *what, uint64_t cycles, int ops) {
+    uart_puts("  ");
+    put_padded(what, 26);
+    uart_put_dec((int)(cycles / (uint64_t)ops));
+    uart_puts(" cycles/op\n");
+}
+
+//   1. alloc+free of the same size back to back: always a magazine hit.
+//   2. BENCH_BATCH allocs, then BENCH_BATCH frees: magazines run dry and
+//      overflow, so this includes the slab refill/flush path.
+//   3. kalloc_page/kfree_page for comparison.
+void kmem_bench(int iters) {
+    static void *batch[BENCH_BATCH];
+    static const int sizes[] = { 32, 128, 512 };
+
+    if (iters <= 0) iters = 10000;
+    uart_puts("kmalloc benchmark (");
+    uart_put_dec(iters);
+    uart_puts(" iterations)\n");
+
+    for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        int n = sizes[k];
+        uart_puts(" size ");
+        uart_put_dec(n);
+        uart_puts("\n");
+
+        uint64_t c0 = rdcycle();
+        for (int i = 0; i < iters; i++)
+            kfree(kmalloc((size_t)n));
+        bench_line("alloc+free (magazine)", rdcycle() - c0, iters);
+
+        int rounds = iters / BENCH_BATCH ? iters / BENCH_BATCH : 1;
+        c0 = rdcycle();
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < BENCH_BATCH; i++)
+                batch[i] = kmalloc((size_t)n);
+            for (int i = 0; i < BENCH_BATCH; i++)
+                kfree(batch[i]);
+        }
+        bench_line("batch alloc/free (slabs)", rdcycle() - c0, 2 * rounds * BENCH_BATCH);
+    }
+
+    uint64_t c0 = rdcycle();
+    for (int i = 0; i < iters; i++)
+        kfree_page(kalloc_page());
+    bench_line("kalloc_page+kfree_page", rdcycle() - c0, iters);
+}
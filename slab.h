@@ -0,0 +1,44 @@
+// slab.h — object caches and kmalloc on top of the page allocator
+// a cache hands out fixed-size objects carved from single pages (slabs).
+// each hart keeps a small magazine of free objects per cache, so the common
+// alloc/free never leaves the hart's own memory. kmalloc() picks a
+// power-of-two size-class cache, or whole pages for anything bigger.
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// largest object a cache (and a kmalloc size class) holds; bigger kmalloc
+// requests are served straight from kalloc_pages()
+#define KMEM_MAX_OBJ    1024
+#define KMEM_MAX_CACHES 24
+#define KMEM_MAG_SIZE   32
+
+typedef struct kmem_cache kmem_cache_t;
+
+//   creates the kmalloc size classes (16 .. KMEM_MAX_OBJ bytes).
+//   called by: - kernel_main() in main.c (after kalloc_init)
+void kmem_init(void);
+
+//   creates a named cache of `size`-byte objects (size <= KMEM_MAX_OBJ).
+//   returns 0 if the cache table is full or size is out of range.
+kmem_cache_t *kmem_cache_create(const char *name, size_t size);
+
+//   objects are not zeroed. free must go back to the same cache.
+void *kmem_cache_alloc(kmem_cache_t *c);
+void kmem_cache_free(kmem_cache_t *c, void *obj);
+
+void *kmalloc(size_t n);
+void *kzalloc(size_t n);
+void kfree(void *p);
+
+//   per-cache usage counters (shell command "slabinfo").
+void kmem_stats(void);
+
+//   alloc/free throughput for the magazine fast path, the slab refill path
+//   and raw page allocation (shell command "bench kmalloc").
+void kmem_bench(int iters);
+
+#endif
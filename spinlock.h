@@ -0,0 +1,82 @@
+// spinlock.h — locks for state shared between harts
+// two flavours:
+//   spinlock_t    test-and-test-and-set on one word (amoswap.w.aq). cheap
+//                 and fine for short, lightly contended sections.
+//   ticketlock_t  FIFO ticket lock (amoadd.w): harts are served in arrival
+//                 order, so nobody starves under heavy contention.
+//
+// a lock must never be held by a thread that can be interrupted on the same
+// hart (the handler could spin on it forever), so the *_irqsave variants
+// disable machine interrupts first and return the old mstatus, exactly like
+// irq_save(). the plain variants are for code that already runs with
+// interrupts off (the trap handler, or inside an irqsave section).
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include "riscv.h"
+
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+typedef struct {
+    volatile uint32_t next;      // next ticket to hand out
+    volatile uint32_t serving;   // ticket currently allowed in
+} ticketlock_t;
+
+#define SPINLOCK_INIT   { 0 }
+#define TICKETLOCK_INIT { 0, 0 }
+
+static inline void spin_lock(spinlock_t *l) {
+    for (;;) {
+        if (!__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE))
+            return;
+        // wait with plain loads so the line is not bounced between harts
+        while (__atomic_load_n(&l->locked, __ATOMIC_RELAXED))
+            ;
+    }
+}
+
+static inline int spin_trylock(spinlock_t *l) {
+    return !__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE);
+}
+
+static inline void spin_unlock(spinlock_t *l) {
+    __atomic_store_n(&l->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t spin_lock_irqsave(spinlock_t *l) {
+    uint64_t s = irq_save();
+    spin_lock(l);
+    return s;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *l, uint64_t s) {
+    spin_unlock(l);
+    irq_restore(s);
+}
+
+static inline void ticket_lock(ticketlock_t *l) {
+    uint32_t t = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&l->serving, __ATOMIC_ACQUIRE) != t)
+        ;
+}
+
+static inline void ticket_unlock(ticketlock_t *l) {
+    __atomic_store_n(&l->serving, l->serving + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t ticket_lock_irqsave(ticketlock_t *l) {
+    uint64_t s = irq_save();
+    ticket_lock(l);
+    return s;
+}
+
+static inline void ticket_unlock_irqrestore(ticketlock_t *l, uint64_t s) {
+    ticket_unlock(l);
+    irq_restore(s);
+}
+
+#endif
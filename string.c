@@ -1,19 +1,89 @@
 // in a freestanding (bare-metal) environment, the standard C library is not
-// linked by default. this file provides a few basic string functions used
-// throughout the OS, reimplemented from scratch
+// linked by default. this file is the kernel's own small libc ("libk"): the
+// memory and string routines every other module uses, reimplemented from
+// scratch.
 
 // implemented functions:
+//   - memcpy() / memmove() / memset() / memcmp()
 //   - strcmp()  compare two strings
 //   - strncmp() compare up to N characters of two strings
 //   - strlen()  calculate the length of a string
+//   - str_eq()  string equality (used by the shell, fs and tasks)
+//
+// the hot routines come in several variants:
+//   byte  - the original one-byte-per-iteration loops (kept as a baseline)
+//   word  - 8 bytes per iteration; works on any rv64 hart
+//   zbb   - word-at-a-time strlen/strcmp using orc.b to find the NUL byte
+//   rvv   - vector memcpy/memset (string_rvv.S)
+// string_init() picks the best available one at boot; the public functions
+// call through the selected pointers.
 
 #include "string.h"
+#include "uart.h"
+#include "kprintf.h"
+#include "riscv.h"
+#include "trap.h"
+#include <stdint.h>
+
+// 8-byte access that is allowed to alias whatever the caller's buffer is
+typedef uint64_t __attribute__((may_alias)) word_t;
+
+#define ONES  0x0101010101010101UL
+#define HIGHS 0x8080808080808080UL
+
+// below this size the vector path's setup cost is not worth it
+#define RVV_MIN_BYTES 128
+// vector registers are not saved on a context switch, so the vector loops
+// run with interrupts off; chunking bounds how long that lasts.
+#define RVV_CHUNK     4096
+
+extern void rvv_memcpy(void *dst, const void *src, size_t n);
+extern void rvv_memset(void *dst, int c, size_t n);
+
+// the word-at-a-time string loops read the whole aligned word holding the
+// terminator on purpose; the host build's AddressSanitizer (host/) would
+// report the bytes after it
+#ifdef __SANITIZE_ADDRESS__
+#define WORD_READS __attribute__((no_sanitize_address))
+#else
+#define WORD_READS
+#endif
+
+// nonzero if any byte of w is zero
+static inline uint64_t word_has_zero(uint64_t w) {
+    return (w - ONES) & ~w & HIGHS;
+}
+
+// -----------------------------------------------------------------------------
+// byte variants
+// -----------------------------------------------------------------------------
+
+static void *memcpy_byte(void *dst, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    for (size_t i = 0; i < n; ++i) d[i] = s[i];
+    return dst;
+}
+
+static void *memset_byte(void *dst, int c, size_t n) {
+    uint8_t *d = (uint8_t *)dst;
+    for (size_t i = 0; i < n; ++i) d[i] = (uint8_t)c;
+    return dst;
+}
+
+//   walks through memory from the start of the string until it hits '\0'.
+//   does not include the null terminator itself.
+static int strlen_byte(const char *s) {
+    int len = 0;
+    while (*s++) len++;
+    return len;
+}
 
 //   the function iterates through both strings until a mismatch is found
 //   or one string reaches the null terminator.
 //   the difference between the first non-matching characters determines
 //   the return value.
-int strcmp(const char *a, const char *b) {
+static int strcmp_byte(const char *a, const char *b) {
     while (*a && (*a == *b)) {
         a++;
         b++;
@@ -21,6 +91,291 @@ int strcmp(const char *a, const char *b) {
     return *(const unsigned char *)a - *(const unsigned char *)b;
 }
 
+// -----------------------------------------------------------------------------
+// word variants
+// -----------------------------------------------------------------------------
+
+//   aligns the destination, then moves 8 bytes per store. if the source
+//   ends up misaligned relative to the destination we still only do aligned
+//   loads and stitch neighbouring words together with shifts (RISC-V
+//   misaligned accesses may trap or be emulated slowly).
+static void *memcpy_word(void *dst, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (n >= 16) {
+        while ((uintptr_t)d & 7) {
+            *d++ = *s++;
+            n--;
+        }
+        word_t *dw = (word_t *)d;
+        uintptr_t off = (uintptr_t)s & 7;
+
+        if (off == 0) {
+            const word_t *sw = (const word_t *)s;
+            for (; n >= 64; n -= 64, dw += 8, sw += 8) {
+                dw[0] = sw[0]; dw[1] = sw[1]; dw[2] = sw[2]; dw[3] = sw[3];
+                dw[4] = sw[4]; dw[5] = sw[5]; dw[6] = sw[6]; dw[7] = sw[7];
+            }
+            for (; n >= 8; n -= 8)
+                *dw++ = *sw++;
+            s = (const uint8_t *)sw;
+        } else {
+            // the last word read always holds at least one byte we need,
+            // so this never touches memory past the end of the source word
+            const word_t *sw = (const word_t *)(s - off);
+            unsigned rs = (unsigned)off * 8, ls = 64 - rs;
+            uint64_t lo = *sw++;
+            size_t words = n / 8;
+            for (size_t i = 0; i < words; i++) {
+                uint64_t hi = *sw++;
+                *dw++ = (lo >> rs) | (hi << ls);
+                lo = hi;
+            }
+            s += words * 8;
+            n -= words * 8;
+        }
+        d = (uint8_t *)dw;
+    }
+
+    while (n--)
+        *d++ = *s++;
+    return dst;
+}
+
+static void *memset_word(void *dst, int c, size_t n) {
+    uint8_t *d = (uint8_t *)dst;
+
+    if (n >= 16) {
+        while ((uintptr_t)d & 7) {
+            *d++ = (uint8_t)c;
+            n--;
+        }
+        uint64_t v = (uint64_t)(uint8_t)c * ONES;
+        word_t *dw = (word_t *)d;
+        for (; n >= 64; n -= 64, dw += 8) {
+            dw[0] = v; dw[1] = v; dw[2] = v; dw[3] = v;
+            dw[4] = v; dw[5] = v; dw[6] = v; dw[7] = v;
+        }
+        for (; n >= 8; n -= 8)
+            *dw++ = v;
+        d = (uint8_t *)dw;
+    }
+
+    while (n--)
+        *d++ = (uint8_t)c;
+    return dst;
+}
+
+// aligned 8-byte loads never cross a page, so reading a few bytes past the
+// terminator is harmless
+WORD_READS static int strlen_word(const char *s) {
+    const char *p = s;
+    while ((uintptr_t)p & 7) {
+        if (*p == '\0') return (int)(p - s);
+        p++;
+    }
+    const word_t *w = (const word_t *)p;
+    while (!word_has_zero(*w))
+        w++;
+    p = (const char *)w;
+    while (*p)
+        p++;
+    return (int)(p - s);
+}
+
+WORD_READS static int strcmp_word(const char *a, const char *b) {
+    if ((((uintptr_t)a ^ (uintptr_t)b) & 7) == 0) {
+        while ((uintptr_t)a & 7) {
+            if (*a == '\0' || *a != *b) goto tail;
+            a++;
+            b++;
+        }
+        const word_t *wa = (const word_t *)a, *wb = (const word_t *)b;
+        while (*wa == *wb && !word_has_zero(*wa)) {
+            wa++;
+            wb++;
+        }
+        a = (const char *)wa;
+        b = (const char *)wb;
+    }
+tail:
+    return strcmp_byte(a, b);
+}
+
+// -----------------------------------------------------------------------------
+// Zbb variants
+// -----------------------------------------------------------------------------
+
+// orc.b turns every nonzero byte into 0xff and every zero byte into 0x00,
+// so a word without a NUL is all ones and ctz finds the first NUL directly.
+WORD_READS static int strlen_zbb(const char *s) {
+    const char *p = s;
+    while ((uintptr_t)p & 7) {
+        if (*p == '\0') return (int)(p - s);
+        p++;
+    }
+    const word_t *w = (const word_t *)p;
+    uint64_t m;
+    while ((m = zbb_orc_b(*w)) == ~0UL)
+        w++;
+    return (int)((const char *)w - s) + (int)(zbb_ctz(~m) >> 3);
+}
+
+WORD_READS static int strcmp_zbb(const char *a, const char *b) {
+    if ((((uintptr_t)a ^ (uintptr_t)b) & 7) == 0) {
+        while ((uintptr_t)a & 7) {
+            if (*a == '\0' || *a != *b) goto tail;
+            a++;
+            b++;
+        }
+        const word_t *wa = (const word_t *)a, *wb = (const word_t *)b;
+        while (*wa == *wb && zbb_orc_b(*wa) == ~0UL) {
+            wa++;
+            wb++;
+        }
+        a = (const char *)wa;
+        b = (const char *)wb;
+    }
+tail:
+    return strcmp_byte(a, b);
+}
+
+// -----------------------------------------------------------------------------
+// RVV variants
+// -----------------------------------------------------------------------------
+
+static void *memcpy_rvv(void *dst, const void *src, size_t n) {
+    if (n < RVV_MIN_BYTES)
+        return memcpy_word(dst, src, n);
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    while (n) {
+        size_t chunk = n < RVV_CHUNK ? n : RVV_CHUNK;
+        uint64_t st = irq_save();
+        rvv_memcpy(d, s, chunk);
+        irq_restore(st);
+        d += chunk;
+        s += chunk;
+        n -= chunk;
+    }
+    return dst;
+}
+
+static void *memset_rvv(void *dst, int c, size_t n) {
+    if (n < RVV_MIN_BYTES)
+        return memset_word(dst, c, n);
+    uint8_t *d = (uint8_t *)dst;
+    while (n) {
+        size_t chunk = n < RVV_CHUNK ? n : RVV_CHUNK;
+        uint64_t st = irq_save();
+        rvv_memset(d, c, chunk);
+        irq_restore(st);
+        d += chunk;
+        n -= chunk;
+    }
+    return dst;
+}
+
+// -----------------------------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------------------------
+
+typedef struct {
+    const char *name;
+    void *(*cpy)(void *, const void *, size_t);
+    void *(*set)(void *, int, size_t);
+    int (*len)(const char *);
+    int (*cmp)(const char *, const char *);
+    int available;
+} str_variant_t;
+
+enum { V_BYTE, V_WORD, V_ZBB, V_RVV, V_COUNT };
+
+static str_variant_t variants[V_COUNT] = {
+    { "byte", memcpy_byte, memset_byte, strlen_byte, strcmp_byte, 1 },
+    { "word", memcpy_word, memset_word, strlen_word, strcmp_word, 1 },
+    { "zbb",  memcpy_word, memset_word, strlen_zbb,  strcmp_zbb,  0 },
+    { "rvv",  memcpy_rvv,  memset_rvv,  strlen_word, strcmp_word, 0 },
+};
+
+// safe defaults so memcpy & co. work before string_init()
+static void *(*memcpy_impl)(void *, const void *, size_t) = memcpy_word;
+static void *(*memset_impl)(void *, int, size_t) = memset_word;
+static int (*strlen_impl)(const char *) = strlen_word;
+static int (*strcmp_impl)(const char *, const char *) = strcmp_word;
+
+#define MISA_V (1UL << ('V' - 'A'))
+
+// mstatus.VS is per hart: every hart that may run the vector variants
+// needs the unit switched on.
+void string_init_hart(void) {
+    if (variants[V_RVV].available)
+        csr_set(mstatus, MSTATUS_VS_INITIAL);
+}
+
+void string_init(void) {
+    // Zbb is not reported in misa; just try an orc.b and see if it traps
+    trap_probe_begin();
+    uint64_t probe = zbb_orc_b(0x100UL);
+    asm volatile("" :: "r"(probe));     // keep the probe from being dropped
+    variants[V_ZBB].available = !trap_probe_end();
+
+    if (csr_read(misa) & MISA_V)
+        variants[V_RVV].available = 1;
+    string_init_hart();
+
+    int mem = variants[V_RVV].available ? V_RVV : V_WORD;
+    int str = variants[V_ZBB].available ? V_ZBB : V_WORD;
+    memcpy_impl = variants[mem].cpy;
+    memset_impl = variants[mem].set;
+    strlen_impl = variants[str].len;
+    strcmp_impl = variants[str].cmp;
+
+    kprintf("[LIBK] memcpy/memset: %s, strlen/strcmp: %s\n",
+            variants[mem].name, variants[str].name);
+}
+
+void *memcpy(void *dst, const void *src, size_t n) {
+    return memcpy_impl(dst, src, n);
+}
+
+// forward copies are safe whenever dst is below src (or they don't overlap);
+// otherwise copy backwards a byte at a time
+void *memmove(void *dst, const void *src, size_t n) {
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    if (d <= s || d >= s + n)
+        return memcpy_word(dst, src, n);
+    while (n--)
+        d[n] = s[n];
+    return dst;
+}
+
+void *memset(void *dst, int c, size_t n) {
+    return memset_impl(dst, c, n);
+}
+
+int memcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *x = (const uint8_t *)a, *y = (const uint8_t *)b;
+    if ((((uintptr_t)x | (uintptr_t)y) & 7) == 0) {
+        while (n >= 8 && *(const word_t *)x == *(const word_t *)y) {
+            x += 8;
+            y += 8;
+            n -= 8;
+        }
+    }
+    for (; n; n--, x++, y++) {
+        if (*x != *y)
+            return *x - *y;
+    }
+    return 0;
+}
+
+int strcmp(const char *a, const char *b) {
+    return strcmp_impl(a, b);
+}
+
 //   similar to strcmp(), but stops early after `n` iterations.
 //   useful for checking prefixes or bounded comparisons.
 int strncmp(const char *a, const char *b, int n) {
@@ -31,10 +386,129 @@ int strncmp(const char *a, const char *b, int n) {
     return n < 0 ? 0 : *(const unsigned char *)a - *(const unsigned char *)b;
 }
 
-//   walks through memory from the start of the string until it hits '\0'.
-//   does not include the null terminator itself.
 int strlen(const char *s) {
-    int len = 0;
-    while (*s++) len++;
-    return len;
+    return strlen_impl(s);
+}
+
+int str_eq(const char *a, const char *b) {
+    return strcmp_impl(a, b) == 0;
+}
+
+// -----------------------------------------------------------------------------
+// Microbenchmark
+// -----------------------------------------------------------------------------
+
+#define BENCH_MAX 16384
+static uint8_t bench_src[BENCH_MAX + 64] __attribute__((aligned(64)));
+static uint8_t bench_dst[BENCH_MAX + 64] __attribute__((aligned(64)));
+
+static const int bench_sizes[] = { 8, 64, 512, 4096, BENCH_MAX };
+#define BENCH_NSIZES ((int)(sizeof(bench_sizes) / sizeof(bench_sizes[0])))
+
+// print v right-aligned in a column of the given width
+static void put_col(int v, int width) {
+    char buf[12];
+    int i = 0;
+    do {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    } while (v > 0 && i < (int)sizeof(buf));
+    while (width-- > i)
+        uart_putc(' ');
+    while (i--)
+        uart_putc(buf[i]);
+}
+
+static void bench_header(const char *what) {
+    uart_puts(what);
+    uart_puts("\n   size d/s");
+    for (int v = 0; v < V_COUNT; v++) {
+        if (!variants[v].available) continue;
+        uart_puts("     ");
+        uart_puts(variants[v].name);
+    }
+    uart_puts("   (cycles per call)\n");
+}
+
+// repetitions so that every measurement moves roughly the same amount of data
+static int bench_reps(int size) {
+    int r = (64 * 1024) / size;
+    return r < 4 ? 4 : r;
+}
+
+//   every routine is timed with mcycle over enough repetitions to move
+//   ~64 KiB, for each size and for aligned / misaligned buffers.
+//   d/s is the offset of the destination/source from an 8-byte boundary.
+void string_bench(void) {
+    static const int offs[][2] = { { 0, 0 }, { 0, 3 }, { 5, 1 } };
+
+    for (int i = 0; i < BENCH_MAX + 64; i++)
+        bench_src[i] = 'a' + (i % 26);
+
+    bench_header("memcpy");
+    for (int si = 0; si < BENCH_NSIZES; si++) {
+        for (int oi = 0; oi < 3; oi++) {
+            int n = bench_sizes[si], reps = bench_reps(n);
+            put_col(n, 7);
+            uart_puts("  ");
+            uart_put_dec(offs[oi][0]);
+            uart_puts("/");
+            uart_put_dec(offs[oi][1]);
+            for (int v = 0; v < V_COUNT; v++) {
+                if (!variants[v].available) continue;
+                uint64_t c0 = rdcycle();
+                for (int r = 0; r < reps; r++)
+                    variants[v].cpy(bench_dst + offs[oi][0], bench_src + offs[oi][1], (size_t)n);
+                put_col((int)((rdcycle() - c0) / (uint64_t)reps), 9);
+            }
+            uart_puts("\n");
+        }
+    }
+
+    bench_header("memset");
+    for (int si = 0; si < BENCH_NSIZES; si++) {
+        for (int oi = 0; oi < 3; oi += 2) {
+            int n = bench_sizes[si], reps = bench_reps(n);
+            put_col(n, 7);
+            uart_puts("  ");
+            uart_put_dec(offs[oi][0]);
+            uart_puts("/-");
+            for (int v = 0; v < V_COUNT; v++) {
+                if (!variants[v].available) continue;
+                uint64_t c0 = rdcycle();
+                for (int r = 0; r < reps; r++)
+                    variants[v].set(bench_dst + offs[oi][0], 0, (size_t)n);
+                put_col((int)((rdcycle() - c0) / (uint64_t)reps), 9);
+            }
+            uart_puts("\n");
+        }
+    }
+
+    bench_header("strlen / strcmp");
+    for (int si = 0; si < BENCH_NSIZES; si++) {
+        for (int oi = 0; oi < 2; oi++) {
+            int n = bench_sizes[si], reps = bench_reps(n);
+            // two equal strings so strcmp has to walk all of it
+            char *a = (char *)bench_src + offs[oi][1];
+            char *b = (char *)bench_dst + offs[oi][0];
+            memcpy_word(b, a, (size_t)n);
+            a[n] = b[n] = '\0';
+            put_col(n, 7);
+            uart_puts("  ");
+            uart_put_dec(offs[oi][0]);
+            uart_puts("/");
+            uart_put_dec(offs[oi][1]);
+            for (int v = 0; v < V_COUNT; v++) {
+                if (!variants[v].available) continue;
+                uint64_t c0 = rdcycle();
+                for (int r = 0; r < reps; r++) {
+                    variants[v].len(a);
+                    variants[v].cmp(a, b);
+                }
+                put_col((int)((rdcycle() - c0) / (uint64_t)reps), 9);
+            }
+            uart_puts("\n");
+            a[n] = 'a' + (char)((n + offs[oi][1]) % 26);
+        }
+    }
 }
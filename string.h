@@ -1,8 +1,50 @@
+// string.h — kernel memory/string library (libk)
+// every module uses these instead of carrying its own copy loops. the bulk
+// routines are dispatched at boot by string_init() to the fastest variant
+// the hart supports (byte, word-at-a-time, Zbb, RVV).
+
 #ifndef STRING_H
 #define STRING_H
 
+#include <stddef.h>
+
+#ifdef HOST_BUILD
+// the host build (riscv.h) links against the host's libc: libk keeps its
+// routines under names of their own, so the two never mix
+#define memcpy  kmemcpy
+#define memmove kmemmove
+#define memset  kmemset
+#define memcmp  kmemcmp
+#define strcmp  kstrcmp
+#define strncmp kstrncmp
+#define strlen  kstrlen
+#endif
+
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+int memcmp(const void *a, const void *b, size_t n);
+
 int strcmp(const char *a, const char *b);
 int strncmp(const char *a, const char *b, int n);
 int strlen(const char *s);
 
+// 1 if the two strings are identical, 0 otherwise
+int str_eq(const char *a, const char *b);
+
+//   probes misa and the Zbb instructions and selects the memcpy/memset/
+//   strlen/strcmp implementations. until it runs, the portable
+//   word-at-a-time versions are used.
+//   called by: - kernel_main() in main.c (after trap_init)
+void string_init(void);
+
+//   turns the vector unit on for the calling hart if string_init() chose
+//   the RVV variants.
+//   called by: - string_init(), and secondary_main() in main.c
+void string_init_hart(void);
+
+//   cycle-counted comparison of all available variants across sizes and
+//   alignments (shell command "bench mem").
+void string_bench(void);
+
 #endif
@@ -0,0 +1,282 @@
+// syscall.c — system calls for U-mode programs
+// ---------------------------------------------------------------
+// a U-mode `ecall` arrives in one of two ways (see trapvec.S):
+//
+//   fast path  calls in syscall_fast_mask (getpid, time). trapvec.S saves
+//              only the caller-saved registers, calls syscall_fast() on the
+//              kernel stack with interrupts off and goes straight back to
+//              U-mode. no trapframe, no scheduler.
+//   full path  everything else: the whole register file is saved,
+//              trap_handler() calls syscall_handler() and the call may
+//              block, yield or exit like any kernel thread.
+//
+// user pointers are virtual addresses in the caller's page table. the
+// kernel runs with translation off, so they are checked with vm_user_ok()
+// and copied through vm_copy_in()/vm_copy_out(). read and write go through
+// the task's stdio handles (handle.h): a pipe copies straight between the
+// user buffer and the other end, without a bounce buffer in between.
+// ---------------------------------------------------------------
+
+#include "syscall.h"
+#include "sched.h"
+#include "tasks.h"
+#include "timer.h"
+#include "uart.h"
+#include "riscv.h"
+#include "vm.h"
+#include "kalloc.h"
+#include "memlayout.h"
+#include "ring.h"
+#include "handle.h"
+#include "slab.h"
+
+#define TF_A1 11
+#define TF_A2 12
+#define TF_A7 17
+
+uint64_t syscall_fast_mask = SYSCALL_FAST_MASK;
+
+typedef int64_t (*syscall_fn)(trapframe_t *tf);
+
+// -----------------------------------------------------------------------------
+// Calls
+// -----------------------------------------------------------------------------
+
+int64_t syscall_write(pagetable_t pt, struct handle *const *stdio, uint64_t fd,
+                      uint64_t va, uint64_t n, int nonblock) {
+    if (fd != 1 && fd != 2)
+        return -1;
+    if (!vm_user_ok(pt, va, n, PTE_R))
+        return -1;
+    pipe_mem_t src = { pt, va };
+    return handle_write(stdio[fd], &src, n, nonblock);
+}
+
+int64_t syscall_read(pagetable_t pt, struct handle *const *stdio, uint64_t fd,
+                     uint64_t va, uint64_t n, int nonblock) {
+    if (fd != 0)
+        return -1;
+    if (!vm_user_ok(pt, va, n, PTE_W))
+        return -1;
+    pipe_mem_t dst = { pt, va };
+    return handle_read(stdio[0], &dst, n, nonblock);
+}
+
+static int64_t sys_write(trapframe_t *tf) {
+    pcb_t *p = sched_current();
+    return syscall_write(p->pagetable, p->stdio, tf->regs[TF_A0],
+                         tf->regs[TF_A1], tf->regs[TF_A2], 0);
+}
+
+static int64_t sys_read(trapframe_t *tf) {
+    pcb_t *p = sched_current();
+    return syscall_read(p->pagetable, p->stdio, tf->regs[TF_A0],
+                        tf->regs[TF_A1], tf->regs[TF_A2], 0);
+}
+
+static int64_t sys_exit(trapframe_t *tf) {
+    sched_exit((int)tf->regs[TF_A0]);
+}
+
+static int64_t sys_getpid(trapframe_t *tf) {
+    (void)tf;
+    return sched_current()->pid;
+}
+
+static int64_t sys_yield(trapframe_t *tf) {
+    (void)tf;
+    sched_yield();
+    return 0;
+}
+
+static int64_t sys_time(trapframe_t *tf) {
+    (void)tf;
+    return (int64_t)(timer_now() / timer_us_to_ticks(1));
+}
+
+static int64_t sys_sleep(trapframe_t *tf) {
+    sched_sleep_us(tf->regs[TF_A0]);
+    return 0;
+}
+
+static int64_t sys_ring_setup(trapframe_t *tf) {
+    return ring_setup(sched_current(), tf->regs[TF_A0], tf->regs[TF_A1]);
+}
+
+static int64_t sys_ring_enter(trapframe_t *tf) {
+    return ring_enter(sched_current(), tf->regs[TF_A0], tf->regs[TF_A1],
+                      tf->regs[TF_A2]);
+}
+
+static const syscall_fn syscalls[NSYSCALLS] = {
+    [SYS_write]  = sys_write,
+    [SYS_read]   = sys_read,
+    [SYS_exit]   = sys_exit,
+    [SYS_getpid] = sys_getpid,
+    [SYS_yield]  = sys_yield,
+    [SYS_time]   = sys_time,
+    [SYS_ring_setup] = sys_ring_setup,
+    [SYS_ring_enter] = sys_ring_enter,
+    [SYS_sleep]  = sys_sleep,
+};
+
+// calls that may sleep run with interrupts on, like a kernel thread: the
+// UART can only make progress if its interrupt gets through
+static const uint8_t blocking[NSYSCALLS] = {
+    [SYS_write] = 1,
+    [SYS_read]  = 1,
+    [SYS_ring_setup] = 1,
+    [SYS_ring_enter] = 1,
+    [SYS_sleep]  = 1,
+};
+
+// -----------------------------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------------------------
+
+trapframe_t *syscall_handler(trapframe_t *tf) {
+    uint64_t nr = tf->regs[TF_A7];
+    tf->mepc += 4;
+    sched_current()->acct.syscalls++;
+    if (nr >= NSYSCALLS || !syscalls[nr]) {
+        tf->regs[TF_A0] = (uint64_t)-1;
+        return tf;
+    }
+    // the frame stays where it is even if we are preempted and resume on
+    // another hart; mepc/mstatus are reloaded from it on the way out
+    if (blocking[nr])
+        csr_set(mstatus, MSTATUS_MIE);
+    int64_t ret = syscalls[nr](tf);
+    if (blocking[nr])
+        csr_clear(mstatus, MSTATUS_MIE);
+    tf->regs[TF_A0] = (uint64_t)ret;
+    return tf;
+}
+
+uint64_t syscall_fast(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                      uint64_t a4, uint64_t a5, uint64_t a6, uint64_t nr) {
+    (void)a0; (void)a1; (void)a2; (void)a3; (void)a4; (void)a5; (void)a6;
+    sched_current()->acct.syscalls++;
+    switch (nr) {
+    case SYS_getpid:
+        return sched_current()->pid;
+    case SYS_time:
+        return timer_now() / timer_us_to_ticks(1);
+    default:
+        return (uint64_t)-1;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Round-trip benchmark
+// -----------------------------------------------------------------------------
+
+// ubench.S: a page of U-mode code mapped straight out of the kernel image
+extern char ubench_start[], ubench_end[];
+
+// shared with ubench.S (UBENCH_DATA there)
+#define UBENCH_DATA (USER_BASE + 0x10000)
+
+struct ubench_result {
+    uint64_t iters;
+    uint64_t getpid_cycles;
+    uint64_t write_cycles;
+    uint64_t ring_cycles;    // the same writes through a ring, 0 if no ring
+    uint64_t done;           // set last, with a fence in front
+};
+
+// run ubench.S once as its own process and wait for it to go; 0 on
+// success, -1 if it failed, -2 if it is still running after 10 s. the
+// program keeps pointers to res (mapped at UBENCH_DATA) and to g (its
+// teardown reports there), so after -2 neither may be freed.
+static int ubench_run(struct ubench_result *res, task_group_t *g) {
+    *g = (task_group_t){0};
+    pcb_t pcb = {0};
+    pcb.name = "sysbench";
+    pcb.entry = USER_BASE;
+    pcb.usp = USER_STACK_TOP;
+    pcb.pagetable = vm_create();
+    tasks_group_add(g, &pcb);
+    if (!pcb.pagetable ||
+        vm_map(pcb.pagetable, USER_BASE, (uint64_t)ubench_start,
+               (uint64_t)(ubench_end - ubench_start),
+               PTE_R | PTE_X | PTE_U | PTE_BORROWED) != 0 ||
+        vm_map(pcb.pagetable, UBENCH_DATA, (uint64_t)res, PGSIZE,
+               PTE_R | PTE_W | PTE_U | PTE_BORROWED) != 0 ||
+        vm_alloc(pcb.pagetable, USER_STACK_TOP - PGSIZE, PGSIZE,
+                 PTE_R | PTE_W | PTE_U) != 0 ||
+        tasks_alloc_stack(&pcb) != 0 || tasks_add_pcb(&pcb) < 0) {
+        tasks_release(&pcb);
+        return -1;
+    }
+    tasks_start_program(&pcb);
+
+    // the group empties once the address space is gone, so res is ours
+    // again after that; done tells an exit from a kill
+    if (tasks_group_wait_until(g, timer_now() + 10 * TIMER_HZ) != 0)
+        return -2;
+    return __atomic_load_n(&res->done, __ATOMIC_ACQUIRE) ? 0 : -1;
+}
+
+static void ubench_report(const char *what, uint64_t cycles, uint64_t n) {
+    uart_puts("  ");
+    uart_puts(what);
+    uart_puts(": ");
+    uart_put_dec((int)(cycles / n));
+    uart_puts(" cycles\n");
+}
+
+//   ubench.S times n getpid() calls and n zero-byte write() calls with
+//   rdcycle from U-mode, then n zero-byte writes submitted 32 at a time
+//   through a ring. it runs twice: once as configured and once with the
+//   fast path switched off, so the first two lines compare the same call on
+//   both paths.
+void syscall_bench(int iters) {
+    if (iters <= 0) iters = 10000;
+    iters = (iters + 31) & ~31;      // whole ring batches (UBENCH_BATCH)
+    struct ubench_result *res = (struct ubench_result *)kalloc_page();
+    task_group_t *g = (task_group_t *)kmalloc(sizeof(*g));
+    if (!res || !g) {
+        uart_puts("bench syscall: out of memory\n");
+        if (res) kfree_page(res);
+        if (g) kfree(g);
+        return;
+    }
+
+    uart_puts("syscall round trip (");
+    uart_put_dec(iters);
+    uart_puts(" calls each, U-mode ecall to mret)\n");
+
+    res->iters = (uint64_t)iters;
+    int rc = ubench_run(res, g);
+    if (rc != 0)
+        goto failed;
+    uint64_t fast = res->getpid_cycles, write = res->write_cycles;
+    uint64_t ring = res->ring_cycles;
+
+    uint64_t mask = syscall_fast_mask;
+    res->done = 0;
+    syscall_fast_mask = 0;
+    rc = ubench_run(res, g);
+    syscall_fast_mask = mask;
+    if (rc != 0)
+        goto failed;
+
+    ubench_report("getpid, fast path", fast, (uint64_t)iters);
+    ubench_report("getpid, full path", res->getpid_cycles, (uint64_t)iters);
+    ubench_report("write 0 bytes    ", write, (uint64_t)iters);
+    if (ring)
+        ubench_report("ring write, x32  ", ring, (uint64_t)iters);
+    kfree_page(res);
+    kfree(g);
+    return;
+
+failed:
+    uart_puts("  benchmark program failed\n");
+    // a program that never exited still writes to res and will report its
+    // exit to g whenever it goes: both stay allocated for good
+    if (rc != -2) {
+        kfree_page(res);
+        kfree(g);
+    }
+}
@@ -0,0 +1,63 @@
+// syscall.h — system call ABI between user programs and the kernel
+// a U-mode program puts the call number in a7 and up to six arguments in
+// a0..a5, then executes `ecall`. the result comes back in a0; a negative
+// value means the call failed. every other register is preserved.
+//
+// the numbers are part of the ABI: userprog.c and ubench.S use them too,
+// so only ever append.
+
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#define SYS_write   0   // write(fd, buf, n) -> bytes written; fd 1 and 2 (stdout, stderr)
+#define SYS_read    1   // read(fd, buf, n)  -> bytes read from fd 0, 0 at end of file
+#define SYS_exit    2   // exit(status)      -> does not return
+#define SYS_getpid  3   // getpid()          -> pid
+#define SYS_yield   4   // yield()           -> 0
+#define SYS_time    5   // time()            -> microseconds since boot
+#define SYS_ring_setup 6 // ring_setup(entries, flags) -> ring address (ring.h)
+#define SYS_ring_enter 7 // ring_enter(to_submit, min_complete, flags) -> submitted
+#define SYS_sleep   8   // sleep(us)         -> 0 after at least us microseconds
+#define NSYSCALLS   9
+
+// calls that never block, never switch threads and never touch user memory
+// can take the fast path in trapvec.S, which saves only the registers the C
+// calling convention lets the handler clobber.
+#define SYSCALL_FAST_MASK ((1 << SYS_getpid) | (1 << SYS_time))
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+#include "trap.h"
+#include "vm.h"
+
+//   full-frame path, called by trap_handler() for every ecall from U-mode
+//   that did not take the fast path. returns the frame to resume.
+trapframe_t *syscall_handler(trapframe_t *tf);
+
+//   fast path, called straight from trapvec.S with the user's a0..a5 and
+//   the call number in a7 (the 8th argument register).
+uint64_t syscall_fast(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                      uint64_t a4, uint64_t a5, uint64_t a6, uint64_t nr);
+
+//   syscalls allowed on the fast path; trapvec.S reads it on every ecall.
+//   clearing it sends everything through syscall_handler().
+extern uint64_t syscall_fast_mask;
+
+//   the bodies of write() and read(), for a given address space and set of
+//   stdio handles (handle.h; an unredirected fd is the console, where read
+//   returns at the end of a line). also used by the ring (ring.c), which
+//   runs them on behalf of a process, nonblocking if the sqe asks for it.
+struct handle;
+int64_t syscall_write(pagetable_t pt, struct handle *const *stdio, uint64_t fd,
+                      uint64_t va, uint64_t n, int nonblock);
+int64_t syscall_read(pagetable_t pt, struct handle *const *stdio, uint64_t fd,
+                     uint64_t va, uint64_t n, int nonblock);
+
+//   round-trip latency of a fast-path call, the same call on the full path,
+//   and a full-path call that does a little work (shell: "bench syscall").
+void syscall_bench(int iters);
+
+#endif
+
+#endif
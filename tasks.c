@@ -1,5 +1,17 @@
 #include "uart.h"
+#include "riscv.h"
 #include "tasks.h"
+#include "sched.h"
+#include "string.h"
+#include "memlayout.h"
+#include "kalloc.h"
+#include "slab.h"
+#include "ring.h"
+#include "loader.h"
+#include "kprintf.h"
+#include "handle.h"
+#include "coro.h"
+#include "timer.h"
 
 //   - tasks_init()
 //       initializes the global task array and resets task count.
@@ -11,155 +23,596 @@
 //       lists all available tasks via UART output.
 
 //   - tasks_run(name)
-//       searches for a task by name and executes its function.
+//       searches for a task by name and starts it as a coroutine on the
+//       "tasks" thread (coro.c), where it runs until it calls task_yield().
+
+//   - tasks_spawn(name, entry, arg)
+//       creates a kernel thread with its own stack and hands it to sched.c.
+//       tasks_spawn_pcb() does the same from a pcb the caller filled in
+//       (stdio handles, group).
+
+//   - tasks_group_add(g, pcb) / tasks_group_wait(g)
+//       lets the shell wait until every stage of a job is gone, and
+//       collects their exit status. tasks_group_wait_until() gives up at
+//       a deadline.
+
+//   - tasks_ps()
+//       lists the running threads/programs and their state.
+
+//   - tasks_top(ms, n)
+//       redraws per-thread and per-task accounting (acct_t) every ms
+//       (shell command "top").
 
 //   - tasks_register_demo_programs()
 //       registers two built-in demonstration tasks.
 
-// defaults for user base and size
-#ifndef USER_BASE
-#define USER_BASE 0x80200000UL
-#endif
+//   - tasks_bench_spawn(n)
+//       spawns and reaps n short-lived programs (shell command
+//       "bench spawn [n]").
 
-#ifndef USER_SIZE
-#define USER_SIZE (32 * 1024 * 1024)
-#endif
-
-// also need to keep some sort of constants and allocation for stack resources, especially the top of stack
-#define STACK_AREA_BASE (USER_BASE + USER_SIZE)
-#define STACK_PER_PROC (64 * 1024)
+// kernel stacks are KSTACK_SIZE blocks from the page allocator. every
+// thread has one: kernel threads run on it, user programs trap onto it.
 #define MAX_PROCS       TASK_MAX_PROC
 
-static uint8_t stack_alloc_bitmap[MAX_PROCS]; // 0 = free, 1 = used
-static pcb_t pcb_table[MAX_PROCS];
+// pcbs and task records come from their own slab caches. the table only
+// holds pointers: its slot number is the process's ASID.
+static kmem_cache_t *pcb_cache;
+static kmem_cache_t *task_cache;
+// the table and next_pid are shared by all harts: threads exit (and are
+// reaped) wherever they happen to run.
+static pcb_t *pcb_table[MAX_PROCS];
 static int next_pid = 1;
+static spinlock_t table_lock;
 
 // Check --> PCB_T is a proccess control block defined in the .h of this file. it will store information essentially
 // and is needed to start the user program in terms of holding the actual binary bitmaps
 
-static task_t tasks[MAX_TASKS];
+static task_t *task_head, *task_tail;
 static int task_count = 0;
 
-// for some reason i need to declare this to prevent an error
-extern void start_user(uint64_t entry, uint64_t sp);
-
 // allocate stack memory for the pcb and give it the stack pointer
 int tasks_alloc_stack(pcb_t *pcb) {
-    for (int i = 0; i < MAX_PROCS; i++) {
-        if (!stack_alloc_bitmap[i]) {
-            stack_alloc_bitmap[i] = 1;
-            uint64_t base = STACK_AREA_BASE + (uint64_t)i * STACK_PER_PROC;
-            pcb->sp = base + STACK_PER_PROC; 
-            return 0;
-        }
-    }
-    return -1;
+    uint8_t *stack = (uint8_t *)kalloc_pages(KSTACK_ORDER);
+    if (!stack)
+        return -1;
+    pcb->sp = (uint64_t)(stack + KSTACK_SIZE);
+    return 0;
 }
 
-// simple task that adds pcb to the interal table and gives it a private id
+// give a stack back. the block starts KSTACK_SIZE below the stack top
+// that tasks_alloc_stack() handed out.
+static void tasks_free_stack(pcb_t *pcb) {
+    if (!pcb->sp) return;
+    kfree_pages((void *)(pcb->sp - KSTACK_SIZE), KSTACK_ORDER);
+    pcb->sp = 0;
+}
+
+// simple task that adds pcb to the interal table and gives it a private id.
+// the slot number doubles as the ASID, so at most MAX_PROCS address spaces
+// are ever live and none of them share TLB tags.
 int tasks_add_pcb(pcb_t *pcb) {
+    pcb_t *p = (pcb_t *)kmem_cache_alloc(pcb_cache);
+    if (!p)
+        return -1;
+    uint64_t s = spin_lock_irqsave(&table_lock);
     for (int i = 0; i < MAX_PROCS; i++) {
-        if (pcb_table[i].pid == 0) {
+        if (!pcb_table[i]) {
             pcb->pid = next_pid++;
-            pcb_table[i] = *pcb;
+            pcb->asid = (uint16_t)(i + 1);
+            if (!pcb->name) pcb->name = "program";
+            *p = *pcb;
+            pcb_table[i] = p;
+            spin_unlock_irqrestore(&table_lock, s);
             return pcb->pid;
         }
     }
+    spin_unlock_irqrestore(&table_lock, s);
+    kmem_cache_free(pcb_cache, p);
     return -1;
 }
 
+static pcb_t *tasks_find_pcb(uint32_t pid) {
+    uint64_t s = spin_lock_irqsave(&table_lock);
+    pcb_t *found = 0;
+    for (int i = 0; i < MAX_PROCS; i++) {
+        if (pcb_table[i] && pcb_table[i]->pid == pid) {
+            found = pcb_table[i];
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&table_lock, s);
+    return found;
+}
+
+// give back the stack and address space of a pcb that may never have made
+// it into the table (e.g. tasks_add_pcb() failed).
+void tasks_release(pcb_t *pcb) {
+    tasks_free_stack(pcb);
+    int had_pt = pcb->pagetable != 0;
+    if (pcb->ring)
+        ring_release(pcb);    // an sq poller may take over pagetable and image
+    if (pcb->pagetable) {
+        vm_free(pcb->pagetable);
+        pcb->pagetable = 0;
+    }
+    if (had_pt && pcb->asid)
+        vm_flush_asid(pcb->asid);
+    if (pcb->image) {
+        loader_image_put(pcb->image);
+        pcb->image = 0;
+    }
+    // closing our pipe ends is what gives the next stage its end of file
+    for (int i = 0; i < 3; i++) {
+        handle_close(pcb->stdio[i]);
+        pcb->stdio[i] = 0;
+    }
+    task_group_t *g = pcb->group;
+    if (g) {
+        pcb->group = 0;
+        uint64_t s = spin_lock_irqsave(&g->lock);
+        if (pcb->exit_status && !g->status)
+            g->status = pcb->exit_status;
+        if (--g->live == 0) {
+            g->exited = timer_now();
+            sched_wakeup(g);
+        }
+        spin_unlock_irqrestore(&g->lock, s);
+    }
+}
 
-// this starts the program using the entry point and the stack pointer. If the user
-// returns from start_user, this will priont a message and return the kernel
-// ** as opposed to spinning forever (its what userprog.c does)
-// we wont reclaim the stack allocation bitmap though, I honestly
-// thought it was the cause of the issues I was getting but it was not
-// so i never implemented reusing stack slots
+// called by the scheduler once it has switched away from a stopped thread:
+// the stack, the address space and the pcb itself all go back.
+void tasks_reap(pcb_t *pcb) {
+    tasks_release(pcb);
+    uint64_t s = spin_lock_irqsave(&table_lock);
+    pcb_table[pcb->asid - 1] = 0;
+    spin_unlock_irqrestore(&table_lock, s);
+    kmem_cache_free(pcb_cache, pcb);
+}
+
+// this hands the program (already copied into pcb_table by tasks_add_pcb) to
+// the scheduler. it does not wait for it: the program gets its own time
+// slices, and whoever started it waits on its group if it wants to. if the
+// program returns from its entry point it exits with the return value as
+// its status (sched_prepare()), and its stack and table slot are reclaimed.
 void tasks_start_program(pcb_t *pcb) {
-    uart_puts(" [TASK] starting the program ... \n");
-    start_user(pcb->entry, pcb->sp);
-    uart_puts(" [TASK] user program returned to kernel.\n");
+    pcb_t *p = tasks_find_pcb(pcb->pid);
+    if (!p) {
+        kprintf(KERN_ERR " [TASK] no such pid\n");
+        return;
+    }
+    sched_prepare(p, 0);
+    kprintf(" [TASK] starting the program, pid %u\n", p->pid);
+    sched_enqueue(p);
+}
+
+// create a kernel thread running entry(arg) on a fresh stack.
+// returns the new pid or -1 if we are out of stacks / pcb slots.
+int tasks_spawn(const char *name, uint64_t entry, uint64_t arg) {
+    pcb_t pcb = {0};
+    pcb.name = name;
+    pcb.entry = entry;
+    return tasks_spawn_pcb(&pcb, arg);
+}
+
+// the same with name, entry and whatever else the caller set up in *pcb.
+// the thread owns pcb's handles and group membership from here on, also
+// when it cannot be started: they are released right away then.
+int tasks_spawn_pcb(pcb_t *pcb, uint64_t arg) {
+    if (tasks_alloc_stack(pcb) != 0 || tasks_add_pcb(pcb) < 0) {
+        pcb->exit_status = TASK_EXIT_FAILED;
+        tasks_release(pcb);
+        return -1;
+    }
+    pcb_t *p = tasks_find_pcb(pcb->pid);
+    sched_prepare(p, arg);
+    sched_enqueue(p);
+    return (int)pcb->pid;
+}
+
+// count pcb in before it is started, so it cannot leave before it joined
+void tasks_group_add(task_group_t *g, pcb_t *pcb) {
+    uint64_t s = spin_lock_irqsave(&g->lock);
+    g->live++;
+    spin_unlock_irqrestore(&g->lock, s);
+    pcb->group = g;
+}
+
+void tasks_group_wait(task_group_t *g) {
+    tasks_group_wait_until(g, SCHED_NO_DEADLINE);
+}
+
+int tasks_group_wait_until(task_group_t *g, uint64_t deadline) {
+    uint64_t s = spin_lock_irqsave(&g->lock);
+    while (g->live && sched_sleep_until(g, &g->lock, deadline) == 0)
+        ;
+    int r = g->live ? -1 : 0;
+    spin_unlock_irqrestore(&g->lock, s);
+    return r;
+}
+
+static const char *state_name(int state) {
+    switch (state) {
+    case TASK_RUNNABLE: return "runnable";
+    case TASK_RUNNING:  return "running";
+    case TASK_STOPPED:  return "stopped";
+    case TASK_BLOCKED:  return "blocked";
+    default:            return "?";
+    }
+}
+
+// threads can exit on another hart while we print, so copy what we show
+// out of the table first and print from the copy.
+void tasks_ps(void) {
+    struct { uint32_t pid; int state; int cpu; const char *name; } snap[MAX_PROCS];
+    int n = 0;
+    uint64_t s = spin_lock_irqsave(&table_lock);
     for (int i = 0; i < MAX_PROCS; i++) {
-        if (pcb_table[i].pid == pcb->pid) {
-            pcb_table[i].pid = 0; 
-            break;
+        pcb_t *p = pcb_table[i];
+        if (!p) continue;
+        snap[n].pid = p->pid;
+        snap[n].state = p->state;
+        snap[n].cpu = p->cpu;
+        snap[n].name = p->name;
+        n++;
+    }
+    spin_unlock_irqrestore(&table_lock, s);
+
+    pcb_t *cur = sched_current();
+    uart_puts("  PID  STATE     CPU  NAME\n");
+    uart_puts("  0    running   ");
+    uart_put_dec(cur->cpu);
+    uart_puts("    shell\n");
+    for (int i = 0; i < n; i++) {
+        uart_puts("  ");
+        uart_put_dec((int)snap[i].pid);
+        uart_puts("    ");
+        uart_puts(state_name(snap[i].state));
+        uart_puts("  ");
+        uart_put_dec(snap[i].cpu);
+        uart_puts("    ");
+        uart_puts(snap[i].name);
+        uart_puts("\n");
+    }
+}
+
+// -----------------------------------------------------------------------------
+// top
+// -----------------------------------------------------------------------------
+
+#define TOP_ROWS (MAX_PROCS + 1 + MAX_HARTS)
+#define TOP_IDLE (1UL << 32)            // key of hart h's idle thread: TOP_IDLE + h
+#define TOP_TASKS 32                    // tasks whose cpu% is tracked, by id
+
+typedef struct top_row {
+    uint64_t key;                       // pid, or TOP_IDLE + hart
+    const char *name;
+    int state;
+    int cpu;
+    acct_t a;
+} top_row_t;
+
+// the shell, every hart's idle thread and the pcb table, each with its acct
+// as of now
+static int top_snapshot(top_row_t *rows) {
+    int n = 0;
+    pcb_t *boot = sched_boot_thread();
+    rows[n] = (top_row_t){ 0, boot->name, boot->state, boot->cpu, {0} };
+    sched_acct_read(boot, &rows[n++].a);
+    for (int h = 0; h < MAX_HARTS; h++) {
+        pcb_t *idle = sched_idle_thread(h);
+        if (!idle) continue;
+        rows[n] = (top_row_t){ TOP_IDLE + (uint64_t)h, idle->name, idle->state, h, {0} };
+        sched_acct_read(idle, &rows[n++].a);
+    }
+    uint64_t s = spin_lock_irqsave(&table_lock);
+    for (int i = 0; i < MAX_PROCS; i++) {
+        pcb_t *p = pcb_table[i];
+        if (!p) continue;
+        rows[n] = (top_row_t){ p->pid, p->name, p->state, p->cpu, {0} };
+        sched_acct_read(p, &rows[n++].a);
+    }
+    spin_unlock_irqrestore(&table_lock, s);
+    return n;
+}
+
+static const acct_t *top_find(const top_row_t *rows, int n, uint64_t key) {
+    for (int i = 0; i < n; i++)
+        if (rows[i].key == key)
+            return &rows[i].a;
+    return 0;
+}
+
+// share of `dt` in percent, capped: a running thread's slice is estimated
+static uint64_t top_pct(uint64_t used, uint64_t dt) {
+    uint64_t pct = dt ? used * 100 / dt : 0;
+    return pct > 100 ? 100 : pct;
+}
+
+// ipc as "x.yy", with cycles 0 as "-"
+static void top_ipc(char *buf, uint64_t instret, uint64_t cycles) {
+    if (!cycles) {
+        ksnprintf(buf, 8, "-");
+        return;
+    }
+    uint64_t v = instret * 100 / cycles;
+    ksnprintf(buf, 8, "%lu.%02lu", v / 100, v % 100);
+}
+
+static void top_line(const char *id, const char *name, const char *state, uint64_t pct,
+                     const acct_t *a, uint64_t sys) {
+    char ipc[8], line[128];
+    top_ipc(ipc, a->instret, a->cycles);
+    ksnprintf(line, sizeof(line), "  %-6s%-10s%-10s%4lu%10lu%10lu%6s%9lu%8lu%9lu\n",
+              id, name, state, pct, a->time / (TIMER_HZ / 1000), a->cycles / 1000000,
+              ipc, a->switches, sys, a->tx_bytes);
+    uart_puts(line);
+}
+
+// one frame: cpu% over the interval since `old` was taken (dt ticks), the
+// rest in totals. task_time[] holds each task's time at the last frame.
+static void top_frame(const top_row_t *rows, int n, const top_row_t *old, int nold,
+                      uint64_t *task_time, uint64_t dt, int clear) {
+    static const char *hdr =
+        "  ID    NAME      STATE     CPU%  TIME(ms)  MCYCLES   IPC SWITCHES SYSCALLS  TXBYTES\n";
+    char line[128];
+    if (clear)
+        uart_puts("\033[2J\033[H");
+    ksnprintf(line, sizeof(line), "top - up %lu ms, %d harts, %d threads\n",
+              timer_now() / (TIMER_HZ / 1000), sched_ncpus(), n);
+    uart_puts(line);
+    for (int i = 0; i < n; i++) {
+        if (rows[i].key < TOP_IDLE) continue;
+        const acct_t *o = top_find(old, nold, rows[i].key);
+        uint64_t idle = rows[i].a.time - (o ? o->time : 0);
+        ksnprintf(line, sizeof(line), "  hart %d: %3lu%% busy\n",
+                  rows[i].cpu, 100 - top_pct(idle, dt));
+        uart_puts(line);
+    }
+
+    uart_puts(hdr);
+    for (int i = 0; i < n; i++) {
+        const top_row_t *r = &rows[i];
+        const acct_t *o = top_find(old, nold, r->key);
+        char id[12];
+        if (r->key >= TOP_IDLE)
+            ksnprintf(id, sizeof(id), "-");
+        else
+            ksnprintf(id, sizeof(id), "%lu", r->key);
+        top_line(id, r->name, state_name(r->state),
+                 top_pct(r->a.time - (o ? o->time : 0), dt), &r->a, r->a.syscalls);
+    }
+
+    // tasks run as coroutines inside the tasks thread: their time is part
+    // of its time, and they make no system calls
+    int any = 0;
+    for (task_t *t = task_head; t; t = t->next) {
+        if (!t->runs) continue;
+        if (!any++)
+            uart_puts("  tasks, over all their runs:\n");
+        char id[12], runs[12];
+        ksnprintf(id, sizeof(id), "[%d]", t->id);
+        ksnprintf(runs, sizeof(runs), "%d runs", t->runs);
+        acct_t a = t->acct;
+        uint64_t pct = 0;
+        if (t->id < TOP_TASKS) {
+            pct = top_pct(a.time - task_time[t->id], dt);
+            task_time[t->id] = a.time;
         }
+        top_line(id, t->name, runs, pct, &a, a.syscalls);
+    }
+}
+
+void tasks_top(int interval_ms, int frames) {
+    static top_row_t rows[2][TOP_ROWS];     // only the shell runs top
+    uint64_t task_time[TOP_TASKS] = {0};
+    if (interval_ms <= 0) interval_ms = 1000;
+    int cur = 0, nold = 0;
+    uint64_t then = 0;
+    for (int f = 0; !frames || f < frames; f++) {
+        uint64_t now = timer_now();
+        int n = top_snapshot(rows[cur]);
+        top_frame(rows[cur], n, rows[cur ^ 1], nold, task_time, now - then, frames == 0);
+        if (!frames)
+            uart_puts("(any key quits)\n");
+        nold = n;
+        cur ^= 1;
+        then = now;
+        if (frames && f + 1 == frames)
+            break;
+        uint64_t deadline = now + timer_us_to_ticks((uint64_t)interval_ms * 1000);
+        if (uart_getc_until(deadline) >= 0)
+            break;
     }
 }
 
-// task 1: simple counter
+// -----------------------------------------------------------------------------
+// Spawn benchmark
+// -----------------------------------------------------------------------------
+
+// returns from _start right away: all that is left is spawn, exit and reap
+#define SPAWN_PROG  "true.elf"
+#define SPAWN_BATCH 8
+
+// load and start one instance of SPAWN_PROG as a member of g
+static int spawn_one(task_group_t *g) {
+    pcb_t pcb = {0};
+    tasks_group_add(g, &pcb);
+    if (load_program_from_fs(SPAWN_PROG, &pcb) != 0 || tasks_add_pcb(&pcb) < 0) {
+        pcb.exit_status = TASK_EXIT_FAILED;
+        tasks_release(&pcb);
+        return -1;
+    }
+    tasks_start_program(&pcb);
+    return 0;
+}
+
+// start up to n instances in one group and wait for all of them. returns
+// how many started.
+static int spawn_batch(int n, int *failed) {
+    task_group_t g = {0};
+    int started = 0;
+    while (started < n && spawn_one(&g) == 0)
+        started++;
+    tasks_group_wait(&g);
+    if (g.status)
+        (*failed)++;
+    return started;
+}
+
+//   every round loads SPAWN_PROG from the image cache into a new address
+//   space, takes a pcb slot and a kernel stack, runs it until it returns
+//   through the exit stub and tears it all down again. first one program
+//   at a time, timing spawn to exit (the last teardown) and spawn to reap
+//   (the shell running again), then SPAWN_BATCH at a time for throughput.
+//   a warm-up batch fills the caches; the free page count before and after
+//   the run shows whether anything leaked.
+void tasks_bench_spawn(int iters) {
+    if (iters <= 0) iters = 1000;
+    // the loader logs every launch; only errors reach the console meanwhile
+    int level = klog_console_level(-1);
+    klog_console_level(4);
+
+    int failed = 0;
+    if (spawn_batch(SPAWN_BATCH, &failed) != SPAWN_BATCH) {
+        klog_console_level(level);
+        uart_puts("bench spawn: cannot start " SPAWN_PROG "\n");
+        return;
+    }
+    uint64_t free0 = kalloc_free_pages();
+
+    uint64_t min = ~0UL, max = 0, exit_sum = 0, reap_sum = 0;
+    int n = 0;
+    for (; n < iters; n++) {
+        task_group_t g = {0};
+        uint64_t t0 = timer_now();
+        if (spawn_one(&g) != 0)
+            break;
+        tasks_group_wait(&g);
+        uint64_t t1 = timer_now();
+        uint64_t lat = g.exited - t0;
+        if (lat < min) min = lat;
+        if (lat > max) max = lat;
+        exit_sum += lat;
+        reap_sum += t1 - t0;
+        if (g.status)
+            failed++;
+    }
+
+    uint64_t t0 = timer_now();
+    int m = 0;
+    while (m < iters) {
+        int want = iters - m < SPAWN_BATCH ? iters - m : SPAWN_BATCH;
+        int got = spawn_batch(want, &failed);
+        m += got;
+        if (got < want)
+            break;
+    }
+    uint64_t ticks = timer_now() - t0;
+    uint64_t free1 = kalloc_free_pages();
+    klog_console_level(level);
+
+    uint64_t tick_ns = 1000000000UL / TIMER_HZ;
+    char line[112];
+    ksnprintf(line, sizeof(line), "spawn benchmark (%d x " SPAWN_PROG ")\n", iters);
+    uart_puts(line);
+    if (n) {
+        ksnprintf(line, sizeof(line),
+                  "  one at a time: spawn to exit %lu us (min %lu, max %lu), to reap %lu us\n",
+                  exit_sum * tick_ns / n / 1000, min * tick_ns / 1000,
+                  max * tick_ns / 1000, reap_sum * tick_ns / n / 1000);
+        uart_puts(line);
+    }
+    ksnprintf(line, sizeof(line), "  %d in flight:   %lu spawns/s\n", SPAWN_BATCH,
+              ticks ? (uint64_t)m * TIMER_HZ / ticks : 0);
+    uart_puts(line);
+    ksnprintf(line, sizeof(line), "  free pages: %lu before, %lu after\n", free0, free1);
+    uart_puts(line);
+    if (n < iters || m < iters || failed) {
+        ksnprintf(line, sizeof(line),
+                  "  %d of %d spawns failed (out of slots or memory), %d non-zero exits\n",
+                  2 * iters - n - m, 2 * iters, failed);
+        uart_puts(line);
+    }
+}
+
+// task 1: simple counter, a tick every 200 ms. sleeping parks only the
+// coroutine, so running both counters interleaves their lines.
 static void task_counter1(void) {
     for (int i = 0; i < 5; i++) {
-        uart_puts("[counter1] tick ");
-        uart_put_dec(i);
-        uart_puts("\n");
+        kprintf("[counter1] tick %d\n", i);
+        task_sleep_us(200000);
     }
 }
 
-// task 2: another counter
+// task 2: another counter, a step every 300 ms
 static void task_counter2(void) {
     for (int i = 0; i < 3; i++) {
-        uart_puts("[counter2] step ");
-        uart_put_dec(i);
-        uart_puts("\n");
+        kprintf("[counter2] step %d\n", i);
+        task_sleep_us(300000);
     }
 }
 
 void tasks_init(void) {
+    pcb_cache = kmem_cache_create("pcb", sizeof(pcb_t));
+    task_cache = kmem_cache_create("task", sizeof(task_t));
+    task_head = task_tail = 0;
     task_count = 0;
-    for (int i = 0; i < MAX_TASKS; i++) {
-        tasks[i].id = i;
-        tasks[i].active = 0;
-        tasks[i].counter = 0;
-        tasks[i].name = 0;
-        tasks[i].step = 0;
-    }
 }
 
 int tasks_add(const char *name, task_step_fn step) {
-    if (task_count >= MAX_TASKS)
+    task_t *t = (task_t *)kmem_cache_alloc(task_cache);
+    if (!t)
         return -1;
-    tasks[task_count].id = task_count;
-    tasks[task_count].name = name;
-    tasks[task_count].step = step;
-    tasks[task_count].active = 1;
+    t->id = task_count;
+    t->name = name;
+    t->step = step;
+    t->active = 1;
+    t->runs = 0;
+    memset(&t->acct, 0, sizeof(t->acct));
+    t->next = 0;
+    if (task_tail)
+        task_tail->next = t;
+    else
+        task_head = t;
+    task_tail = t;
     return task_count++;
 }
 
 void tasks_list(void) {
     uart_puts("Available tasks:\n");
-    for (int i = 0; i < task_count; i++) {
+    for (task_t *t = task_head; t; t = t->next) {
         uart_puts("  [");
-        uart_put_dec(tasks[i].id);
+        uart_put_dec(t->id);
         uart_puts("] ");
-        uart_puts(tasks[i].name);
+        uart_puts(t->name);
         uart_puts("\n");
     }
 }
 
+// body of every coroutine started with `run`: call the task's step
+// function; the coroutine ends when it returns. the step function shares
+// the "tasks" thread with the other tasks and hands it on with task_yield().
+static void task_coro(void *arg) {
+    task_t *t = (task_t *)arg;
+    t->runs++;
+    t->step();
+}
+
 void tasks_run(const char *name) {
-    for (int i = 0; i < task_count; i++) {
-        if (tasks[i].active && tasks[i].name && name) {
-            // simple string compare
-            const char *a = tasks[i].name, *b = name;
-            int match = 1;
-            while (*a && *b) {
-                if (*a++ != *b++) { match = 0; break; }
-            }
-            if (match && *a == *b) {
-                uart_puts("Running task: ");
-                uart_puts(tasks[i].name);
-                uart_puts("\n");
-                tasks[i].step();
-                return;
-            }
+    for (task_t *t = task_head; t; t = t->next) {
+        if (t->active && t->name && name && str_eq(t->name, name)) {
+            kprintf("Running task: %s\n", t->name);
+            if (coro_spawn_task(t->name, task_coro, t, &t->acct) < 0)
+                kprintf(KERN_ERR "tasks: out of memory or slots\n");
+            return;
         }
     }
     uart_puts("No such task.\n");
 }
 
 static void task_dynamic_hello(void) {
-    uart_puts("[dynamic] Hello from a dynamically created program!\n");
+    kprintf("[dynamic] Hello from a dynamically created program!\n");
 }
 
 
@@ -172,7 +625,7 @@ static void task_dynamic_hello(void) {
 void tasks_create_dynamic_program(const char *name) {
     int id = tasks_add(name, task_dynamic_hello);
     if (id < 0) {
-        uart_puts("Failed to create program (task table full).\n");
+        uart_puts("Failed to create program (out of memory).\n");
     } else {
         uart_puts("Created program: ");
         uart_puts(name);
@@ -2,29 +2,85 @@
 #define TASKS_H
 
 #include <stdint.h>
+#include "vm.h"
+#include "spinlock.h"
 
-#define MAX_TASKS 8
 // Extra variables for tasks.c program loading
-#define TASK_MAX_PROC 8
+#define TASK_MAX_PROC 16
 #define TASK_RUNNABLE 1
 #define TASK_RUNNING  2
 #define TASK_STOPPED  3
+#define TASK_BLOCKED  4
+
+// exit status of a thread killed after a fault, and of one that could not
+// be started at all (the shell's "not found")
+#define TASK_EXIT_KILLED (-1)
+#define TASK_EXIT_FAILED 127
 
 typedef void (*task_step_fn)(void);
 
-typedef struct {
+// what a thread (pcb_t) or a task (task_t) has used so far. time, cycles
+// and instret are sampled at switch points: by sched.c for threads, by
+// coro.c for the coroutines a task runs as. only the hart a thread runs on
+// writes its record, so readers see each field whole but maybe one slice
+// behind.
+typedef struct acct {
+    uint64_t time;            // mtime ticks on a hart
+    uint64_t cycles;          // mcycle
+    uint64_t instret;         // minstret
+    uint64_t switches;        // times switched in
+    uint64_t syscalls;
+    uint64_t tx_bytes;        // written to the console, directly or via kprintf
+} acct_t;
+
+typedef struct task {
     int id;                   
     const char *name;
     task_step_fn step;
     int active;
-    int counter;
+    int runs;                 // times started with `run`
+    acct_t acct;              // all of its runs together (coro.c)
+    struct task *next;        // registration order (tasks.c)
 } task_t;
 
+struct trapframe;
+struct handle;
+
+// threads started together and waited for as a whole (a shell job).
+// live counts the members that have not been torn down yet; status is the
+// first non-zero exit status among them, exited the timer_now() at which
+// the last one went.
+typedef struct task_group {
+    spinlock_t lock;
+    int live;
+    int status;
+    uint64_t exited;
+} task_group_t;
+
 typedef struct pcb {
     uint32_t pid;
     uint64_t entry;
     uint64_t sp;
     int state;
+    const char *name;
+    struct trapframe *tf;     // saved context while not running (sched.c)
+    pagetable_t pagetable;    // user address space, 0 for kernel threads
+    uint64_t usp;             // initial user stack pointer (virtual)
+    uint16_t asid;            // address space id, tags this process's TLB entries
+    struct pcb *next;         // run queue / sleep list link (sched.c)
+    void *chan;               // what a blocked thread is waiting for
+    spinlock_t *sleep_lk;     // released by the scheduler once we are asleep
+    int cpu;                  // hart it last ran on
+    volatile int on_cpu;      // a hart is still using its stack (sched.c)
+    struct ring *ring;        // submission/completion ring, if set up (ring.c)
+    struct image *image;      // prepared program image it runs from (loader.c)
+    struct handle *stdio[3];  // stdin/stdout/stderr, 0 = console (handle.h)
+    task_group_t *group;      // told when this thread is torn down
+    int exit_status;          // from sched_exit(), passed on to group
+    int pinned;               // 1 + the only hart it may run on, 0 = any (sched.c)
+    struct coro_runner *coro; // coroutines this thread is running (coro.c)
+    acct_t acct;              // sched.c, syscall.c, uart.c
+    acct_t *sub_acct;         // running coroutine's task: charged tx bytes too
 } pcb_t;
 
 void tasks_init(void);
@@ -36,6 +92,16 @@ void tasks_register_demo_programs(void);
 int tasks_alloc_stack(pcb_t *pcb);
 void tasks_start_program(pcb_t *pcb);
 int tasks_add_pcb(pcb_t *pcb);
+int tasks_spawn(const char *name, uint64_t entry, uint64_t arg);
+int tasks_spawn_pcb(pcb_t *pcb, uint64_t arg);
+void tasks_group_add(task_group_t *g, pcb_t *pcb);
+void tasks_group_wait(task_group_t *g);
+int tasks_group_wait_until(task_group_t *g, uint64_t deadline);
+void tasks_reap(pcb_t *pcb);
+void tasks_release(pcb_t *pcb);
+void tasks_ps(void);
+void tasks_top(int interval_ms, int frames);
+void tasks_bench_spawn(int iters);
 
 
 #endif
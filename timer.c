@@ -0,0 +1,48 @@
+// timer.c — CLINT machine timer for the RISC-V OS
+// the CLINT exposes one 64-bit mtime counter shared by all harts and one
+// mtimecmp compare register per hart. a machine timer interrupt is pending
+// whenever mtime >= mtimecmp. the msip words in the same block raise a
+// machine software interrupt on a hart; we use them as inter-processor
+// interrupts.
+
+#include "timer.h"
+#include "riscv.h"
+
+#define CLINT_BASE      0x02000000UL
+#define CLINT_MSIP      (CLINT_BASE + 0x0)      // + 4 * hartid
+#define CLINT_MTIMECMP  (CLINT_BASE + 0x4000)   // + 8 * hartid
+#define CLINT_MTIME     (CLINT_BASE + 0xBFF8)
+
+static inline volatile uint64_t *mtimecmp(void) {
+    return (volatile uint64_t *)(CLINT_MTIMECMP + 8 * hart_id());
+}
+
+void timer_init(void) {
+    // park the compare register far in the future until someone arms it
+    *mtimecmp() = ~0UL;
+    csr_set(mie, MIE_MTIE);
+}
+
+uint64_t timer_now(void) {
+    return *(volatile uint64_t *)CLINT_MTIME;
+}
+
+void timer_arm_in(uint64_t ticks) {
+    *mtimecmp() = timer_now() + ticks;
+}
+
+void timer_arm_at(uint64_t when) {
+    *mtimecmp() = when;
+}
+
+uint64_t timer_deadline(void) {
+    return *mtimecmp();
+}
+
+void timer_send_ipi(int hart) {
+    *(volatile uint32_t *)(CLINT_MSIP + 4 * (uint64_t)hart) = 1;
+}
+
+void timer_clear_ipi(void) {
+    *(volatile uint32_t *)(CLINT_MSIP + 4 * hart_id()) = 0;
+}
@@ -0,0 +1,40 @@
+// timer.h — CLINT machine timer
+// thin wrapper over the core-local interruptor's mtime / mtimecmp registers
+// on the QEMU virt board. the scheduler programs each hart's next timer
+// interrupt with it (the quantum, kernel timers in ktimer.h, profiling).
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// QEMU virt drives mtime at 10 MHz
+#define TIMER_HZ 10000000UL
+
+//   enables the machine timer interrupt (mie.MTIE) on the calling hart. the
+//   first deadline is programmed by the caller with timer_arm_at().
+//   called by: - sched_start() and sched_start_secondary() in sched.c
+void timer_init(void);
+
+//   current value of the free-running mtime counter.
+uint64_t timer_now(void);
+
+//   programs this hart's mtimecmp so its next timer interrupt fires `ticks`
+//   from now. writing mtimecmp also clears the pending interrupt.
+void timer_arm_in(uint64_t ticks);
+
+//   programs this hart's mtimecmp to the absolute mtime `when` (~0: no
+//   timer interrupt at all); timer_deadline() reads it back.
+void timer_arm_at(uint64_t when);
+uint64_t timer_deadline(void);
+
+//   raises a machine software interrupt on `hart` (CLINT msip). the target
+//   must have mie.MSIE set and acknowledges with timer_clear_ipi().
+void timer_send_ipi(int hart);
+void timer_clear_ipi(void);
+
+static inline uint64_t timer_us_to_ticks(uint64_t us) {
+    return us * (TIMER_HZ / 1000000UL);
+}
+
+#endif
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""benchcmp.py - compare two benchmark result files.
+
+A result file has one measurement per line, "<name> <value> <unit> ...",
+as host/bench prints it; lines starting with '#' are comments. The first
+value of each line is compared, and lower is better (times, cycles).
+Prints every name with both values and the change, marks changes beyond
+the threshold, and with --fail exits 1 if anything got slower by more
+than that.
+
+    make host-bench > old.txt          # on the baseline commit
+    make host-bench > new.txt
+    ./tools/benchcmp.py old.txt new.txt
+    ./tools/benchcmp.py old.txt new.txt --threshold 10 --fail
+"""
+
+import argparse
+import sys
+
+
+def parse_results(lines, source):
+    """name -> (value, unit), in the order of the lines."""
+    results = {}
+    for lineno, line in enumerate(lines, 1):
+        line = line.strip()
+        if not line or line.startswith("#"):
+            continue
+        fields = line.split()
+        if len(fields) < 3:
+            raise ValueError("%s:%d: expected '<name> <value> <unit>'" % (source, lineno))
+        results[fields[0]] = (float(fields[1]), fields[2])
+    return results
+
+
+def read_results(path):
+    with open(path) as f:
+        return parse_results(f, path)
+
+
+def compare(old, new, threshold):
+    """Rows (name, old, new, unit, change%, mark) and the regressed names."""
+    rows, regressed = [], []
+    for name, (nv, unit) in new.items():
+        if name not in old:
+            rows.append((name, None, nv, unit, None, "new"))
+            continue
+        ov, _ = old[name]
+        change = (nv - ov) / ov * 100.0 if ov else 0.0
+        mark = ""
+        if change > threshold:
+            mark = "SLOWER"
+            regressed.append(name)
+        elif change < -threshold:
+            mark = "faster"
+        rows.append((name, ov, nv, unit, change, mark))
+    for name, (ov, unit) in old.items():
+        if name not in new:
+            rows.append((name, ov, None, unit, None, "gone"))
+    return rows, regressed
+
+
+def fmt(v):
+    return "-" if v is None else "%.2f" % v
+
+
+def print_rows(rows):
+    width = max([len(r[0]) for r in rows] + [4])
+    print("%-*s %14s %14s %-10s %8s" % (width, "name", "old", "new", "unit", "change"))
+    for name, ov, nv, unit, change, mark in rows:
+        ch = "-" if change is None else "%+.1f%%" % change
+        print("%-*s %14s %14s %-10s %8s  %s" % (width, name, fmt(ov), fmt(nv), unit, ch, mark))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("old", help="baseline results")
+    ap.add_argument("new", help="results to check")
+    ap.add_argument("--threshold", type=float, default=5.0,
+                    help="percent change that counts (default 5)")
+    ap.add_argument("--fail", action="store_true",
+                    help="exit 1 if anything is slower by more than the threshold")
+    args = ap.parse_args()
+
+    try:
+        old = read_results(args.old)
+        new = read_results(args.new)
+    except (OSError, ValueError) as e:
+        sys.exit("benchcmp: %s" % e)
+
+    rows, regressed = compare(old, new, args.threshold)
+    print_rows(rows)
+
+    if regressed:
+        print("\n%d of %d slower by more than %g%%: %s"
+              % (len(regressed), len(rows), args.threshold, " ".join(regressed)))
+    if args.fail and regressed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,408 @@
+/* fspack.c - host tool: pack files into the kernel's file system image.
+ *
+ *     tools/fspack -o fs.img rootfs userprog.elf wc.elf
+ *
+ * Every argument is a file, or a directory whose regular files are all
+ * taken (not recursively); a file's name in the image is its base name.
+ * The result is laid out as fsimg.h describes: a header, a minimal
+ * perfect hash over the names, one entry per file with its size, stored
+ * size and checksum, then the data.
+ *
+ * A file is stored as an LZ4 block (lz4.h) if that saves at least an
+ * eighth of it, raw otherwise. The compressor is the simple greedy kind: a
+ * hash of the next four bytes finds the last position that started with
+ * them, and a match is taken whenever one is found within the 64 KiB
+ * window. The block ends the way the format demands: the last match
+ * starts at least 12 bytes before the end and the last 5 bytes are
+ * literals. Raw ELF files start on a page boundary, so the kernel can map
+ * their text in place.
+ *
+ * Before the image is written every name is looked up through the hash
+ * and every file decoded and checksummed, so a broken image fails the
+ * build instead of the boot.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../fsimg.h"
+
+#define HASH_BITS   12
+#define MIN_MATCH   4
+#define MF_LIMIT    12      /* no match may start in the last 12 bytes */
+#define LAST_LITS   5       /* ... or reach into the last 5 */
+#define MAX_OFFSET  65535
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t *put_length(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* one sequence: literals [lit, lit + nlit), then a match (mlen 0: none) */
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *lit, size_t nlit,
+                             size_t off, size_t mlen) {
+    uint8_t *token = op++;
+    *token = (uint8_t)((nlit < 15 ? nlit : 15) << 4);
+    if (nlit >= 15)
+        op = put_length(op, nlit - 15);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (!mlen)
+        return op;
+    *op++ = (uint8_t)off;
+    *op++ = (uint8_t)(off >> 8);
+    mlen -= MIN_MATCH;
+    *token |= (uint8_t)(mlen < 15 ? mlen : 15);
+    if (mlen >= 15)
+        op = put_length(op, mlen - 15);
+    return op;
+}
+
+static size_t compress(const uint8_t *src, size_t n, uint8_t *dst) {
+    static int64_t table[1 << HASH_BITS];
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+        table[i] = -1;
+
+    uint8_t *op = dst;
+    size_t anchor = 0, ip = 0;
+    while (n >= MF_LIMIT && ip + MF_LIMIT <= n) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = hash4(seq);
+        int64_t ref = table[h];
+        table[h] = (int64_t)ip;
+        if (ref < 0 || ip - (size_t)ref > MAX_OFFSET || read32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+        size_t len = MIN_MATCH;
+        while (ip + len < n - LAST_LITS && src[ref + len] == src[ip + len])
+            len++;
+        op = put_sequence(op, src + anchor, ip - anchor, ip - (size_t)ref, len);
+        ip += len;
+        anchor = ip;
+    }
+    return (size_t)(put_sequence(op, src + anchor, n - anchor, 0, 0) - dst);
+}
+
+/* reference decoder for the self-check; the kernel has its own (lz4.c) */
+static long decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    const uint8_t *ip = src, *iend = src + n;
+    size_t o = 0;
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t len = token >> 4;
+        if (len == 15) {
+            uint8_t b;
+            do { if (ip >= iend) return -1; b = *ip++; len += b; } while (b == 255);
+        }
+        if (len > (size_t)(iend - ip) || len > cap - o)
+            return -1;
+        memcpy(dst + o, ip, len);
+        o += len;
+        ip += len;
+        if (ip == iend)
+            return (long)o;
+        if (iend - ip < 2)
+            return -1;
+        size_t off = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        len = (token & 15) + MIN_MATCH;
+        if ((token & 15) == 15) {
+            uint8_t b;
+            do { if (ip >= iend) return -1; b = *ip++; len += b; } while (b == 255);
+        }
+        if (off == 0 || off > o || len > cap - o)
+            return -1;
+        for (size_t i = 0; i < len; i++, o++)
+            dst[o] = dst[o - off];
+    }
+    return -1;
+}
+
+#define MAX_TRIES   (1u << 22)  /* displacements tried per bucket */
+
+typedef struct {
+    char name[FSIMG_NAME_MAX];
+    uint8_t *data;
+    size_t size;
+    uint8_t *stored;            /* LZ4 block, or data itself */
+    size_t nstored;
+    int lz4;
+    uint32_t bucket;
+} file_t;
+
+static file_t *files;
+static size_t nfiles, files_cap;
+
+static void die(const char *what, const char *arg) {
+    fprintf(stderr, "fspack: %s%s%s\n", what, arg ? ": " : "", arg ? arg : "");
+    exit(1);
+}
+
+static void add_file(const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    if (strlen(base) >= FSIMG_NAME_MAX)
+        die("name too long", base);
+    for (size_t i = 0; i < nfiles; i++)
+        if (!strcmp(files[i].name, base))
+            die("duplicate name", base);
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        die("cannot open", path);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0 || size > 0x7fffffff)
+        die("cannot size", path);
+    uint8_t *data = malloc((size_t)size + 1);
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size)
+        die("cannot read", path);
+    fclose(f);
+
+    if (nfiles == files_cap) {
+        files_cap = files_cap ? files_cap * 2 : 16;
+        files = realloc(files, files_cap * sizeof(*files));
+        if (!files)
+            die("out of memory", 0);
+    }
+    file_t *fp = &files[nfiles++];
+    memset(fp, 0, sizeof(*fp));
+    strcpy(fp->name, base);
+    fp->data = data;
+    fp->size = (size_t)size;
+}
+
+static void add_path(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        die("cannot stat", path);
+    if (!S_ISDIR(st.st_mode)) {
+        add_file(path);
+        return;
+    }
+    DIR *d = opendir(path);
+    if (!d)
+        die("cannot open", path);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.')
+            continue;
+        char full[4096];
+        snprintf(full, sizeof(full), "%s/%s", path, de->d_name);
+        if (stat(full, &st) == 0 && S_ISREG(st.st_mode))
+            add_file(full);
+    }
+    closedir(d);
+}
+
+static void pack(file_t *fp) {
+    /* worst case: every byte a literal, one length byte per 255 of them */
+    uint8_t *out = malloc(fp->size + fp->size / 255 + 16);
+    uint8_t *check = malloc(fp->size + 1);
+    if (!out || !check)
+        die("out of memory", 0);
+    size_t n = compress(fp->data, fp->size, out);
+    if (decompress(out, n, check, fp->size) != (long)fp->size ||
+        memcmp(fp->data, check, fp->size) != 0)
+        die("compressed block does not decode back", fp->name);
+    free(check);
+    if (fp->size >= 64 && n <= fp->size - fp->size / 8) {
+        fp->stored = out;
+        fp->nstored = n;
+        fp->lz4 = 1;
+    } else {
+        free(out);
+        fp->stored = fp->data;
+        fp->nstored = fp->size;
+    }
+}
+
+/* hash and displace: buckets with the most names are placed first, each
+ * with the smallest displacement that puts all its names on free slots */
+static int place(uint32_t seed, uint32_t nb, uint32_t *disp, int32_t *slot_of) {
+    uint32_t *count = calloc(nb, sizeof(*count));
+    uint8_t *used = calloc(nfiles, 1);
+    size_t *order = malloc(nfiles * sizeof(*order));
+    if (!count || !used || !order)
+        die("out of memory", 0);
+    for (size_t i = 0; i < nfiles; i++) {
+        files[i].bucket = fsimg_hash(files[i].name, seed) % nb;
+        count[files[i].bucket]++;
+        order[i] = i;
+    }
+    /* sort names by bucket size (descending), then bucket */
+    for (size_t i = 1; i < nfiles; i++) {
+        size_t x = order[i], j = i;
+        while (j > 0) {
+            size_t y = order[j - 1];
+            uint32_t cx = count[files[x].bucket], cy = count[files[y].bucket];
+            if (cy > cx || (cy == cx && files[y].bucket <= files[x].bucket))
+                break;
+            order[j] = y;
+            j--;
+        }
+        order[j] = x;
+    }
+
+    int ok = 1;
+    uint32_t slots[64];
+    for (size_t i = 0; i < nfiles && ok; ) {
+        uint32_t b = files[order[i]].bucket;
+        size_t k = count[b];
+        if (k > 64) {
+            ok = 0;
+            break;
+        }
+        uint32_t d;
+        for (d = 1; d < MAX_TRIES; d++) {
+            size_t j;
+            for (j = 0; j < k; j++) {
+                uint32_t s = fsimg_hash(files[order[i + j]].name, d) % (uint32_t)nfiles;
+                if (used[s])
+                    break;
+                size_t m;
+                for (m = 0; m < j && slots[m] != s; m++)
+                    ;
+                if (m < j)
+                    break;
+                slots[j] = s;
+            }
+            if (j == k)
+                break;
+        }
+        if (d == MAX_TRIES) {
+            ok = 0;
+            break;
+        }
+        disp[b] = d;
+        for (size_t j = 0; j < k; j++) {
+            used[slots[j]] = 1;
+            slot_of[order[i + j]] = (int32_t)slots[j];
+        }
+        i += k;
+    }
+    free(count);
+    free(used);
+    free(order);
+    return ok ? 0 : -1;
+}
+
+static size_t align(size_t v, size_t a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+int main(int argc, char **argv) {
+    const char *out = 0;
+    int i = 1;
+    if (argc > 2 && !strcmp(argv[1], "-o")) {
+        out = argv[2];
+        i = 3;
+    }
+    if (!out || i == argc) {
+        fprintf(stderr, "usage: %s -o <image> <file|dir>...\n", argv[0]);
+        return 2;
+    }
+    for (; i < argc; i++)
+        add_path(argv[i]);
+    for (size_t k = 0; k < nfiles; k++)
+        pack(&files[k]);
+
+    /* about two names per bucket keeps the displacement search short */
+    uint32_t nb = nfiles ? (uint32_t)(nfiles + 1) / 2 : 0;
+    uint32_t *disp = calloc(nb ? nb : 1, sizeof(*disp));
+    int32_t *slot_of = malloc((nfiles ? nfiles : 1) * sizeof(*slot_of));
+    if (!disp || !slot_of)
+        die("out of memory", 0);
+    uint32_t seed = 0;
+    while (nfiles && place(seed, nb, disp, slot_of) != 0)
+        if (++seed == 64)
+            die("no perfect hash found", 0);
+
+    /* header, displacements, entries, then the data in slot order */
+    size_t entries_off = align(sizeof(fsimg_header_t) + 4 * (size_t)nb, 8);
+    size_t size = entries_off + nfiles * sizeof(fsimg_entry_t);
+    fsimg_entry_t *ent = calloc(nfiles ? nfiles : 1, sizeof(*ent));
+    file_t **by_slot = calloc(nfiles ? nfiles : 1, sizeof(*by_slot));
+    if (!ent || !by_slot)
+        die("out of memory", 0);
+    for (size_t k = 0; k < nfiles; k++)
+        by_slot[slot_of[k]] = &files[k];
+    size_t raw_total = 0;
+    for (size_t s = 0; s < nfiles; s++) {
+        file_t *fp = by_slot[s];
+        int elf = fp->size >= 4 && !memcmp(fp->data, "\x7f" "ELF", 4);
+        size = align(size, !fp->lz4 && elf ? FSIMG_PAGE : 8);
+        strcpy(ent[s].name, fp->name);
+        ent[s].offset = size;
+        ent[s].size = (uint32_t)fp->size;
+        ent[s].stored = (uint32_t)fp->nstored;
+        ent[s].flags = fp->lz4 ? FSIMG_LZ4 : 0;
+        ent[s].sum = fsimg_sum(fp->data, fp->size);
+        size += fp->nstored;
+        raw_total += fp->size;
+    }
+
+    uint8_t *img = calloc(size ? size : 1, 1);
+    if (!img)
+        die("out of memory", 0);
+    fsimg_header_t *h = (fsimg_header_t *)img;
+    h->magic = FSIMG_MAGIC;
+    h->version = FSIMG_VERSION;
+    h->nfiles = (uint32_t)nfiles;
+    h->nbuckets = nb;
+    h->seed = seed;
+    h->entries_off = (uint32_t)entries_off;
+    h->size = size;
+    memcpy(img + sizeof(*h), disp, 4 * (size_t)nb);
+    memcpy(img + entries_off, ent, nfiles * sizeof(*ent));
+    for (size_t s = 0; s < nfiles; s++)
+        memcpy(img + ent[s].offset, by_slot[s]->stored, by_slot[s]->nstored);
+
+    /* read everything back the way the kernel will */
+    if (fsimg_check(h, size) != 0)
+        die("image fails its own check", 0);
+    for (size_t k = 0; k < nfiles; k++) {
+        int s = fsimg_lookup(h, files[k].name);
+        if (s < 0 || strcmp(fsimg_entries(h)[s].name, files[k].name))
+            die("perfect hash misses", files[k].name);
+        const fsimg_entry_t *e = &fsimg_entries(h)[s];
+        uint8_t *buf = malloc(e->size + 1);
+        if (!buf)
+            die("out of memory", 0);
+        if (e->flags & FSIMG_LZ4) {
+            if (decompress(img + e->offset, e->stored, buf, e->size) != (long)e->size)
+                die("stored block does not decode", e->name);
+        } else {
+            memcpy(buf, img + e->offset, e->size);
+        }
+        if (fsimg_sum(buf, e->size) != e->sum)
+            die("checksum mismatch", e->name);
+        free(buf);
+    }
+
+    FILE *o = fopen(out, "wb");
+    if (!o || fwrite(img, 1, size, o) != size || fclose(o) != 0)
+        die("cannot write", out);
+    printf("fspack: %zu files, %zu bytes (%zu unpacked), %u buckets, seed %u\n",
+           nfiles, size, raw_total, nb, seed);
+    return 0;
+}
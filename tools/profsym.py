@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""profsym.py - symbolize a `prof dump` capture from the RISC-V OS console.
+
+Reads a console log containing the lines printed by `prof dump`
+("S <hart> <pid> <k|u> <pc> <thread>") and resolves every pc against the
+symbol table of kernel.elf (M-mode samples) or userprog.elf (U-mode
+samples). Prints a flat profile and, with --folded, writes folded stacks
+("thread;kernel;function count") for flamegraph.pl or speedscope.
+
+There is no unwinder in the kernel, so a "stack" is the thread, the
+privilege mode and the function the sample landed in.
+
+    ./tools/profsym.py console.log
+    ./tools/profsym.py console.log --folded prof.folded --by-hart
+"""
+
+import argparse
+import bisect
+import collections
+import struct
+import sys
+
+USER_BASE = 0x400000    # memlayout.h: where the loader puts a PIE
+
+SHT_SYMTAB = 2
+STT_NOTYPE = 0
+STT_FUNC = 2
+ET_DYN = 3
+PT_LOAD = 1
+
+
+class Symbols:
+    """Function symbols of one ELF file, looked up by address."""
+
+    def __init__(self, path, bias_for_pie=False):
+        self.path = path
+        self.addrs = []
+        self.entries = []   # (start, end, name), sorted by start
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[4] != 2:
+            raise ValueError(path + ": not a 64-bit ELF file")
+
+        (e_type, _, _, _, e_phoff, e_shoff, _, _, e_phentsize, e_phnum,
+         e_shentsize, e_shnum, _) = struct.unpack_from("<HHIQQQIHHHHHH", data, 16)
+
+        self.bias = 0
+        if bias_for_pie and e_type == ET_DYN:
+            # same placement as loader.c: lowest PT_LOAD page at USER_BASE
+            lowest = min(
+                struct.unpack_from("<IIQQ", data, e_phoff + i * e_phentsize)[3]
+                for i in range(e_phnum)
+                if struct.unpack_from("<I", data, e_phoff + i * e_phentsize)[0] == PT_LOAD)
+            self.bias = USER_BASE - (lowest & ~0xfff)
+
+        sections = [struct.unpack_from("<IIQQQQIIQQ", data, e_shoff + i * e_shentsize)
+                    for i in range(e_shnum)]
+        syms = []
+        for sh in sections:
+            if sh[1] != SHT_SYMTAB:
+                continue
+            strtab = sections[sh[6]]
+            for off in range(sh[4], sh[4] + sh[5], 24):
+                st_name, st_info, _, st_shndx, st_value, st_size = \
+                    struct.unpack_from("<IBBHQQ", data, off)
+                if st_shndx == 0 or st_info & 0xf not in (STT_FUNC, STT_NOTYPE):
+                    continue
+                end = data.index(b"\0", strtab[4] + st_name)
+                name = data[strtab[4] + st_name:end].decode(errors="replace")
+                # skip mapping symbols and local labels
+                if not name or name.startswith(("$", ".L")):
+                    continue
+                syms.append((st_value + self.bias, st_size, name))
+
+        syms.sort()
+        for i, (start, size, name) in enumerate(syms):
+            if size:
+                end = start + size
+            else:
+                end = syms[i + 1][0] if i + 1 < len(syms) else start + 0x10000
+            self.entries.append((start, end, name))
+            self.addrs.append(start)
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        # functions may nest (an asm label inside a sized symbol): walk back
+        # to the closest one that covers pc
+        while i >= 0:
+            start, end, name = self.entries[i]
+            if start <= pc < end:
+                return name
+            if pc - start > 0x100000:
+                break
+            i -= 1
+        return None
+
+
+def read_samples(lines):
+    samples = []
+    inside = False
+    for line in lines:
+        line = line.strip()
+        if line.startswith("# prof begin"):
+            inside = True
+            samples = []    # keep only the last dump in the log
+        elif line.startswith("# prof end"):
+            inside = False
+        elif inside and line.startswith("S "):
+            parts = line.split(None, 5)
+            if len(parts) < 5:
+                continue
+            hart, pid, mode, pc = int(parts[1]), int(parts[2]), parts[3], int(parts[4], 16)
+            thread = parts[5] if len(parts) > 5 else "?"
+            samples.append((hart, pid, mode, pc, thread))
+    return samples
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log", help="console capture with a `prof dump` in it ('-' for stdin)")
+    ap.add_argument("--kernel", default="kernel.elf", help="kernel image (default: kernel.elf)")
+    ap.add_argument("--user", default="userprog.elf", help="user program (default: userprog.elf)")
+    ap.add_argument("--folded", metavar="FILE", help="write folded stacks to FILE")
+    ap.add_argument("--by-hart", action="store_true", help="put the hart at the root of each folded stack")
+    ap.add_argument("--top", type=int, default=40, help="rows in the flat profile (default 40)")
+    args = ap.parse_args()
+
+    log = sys.stdin if args.log == "-" else open(args.log, errors="replace")
+    samples = read_samples(log)
+    if not samples:
+        sys.exit("profsym: no `prof dump` output found in " + args.log)
+
+    kernel = Symbols(args.kernel)
+    try:
+        user = Symbols(args.user, bias_for_pie=True)
+    except OSError:
+        user = None
+
+    flat = collections.Counter()
+    folded = collections.Counter()
+    threads = collections.Counter()
+    for hart, pid, mode, pc, thread in samples:
+        syms = user if mode == "u" else kernel
+        func = syms.lookup(pc) if syms else None
+        if func is None:
+            func = "0x%x" % pc
+        where = "user" if mode == "u" else "kernel"
+        flat[(func, where)] += 1
+        threads["%s (pid %d)" % (thread, pid)] += 1
+        stack = ["%s-%d" % (thread, pid), where, func]
+        if args.by_hart:
+            stack.insert(0, "hart%d" % hart)
+        folded[";".join(stack)] += 1
+
+    total = len(samples)
+    print("%d samples\n" % total)
+    print("  samples      %  thread")
+    for name, n in threads.most_common():
+        print("%9d %6.2f  %s" % (n, 100.0 * n / total, name))
+    print("\n  samples      %  function")
+    for (func, where), n in flat.most_common(args.top):
+        print("%9d %6.2f  %s%s" % (n, 100.0 * n / total, func,
+                                   "  [user]" if where == "user" else ""))
+
+    if args.folded:
+        with open(args.folded, "w") as f:
+            for stack, n in sorted(folded.items()):
+                f.write("%s %d\n" % (stack, n))
+
+
+if __name__ == "__main__":
+    main()
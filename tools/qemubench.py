@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""qemubench.py - boot the kernel headless, run a fixed workload, check timings.
+
+Starts QEMU (the command after `--`) with the console on its stdin and
+stdout, waits for the shell, and types a fixed workload into it. Every
+command is sent as `mark <name> <command>`, so the kernel times it and
+prints "@mark <name> <us> us ..." before the next prompt (shell.c); the
+boot marker comes with the first prompt. The median of each name is
+written in the format tools/benchcmp.py reads, and compared against a
+baseline: anything slower than the threshold fails the run, and so does
+a --baseline file that does not exist. Leave --baseline out to only print
+the results (make bench BENCH_NO_BASELINE=1).
+
+    ./tools/qemubench.py --write-baseline tools/qemubench.baseline -- qemu-system-riscv64 ...
+    ./tools/qemubench.py --baseline tools/qemubench.baseline --threshold 10 -- qemu-system-riscv64 ...
+
+The workload also fails if a command reports an error (unknown command,
+a program killed or exiting non-zero, a loader message) or if the
+console goes quiet for longer than --timeout seconds.
+"""
+
+import argparse
+import os
+import re
+import statistics
+import subprocess
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import benchcmp  # noqa: E402
+
+MARK = re.compile(r"@mark (\S+) (\d+) us")
+PROMPT = re.compile(r"\n> ")
+FAILURE = re.compile(r"Unknown command|No such task|killed|^exit \d+|loader: ", re.M)
+
+
+class Console:
+    """The guest console: everything QEMU prints, and a way to type."""
+
+    def __init__(self, cmd, log):
+        self.proc = subprocess.Popen(cmd, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT, bufsize=0)
+        self.text = ""
+        self.pos = 0            # where the next expect() starts looking
+        self.done = False       # QEMU closed its output
+        self.log = log
+        self.cond = threading.Condition()
+        self.reader = threading.Thread(target=self._read, daemon=True)
+        self.reader.start()
+
+    def _read(self):
+        fd = self.proc.stdout.fileno()
+        while True:
+            data = os.read(fd, 4096)
+            with self.cond:
+                if not data:
+                    self.done = True
+                    self.cond.notify_all()
+                    return
+                chunk = data.decode("utf-8", "replace").replace("\r", "")
+                self.text += chunk
+                if self.log:
+                    self.log.write(chunk)
+                self.cond.notify_all()
+
+    def expect(self, pattern, timeout):
+        """Wait for pattern after the last match; returns the match."""
+        deadline = time.monotonic() + timeout
+        with self.cond:
+            while True:
+                m = pattern.search(self.text, self.pos)
+                if m:
+                    self.pos = m.end()
+                    return m
+                if self.done:
+                    raise RuntimeError("QEMU exited")
+                left = deadline - time.monotonic()
+                if left <= 0:
+                    raise RuntimeError("timed out waiting for %r" % pattern.pattern)
+                self.cond.wait(left)
+
+    def send(self, line):
+        self.proc.stdin.write((line + "\r").encode())
+        self.proc.stdin.flush()
+
+    def close(self):
+        if self.proc.poll() is None:
+            self.proc.kill()
+        self.proc.wait()
+
+
+def run_step(con, name, command, timeout):
+    """Type one marked command; returns its microseconds."""
+    start = con.pos
+    con.send("mark %s %s" % (name, command))
+    m = con.expect(re.compile(r"@mark %s (\d+) us" % re.escape(name)), timeout)
+    con.expect(PROMPT, timeout)
+    output = con.text[start:m.start()]
+    bad = FAILURE.search(output)
+    if bad:
+        raise RuntimeError("%s: %r failed: %s" % (name, command, bad.group(0)))
+    return int(m.group(1))
+
+
+def run_workload(con, reps, timeout):
+    """name -> list of microseconds, in the order the steps ran."""
+    samples = {}
+
+    def step(name, command, wait=None):
+        samples.setdefault(name, []).append(run_step(con, name, command, timeout))
+        if wait:
+            con.expect(re.compile(wait), timeout)
+
+    m = con.expect(MARK, timeout)
+    if m.group(1) != "boot":
+        raise RuntimeError("first marker is %s, not boot" % m.group(1))
+    samples["boot"] = [int(m.group(2))]
+    con.expect(PROMPT, timeout)
+
+    for _ in range(reps):
+        step("ls", "ls")
+    for _ in range(reps):
+        step("cat", "cat manual.txt")
+    # `run` returns once the coroutine is started; its output comes later
+    for _ in range(3):
+        step("run.counter1", "run counter1", wait=r"\[counter1\] tick 4")
+
+    # the first load after a flush parses and relocates, the rest come
+    # from the prepared image cache
+    con.send("imgcache flush")
+    con.expect(PROMPT, timeout)
+    step("load.userprog.cold", "load userprog.elf")
+    for _ in range(reps):
+        step("load.userprog", "load userprog.elf")
+    for _ in range(reps):
+        step("load.true", "load true.elf")
+    return samples
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--baseline", help="results to compare against")
+    ap.add_argument("--write-baseline", metavar="FILE", help="store the results as the baseline")
+    ap.add_argument("--threshold", type=float, default=10.0,
+                    help="percent slowdown that fails the run (default 10)")
+    ap.add_argument("--reps", type=int, default=10, help="repetitions per command (default 10)")
+    ap.add_argument("--timeout", type=float, default=60.0,
+                    help="seconds to wait for any one step (default 60)")
+    ap.add_argument("--out", help="also write the results here")
+    ap.add_argument("--log", help="write the console transcript here")
+    ap.add_argument("qemu", nargs=argparse.REMAINDER, help="-- qemu-system-riscv64 ...")
+    args = ap.parse_args()
+
+    cmd = args.qemu[1:] if args.qemu[:1] == ["--"] else args.qemu
+    if not cmd:
+        ap.error("no QEMU command given")
+    if args.baseline and not os.path.exists(args.baseline):
+        sys.exit("qemubench: no baseline %s; record one with `make bench-baseline` "
+                 "on the reference commit, or run without one with "
+                 "`make bench BENCH_NO_BASELINE=1`" % args.baseline)
+    if not args.baseline and not args.write_baseline:
+        sys.stderr.write("qemubench: warning: no baseline, only printing the results\n")
+
+    log = open(args.log, "w") if args.log else None
+    con = Console(cmd, log)
+    try:
+        samples = run_workload(con, args.reps, args.timeout)
+    except RuntimeError as e:
+        sys.stderr.write(con.text[-2000:])
+        sys.exit("\nqemubench: %s" % e)
+    finally:
+        con.close()
+        if log:
+            log.close()
+
+    lines = ["# qemubench: median of %d, microseconds of guest time" % args.reps]
+    lines += ["%s %d us" % (name, statistics.median(v)) for name, v in samples.items()]
+    results = "\n".join(lines) + "\n"
+    for path in (args.out, args.write_baseline):
+        if path:
+            with open(path, "w") as f:
+                f.write(results)
+    if not args.baseline:
+        sys.stdout.write(results)
+        return
+
+    rows, regressed = benchcmp.compare(benchcmp.read_results(args.baseline),
+                                       benchcmp.parse_results(lines, "results"),
+                                       args.threshold)
+    benchcmp.print_rows(rows)
+    if regressed:
+        sys.exit("qemubench: %d slower than the baseline by more than %g%%: %s"
+                 % (len(regressed), args.threshold, " ".join(regressed)))
+    print("qemubench: within %g%% of the baseline" % args.threshold)
+
+
+if __name__ == "__main__":
+    main()
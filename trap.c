@@ -0,0 +1,100 @@
+// trap.c — machine-mode trap dispatch for the RISC-V OS
+// trapvec.S saves the interrupted context and calls trap_handler(). we look
+// at mcause and either reschedule (timer tick, ecall-yield, IPI from another
+// hart), service a device through the PLIC, or report the fault and kill the
+// offending thread. every hart runs this; only hart 0 takes PLIC interrupts.
+
+#include "uart.h"
+#include "riscv.h"
+#include "trap.h"
+#include "sched.h"
+#include "plic.h"
+#include "timer.h"
+#include "syscall.h"
+#include "prof.h"
+
+extern void trap_vector(void);
+
+static volatile int probe_active;
+static volatile int probe_faulted;
+
+// called once per hart: mtvec and mscratch are per-hart CSRs
+void trap_init(void) {
+    csr_write(mscratch, 0);     // we are in the kernel (see trapvec.S)
+    csr_write(mtvec, (uint64_t)trap_vector);
+}
+
+void trap_probe_begin(void) {
+    probe_faulted = 0;
+    probe_active = 1;
+}
+
+int trap_probe_end(void) {
+    probe_active = 0;
+    return probe_faulted;
+}
+
+static void external_intr(void) {
+    uint32_t irq;
+    while ((irq = plic_claim()) != 0) {
+        if (irq == UART0_IRQ)
+            uart_intr();
+        plic_complete(irq);
+    }
+}
+
+static void trap_report(const char *what, uint64_t cause, trapframe_t *tf) {
+    uart_puts("trap: ");
+    uart_puts(what);
+    uart_puts(" mcause=");
+    uart_put_hex(cause);
+    uart_puts(" mepc=");
+    uart_put_hex(tf->mepc);
+    uart_puts(" mtval=");
+    uart_put_hex(csr_read(mtval));
+    uart_puts("\n");
+}
+
+trapframe_t *trap_handler(trapframe_t *tf) {
+    uint64_t cause = csr_read(mcause);
+
+    if (cause & MCAUSE_INTR) {
+        switch (cause & ~MCAUSE_INTR) {
+        case IRQ_M_TIMER:
+            if (prof_period)
+                prof_sample(tf);
+            return sched_tick(tf);
+        case IRQ_M_EXT:
+            external_intr();
+            return sched_wake_check(tf);
+        case IRQ_M_SOFT:
+            // another hart queued work for us (sched_wakeup/enqueue)
+            timer_clear_ipi();
+            return sched_wake_check(tf);
+        default:
+            trap_report("unexpected interrupt", cause, tf);
+            return tf;
+        }
+    }
+
+    switch (cause) {
+    case EXC_ECALL_M:
+        // kernel threads use ecall to yield (see sched_yield)
+        tf->mepc += 4;
+        return sched_switch(tf);
+    case EXC_ECALL_U:
+        // system calls that did not take the fast path in trapvec.S
+        return syscall_handler(tf);
+    case EXC_ILLEGAL_INSN:
+        if (probe_active) {
+            probe_faulted = 1;
+            tf->mepc += 4;
+            return tf;
+        }
+        trap_report("illegal instruction", cause, tf);
+        return sched_kill_current(tf);
+    default:
+        trap_report("exception", cause, tf);
+        return sched_kill_current(tf);
+    }
+}
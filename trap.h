@@ -0,0 +1,40 @@
+// trap.h — machine-mode trap handling
+// declares the register frame that trapvec.S pushes on every trap and the
+// C-side handler that decides what to do with it (timer tick, yield, fault).
+
+#ifndef TRAP_H
+#define TRAP_H
+
+#include <stdint.h>
+
+// saved register context. trapvec.S builds one of these on the stack of
+// whatever was running when the trap arrived; the scheduler keeps a pointer
+// to it in the pcb so the thread can be resumed later. the layout is shared
+// with trapvec.S, so keep the two in sync.
+typedef struct trapframe {
+    uint64_t regs[32];    // x0..x31 (regs[2] is the interrupted sp)
+    uint64_t mepc;
+    uint64_t mstatus;
+} trapframe_t;
+
+#define TF_RA   1
+#define TF_SP   2
+#define TF_A0   10
+
+//   installs trapvec.S as the machine trap vector (mtvec).
+//   called by: - kernel_main() in main.c
+void trap_init(void);
+
+//   run a single instruction that may not exist on this hart: between
+//   begin and end an illegal-instruction trap is swallowed (the instruction
+//   is skipped) and trap_probe_end() returns 1.
+//   called by: - string_init() in string.c
+void trap_probe_begin(void);
+int trap_probe_end(void);
+
+//   called from trapvec.S with the saved frame. returns the frame that
+//   should be restored, which is a different thread's frame whenever the
+//   scheduler decided to switch.
+trapframe_t *trap_handler(trapframe_t *tf);
+
+#endif
@@ -0,0 +1,9 @@
+/* true.c - the smallest user program: returns 0 from _start.
+ * It makes no system call of its own; the return lands in the kernel's
+ * exit stub (uexit.S), which exits with status 0. bench spawn starts it
+ * thousands of times to time spawn, exit and reap.
+ */
+
+int _start(void) {
+    return 0;
+}
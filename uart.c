@@ -1,12 +1,61 @@
+// uart.c — interrupt-driven NS16550 driver for the RISC-V OS
+// ---------------------------------------------------------------
+// output goes into a kernel TX ring and is drained by the THR-empty
+// interrupt, up to one hardware FIFO (16 bytes) per interrupt. input is
+// pulled out of the RX FIFO by the receive interrupt into an RX ring, and
+// uart_getc() sleeps on that ring instead of spinning on LSR.
+//
+// when machine interrupts are off (early boot, or we are already inside the
+// trap handler) there is nobody to drain the rings, so both paths fall back
+// to polling the hardware directly.
+//
+// the rings, the IER shadow and the device registers are shared by all
+// harts and guarded by uart_lock. the device interrupt is only routed to
+// hart 0, but any hart may print or read.
+// ---------------------------------------------------------------
+
 #include "uart.h"
+#include "riscv.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "perf.h"
 
 #define UART_BASE   0x10000000UL
 
 /* NS16550-ish register offsets (byte offsets) */
 #define UART_RBR    0x00  /* receive buffer (read) */
 #define UART_THR    0x00  /* transmit holding (write) */
+#define UART_IER    0x01  /* interrupt enable */
+#define UART_FCR    0x02  /* FIFO control (write) */
+#define UART_LCR    0x03  /* line control */
 #define UART_LSR    0x05  /* line status register */
 
+#define IER_RDI     0x01  /* receive data available */
+#define IER_THRI    0x02  /* transmit holding register empty */
+
+#define FCR_ENABLE  0x01
+#define FCR_CLR_RX  0x02
+#define FCR_CLR_TX  0x04
+
+#define LCR_8N1     0x03
+
+#define LSR_DR      0x01  /* data ready */
+#define LSR_THRE    0x20  /* TX FIFO empty */
+
+#define UART_FIFO_DEPTH 16
+
+// ring sizes must be powers of two
+#define TX_RING_SIZE 2048
+#define RX_RING_SIZE 256
+
+static char tx_ring[TX_RING_SIZE];
+static volatile uint32_t tx_head, tx_tail;   // head = next write, tail = next send
+static char rx_ring[RX_RING_SIZE];
+static volatile uint32_t rx_head, rx_tail;
+
+static uint8_t ier_shadow;
+static spinlock_t uart_lock;
+
 static inline uint8_t mmio_read8(uintptr_t addr) {
     return *(volatile uint8_t *)addr;
 }
@@ -15,35 +64,194 @@ static inline void mmio_write8(uintptr_t addr, uint8_t val) {
     *(volatile uint8_t *)addr = val;
 }
 
+static void uart_set_ier(uint8_t ier) {
+    if (ier != ier_shadow) {
+        ier_shadow = ier;
+        mmio_write8(UART_BASE + UART_IER, ier);
+    }
+}
+
 void uart_init(void) {
-    // using QEMU’s default UART config (no setup needed)
+    // 8N1, FIFOs on and flushed, RX trigger at 1 byte so keystrokes are
+    // delivered immediately. only RX interrupts stay enabled; THRI is
+    // switched on while there is something queued to send.
+    mmio_write8(UART_BASE + UART_LCR, LCR_8N1);
+    mmio_write8(UART_BASE + UART_FCR, FCR_ENABLE | FCR_CLR_RX | FCR_CLR_TX);
+    tx_head = tx_tail = 0;
+    rx_head = rx_tail = 0;
+    ier_shadow = 0xff;
+    uart_set_ier(IER_RDI);
 }
 
-void uart_putc(char c) {
-    // wait for transmitter to be ready (bit 5)
-    while ((mmio_read8(UART_BASE + UART_LSR) & (1 << 5)) == 0);
-    mmio_write8(UART_BASE + UART_THR, (uint8_t)c);
+// -----------------------------------------------------------------------------
+// Transmit
+// -----------------------------------------------------------------------------
+
+// move up to one FIFO's worth of queued bytes into THR. only called when
+// LSR says the FIFO is empty, so no per-byte status polling is needed.
+// uart_lock must be held.
+static void tx_fill_fifo(void) {
+    int n = 0;
+    while (tx_tail != tx_head && n < UART_FIFO_DEPTH) {
+        mmio_write8(UART_BASE + UART_THR, (uint8_t)tx_ring[tx_tail & (TX_RING_SIZE - 1)]);
+        tx_tail++;
+        n++;
+    }
+    uart_set_ier(tx_tail != tx_head ? (IER_RDI | IER_THRI) : IER_RDI);
 }
 
-char uart_getc(void) {
-    // wait for data ready (bit 0)
-    while ((mmio_read8(UART_BASE + UART_LSR) & (1 << 0)) == 0);
-    return (char)mmio_read8(UART_BASE + UART_RBR);
+// synchronously push queued data out; used when nobody else can.
+static void tx_poll_fill(void) {
+    while ((mmio_read8(UART_BASE + UART_LSR) & LSR_THRE) == 0);
+    tx_fill_fifo();
+}
+
+// start the transmitter if it is idle; the THRE interrupt does the rest.
+static void tx_kick(void) {
+    if (mmio_read8(UART_BASE + UART_LSR) & LSR_THRE)
+        tx_fill_fifo();
+    else if (tx_tail != tx_head)
+        uart_set_ier(IER_RDI | IER_THRI);
+}
+
+// queue one byte; uart_lock must be held (s = state before the irqsave)
+static void tx_put_locked(char c, uint64_t s) {
+    while (tx_head - tx_tail == TX_RING_SIZE) {
+        if (s & MSTATUS_MIE) {
+            tx_kick();
+            sched_sleep(tx_ring, &uart_lock);
+        } else {
+            tx_poll_fill();
+        }
+    }
+    tx_ring[tx_head & (TX_RING_SIZE - 1)] = c;
+    tx_head++;
+}
+
+void uart_putc(char c) {
+    uint64_t s = spin_lock_irqsave(&uart_lock);
+    tx_put_locked(c, s);
+    tx_kick();
+    spin_unlock_irqrestore(&uart_lock, s);
+    sched_acct_tx(1);
 }
 
 void uart_puts(const char *s) {
+    PERF_SCOPE(PERF_UART_TX);
+    const char *s0 = s;
+    uint64_t st = spin_lock_irqsave(&uart_lock);
     while (*s) {
         if (*s == '\n')
-            uart_putc('\r');
-        uart_putc(*s++);
+            tx_put_locked('\r', st);
+        tx_put_locked(*s++, st);
+    }
+    tx_kick();
+    spin_unlock_irqrestore(&uart_lock, st);
+    PERF_COUNT(PERF_UART_BYTES, (uint64_t)(s - s0));
+    sched_acct_tx((uint64_t)(s - s0));
+}
+
+// like uart_puts() for a buffer that is not NUL-terminated. charges nobody:
+// it is how klogd drains the log, whose bytes kprintf() has charged already
+void uart_write(const char *buf, size_t n) {
+    PERF_SCOPE(PERF_UART_TX);
+    uint64_t st = spin_lock_irqsave(&uart_lock);
+    for (size_t i = 0; i < n; i++) {
+        if (buf[i] == '\n')
+            tx_put_locked('\r', st);
+        tx_put_locked(buf[i], st);
+    }
+    tx_kick();
+    spin_unlock_irqrestore(&uart_lock, st);
+    PERF_COUNT(PERF_UART_BYTES, n);
+}
+
+void uart_flush(void) {
+    uint64_t s = spin_lock_irqsave(&uart_lock);
+    while (tx_tail != tx_head)
+        tx_poll_fill();
+    spin_unlock_irqrestore(&uart_lock, s);
+}
+
+// -----------------------------------------------------------------------------
+// Receive
+// -----------------------------------------------------------------------------
+
+char uart_getc(void) {
+    uint64_t s = spin_lock_irqsave(&uart_lock);
+    char c;
+    if (!(s & MSTATUS_MIE)) {
+        // no interrupts yet: wait for data ready the old way
+        while (rx_tail == rx_head &&
+               (mmio_read8(UART_BASE + UART_LSR) & LSR_DR) == 0);
+        if (rx_tail == rx_head) {
+            c = (char)mmio_read8(UART_BASE + UART_RBR);
+            spin_unlock_irqrestore(&uart_lock, s);
+            return c;
+        }
+    }
+    while (rx_tail == rx_head)
+        sched_sleep(rx_ring, &uart_lock);
+    c = rx_ring[rx_tail & (RX_RING_SIZE - 1)];
+    rx_tail++;
+    spin_unlock_irqrestore(&uart_lock, s);
+    return c;
+}
+
+// needs interrupts on: nothing else would fill the ring meanwhile
+int uart_getc_until(uint64_t deadline) {
+    uint64_t s = spin_lock_irqsave(&uart_lock);
+    while (rx_tail == rx_head && sched_sleep_until(rx_ring, &uart_lock, deadline) == 0)
+        ;
+    int c = -1;
+    if (rx_tail != rx_head) {
+        c = (unsigned char)rx_ring[rx_tail & (RX_RING_SIZE - 1)];
+        rx_tail++;
+    }
+    spin_unlock_irqrestore(&uart_lock, s);
+    return c;
+}
+
+// -----------------------------------------------------------------------------
+// Interrupt handler (called from trap.c via the PLIC, interrupts off)
+// -----------------------------------------------------------------------------
+
+void uart_intr(void) {
+    spin_lock(&uart_lock);
+    int got = 0;
+    while (mmio_read8(UART_BASE + UART_LSR) & LSR_DR) {
+        char c = (char)mmio_read8(UART_BASE + UART_RBR);
+        if (rx_head - rx_tail < RX_RING_SIZE) {
+            rx_ring[rx_head & (RX_RING_SIZE - 1)] = c;
+            rx_head++;
+        }
+        got = 1;
+    }
+    if (got)
+        sched_wakeup(rx_ring);
+
+    if (mmio_read8(UART_BASE + UART_LSR) & LSR_THRE) {
+        uint32_t before = tx_tail;
+        tx_fill_fifo();
+        if (tx_tail != before)
+            sched_wakeup(tx_ring);
     }
+    spin_unlock(&uart_lock);
 }
 
+// -----------------------------------------------------------------------------
+// Formatting helpers
+// -----------------------------------------------------------------------------
+
 void uart_put_hex(uint64_t v) {
     static const char *digits = "0123456789abcdef";
-    uart_puts("0x");
-    for (int i = 60; i >= 0; i -= 4)
-        uart_putc(digits[(v >> i) & 0xF]);
+    char buf[19];
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (int i = 0; i < 16; i++)
+        buf[2 + i] = digits[(v >> (60 - 4 * i)) & 0xF];
+    buf[18] = '\0';
+    uart_puts(buf);
 }
 
 void uart_put_dec(int v) {
@@ -65,3 +273,15 @@ void uart_put_dec(int v) {
     while (i--)
         uart_putc(buf[i]);
 }
+
+// for counters that outgrow an int (cycle totals)
+void uart_put_u64(uint64_t v) {
+    char buf[20];
+    int i = 0;
+    do {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+    while (i--)
+        uart_putc(buf[i]);
+}
@@ -2,12 +2,19 @@
 #define UART_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 void uart_init(void);
 void uart_putc(char c);
 void uart_puts(const char *s);
+void uart_write(const char *buf, size_t n);
 char uart_getc(void);
+// the next input byte, or -1 if none came by mtime `deadline`
+int uart_getc_until(uint64_t deadline);
+void uart_flush(void);
+void uart_intr(void);
 void uart_put_hex(uint64_t v);
 void uart_put_dec(int v);
+void uart_put_u64(uint64_t v);
 
 #endif
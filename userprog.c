@@ -1,28 +1,50 @@
-/* userprog.c - self-contained user program that talks to UART MMIO directly.
- * No external symbols required.
+/* userprog.c - self-contained user program that talks to the kernel
+ * through system calls (syscall.h). Runs in U-mode in its own address
+ * space; no devices are mapped, so the console is reached with write().
  */
 
 #include <stdint.h>
-#define UART0_BASE 0x10000000UL
-#define UART_THR 0x00
-#define UART_LSR 0x05
-#define LSR_TX_IDLE 0x20
+#include "syscall.h"
 
-static inline void uart_putc(char c) {
-    volatile uint8_t *thr = (volatile uint8_t *)(UART0_BASE + UART_THR);
-    volatile uint8_t *lsr = (volatile uint8_t *)(UART0_BASE + UART_LSR);
-    while ((*lsr & LSR_TX_IDLE) == 0) {}
-    *thr = (uint8_t)c;
+static inline long syscall3(long nr, long a0, long a1, long a2) {
+    register long r_a0 asm("a0") = a0;
+    register long r_a1 asm("a1") = a1;
+    register long r_a2 asm("a2") = a2;
+    register long r_a7 asm("a7") = nr;
+    asm volatile("ecall"
+                 : "+r"(r_a0)
+                 : "r"(r_a1), "r"(r_a2), "r"(r_a7)
+                 : "memory");
+    return r_a0;
 }
 
-static void uart_puts(const char *s) {
-    while (*s) {
-        if (*s == '\n') uart_putc('\r');
-        uart_putc(*s++);
-    }
+static void puts_user(const char *s) {
+    long n = 0;
+    while (s[n]) n++;
+    syscall3(SYS_write, 1, (long)s, n);
+}
+
+static void put_dec(unsigned long v) {
+    char buf[24];
+    int i = sizeof(buf);
+    do {
+        buf[--i] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    syscall3(SYS_write, 1, (long)(buf + i), (long)sizeof(buf) - i);
 }
 
 void _start(void) {
-    uart_puts("Hello from user program at 0x80200000!\n");
-    for (;;) {}
+    puts_user("Hello from user program at 0x400000!\n");
+    puts_user("pid ");
+    put_dec((unsigned long)syscall3(SYS_getpid, 0, 0, 0));
+    puts_user(", ");
+    put_dec((unsigned long)syscall3(SYS_time, 0, 0, 0));
+    puts_user(" us since boot\n");
+    long t0 = syscall3(SYS_time, 0, 0, 0);
+    syscall3(SYS_sleep, 100000, 0, 0);
+    puts_user("slept ");
+    put_dec((unsigned long)(syscall3(SYS_time, 0, 0, 0) - t0));
+    puts_user(" us (asked for 100000)\n");
+    syscall3(SYS_exit, 0, 0, 0);
 }
@@ -0,0 +1,269 @@
+// vm.c — Sv39 paging for the RISC-V OS
+// ---------------------------------------------------------------
+// Sv39 splits a 39-bit virtual address into three 9-bit indexes (one per
+// page table level) and a 12-bit page offset. a leaf can sit at any level:
+// level 0 maps 4 KiB pages, level 1 maps 2 MiB megapages.
+//
+// the kernel itself runs in M-mode, where translation is off, so it keeps
+// using physical addresses everywhere. user programs run in U-mode under
+// their own page table. each table also carries a direct map of all of RAM
+// at its physical address: non-user and global, built from 2 MiB megapages
+// so it costs 64 PTEs (one shared level-1 table) and few TLB entries. that
+// keeps the upper part of every address space identical to the kernel's
+// view for any supervisor-level or MPRV access made on a process's behalf.
+//
+// sfence.vma only flushes the hart that executes it. when an ASID is
+// retired, vm_flush_asid() bumps that ASID's generation; every hart records
+// the generation it last flushed and vm_activate() flushes lazily when it is
+// about to run an ASID whose generation moved on. no IPIs needed.
+// ---------------------------------------------------------------
+
+#include "vm.h"
+#include "kalloc.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "uart.h"
+#include "kprintf.h"
+#include "string.h"
+#include "tasks.h"
+
+#define MEGAPAGE        (2UL * 1024 * 1024)
+#define PX(level, va)   (((uint64_t)(va) >> (12 + 9 * (level))) & 0x1FF)
+#define PA2PTE(pa)      (((uint64_t)(pa) >> 12) << 10)
+#define PTE2PA(pte)     (((uint64_t)(pte) >> 10) << 12)
+#define PTE_LEAF        (PTE_R | PTE_W | PTE_X)
+
+#define SATP_SV39       (8UL << 60)
+#define SATP_ASID_SHIFT 44
+
+// PMP: one NAPOT region covering the whole address space, RWX
+#define PMPCFG_R        0x01
+#define PMPCFG_W        0x02
+#define PMPCFG_X        0x04
+#define PMPCFG_NAPOT    0x18
+
+// level-1 table holding the megapage direct map; shared by every process
+static pagetable_t kernel_l1;
+
+#define NASID (TASK_MAX_PROC + 1)
+static volatile uint32_t asid_gen[NASID];
+static uint32_t asid_seen[MAX_HARTS][NASID];
+
+void vm_init(void) {
+    kernel_l1 = (pagetable_t)kalloc_page();
+    for (uint64_t pa = RAM_BASE; pa < RAM_END; pa += MEGAPAGE)
+        kernel_l1[PX(1, pa)] = PA2PTE(pa) | PTE_R | PTE_W | PTE_X |
+                               PTE_G | PTE_A | PTE_D | PTE_V;
+
+    vm_init_hart();
+    kprintf("[VM] Sv39 enabled, kernel direct map with 2 MiB pages\n");
+}
+
+void vm_init_hart(void) {
+    // without a matching PMP entry every U-mode access faults
+    csr_write(pmpaddr0, ~0UL >> 10);
+    csr_write(pmpcfg0, PMPCFG_NAPOT | PMPCFG_R | PMPCFG_W | PMPCFG_X);
+    // let U-mode read cycle, time and instret (rdcycle & co.)
+    csr_write(mcounteren, 7);
+}
+
+pagetable_t vm_create(void) {
+    pagetable_t root = (pagetable_t)kalloc_page();
+    if (!root)
+        return 0;
+    root[PX(2, RAM_BASE)] = PA2PTE(kernel_l1) | PTE_V;
+    return root;
+}
+
+// returns the level-0 PTE for va, creating intermediate tables if `alloc`.
+// user addresses never reach the shared kernel level-1 table.
+static pte_t *walk(pagetable_t pt, uint64_t va, int alloc) {
+    if (va >= RAM_BASE)
+        return 0;
+    for (int level = 2; level > 0; level--) {
+        pte_t *pte = &pt[PX(level, va)];
+        if (*pte & PTE_V) {
+            if (*pte & PTE_LEAF)
+                return 0;
+            pt = (pagetable_t)PTE2PA(*pte);
+        } else {
+            if (!alloc)
+                return 0;
+            pagetable_t next = (pagetable_t)kalloc_page();
+            if (!next)
+                return 0;
+            *pte = PA2PTE(next) | PTE_V;
+            pt = next;
+        }
+    }
+    return &pt[PX(0, va)];
+}
+
+int vm_map(pagetable_t pt, uint64_t va, uint64_t pa, uint64_t size, uint64_t perm) {
+    for (uint64_t off = 0; off < size; off += PGSIZE) {
+        pte_t *pte = walk(pt, va + off, 1);
+        if (!pte || (*pte & PTE_V))
+            return -1;
+        // A/D preset: we never page out, and not every implementation
+        // updates them in hardware
+        *pte = PA2PTE(pa + off) | perm | PTE_A | PTE_D | PTE_V;
+    }
+    return 0;
+}
+
+int vm_alloc(pagetable_t pt, uint64_t va, uint64_t size, uint64_t perm) {
+    for (uint64_t off = 0; off < size; off += PGSIZE) {
+        void *page = kalloc_page();
+        if (!page)
+            return -1;
+        if (vm_map(pt, va + off, (uint64_t)page, PGSIZE, perm) != 0) {
+            kfree_page(page);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int vm_add_perm(pagetable_t pt, uint64_t va, uint64_t perm) {
+    pte_t *pte = walk(pt, va, 0);
+    if (!pte || !(*pte & PTE_V))
+        return -1;
+    *pte |= perm;
+    return 0;
+}
+
+int vm_privatize(pagetable_t pt, uint64_t va) {
+    pte_t *pte = walk(pt, va, 0);
+    if (!pte || !(*pte & PTE_V))
+        return -1;
+    if (!(*pte & PTE_BORROWED))
+        return 0;
+    void *page = kalloc_page();
+    if (!page)
+        return -1;
+    memcpy(page, (void *)PTE2PA(*pte), PGSIZE);
+    *pte = PA2PTE(page) | (*pte & 0x3FF & ~PTE_BORROWED);
+    return 0;
+}
+
+int vm_is_borrowed(pagetable_t pt, uint64_t va) {
+    pte_t *pte = walk(pt, va, 0);
+    return pte && (*pte & PTE_V) && (*pte & PTE_BORROWED);
+}
+
+uint64_t vm_take(pagetable_t pt, uint64_t va, uint64_t *flags) {
+    pte_t *pte = walk(pt, va, 0);
+    if (!pte || !(*pte & PTE_V))
+        return 0;
+    *flags = *pte & 0x3ff;
+    *pte |= PTE_BORROWED;
+    return PTE2PA(*pte);
+}
+
+int vm_copy_out(pagetable_t pt, uint64_t va, const void *src, uint64_t len) {
+    const uint8_t *s = (const uint8_t *)src;
+    while (len) {
+        uint64_t pa = vm_translate(pt, va);
+        if (!pa)
+            return -1;
+        uint64_t n = PGSIZE - (va & (PGSIZE - 1));
+        if (n > len) n = len;
+        memcpy((void *)pa, s, n);
+        s += n;
+        va += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int vm_copy_in(pagetable_t pt, void *dst, uint64_t va, uint64_t len) {
+    uint8_t *d = (uint8_t *)dst;
+    while (len) {
+        uint64_t pa = vm_translate(pt, va);
+        if (!pa)
+            return -1;
+        uint64_t n = PGSIZE - (va & (PGSIZE - 1));
+        if (n > len) n = len;
+        memcpy(d, (const void *)pa, n);
+        d += n;
+        va += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int vm_copy_in_str(pagetable_t pt, char *dst, uint64_t va, uint64_t max) {
+    for (uint64_t i = 0; i < max; i++) {
+        if (!vm_user_ok(pt, va + i, 1, PTE_R))
+            return -1;
+        char c = *(const char *)vm_translate(pt, va + i);
+        dst[i] = c;
+        if (!c)
+            return 0;
+    }
+    return -1;
+}
+
+int vm_user_ok(pagetable_t pt, uint64_t va, uint64_t len, uint64_t perm) {
+    if (va + len < va)
+        return 0;
+    perm |= PTE_V | PTE_U;
+    for (uint64_t a = PGROUNDDOWN(va); a < va + len; a += PGSIZE) {
+        pte_t *pte = walk(pt, a, 0);
+        if (!pte || (*pte & perm) != perm)
+            return 0;
+    }
+    return 1;
+}
+
+uint64_t vm_translate(pagetable_t pt, uint64_t va) {
+    pte_t *pte = walk(pt, va, 0);
+    if (!pte || !(*pte & PTE_V))
+        return 0;
+    return PTE2PA(*pte) | (va & (PGSIZE - 1));
+}
+
+static void free_level(pagetable_t pt, int level) {
+    for (int i = 0; i < 512; i++) {
+        pte_t pte = pt[i];
+        if (!(pte & PTE_V))
+            continue;
+        if (level == 0) {
+            if (!(pte & PTE_BORROWED))
+                kfree_page((void *)PTE2PA(pte));
+        } else {
+            free_level((pagetable_t)PTE2PA(pte), level - 1);
+        }
+    }
+    kfree_page(pt);
+}
+
+void vm_free(pagetable_t pt) {
+    for (uint64_t i = 0; i < 512; i++) {
+        if (i == PX(2, RAM_BASE) || !(pt[i] & PTE_V))
+            continue;
+        free_level((pagetable_t)PTE2PA(pt[i]), 1);
+    }
+    kfree_page(pt);
+}
+
+void vm_activate(pagetable_t pt, uint16_t asid) {
+    csr_write(satp, SATP_SV39 | ((uint64_t)asid << SATP_ASID_SHIFT) |
+                    ((uint64_t)pt >> 12));
+    if (asid < NASID) {
+        uint32_t g = __atomic_load_n(&asid_gen[asid], __ATOMIC_ACQUIRE);
+        uint32_t *seen = &asid_seen[hart_id()][asid];
+        if (*seen != g) {
+            sfence_vma_asid(asid);
+            *seen = g;
+        }
+    }
+}
+
+void vm_flush_asid(uint16_t asid) {
+    if (asid < NASID)
+        __atomic_fetch_add(&asid_gen[asid], 1, __ATOMIC_RELEASE);
+    sfence_vma_asid(asid);
+    if (asid < NASID)
+        asid_seen[hart_id()][asid] = asid_gen[asid];
+}
@@ -0,0 +1,90 @@
+// vm.h — Sv39 page tables and per-process address spaces
+// every user program gets its own three-level Sv39 page table with its
+// segments, its stack and a shared, non-user direct map of kernel RAM.
+// the scheduler loads the table into satp (tagged with the process's ASID)
+// whenever it switches to that process.
+
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+
+typedef uint64_t pte_t;
+typedef pte_t *pagetable_t;
+
+#define PTE_V   (1UL << 0)
+#define PTE_R   (1UL << 1)
+#define PTE_W   (1UL << 2)
+#define PTE_X   (1UL << 3)
+#define PTE_U   (1UL << 4)
+#define PTE_G   (1UL << 5)
+#define PTE_A   (1UL << 6)
+#define PTE_D   (1UL << 7)
+#define PTE_BORROWED (1UL << 8)   // software bit: frame not owned (MMIO or kernel
+                                  // image), never freed
+
+//   builds the kernel direct map and opens PMP so U-mode can reach memory at
+//   all (the page tables do the actual protection).
+//   called by: - kernel_main() in main.c
+void vm_init(void);
+
+//   per-hart part of vm_init(): the PMP entry that lets U-mode touch memory.
+//   called by: - vm_init(), and secondary_main() in main.c
+void vm_init_hart(void);
+
+//   new, empty user address space (only the kernel direct map is present).
+//   returns 0 if out of memory.
+pagetable_t vm_create(void);
+
+//   frees every page table page and every user frame of the address space.
+void vm_free(pagetable_t pt);
+
+//   maps [va, va+size) to [pa, pa+size) with 4 KiB pages. both must be page
+//   aligned. returns 0 on success, -1 if out of memory or already mapped.
+int vm_map(pagetable_t pt, uint64_t va, uint64_t pa, uint64_t size, uint64_t perm);
+
+//   allocates zeroed frames and maps them at [va, va+size).
+int vm_alloc(pagetable_t pt, uint64_t va, uint64_t size, uint64_t perm);
+
+//   adds permission bits to an existing 4 KiB mapping.
+int vm_add_perm(pagetable_t pt, uint64_t va, uint64_t perm);
+
+//   if the page at va is borrowed (mapped straight from the kernel image),
+//   replace it with a private copy so it can be modified. 0 on success.
+int vm_privatize(pagetable_t pt, uint64_t va);
+
+//   1 if the page at va is mapped and borrowed.
+int vm_is_borrowed(pagetable_t pt, uint64_t va);
+
+//   hands the frame mapped at va over to the caller: the PTE is marked
+//   borrowed so vm_free() leaves the frame alone. *flags gets the PTE bits
+//   from before (PTE_BORROWED set means the caller does not own it after
+//   all). returns the frame's address, or 0 if va is not mapped.
+uint64_t vm_take(pagetable_t pt, uint64_t va, uint64_t *flags);
+
+//   copy between kernel memory and an address space, page by page.
+//   returns -1 if any part of the user range is not mapped.
+int vm_copy_out(pagetable_t pt, uint64_t va, const void *src, uint64_t len);
+int vm_copy_in(pagetable_t pt, void *dst, uint64_t va, uint64_t len);
+
+//   1 if every page of [va, va+len) is mapped user-accessible with at least
+//   `perm` (PTE_R/PTE_W), i.e. the program could touch it itself. syscalls
+//   check user pointers with this before copying.
+int vm_user_ok(pagetable_t pt, uint64_t va, uint64_t len, uint64_t perm);
+
+//   copies a NUL-terminated string of at most max bytes (NUL included) out
+//   of user memory. -1 if it is unmapped, not user-readable or too long.
+int vm_copy_in_str(pagetable_t pt, char *dst, uint64_t va, uint64_t max);
+
+//   physical address for va, or 0 if va is not mapped.
+uint64_t vm_translate(pagetable_t pt, uint64_t va);
+
+//   loads pt into satp under the given ASID. no TLB flush is needed: entries
+//   of other address spaces are tagged with their own ASID.
+void vm_activate(pagetable_t pt, uint16_t asid);
+
+//   drops all cached translations of one ASID (before it is reused): right
+//   away on this hart, and on the others the next time they activate it.
+void vm_flush_asid(uint16_t asid);
+
+#endif
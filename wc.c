@@ -0,0 +1,55 @@
+/* wc.c - line, word and byte count of standard input, as a filter program.
+ * Reads fd 0 until end of file and writes "lines words bytes" to fd 1, so
+ * it can sit at the end of a shell pipeline: cat manual.txt | wc.elf
+ */
+
+#include <stdint.h>
+#include "syscall.h"
+
+static inline long syscall3(long nr, long a0, long a1, long a2) {
+    register long r_a0 asm("a0") = a0;
+    register long r_a1 asm("a1") = a1;
+    register long r_a2 asm("a2") = a2;
+    register long r_a7 asm("a7") = nr;
+    asm volatile("ecall"
+                 : "+r"(r_a0)
+                 : "r"(r_a1), "r"(r_a2), "r"(r_a7)
+                 : "memory");
+    return r_a0;
+}
+
+static void put_dec(unsigned long v, char end) {
+    char buf[24];
+    int i = sizeof(buf);
+    buf[--i] = end;
+    do {
+        buf[--i] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    syscall3(SYS_write, 1, (long)(buf + i), (long)sizeof(buf) - i);
+}
+
+static char buf[4096];
+
+void _start(void) {
+    unsigned long lines = 0, words = 0, bytes = 0;
+    int in_word = 0;
+    long n;
+    while ((n = syscall3(SYS_read, 0, (long)buf, sizeof(buf))) > 0) {
+        bytes += (unsigned long)n;
+        for (long i = 0; i < n; i++) {
+            char c = buf[i];
+            int blank = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+            if (c == '\n')
+                lines++;
+            if (!blank && !in_word)
+                words++;
+            in_word = !blank;
+        }
+    }
+    put_dec(lines, ' ');
+    put_dec(words, ' ');
+    put_dec(bytes, '\n');
+    syscall3(SYS_exit, 0, 0, 0);
+    for (;;) {}
+}